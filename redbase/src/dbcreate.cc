@@ -33,6 +33,17 @@ static const AttrInfo AttrcatInfo[] = {
     {(char*)"indexNo", INT, 4}
 };
 
+static const AttrInfo BufstatInfo[] = {
+    {(char*)"fileName", STRING, PF_FILENAME_LEN},
+    {(char*)"hits", INT, 4},
+    {(char*)"misses", INT, 4},
+    {(char*)"reads", INT, 4},
+    {(char*)"writes", INT, 4},
+    {(char*)"evictions", INT, 4},
+    {(char*)"hitRatio", FLOAT, 4},
+    {(char*)"pinWait", FLOAT, 4}
+};
+
 //
 // main
 //
@@ -41,17 +52,34 @@ int main(int argc, char *argv[])
     char *dbname;
     char command[255] = "mkdir ";
     RC rc;
+    int pageSize = PF_MIN_PAGE_SIZE;
+    int opt;
+
+    // Options come first:
+    //   -P size   page size of the database: 4K (default), 8K, 16K, 32K
+    //             or 64K
+    while ((opt = getopt(argc, argv, "P:")) != -1) {
+        switch (opt) {
+        case 'P':
+            if ((rc = PF_ParsePageSize(optarg, pageSize))) {
+                PrintError(rc);
+                exit(1);
+            }
+            break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-P pagesize] dbname \n";
+            exit(1);
+        }
+    }
 
-    // Look for 2 arguments. The first is always the name of the program
-    // that was executed, and the second should be the name of the
-    // database.
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " dbname \n";
+    // Look for 1 remaining argument, the name of the database.
+    if (argc - optind != 1) {
+        cerr << "Usage: " << argv[0] << " [-P pagesize] dbname \n";
         exit(1);
     }
 
-    // The database name is the second argument
-    dbname = argv[1];
+    // The database name is the last argument
+    dbname = argv[optind];
 
     // Create a subdirectory for the database
     if (system (strcat(command,dbname)) != 0) {
@@ -65,7 +93,9 @@ int main(int argc, char *argv[])
         return SM_DBNOTEXIST;
     }
 
-    PF_Manager pfm;
+    // dbcreate only touches the catalogs: the default buffer will do.
+    // The buffer size of a database is chosen when redbase starts.
+    PF_Manager pfm(0, PF_LRU, pageSize);
     RM_Manager rmm(pfm);
     LG_Manager lgm(pfm, rmm);
     IX_Manager ixm(pfm);
@@ -85,6 +115,9 @@ int main(int argc, char *argv[])
     if ((rc = smm.AddToCatalog((char *)"relcat", RelcatCount, (AttrInfo *)RelcatInfo))) goto terminate;
     if ((rc = smm.AddToCatalog((char *)"attrcat", AttrcatCount, (AttrInfo *)AttrcatInfo))) goto terminate;
 
+    /* bufstat has no record file: its tuples come from the buffer manager */
+    if ((rc = smm.AddToCatalog((char *)"bufstat", BufstatCount, (AttrInfo *)BufstatInfo))) goto terminate;
+
     if ((rc = smm.CloseDb())) goto terminate;
 
     return (0);
@@ -0,0 +1,96 @@
+//
+// dbupgrade.cc
+//
+// Rewrite the files of a database created before the free-space map,
+// which cannot be opened otherwise (PF_OLDFORMAT), in the current layout.
+// Files already in that layout are left alone.  The database must not be
+// in use.  The record files keep their old free list until they are first
+// opened for writing, when RM builds their free-space map.
+//
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "pf.h"
+#include "redbase.h"
+
+using namespace std;
+
+//
+// UpgradeFile
+//
+// Upgrade one file if it has the older layout.  Returns 1 if it was
+// upgraded, 0 if it did not need to be, or -1 if it could not be.
+//
+static int UpgradeFile(PF_Manager &pfm, const char *fileName)
+{
+    PF_FileHandle fh;
+    RC rc;
+
+    // Opening the file tells the layout it has
+    if ((rc = pfm.OpenFile(fileName, fh, PF_MAPPED)) == 0) {
+        if ((rc = pfm.CloseFile(fh))) {
+            PF_PrintError(rc);
+            return (-1);
+        }
+        return (0);
+    }
+
+    if (rc != PF_OLDFORMAT || (rc = pfm.UpgradeFile(fileName))) {
+        cerr << fileName << ": ";
+        PF_PrintError(rc);
+        return (-1);
+    }
+    cout << fileName << ": upgraded\n";
+    return (1);
+}
+
+//
+// main
+//
+int main(int argc, char *argv[])
+{
+    char *dbname;
+    DIR *dir;
+    struct dirent *entry;
+    struct stat fileStat;
+    int numUpgraded = 0;
+    int bFailed = FALSE;
+
+    // Look for 2 arguments. The first is always the name of the program
+    // that was executed, and the second should be the name of the
+    // database.
+    if (argc != 2) {
+        cerr << "Usage: " << argv[0] << " dbname \n";
+        exit(1);
+    }
+
+    // The database name is the second argument
+    dbname = argv[1];
+
+    if (chdir(dbname) < 0 || (dir = opendir(".")) == NULL) {
+        cerr << argv[0] << " chdir error to " << dbname << "\n";
+        exit(1);
+    }
+
+    // Every regular file of the database directory is a paged file
+    PF_Manager pfm;
+    while ((entry = readdir(dir)) != NULL) {
+        if (stat(entry->d_name, &fileStat) < 0 || !S_ISREG(fileStat.st_mode))
+            continue;
+
+        int n = UpgradeFile(pfm, entry->d_name);
+        if (n < 0)
+            bFailed = TRUE;
+        else
+            numUpgraded += n;
+    }
+    closedir(dir);
+
+    cout << numUpgraded << " files upgraded\n";
+
+    return (bFailed ? 1 : 0);
+}
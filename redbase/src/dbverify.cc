@@ -0,0 +1,103 @@
+//
+// dbverify.cc
+//
+// Check every page of the files of a database against its checksum,
+// without changing anything.  Prints the pages that are damaged or were
+// only partly written, and exits with status 1 if there are any.
+//
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "pf.h"
+#include "redbase.h"
+
+using namespace std;
+
+//
+// VerifyFile
+//
+// Check the used pages of one file.  Returns the number of bad pages, or
+// -1 if the file could not be read as a paged file.
+//
+static int VerifyFile(PF_Manager &pfm, const char *fileName)
+{
+    PF_FileHandle fh;
+    RC rc;
+    int numBad = 0;
+
+    // The file is mapped read only, so that it is not changed and its
+    // pages do not go through the buffer pool
+    if ((rc = pfm.OpenFile(fileName, fh, PF_MAPPED))) {
+        cerr << fileName << ": ";
+        PF_PrintError(rc);
+        return (-1);
+    }
+
+    for (PageNum pageNum = 0; (rc = fh.VerifyPage(pageNum)) != PF_INVALIDPAGE;
+         pageNum++) {
+        if (rc == 0 || rc == PF_PAGEFREE)
+            continue;
+        cerr << fileName << ": page " << pageNum << ": ";
+        PF_PrintError(rc);
+        numBad++;
+    }
+
+    if ((rc = pfm.CloseFile(fh))) {
+        PF_PrintError(rc);
+        return (-1);
+    }
+    return (numBad);
+}
+
+//
+// main
+//
+int main(int argc, char *argv[])
+{
+    char *dbname;
+    DIR *dir;
+    struct dirent *entry;
+    struct stat fileStat;
+    int numFiles = 0;
+    int numBad = 0;
+    int bFailed = FALSE;
+
+    // Look for 2 arguments. The first is always the name of the program
+    // that was executed, and the second should be the name of the
+    // database.
+    if (argc != 2) {
+        cerr << "Usage: " << argv[0] << " dbname \n";
+        exit(1);
+    }
+
+    // The database name is the second argument
+    dbname = argv[1];
+
+    if (chdir(dbname) < 0 || (dir = opendir(".")) == NULL) {
+        cerr << argv[0] << " chdir error to " << dbname << "\n";
+        exit(1);
+    }
+
+    // Every regular file of the database directory is a paged file
+    PF_Manager pfm;
+    while ((entry = readdir(dir)) != NULL) {
+        if (stat(entry->d_name, &fileStat) < 0 || !S_ISREG(fileStat.st_mode))
+            continue;
+
+        int n = VerifyFile(pfm, entry->d_name);
+        if (n < 0)
+            bFailed = TRUE;
+        else
+            numBad += n;
+        numFiles++;
+    }
+    closedir(dir);
+
+    cout << numFiles << " files checked, " << numBad << " bad pages\n";
+
+    return ((numBad > 0 || bFailed) ? 1 : 0);
+}
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include "redbase.h"
@@ -19,9 +20,7 @@
 #include "ql.h"
 #include "lg.h"
 
-extern SM_Manager *pSmm;
-extern QL_Manager *pQlm;
-extern LG_Manager *pLgm;
+using namespace std;
 
 #define E_OK                0
 #define E_INCOMPATIBLE      -1
@@ -36,9 +35,9 @@ extern LG_Manager *pLgm;
 #define E_STRINGTOOLONG     -10
 
 /*
- * file pointer to which error messages are printed
+ * stream to which error messages are printed
  */
-#define ERRFP stderr
+#define ERRFP cerr
 
 /*
  * local functions
@@ -51,6 +50,7 @@ static int mk_relations(NODE *list, int max, char *relations[]);
 static int mk_conditions(NODE *list, int max, Condition conditions[]);
 static int mk_values(NODE *list, int max, Value values[]);
 static void mk_value(NODE *node, Value &value);
+static void print(ostream &out, const char *format, ...);
 static void print_error(char *errmsg, RC errval);
 static void echo_query(NODE *n);
 static void print_attrtypes(NODE *n);
@@ -67,12 +67,15 @@ static void print_values(NODE *n);
  * interp: interprets parse trees
  *
  */
-RC interp(NODE *n)
+RC interp(PARSER *p, NODE *n)
 {
    RC errval = 0;         /* returned error value      */
+   SM_Manager *pSmm = p -> pSmm;
+   QL_Manager *pQlm = p -> pQlm;
+   LG_Manager *pLgm = p -> pLgm;
 
    /* if input not coming from a terminal, then echo the query */
-   if(!isatty(0))
+   if(p -> bEcho)
       echo_query(n);
 
    switch(n -> kind){
@@ -547,51 +550,67 @@ static int parse_format_string(char *format_string, AttrType *type, int *len)
    return E_OK;
 }
 
+/*
+ * print: printf to a stream.  The output of the interpreter goes through
+ * cout and cerr, with that of the components, so that it goes where the
+ * parser sends the output of its commands.
+ */
+static void print(ostream &out, const char *format, ...)
+{
+   char buf[MAXSTRINGLEN + MAXNAME + 64];
+   va_list args;
+
+   va_start(args, format);
+   vsnprintf(buf, sizeof(buf), format, args);
+   va_end(args);
+   out << buf;
+}
+
 /*
  * print_error: prints an error message corresponding to errval
  */
 static void print_error(char *errmsg, RC errval)
 {
    if(errmsg != NULL)
-      fprintf(stderr, "%s: ", errmsg);
+      print(cerr, "%s: ", errmsg);
    switch(errval){
       case E_OK:
-         fprintf(ERRFP, "no error\n");
+         print(ERRFP, "no error\n");
          break;
       case E_INCOMPATIBLE:
-         fprintf(ERRFP, "attributes must be from selected relation(s)\n");
+         print(ERRFP, "attributes must be from selected relation(s)\n");
          break;
       case E_TOOMANY:
-         fprintf(ERRFP, "too many elements\n");
+         print(ERRFP, "too many elements\n");
          break;
       case E_NOLENGTH:
-         fprintf(ERRFP, "length must be specified for STRING attribute\n");
+         print(ERRFP, "length must be specified for STRING attribute\n");
          break;
       case E_INVINTSIZE:
-         fprintf(ERRFP, "invalid size for INTEGER attribute (should be %d)\n",
+         print(ERRFP, "invalid size for INTEGER attribute (should be %d)\n",
                (int)sizeof(int));
          break;
       case E_INVREALSIZE:
-         fprintf(ERRFP, "invalid size for REAL attribute (should be %d)\n",
+         print(ERRFP, "invalid size for REAL attribute (should be %d)\n",
                (int)sizeof(real));
          break;
       case E_INVFORMATSTRING:
-         fprintf(ERRFP, "invalid format string\n");
+         print(ERRFP, "invalid format string\n");
          break;
       case E_INVSTRLEN:
-         fprintf(ERRFP, "invalid length for string attribute\n");
+         print(ERRFP, "invalid length for string attribute\n");
          break;
       case E_DUPLICATEATTR:
-         fprintf(ERRFP, "duplicated attribute name\n");
+         print(ERRFP, "duplicated attribute name\n");
          break;
       case E_TOOLONG:
-         fprintf(stderr, "relation name or attribute name too long\n");
+         print(cerr, "relation name or attribute name too long\n");
          break;
       case E_STRINGTOOLONG:
-         fprintf(stderr, "string attribute too long\n");
+         print(cerr, "string attribute too long\n");
          break;
       default:
-         fprintf(ERRFP, "unrecognized errval: %d\n", errval);
+         print(ERRFP, "unrecognized errval: %d\n", errval);
    }
 }
 
@@ -599,68 +618,68 @@ static void echo_query(NODE *n)
 {
    switch(n -> kind){
       case N_CREATETABLE:            /* for CreateTable() */
-         printf("create table %s (", n -> u.CREATETABLE.relname);
+         print(cout, "create table %s (", n -> u.CREATETABLE.relname);
          print_attrtypes(n -> u.CREATETABLE.attrlist);
-         printf(")");
-         printf(";\n");
+         print(cout, ")");
+         print(cout, ";\n");
          break;
       case N_CREATEINDEX:            /* for CreateIndex() */
-         printf("create index %s(%s);\n", n -> u.CREATEINDEX.relname,
+         print(cout, "create index %s(%s);\n", n -> u.CREATEINDEX.relname,
                n -> u.CREATEINDEX.attrname);
          break;
       case N_DROPINDEX:            /* for DropIndex() */
-         printf("drop index %s(%s);\n", n -> u.DROPINDEX.relname,
+         print(cout, "drop index %s(%s);\n", n -> u.DROPINDEX.relname,
                n -> u.DROPINDEX.attrname);
          break;
       case N_DROPTABLE:            /* for DropTable() */
-         printf("drop table %s;\n", n -> u.DROPTABLE.relname);
+         print(cout, "drop table %s;\n", n -> u.DROPTABLE.relname);
          break;
       case N_LOAD:            /* for Load() */
-         printf("load %s(\"%s\");\n",
+         print(cout, "load %s(\"%s\");\n",
                n -> u.LOAD.relname, n -> u.LOAD.filename);
          break;
       case N_HELP:            /* for Help() */
-         printf("help");
+         print(cout, "help");
          if(n -> u.HELP.relname != NULL)
-            printf(" %s", n -> u.HELP.relname);
-         printf(";\n");
+            print(cout, " %s", n -> u.HELP.relname);
+         print(cout, ";\n");
          break;
       case N_PRINT:            /* for Print() */
-         printf("print %s;\n", n -> u.PRINT.relname);
+         print(cout, "print %s;\n", n -> u.PRINT.relname);
          break;
       case N_SET:                                 /* for Set() */
-         printf("set %s = \"%s\";\n", n->u.SET.paramName, n->u.SET.string);
+         print(cout, "set %s = \"%s\";\n", n->u.SET.paramName, n->u.SET.string);
          break;
       case N_QUERY:            /* for Query() */
-         printf("select ");
+         print(cout, "select ");
          print_relattrs(n -> u.QUERY.relattrlist);
-         printf("\n from ");
+         print(cout, "\n from ");
          print_relations(n -> u.QUERY.rellist);
-         printf("\n");
+         print(cout, "\n");
          if (n->u.QUERY.conditionlist) {
-            printf("where ");
+            print(cout, "where ");
             print_conditions(n->u.QUERY.conditionlist);
          }
-         printf(";\n");
+         print(cout, ";\n");
          break;
       case N_INSERT:            /* for Insert() */
-         printf("insert into %s values ( ",n->u.INSERT.relname);
+         print(cout, "insert into %s values ( ",n->u.INSERT.relname);
          print_values(n -> u.INSERT.valuelist);
-         printf(");\n");
+         print(cout, ");\n");
          break;
       case N_DELETE:            /* for Delete() */
-         printf("delete %s ",n->u.DELETE.relname);
+         print(cout, "delete %s ",n->u.DELETE.relname);
          if (n->u.DELETE.conditionlist) {
-            printf("where ");
+            print(cout, "where ");
             print_conditions(n->u.DELETE.conditionlist);
          }
-         printf(";\n");
+         print(cout, ";\n");
          break;
       case N_UPDATE:            /* for Update() */
          {
-            printf("update %s set ",n->u.UPDATE.relname);
+            print(cout, "update %s set ",n->u.UPDATE.relname);
             print_relattr(n->u.UPDATE.relattr);
-            printf(" = ");
+            print(cout, " = ");
             struct node *rhs = n->u.UPDATE.relorvalue;
 
             /* The RHS can be either a relation.attribute or a value */
@@ -672,16 +691,16 @@ static void echo_query(NODE *n)
                print_value(rhs->u.RELATTR_OR_VALUE.value);
             }
             if (n->u.UPDATE.conditionlist) {
-               printf("where ");
+               print(cout, "where ");
                print_conditions(n->u.UPDATE.conditionlist);
             }
-            printf(";\n");
+            print(cout, ";\n");
             break;
          }
       default:   // should never get here
          break;
    }
-   fflush(stdout);
+   cout.flush();
 }
 
 static void print_attrtypes(NODE *n)
@@ -690,9 +709,9 @@ static void print_attrtypes(NODE *n)
 
    for(; n != NULL; n = n -> u.LIST.next){
       attr = n -> u.LIST.curr;
-      printf("%s = %s", attr -> u.ATTRTYPE.attrname, attr -> u.ATTRTYPE.type);
+      print(cout, "%s = %s", attr -> u.ATTRTYPE.attrname, attr -> u.ATTRTYPE.type);
       if(n -> u.LIST.next != NULL)
-         printf(", ");
+         print(cout, ", ");
    }
 }
 
@@ -700,48 +719,48 @@ static void print_op(CompOp op)
 {
    switch(op){
       case EQ_OP:
-         printf(" =");
+         print(cout, " =");
          break;
       case NE_OP:
-         printf(" <>");
+         print(cout, " <>");
          break;
       case LT_OP:
-         printf(" <");
+         print(cout, " <");
          break;
       case LE_OP:
-         printf(" <=");
+         print(cout, " <=");
          break;
       case GT_OP:
-         printf(" >");
+         print(cout, " >");
          break;
       case GE_OP:
-         printf(" >=");
+         print(cout, " >=");
          break;
       case NO_OP:
-         printf(" NO_OP");
+         print(cout, " NO_OP");
          break;
    }
 }
 
 static void print_relattr(NODE *n)
 {
-   printf(" ");
+   print(cout, " ");
    if (n->u.RELATTR.relname)
-      printf("%s.",n->u.RELATTR.relname);
-   printf("%s",n->u.RELATTR.attrname);
+      print(cout, "%s.",n->u.RELATTR.relname);
+   print(cout, "%s",n->u.RELATTR.attrname);
 }  
 
 static void print_value(NODE *n)
 {
    switch(n -> u.VALUE.type){
       case INT:
-         printf(" %d", n -> u.VALUE.ival);
+         print(cout, " %d", n -> u.VALUE.ival);
          break;
       case FLOAT:
-         printf(" %f", n -> u.VALUE.rval);
+         print(cout, " %f", n -> u.VALUE.rval);
          break;
       case STRING:
-         printf(" \"%s\"", n -> u.VALUE.sval);
+         print(cout, " \"%s\"", n -> u.VALUE.sval);
          break;
    }
 }
@@ -761,16 +780,16 @@ static void print_relattrs(NODE *n)
    for(; n != NULL; n = n -> u.LIST.next){
       print_relattr(n->u.LIST.curr);
       if(n -> u.LIST.next != NULL)
-         printf(",");
+         print(cout, ",");
    }
 }
 
 static void print_relations(NODE *n)
 {
    for(; n != NULL; n = n -> u.LIST.next){
-      printf(" %s", n->u.LIST.curr->u.RELATION.relname);
+      print(cout, " %s", n->u.LIST.curr->u.RELATION.relname);
       if(n -> u.LIST.next != NULL)
-         printf(",");
+         print(cout, ",");
    }
 }
 
@@ -779,7 +798,7 @@ static void print_conditions(NODE *n)
    for(; n != NULL; n = n -> u.LIST.next){
       print_condition(n->u.LIST.curr);
       if(n -> u.LIST.next != NULL)
-         printf(" and");
+         print(cout, " and");
    }
 }
 
@@ -788,7 +807,7 @@ static void print_values(NODE *n)
    for(; n != NULL; n = n -> u.LIST.next){
       print_value(n->u.LIST.curr);
       if(n -> u.LIST.next != NULL)
-         printf(",");
+         print(cout, ",");
    }
 }
 
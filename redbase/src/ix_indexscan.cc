@@ -121,7 +121,7 @@ RC IX_IndexScan::FetchNextPage(PageNum next) {
 
   /* Update nodeData_ and nextLeaf_ */
   PF_PageHandle pageHandle;
-  rc = indexHandle_.PFfileHandle_.GetThisPage(currentPage_, pageHandle);
+  rc = indexHandle_.PFfileHandle_.GetThisPage(currentPage_, pageHandle, pinHint_);
   if (rc) return rc;
   rc = pageHandle.GetData(nodeData_);
   if (rc) return rc;
@@ -172,7 +172,7 @@ RC IX_IndexScan::InitializeScanPtr() {
     currentKeyIndex_ = 0;
 
     PF_PageHandle pageHandle;
-    RC rc = indexHandle_.PFfileHandle_.GetThisPage(currentPage_, pageHandle);
+    RC rc = indexHandle_.PFfileHandle_.GetThisPage(currentPage_, pageHandle, pinHint_);
     if (rc) return rc;
     pageHandle.GetData(nodeData_);
     nextLeaf_ = ((IX_LeafHdr *) nodeData_)->next;
@@ -207,7 +207,7 @@ RC IX_IndexScan::InitializeScanPtr() {
     if (currentPage_ == IX_INDEX_LIST_END) return IX_EOF;
 
     PF_PageHandle pageHandle;
-    rc = indexHandle_.PFfileHandle_.GetThisPage(currentPage_, pageHandle);
+    rc = indexHandle_.PFfileHandle_.GetThisPage(currentPage_, pageHandle, pinHint_);
     if (rc) return rc;
 
     pageHandle.GetData(nodeData_);
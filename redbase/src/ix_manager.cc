@@ -30,8 +30,10 @@ RC IX_Manager::CreateIndex(const char *fileName, int indexNo,
 
 	// Fill out Index File Header
 	IX_FileHdr fileHdr;
-    fileHdr.maxKeysInternal = (PF_PAGE_SIZE - sizeof(IX_NodeHdr)) / (attrLength + sizeof(RID) + sizeof(PageNum));
-    fileHdr.maxKeysLeaf = (PF_PAGE_SIZE - sizeof(IX_LeafHdr)) / (attrLength + sizeof(RID));
+    int pageSize;
+    pfm_->GetPageSize(pageSize);
+    fileHdr.maxKeysInternal = (pageSize - sizeof(IX_NodeHdr)) / (attrLength + sizeof(RID) + sizeof(PageNum));
+    fileHdr.maxKeysLeaf = (pageSize - sizeof(IX_LeafHdr)) / (attrLength + sizeof(RID));
     fileHdr.attrType = attrType;
     fileHdr.attrLength = attrLength;
     fileHdr.numKeys = 0;
@@ -24,8 +24,11 @@ class RM_Manager;
 #define LG_EOF          -1
 #define LOGFILENAME     "log"
 
+// L_INSERTPAGE logs records appended to consecutive slots of one page
+// (rid is the first of them); L_DELETEPAGE is only the undoType of its CLR
 enum LogType {
-    L_INSERT, L_DELETE, L_UPDATE, L_COMMIT, L_ABORT, L_END, L_CLR
+    L_INSERT, L_DELETE, L_UPDATE, L_COMMIT, L_ABORT, L_END, L_CLR,
+    L_INSERTPAGE, L_DELETEPAGE
 };
 
 struct LSN {
@@ -87,6 +90,14 @@ public:
     RC BeginT();
     RC CommitT();
     RC AbortT();
+
+    // One transaction runs at a time.  It belongs to the session that
+    // began it: the commands of other sessions cannot commit or abort it,
+    // and their own updates are refused (LG_TRANSACTIONLOCKED) until it
+    // ends.  A program without sessions is session 0.
+    void SetSession(int session);        // session whose commands run now
+    int InTransaction() const;           // 1 if the session is in a transaction
+    int Locked() const;                  // 1 if another session is
     RC Checkpoint();
     RC Recover();
     RC PrintLog();
@@ -107,6 +118,8 @@ private:
     LSN lastRec;                    // last log record
     int lastRecSize;                // Size of the last log record
     int currXID;                    // ID for the current transaction
+    int owner;                      // Session of the current transaction
+    int session;                    // Session whose commands are running
     
     set<string> dirtyFiles;         // dirty files where INSERT/DELETE/UPDATE operations occurred
 };
@@ -119,7 +132,8 @@ void LG_PrintError(RC rc);
 #define LG_INTRANSACTION                (START_LG_WARN + 0)
 #define LG_NOTINTRANSACTION             (START_LG_WARN + 1)
 #define LG_LOGEMPTY                     (START_LG_WARN + 2)
-#define LG_LASTWARN                     LG_LOGEMPTY
+#define LG_TRANSACTIONLOCKED            (START_LG_WARN + 3)
+#define LG_LASTWARN                     LG_TRANSACTIONLOCKED
 
 #define LG_LASTERROR                    (END_LG_ERR)
 
@@ -12,7 +12,8 @@ using namespace std;
 static char *LG_WarnMsg[] = {
   (char *) "There is a transaction in progress",
   (char *) "There is NO transaction in progress",
-  (char *) "The log is empty"
+  (char *) "The log is empty",
+  (char *) "Another session has a transaction in progress"
 };
 
 static char *LG_ErrorMsg[] = {
@@ -7,11 +7,14 @@
 int CalculateLogRecordSize(LG_FullRec &logRec);
 char *GetLogRecData(LSN lsn, PF_PageHandle &ph);
 void DumpLogContent(LG_Rec *rec);
+RC DeleteRecRange(RM_FileHandle &fh, const RID &rid, int dataSize);
 
 LG_Manager::LG_Manager (PF_Manager &pfm, RM_Manager &rmm) {
     pfm_ = &pfm;
     rmm_ = &rmm;
     rmm_->lgmanager_ = this;
+    owner = 0;
+    session = 0;
 }
 
 LG_Manager::~LG_Manager() {
@@ -67,7 +70,7 @@ RC LG_Manager::InsertLogRec(LG_FullRec &logRec, const char *oldValue, const char
         currLogPage_.GetPageNum(pn);
 
         logRec.lsn = LSN(pn, 0);
-        availableSpace = PF_PAGE_SIZE;
+        pfm_->GetPageSize(availableSpace);
     } else {
         /* Get slot following the last record */
         currLogPage_.GetPageNum(pn);
@@ -96,15 +99,20 @@ RC LG_Manager::InsertLogRec(LG_FullRec &logRec, const char *oldValue, const char
 
     char *pData;
     currLogPage_.GetData(pData);
-    /* Insert the new log record */
+    /* Insert the new log record.  The page is latched because the
+     * background page writer may be forcing the log meanwhile */
+    if ((rc = logFile_.LatchPage(logRec.lsn.pn, TRUE))) return rc;
     memcpy(pData + logRec.lsn.offset, newLogRecord, logRecordSize);
-    if ((rc = logFile_.MarkDirty(logRec.lsn.pn))) return rc;
+    rc = logFile_.MarkDirty(logRec.lsn.pn);
+    logFile_.UnlatchPage(logRec.lsn.pn);
+    if (rc) return rc;
 
     /* Update nextLSN of last rec */
     if ((rc = UpdateLastRecNextLSN(logRec.lsn))) return rc;
 
     /* Add file to a list of dirty files */
-    if (logRec.type == L_INSERT || logRec.type == L_DELETE || logRec.type == L_UPDATE)
+    if (logRec.type == L_INSERT || logRec.type == L_DELETE || logRec.type == L_UPDATE ||
+        logRec.type == L_INSERTPAGE)
         dirtyFiles.insert(string(logRec.fileName));
 
     /* Update available space and lastRec */
@@ -123,8 +131,11 @@ RC LG_Manager::UpdateLastRecNextLSN(LSN nextLSN) {
         if ((rc = logFile_.GetThisPage(lastRec.pn, ph))) return rc;
 
         LG_Rec *lastLogRecData = (LG_Rec *) GetLogRecData(lastRec, ph);
+        if ((rc = logFile_.LatchPage(lastRec.pn, TRUE))) return rc;
         lastLogRecData->nextLSN = nextLSN;
-        if ((rc = logFile_.MarkDirty(lastRec.pn))) return rc;
+        rc = logFile_.MarkDirty(lastRec.pn);
+        logFile_.UnlatchPage(lastRec.pn);
+        if (rc) return rc;
         if ((rc = logFile_.UnpinPage(lastRec.pn))) return rc;
     }
     return 0;
@@ -138,7 +149,7 @@ int CalculateLogRecordSize(LG_FullRec &logRec) {
     if (type == L_COMMIT || type == L_ABORT || type == L_END)
         return sizeof(LG_Rec);
 
-    if (type == L_INSERT || type == L_DELETE)
+    if (type == L_INSERT || type == L_DELETE || type == L_INSERTPAGE)
         return sizeof(LG_FullRec) + logRec.dataSize;
 
     if (type == L_UPDATE)
@@ -148,20 +159,34 @@ int CalculateLogRecordSize(LG_FullRec &logRec) {
         LogType undoType = logRec.undoType;
         if (undoType == L_INSERT || undoType == L_DELETE)
             return sizeof(LG_FullRec) + logRec.dataSize;
-        if (undoType == L_UPDATE)
+        if (undoType == L_UPDATE || undoType == L_DELETEPAGE)
             return sizeof(LG_FullRec);
     }
     return -1;
 }
 
+void LG_Manager::SetSession(int session) {
+    this->session = session;
+}
+
+int LG_Manager::InTransaction() const {
+    return bInTransaction && owner == session;
+}
+
+int LG_Manager::Locked() const {
+    return bInTransaction && owner != session;
+}
+
 RC LG_Manager::FlushLog() {
     return logFile_.ForcePages();
 }
 
 RC LG_Manager::BeginT() {
     cout << "begin transaction" << endl;
+    if (Locked()) return LG_TRANSACTIONLOCKED;
     if (bInTransaction) return LG_INTRANSACTION;
     bInTransaction = 1;
+    owner = session;
     currXID++;
     return 0;
 }
@@ -190,9 +215,14 @@ void DumpLogContent(LG_Rec *rec) {
             cout << "End" << endl; break;
         case L_CLR:
             cout << "CLR" << endl; break;
+        case L_INSERTPAGE:
+            cout << "Insert page" << endl; break;
+        default:
+            cout << "INVALID" << endl; break;
     }
 
-    if (type == L_INSERT || type == L_DELETE || type == L_UPDATE || type == L_CLR) {
+    if (type == L_INSERT || type == L_DELETE || type == L_UPDATE || type == L_CLR ||
+        type == L_INSERTPAGE) {
         LG_FullRec *fullRec = (LG_FullRec *) rec;
         cout << "Data Offset: " << fullRec->offset << endl;
         cout << "Data Size: " << fullRec->dataSize << endl;
@@ -212,6 +242,8 @@ void DumpLogContent(LG_Rec *rec) {
                     cout << "Update" << endl; break;
                 case L_DELETE:
                     cout << "Delete" << endl; break;
+                case L_DELETEPAGE:
+                    cout << "Delete page" << endl; break;
                 default:
                     cout << "INVALID" << endl; break;
             }
@@ -256,7 +288,7 @@ RC LG_Manager::PrintLog() {
 RC LG_Manager::CommitT() {
     cout << "commit transaction" << endl;
     RC rc;
-    if (!bInTransaction) return LG_NOTINTRANSACTION;
+    if (!InTransaction()) return LG_NOTINTRANSACTION;
 
     if (bAbort) abort();
 
@@ -272,7 +304,7 @@ RC LG_Manager::CommitT() {
 RC LG_Manager::AbortT() {
     cout << "abort transaction" << endl;
     RC rc;
-    if (!bInTransaction) return LG_NOTINTRANSACTION;
+    if (!InTransaction()) return LG_NOTINTRANSACTION;
 
     LG_FullRec abortRec;
     abortRec.type = L_ABORT;
@@ -346,7 +378,7 @@ RC LG_Manager::Undo(LSN &undoLSN, const int XID) {
     /* Undo INSERT, DELETE and UPDATE log records */
     LG_FullRec *logRec = (LG_FullRec *) logData;
 
-    if (type == L_INSERT || type == L_DELETE || type == L_UPDATE) {
+    if (type == L_INSERT || type == L_DELETE || type == L_UPDATE || type == L_INSERTPAGE) {
         RM_FileHandle fh;
         RID rid = logRec->rid;
         char *filename = logRec->fileName;
@@ -371,6 +403,9 @@ RC LG_Manager::Undo(LSN &undoLSN, const int XID) {
         } else if (type == L_UPDATE) {
             clrRec.undoType = L_UPDATE;
             rc = InsertLogRec(clrRec, NULL, (char *) logRec + sizeof(LG_FullRec));
+        } else if (type == L_INSERTPAGE) {
+            clrRec.undoType = L_DELETEPAGE;
+            rc = InsertLogRec(clrRec, NULL, NULL);
         }
         if (rc) return rc;
         if ((rc = fh.UpdatePageLSN(rid, clrRec.lsn))) return rc;
@@ -389,6 +424,8 @@ RC LG_Manager::Undo(LSN &undoLSN, const int XID) {
             if ((rc = fh.GetRec(rid, rmrec))) return rc;
             memcpy(rmrec.contents_ + logRec->offset, oldValue, logRec->dataSize);
             if ((rc = fh.UpdateRec(rmrec))) return rc;
+        } else if (type == L_INSERTPAGE) {
+            if ((rc = DeleteRecRange(fh, rid, logRec->dataSize))) return rc;
         }
 
         if ((rc = rmm_->CloseFile(fh))) return rc;
@@ -403,6 +440,18 @@ RC LG_Manager::Undo(LSN &undoLSN, const int XID) {
     return Undo(prevLSN, XID);
 }
 
+/* Deletes the records logged by an L_INSERTPAGE record: dataSize bytes of
+   records in consecutive slots from rid */
+RC DeleteRecRange(RM_FileHandle &fh, const RID &rid, int dataSize) {
+    RC rc;
+    PageNum pn; SlotNum sn;
+    rid.GetPageNum(pn);
+    rid.GetSlotNum(sn);
+    for (int i = 0; i < dataSize / fh.GetRecordSize(); i++)
+        if ((rc = fh.DeleteRec(RID(pn, sn + i)))) return rc;
+    return 0;
+}
+
 /* Returns 1 if pageLSN is lesser than redoLSN */
 int CompareLSN(const LSN &pageLSN, const LSN &redoLSN) {
     if (pageLSN.pn < redoLSN.pn) return 1;
@@ -422,7 +471,8 @@ RC LG_Manager::Redo(LSN &redoLSN, LSN &lastLSN, int &lastXID) {
     //DumpLogContent(logData);
 
     /* Redos INSERT, DELETE, UPDATE and CLR records */
-    if (type == L_INSERT || type == L_DELETE || type == L_UPDATE || type == L_CLR) {
+    if (type == L_INSERT || type == L_DELETE || type == L_UPDATE || type == L_CLR ||
+        type == L_INSERTPAGE) {
         LG_FullRec *logRec = (LG_FullRec *) logData;
         RM_FileHandle fh;
         RID rid = logRec->rid;
@@ -450,6 +500,18 @@ RC LG_Manager::Redo(LSN &redoLSN, LSN &lastLSN, int &lastXID) {
                 if ((rc = fh.GetRec(rid, rmrec))) return rc;
                 memcpy(rmrec.contents_ + logRec->offset, newValue, logRec->dataSize);
                 if ((rc = fh.UpdateRec(rmrec))) return rc;
+
+            } else if (type == L_INSERTPAGE) {
+                char *newValue = (char *) logRec + sizeof(LG_FullRec);
+                int recSz = fh.GetRecordSize();
+                PageNum pn; SlotNum sn;
+                rid.GetPageNum(pn);
+                rid.GetSlotNum(sn);
+                for (int i = 0; i < logRec->dataSize / recSz; i++)
+                    if ((rc = fh.InsertRecAtRid(newValue + i*recSz, RID(pn, sn + i)))) return rc;
+
+            } else if (type == L_CLR && undoType == L_DELETEPAGE) {
+                if ((rc = DeleteRecRange(fh, rid, logRec->dataSize))) return rc;
             }
             if ((rc = fh.UpdatePageLSN(rid, redoLSN))) return rc;
         }
@@ -15,23 +15,17 @@
 #include "parser_internal.h"
 #include "y.tab.h"
 
-/*
- * total number of nodes available for a given parse-tree
- */
-#define MAXNODE		100
-
-static NODE nodepool[MAXNODE];
-static int nodeptr = 0;
+using namespace std;
 
 /*
  * reset_parser: resets the scanner and parser when a syntax error occurs
  *
  * No return value
  */
-void reset_parser(void)
+void reset_parser(PARSER *p)
 {
-    reset_scanner();
-    nodeptr = 0;
+    reset_scanner(p -> scanner);
+    p -> nodeptr = 0;
 }
 
 static void (*cleanup_func)() = NULL;
@@ -42,10 +36,10 @@ static void (*cleanup_func)() = NULL;
  *
  * No return value.
  */
-void new_query(void)
+void new_query(PARSER *p)
 {
-    nodeptr = 0;
-    reset_charptr();
+    p -> nodeptr = 0;
+    reset_charptr(p);
     if(cleanup_func != NULL)
 	(*cleanup_func)();
 }
@@ -59,19 +53,19 @@ void register_cleanup_function(void (*func)())
  * newnode: allocates a new node of the specified kind and returns a pointer
  * to it on success.  Returns NULL on error.
  */
-NODE *newnode(NODEKIND kind)
+NODE *newnode(PARSER *p, NODEKIND kind)
 {
     NODE *n;
 
     /* if we've used up all of the nodes then error */
-    if(nodeptr == MAXNODE){
-	fprintf(stderr, "out of memory\n");
+    if(p -> nodeptr == MAXNODE){
+	cerr << "out of memory\n";
 	exit(1);
     }
 
     /* get the next node */
-    n = nodepool + nodeptr;
-    ++nodeptr;
+    n = p -> nodepool + p -> nodeptr;
+    ++p -> nodeptr;
 
     /* initialize the `kind' field */
     n -> kind = kind;
@@ -82,9 +76,9 @@ NODE *newnode(NODEKIND kind)
  * create_table_node: allocates, initializes, and returns a pointer to a new
  * create table node having the indicated values.
  */
-NODE *create_table_node(char *relname, NODE *attrlist)
+NODE *create_table_node(PARSER *p, char *relname, NODE *attrlist)
 {
-    NODE *n = newnode(N_CREATETABLE);
+    NODE *n = newnode(p, N_CREATETABLE);
 
     n -> u.CREATETABLE.relname = relname;
     n -> u.CREATETABLE.attrlist = attrlist;
@@ -95,9 +89,9 @@ NODE *create_table_node(char *relname, NODE *attrlist)
  * create_index_node: allocates, initializes, and returns a pointer to a new
  * create index node having the indicated values.
  */
-NODE *create_index_node(char *relname, char *attrname)
+NODE *create_index_node(PARSER *p, char *relname, char *attrname)
 {
-    NODE *n = newnode(N_CREATEINDEX);
+    NODE *n = newnode(p, N_CREATEINDEX);
 
     n -> u.CREATEINDEX.relname = relname;
     n -> u.CREATEINDEX.attrname = attrname;
@@ -108,9 +102,9 @@ NODE *create_index_node(char *relname, char *attrname)
  * drop_index_node: allocates, initializes, and returns a pointer to a new
  * drop index node having the indicated values.
  */
-NODE *drop_index_node(char *relname, char *attrname)
+NODE *drop_index_node(PARSER *p, char *relname, char *attrname)
 {
-    NODE *n = newnode(N_DROPINDEX);
+    NODE *n = newnode(p, N_DROPINDEX);
 
     n -> u.DROPINDEX.relname = relname;
     n -> u.DROPINDEX.attrname = attrname;
@@ -121,9 +115,9 @@ NODE *drop_index_node(char *relname, char *attrname)
  * drop_table_node: allocates, initializes, and returns a pointer to a new
  * drop table node having the indicated values.
  */
-NODE *drop_table_node(char *relname)
+NODE *drop_table_node(PARSER *p, char *relname)
 {
-    NODE *n = newnode(N_DROPTABLE);
+    NODE *n = newnode(p, N_DROPTABLE);
 
     n -> u.DROPTABLE.relname = relname;
     return n;
@@ -133,9 +127,9 @@ NODE *drop_table_node(char *relname)
  * load_node: allocates, initializes, and returns a pointer to a new
  * load node having the indicated values.
  */
-NODE *load_node(char *relname, char *filename)
+NODE *load_node(PARSER *p, char *relname, char *filename)
 {
-    NODE *n = newnode(N_LOAD);
+    NODE *n = newnode(p, N_LOAD);
 
     n -> u.LOAD.relname = relname;
     n -> u.LOAD.filename = filename;
@@ -146,9 +140,9 @@ NODE *load_node(char *relname, char *filename)
  * set_node: allocates, initializes, and returns a pointer to a new
  * set node having the indicated values.
  */
-NODE *set_node(char *paramName, char *string)
+NODE *set_node(PARSER *p, char *paramName, char *string)
 {
-    NODE *n = newnode(N_SET);
+    NODE *n = newnode(p, N_SET);
 
     n -> u.SET.paramName = paramName;
     n -> u.SET.string = string;
@@ -159,9 +153,9 @@ NODE *set_node(char *paramName, char *string)
  * help_node: allocates, initializes, and returns a pointer to a new
  * help node having the indicated values.
  */
-NODE *help_node(char *relname)
+NODE *help_node(PARSER *p, char *relname)
 {
-    NODE *n = newnode(N_HELP);
+    NODE *n = newnode(p, N_HELP);
 
     n -> u.HELP.relname = relname;
     return n;
@@ -171,9 +165,9 @@ NODE *help_node(char *relname)
  * print_node: allocates, initializes, and returns a pointer to a new
  * print node having the indicated values.
  */
-NODE *print_node(char *relname)
+NODE *print_node(PARSER *p, char *relname)
 {
-    NODE *n = newnode(N_PRINT);
+    NODE *n = newnode(p, N_PRINT);
 
     n -> u.PRINT.relname = relname;
     return n;
@@ -183,9 +177,9 @@ NODE *print_node(char *relname)
  * query_node: allocates, initializes, and returns a pointer to a new
  * query node having the indicated values.
  */
-NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist)
+NODE *query_node(PARSER *p, NODE *relattrlist, NODE *rellist, NODE *conditionlist)
 {
-    NODE *n = newnode(N_QUERY);
+    NODE *n = newnode(p, N_QUERY);
 
     n->u.QUERY.relattrlist = relattrlist;
     n->u.QUERY.rellist = rellist;
@@ -197,9 +191,9 @@ NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist)
  * insert_node: allocates, initializes, and returns a pointer to a new
  * insert node having the indicated values.
  */
-NODE *insert_node(char *relname, NODE *valuelist)
+NODE *insert_node(PARSER *p, char *relname, NODE *valuelist)
 {
-    NODE *n = newnode(N_INSERT);
+    NODE *n = newnode(p, N_INSERT);
 
     n->u.INSERT.relname = relname;
     n->u.INSERT.valuelist = valuelist;
@@ -210,9 +204,9 @@ NODE *insert_node(char *relname, NODE *valuelist)
  * delete_node: allocates, initializes, and returns a pointer to a new
  * delete node having the indicated values.
  */
-NODE *delete_node(char *relname, NODE *conditionlist)
+NODE *delete_node(PARSER *p, char *relname, NODE *conditionlist)
 {
-    NODE *n = newnode(N_DELETE);
+    NODE *n = newnode(p, N_DELETE);
 
     n->u.DELETE.relname = relname;
     n->u.DELETE.conditionlist = conditionlist;
@@ -223,10 +217,10 @@ NODE *delete_node(char *relname, NODE *conditionlist)
  * update_node: allocates, initializes, and returns a pointer to a new
  * update node having the indicated values.
  */
-NODE *update_node(char *relname, NODE *relattr, NODE *relorvalue, 
+NODE *update_node(PARSER *p, char *relname, NODE *relattr, NODE *relorvalue, 
 		  NODE *conditionlist)
 {
-    NODE *n = newnode(N_UPDATE);
+    NODE *n = newnode(p, N_UPDATE);
 
     n->u.UPDATE.relname = relname;
     n->u.UPDATE.relattr = relattr;
@@ -240,9 +234,9 @@ NODE *update_node(char *relname, NODE *relattr, NODE *relorvalue,
  * relattr_node: allocates, initializes, and returns a pointer to a new
  * relattr node having the indicated values.
  */
-NODE *relattr_node(char *relname, char *attrname)
+NODE *relattr_node(PARSER *p, char *relname, char *attrname)
 {
-    NODE *n = newnode(N_RELATTR);
+    NODE *n = newnode(p, N_RELATTR);
 
     n -> u.RELATTR.relname = relname;
     n -> u.RELATTR.attrname = attrname;
@@ -253,9 +247,9 @@ NODE *relattr_node(char *relname, char *attrname)
  * condition_node: allocates, initializes, and returns a pointer to a new
  * condition node having the indicated values.
  */
-NODE *condition_node(NODE *lhsRelattr, CompOp op, NODE *rhsRelattrOrValue)
+NODE *condition_node(PARSER *p, NODE *lhsRelattr, CompOp op, NODE *rhsRelattrOrValue)
 {
-    NODE *n = newnode(N_CONDITION);
+    NODE *n = newnode(p, N_CONDITION);
 
     n->u.CONDITION.lhsRelattr = lhsRelattr;
     n->u.CONDITION.op = op;
@@ -270,9 +264,9 @@ NODE *condition_node(NODE *lhsRelattr, CompOp op, NODE *rhsRelattrOrValue)
  * value_node: allocates, initializes, and returns a pointer to a new
  * value node having the indicated values.
  */
-NODE *value_node(AttrType type, void *value)
+NODE *value_node(PARSER *p, AttrType type, void *value)
 {
-    NODE *n = newnode(N_VALUE);
+    NODE *n = newnode(p, N_VALUE);
 
     n->u.VALUE.type = type;
     switch (type) {
@@ -293,9 +287,9 @@ NODE *value_node(AttrType type, void *value)
  * relattr_or_valuenode: allocates, initializes, and returns a pointer to 
  * a new relattr_or_value node having the indicated values.
  */
-NODE *relattr_or_value_node(NODE *relattr, NODE *value)
+NODE *relattr_or_value_node(PARSER *p, NODE *relattr, NODE *value)
 {
-    NODE *n = newnode(N_RELATTR_OR_VALUE);
+    NODE *n = newnode(p, N_RELATTR_OR_VALUE);
 
     n->u.RELATTR_OR_VALUE.relattr = relattr;
     n->u.RELATTR_OR_VALUE.value = value;
@@ -306,9 +300,9 @@ NODE *relattr_or_value_node(NODE *relattr, NODE *value)
  * attrtype_node: allocates, initializes, and returns a pointer to a new
  * attrtype node having the indicated values.
  */
-NODE *attrtype_node(char *attrname, char *type)
+NODE *attrtype_node(PARSER *p, char *attrname, char *type)
 {
-    NODE *n = newnode(N_ATTRTYPE);
+    NODE *n = newnode(p, N_ATTRTYPE);
 
     n -> u.ATTRTYPE.attrname = attrname;
     n -> u.ATTRTYPE.type = type;
@@ -319,9 +313,9 @@ NODE *attrtype_node(char *attrname, char *type)
  * relation_node: allocates, initializes, and returns a pointer to a new
  * relation node having the indicated values.
  */
-NODE *relation_node(char *relname)
+NODE *relation_node(PARSER *p, char *relname)
 {
-    NODE *n = newnode(N_RELATION);
+    NODE *n = newnode(p, N_RELATION);
 
     n->u.RELATION.relname = relname;
     return n;
@@ -331,9 +325,9 @@ NODE *relation_node(char *relname)
  * list_node: allocates, initializes, and returns a pointer to a new
  * list node having the indicated values.
  */
-NODE *list_node(NODE *n)
+NODE *list_node(PARSER *p, NODE *n)
 {
-    NODE *list = newnode(N_LIST);
+    NODE *list = newnode(p, N_LIST);
 
     list -> u.LIST.curr = n;
     list -> u.LIST.next = NULL;
@@ -345,9 +339,9 @@ NODE *list_node(NODE *n)
  *
  * Returns the resulting list.
  */
-NODE *prepend(NODE *n, NODE *list)
+NODE *prepend(PARSER *p, NODE *n, NODE *list)
 {
-    NODE *newlist = newnode(N_LIST);
+    NODE *newlist = newnode(p, N_LIST);
 
     newlist -> u.LIST.curr = n;
     newlist -> u.LIST.next = list;
@@ -17,10 +17,12 @@
  */
 
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <sys/types.h>
 #include <cstdlib>
 #include <unistd.h>
+#include <pthread.h>
 #include "redbase.h"
 #include "parser_internal.h"
 #include "pf.h"     // for PF_PrintError
@@ -32,11 +34,6 @@
 
 using namespace std;
 
-  // Added by Wendy Tobagus
-#ifndef yyrestart
-void yyrestart(FILE*);
-#endif
-
 // The PF_STATS indicates that we will be tracking statistics for the PF
 // Layer.  The Manager is defined within pf_buffermgr.cc.  
 // We include it within the parser so that a system command can display
@@ -49,31 +46,29 @@ extern StatisticsMgr *pStatisticsMgr;
 
 #endif    // PF_STATS
 
-/*
- * string representation of tokens; provided by scanner
- */
-extern char *yytext;
-
-/*
- * points to root of parse tree
- */
-static NODE *parse_tree;
-
-int bExit;                 // when to return from RBparse
-
 int bQueryPlans;           // When to print the query plans
 
 int bAbort;
 
 int abortProb;
 
-PF_Manager *pPfm;          // PF component manager
-SM_Manager *pSmm;          // SM component manager
-QL_Manager *pQlm;          // QL component manager
-LG_Manager *pLgm;          // LG component manager
+static int RunShellCommand(PARSER *p, const char *psCommand);
+static void yyerror(PARSER *p, yyscan_t scanner, char const *s);
 
 %}
 
+/*
+ * The parser and the scanner are reentrant: all of their state is in
+ * the PARSER and the scanner passed to yyparse
+ */
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {PARSER *p} {yyscan_t scanner}
+
+%code {
+int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+}
+
 %union{
     int ival;
     CompOp cval;
@@ -182,33 +177,33 @@ LG_Manager *pLgm;          // LG component manager
 start
    : command ';'
    {
-      parse_tree = $1;
+      p->parse_tree = $1;
       YYACCEPT;
    }
    | T_SHELL_CMD
    {
-      if (!isatty(0)) {
+      if (p->bEcho) {
         cout << ($1) << "\n";
         cout.flush();
       }
-      int exitstatus = system($1);
+      int exitstatus = RunShellCommand(p, $1);
       if (exitstatus != 0) {
         cout << "Shell command exited with non-zero status: " << exitstatus << "\n";
         cout.flush();
       }
-      parse_tree = NULL;
+      p->parse_tree = NULL;
       YYACCEPT;
    }
    | error
    {
-      reset_scanner();
-      parse_tree = NULL;
+      reset_scanner(scanner);
+      p->parse_tree = NULL;
       YYACCEPT;
    }
    | T_EOF
    {
-      parse_tree = NULL;
-      bExit = 1;
+      p->parse_tree = NULL;
+      p->bExit = 1;
       YYACCEPT;
    }
    ;
@@ -262,13 +257,13 @@ utility
 queryplans
    : RW_QUERY_PLAN RW_ON
    {
-      bQueryPlans = 1;
+      p->bQueryPlans = 1;
       cout << "Query plan display turned on.\n";
       $$ = NULL;
    }
    | RW_QUERY_PLAN RW_OFF
    { 
-      bQueryPlans = 0;
+      p->bQueryPlans = 0;
       cout << "Query plan display turned off.\n";
       $$ = NULL;
    }
@@ -277,7 +272,7 @@ queryplans
 abortprogram
    : RW_ABORT RW_PROGRAM
    {
-      $$ = newnode(N_ABORTPROGRAM);
+      $$ = newnode(p, N_ABORTPROGRAM);
    }   
 
 aborton
@@ -292,7 +287,7 @@ aborton
 buffer
    : RW_RESET RW_BUFFER
    {
-      if (pPfm->ClearBuffer())
+      if (p->pPfm->ClearBuffer())
          cout << "Trouble clearing buffer!  Things may be pinned.\n";
       else 
          cout << "Everything kicked out of Buffer!\n";
@@ -300,12 +295,12 @@ buffer
    }
    | RW_PRINT RW_BUFFER
    {
-      pPfm->PrintBuffer();
+      p->pPfm->PrintBuffer();
       $$ = NULL;
    }
    | RW_RESIZE RW_BUFFER T_INT
    {
-      pPfm->ResizeBuffer($3);
+      p->pPfm->ResizeBuffer($3);
       $$ = NULL;
    }
    ;
@@ -327,6 +322,7 @@ statistics
       #ifdef PF_STATS
          cout << "Statistics reset.\n";
          pStatisticsMgr->Reset();
+         p->pPfm->ResetFileStats();
       #else
          cout << "Statitisics not compiled.\n";
       #endif
@@ -337,65 +333,65 @@ statistics
 begintransaction
    : RW_BEGIN RW_TRANSACTION
    {
-      $$ = newnode(N_BEGINTRANSACTION);
+      $$ = newnode(p, N_BEGINTRANSACTION);
    };
 
 committransaction
    : RW_COMMIT RW_TRANSACTION
    {
-      $$ = newnode(N_COMMITTRANSACTION);
+      $$ = newnode(p, N_COMMITTRANSACTION);
    };
 
 aborttransaction
    : RW_ABORT RW_TRANSACTION
    {
-      $$ = newnode(N_ABORTTRANSACTION);
+      $$ = newnode(p, N_ABORTTRANSACTION);
    };
 
 checkpoint
    : RW_CHECKPOINT
    {
-      $$ = newnode(N_CHECKPOINT);
+      $$ = newnode(p, N_CHECKPOINT);
    };
 
 printlog
    : RW_PRINT RW_LOG
    {
-      $$ = newnode(N_PRINTLOG);
+      $$ = newnode(p, N_PRINTLOG);
    };
 
 createtable
    : RW_CREATE RW_TABLE T_STRING '(' non_mt_attrtype_list ')'
    {
-      $$ = create_table_node($3, $5);
+      $$ = create_table_node(p, $3, $5);
    }
    ;
 
 createindex
    : RW_CREATE RW_INDEX T_STRING '(' T_STRING ')'
    {
-      $$ = create_index_node($3, $5);
+      $$ = create_index_node(p, $3, $5);
    }
    ;
 
 droptable
    : RW_DROP RW_TABLE T_STRING
    {
-      $$ = drop_table_node($3);
+      $$ = drop_table_node(p, $3);
    }
    ;
 
 dropindex
    : RW_DROP RW_INDEX T_STRING '(' T_STRING ')'
    {
-      $$ = drop_index_node($3, $5);
+      $$ = drop_index_node(p, $3, $5);
    }
    ;
 
 load
    : RW_LOAD T_STRING '(' T_QSTRING ')'
    {
-      $$ = load_node($2, $4);
+      $$ = load_node(p, $2, $4);
    }
    ;
 
@@ -403,21 +399,21 @@ load
 set
    : RW_SET T_STRING T_EQ T_QSTRING
    {
-      $$ = set_node($2, $4);
+      $$ = set_node(p, $2, $4);
    }
    ;
 
 help
    : RW_HELP opt_relname
    {
-      $$ = help_node($2);
+      $$ = help_node(p, $2);
    }
    ;
 
 print
    : RW_PRINT T_STRING
    {
-      $$ = print_node($2);
+      $$ = print_node(p, $2);
    }
    ;
 
@@ -425,53 +421,53 @@ exit
    : RW_EXIT
    {
       $$ = NULL;
-      bExit = 1;
+      p->bExit = 1;
    }
    ;
 
 query
    : RW_SELECT non_mt_select_clause RW_FROM non_mt_relation_list opt_where_clause
    {
-      $$ = query_node($2, $4, $5);
+      $$ = query_node(p, $2, $4, $5);
    }
    ;
 
 insert
    : RW_INSERT RW_INTO T_STRING RW_VALUES '(' non_mt_value_list ')'
    {
-      $$ = insert_node($3, $6);
+      $$ = insert_node(p, $3, $6);
    }
    ;
 
 delete
    : RW_DELETE RW_FROM T_STRING opt_where_clause
    {
-      $$ = delete_node($3, $4);
+      $$ = delete_node(p, $3, $4);
    }
    ;
 
 update
    : RW_UPDATE T_STRING RW_SET relattr T_EQ relattr_or_value opt_where_clause
    {
-      $$ = update_node($2, $4, $6, $7);
+      $$ = update_node(p, $2, $4, $6, $7);
    }
    ;
 
 non_mt_attrtype_list
    : attrtype ',' non_mt_attrtype_list
    {
-      $$ = prepend($1, $3);
+      $$ = prepend(p, $1, $3);
    }
    | attrtype
    {
-      $$ = list_node($1);
+      $$ = list_node(p, $1);
    }
    ;
 
 attrtype
    : T_STRING T_STRING
     {
-      $$ = attrtype_node($1, $2);
+      $$ = attrtype_node(p, $1, $2);
    }
    ;
 
@@ -479,47 +475,47 @@ non_mt_select_clause
    : non_mt_relattr_list
    | '*'
    {
-       $$ = list_node(relattr_node(NULL, (char*)"*"));
+       $$ = list_node(p, relattr_node(p, NULL, (char*)"*"));
    }
       
 
 non_mt_relattr_list
    : relattr ',' non_mt_relattr_list
    {
-      $$ = prepend($1, $3);
+      $$ = prepend(p, $1, $3);
    }
    | relattr
    {
-      $$ = list_node($1);
+      $$ = list_node(p, $1);
    }
    ;
 
 relattr
    : T_STRING '.' T_STRING
    {
-      $$ = relattr_node($1, $3);
+      $$ = relattr_node(p, $1, $3);
    }
    | T_STRING
    {
-      $$ = relattr_node(NULL, $1);
+      $$ = relattr_node(p, NULL, $1);
    }
    ;
 
 non_mt_relation_list
    : relation ',' non_mt_relation_list
    {
-      $$ = prepend($1, $3);
+      $$ = prepend(p, $1, $3);
    }
    | relation
    {
-      $$ = list_node($1);
+      $$ = list_node(p, $1);
    }
    ;
 
 relation
    : T_STRING
    {
-      $$ = relation_node($1);
+      $$ = relation_node(p, $1);
    }
    ;
 
@@ -537,55 +533,55 @@ opt_where_clause
 non_mt_cond_list
    : condition RW_AND non_mt_cond_list
    {
-      $$ = prepend($1, $3);
+      $$ = prepend(p, $1, $3);
    }
    | condition
    {
-      $$ = list_node($1);
+      $$ = list_node(p, $1);
    }
    ;
 
 condition
    : relattr op relattr_or_value
    {
-      $$ = condition_node($1, $2, $3);
+      $$ = condition_node(p, $1, $2, $3);
    }
    ;
 
 relattr_or_value
    : relattr
    {
-      $$ = relattr_or_value_node($1, NULL);
+      $$ = relattr_or_value_node(p, $1, NULL);
    }
    | value
    {
-      $$ = relattr_or_value_node(NULL, $1);
+      $$ = relattr_or_value_node(p, NULL, $1);
    }
    ;
 
 non_mt_value_list
    : value ',' non_mt_value_list
    {
-      $$ = prepend($1, $3);
+      $$ = prepend(p, $1, $3);
    }
    | value
    {
-      $$ = list_node($1);
+      $$ = list_node(p, $1);
    }
    ;
 
 value
    : T_QSTRING
    {
-      $$ = value_node(STRING, (void *) $1);
+      $$ = value_node(p, STRING, (void *) $1);
    }
    | T_INT
    {
-      $$ = value_node(INT, (void *)& $1);
+      $$ = value_node(p, INT, (void *)& $1);
    }
    | T_REAL
    {
-      $$ = value_node(FLOAT, (void *)& $1);
+      $$ = value_node(p, FLOAT, (void *)& $1);
    }
    ;
 
@@ -657,6 +653,106 @@ void PrintError(RC rc)
       cerr << "Error code out of range: " << rc << "\n";
 }
 
+//
+// Output of the commands of a parser
+//
+// cout and cerr are shared by the whole process.  Once a parser with an
+// output stream of its own has been opened, they write through
+// RB_OutputBuf, which sends what a thread writes to the output stream of
+// the parser whose command the thread is running, and everything else to
+// the standard output or error as before.  RB_OutputBuf keeps no buffer
+// of its own, so threads never share one.
+//
+class RB_OutputBuf : public streambuf {
+public:
+   RB_OutputBuf(streambuf *pStdBuf) : pStdBuf(pStdBuf) {}
+
+protected:
+   int overflow(int c) {
+      if (c == EOF)
+         return (!EOF);
+      return (Target()->sputc(c));
+   }
+   streamsize xsputn(const char *s, streamsize n) {
+      return (Target()->sputn(s, n));
+   }
+   int sync() {
+      return (Target()->pubsync());
+   }
+
+private:
+   streambuf *Target();
+   streambuf *pStdBuf;                // standard output or error
+};
+
+// Output of the command the thread is running, if any
+static __thread streambuf *pCommandOut;
+
+streambuf *RB_OutputBuf::Target()
+{
+   return (pCommandOut != NULL ? pCommandOut : pStdBuf);
+}
+
+static pthread_once_t outputOnce = PTHREAD_ONCE_INIT;
+
+static void SetupOutput()
+{
+   static RB_OutputBuf outBuf(cout.rdbuf());
+   static RB_OutputBuf errBuf(cerr.rdbuf());
+
+   cout.rdbuf(&outBuf);
+   cerr.rdbuf(&errBuf);
+}
+
+//
+// NewParser
+//
+// Desc: Allocate a parser and its scanner, reading the standard input
+// Ret:  The parser, or NULL if out of memory
+//
+static PARSER *NewParser(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm,
+                         LG_Manager &lgm)
+{
+   PARSER *p = new PARSER;
+
+   if ((p->scanner = open_scanner(p)) == NULL) {
+      delete p;
+      return (NULL);
+   }
+   p->nodeptr = 0;
+   p->charptr = 0;
+   p->parse_tree = NULL;
+   p->bExit = 0;
+   p->bQueryPlans = 0;
+   p->bEcho = FALSE;
+   p->pOut = NULL;
+   p->pPfm = &pfm;
+   p->pSmm = &smm;
+   p->pQlm = &qlm;
+   p->pLgm = &lgm;
+   return (p);
+}
+
+//
+// Interpret
+//
+// Desc: Interpret the command just parsed by p, if any
+//
+static void Interpret(PARSER *p)
+{
+   RC rc;
+
+   if (p->parse_tree == NULL)
+      return;
+
+   bQueryPlans = p->bQueryPlans;
+   if ((rc = interp(p, p->parse_tree))) {
+      PrintError(rc);
+      if (rc < 0)
+         p->bExit = TRUE;
+   }
+}
+
 //
 // RBparse
 //
@@ -664,21 +760,19 @@ void PrintError(RC rc)
 //
 void RBparse(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm, LG_Manager &lgm)
 {
-   RC rc;
+   PARSER *p;
 
-   // Set up global variables to their defaults
-   pPfm  = &pfm;
-   pSmm  = &smm;
-   pQlm  = &qlm;
-   pLgm  = &lgm;
-   bExit = 0;
-   bQueryPlans = 0;
+   if ((p = NewParser(pfm, smm, qlm, lgm)) == NULL) {
+      cerr << "out of memory\n";
+      return;
+   }
+   p->bEcho = !isatty(0);
 
    /* Do forever */
-   while (!bExit) {
+   while (!p->bExit) {
 
       /* Reset parser and scanner for a new query */
-      new_query();
+      new_query(p);
 
       /* Print a prompt */
       cout << PROMPT;
@@ -687,13 +781,102 @@ void RBparse(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm, LG_Manager &lgm)
       cout.flush(); 
 
       /* If a query was successfully read, interpret it */
-      if(yyparse() == 0 && parse_tree != NULL)
-         if ((rc = interp(parse_tree))) {
-            PrintError(rc);
-            if (rc < 0)
-               bExit = TRUE;
-         }
+      if (yyparse(p, p->scanner) == 0)
+         Interpret(p);
    }
+
+   RBclose(p);
+}
+
+//
+// RBopen
+//
+// Desc: Open a parser for a session of the server.  Its commands are
+//       given to RBexecute one at a time, and their output goes to out.
+// Ret:  The parser, or NULL if out of memory
+//
+struct parser *RBopen(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm,
+                      LG_Manager &lgm, ostream &out)
+{
+   PARSER *p;
+
+   if ((p = NewParser(pfm, smm, qlm, lgm)) == NULL)
+      return (NULL);
+   p->pOut = &out;
+   pthread_once(&outputOnce, SetupOutput);
+   return (p);
+}
+
+//
+// RBclose
+//
+// Desc: Destroy a parser
+//
+void RBclose(struct parser *p)
+{
+   close_scanner(p->scanner);
+   delete p;
+}
+
+//
+// RBexecute
+//
+// Desc: Parse and interpret a single command held in a string, rather
+//       than read from the standard input.  Used by the server mode of
+//       redbase, which reads each command from a client first.  The
+//       output of the command goes to the output stream of p.  Commands
+//       of different parsers may be parsed at the same time; the caller
+//       runs one command at a time through the layers above PF.
+// In:   p - a parser opened by RBopen
+//       psCommand - the command, including its ';' (or a shell command)
+// Ret:  TRUE if the command was exit or failed with an error, in which
+//       case RBparse would have returned
+//
+int RBexecute(struct parser *p, const char *psCommand)
+{
+   p->bExit = 0;
+
+   /* Reset parser and scanner, and read from the command */
+   new_query(p);
+   scan_string(p->scanner, psCommand);
+
+   pCommandOut = p->pOut->rdbuf();
+
+   /* If a query was successfully read, interpret it */
+   if (yyparse(p, p->scanner) == 0)
+      Interpret(p);
+
+   cout.flush();
+   cerr.flush();
+   pCommandOut = NULL;
+
+   return (p->bExit);
+}
+
+//
+// RunShellCommand
+//
+// Desc: Run a shell command.  The output of a command of a server
+//       session is copied to the output of the session, which the
+//       command cannot write to itself.
+// Ret:  The exit status of the command
+//
+static int RunShellCommand(PARSER *p, const char *psCommand)
+{
+   string command;
+   FILE *pipe;
+   char buf[4096];
+   size_t n;
+
+   if (p->pOut == NULL)
+      return (system(psCommand));
+
+   command = string(psCommand) + " 2>&1";
+   if ((pipe = popen(command.c_str(), "r")) == NULL)
+      return (-1);
+   while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+      cout.write(buf, n);
+   return (pclose(pipe));
 }
 
 //
@@ -791,9 +974,9 @@ ostream &operator<<(ostream &s, const AttrType &at)
 /*
  * Required by yacc
  */
-void yyerror(char const *s) // New in 2000
+static void yyerror(PARSER *p, yyscan_t scanner, char const *s) // New in 2000
 {
-   puts(s);
+   cout << s << "\n";
 }
 
 #if 0
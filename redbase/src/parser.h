@@ -59,6 +59,21 @@ class LG_Manager;
 
 void RBparse(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm, LG_Manager &lgm);
 
+// A parser of its own, for a session of the server.  The output of the
+// commands it runs (everything written to cout and cerr by the thread
+// running them) goes to out instead of the standard output and error.
+// Parsers are independent: commands of different parsers can be parsed
+// at the same time, but the layers above PF must still run one command
+// at a time.
+struct parser;
+struct parser *RBopen(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm,
+                      LG_Manager &lgm, std::ostream &out);
+void RBclose(struct parser *p);
+
+// Parse and interpret a single command held in a string.  Returns TRUE
+// if the caller should stop sending commands (exit, or a fatal error).
+int RBexecute(struct parser *p, const char *psCommand);
+
 //
 // Error printing function; calls component-specific functions
 //
@@ -66,7 +81,8 @@ void PrintError(RC rc);
 
 // bQueryPlans is allocated by parse.y.  When bQueryPlans is 1 then the
 // query plan chosen for the SFW query will be displayed.  When
-// bQueryPlans is 0 then no query plan is shown.
+// bQueryPlans is 0 then no query plan is shown.  It is set from the
+// parser running the command.
 extern int bQueryPlans;
 extern int bAbort;
 extern int abortProb;
@@ -10,6 +10,7 @@
 #ifndef PARSER_INTERNAL_H
 #define PARSER_INTERNAL_H
 
+#include <stdio.h>
 #include "parser.h"
 
 /*
@@ -202,38 +203,85 @@ typedef struct node{
 } NODE;
 
 
+/*
+ * total number of nodes available for a given parse-tree
+ */
+#define MAXNODE		100
+
+/*
+ * size of buffer of strings
+ */
+#define MAXCHAR		5000
+
+/*
+ * the scanner, as generated by flex with %option reentrant
+ */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+/*
+ * PARSER: the state of one parser.  RBparse has its own; each session of
+ * the server has one, so that sessions parse their commands independently.
+ */
+typedef struct parser{
+   yyscan_t scanner;             /* the scanner, whose extra is the parser */
+   void *buffer;                 /* string being scanned, if any */
+
+   NODE nodepool[MAXNODE];       /* nodes of the current parse tree */
+   int nodeptr;
+   char charpool[MAXCHAR];       /* strings of the current parse tree */
+   int charptr;
+
+   NODE *parse_tree;             /* root of the parse tree */
+   int bExit;                    /* when to return from RBparse */
+   int bQueryPlans;              /* when to print the query plans */
+   int bEcho;                    /* TRUE to echo queries before running them */
+   std::ostream *pOut;           /* output of the commands; NULL = cout */
+
+   PF_Manager *pPfm;             /* PF component manager */
+   SM_Manager *pSmm;             /* SM component manager */
+   QL_Manager *pQlm;             /* QL component manager */
+   LG_Manager *pLgm;             /* LG component manager */
+} PARSER;
+
 /*
  * function prototypes
  */
-NODE *newnode(NODEKIND kind);
-NODE *create_table_node(char *relname, NODE *attrlist);
-NODE *create_index_node(char *relname, char *attrname);
-NODE *drop_index_node(char *relname, char *attrname);
-NODE *drop_table_node(char *relname);
-NODE *load_node(char *relname, char *filename);
-NODE *set_node(char *paramName, char *string);
-NODE *help_node(char *relname);
-NODE *print_node(char *relname);
-NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist);
-NODE *insert_node(char *relname, NODE *valuelist);
-NODE *delete_node(char *relname, NODE *conditionlist);
-NODE *update_node(char *relname, NODE *relattr, NODE *value,
+NODE *newnode(PARSER *p, NODEKIND kind);
+NODE *create_table_node(PARSER *p, char *relname, NODE *attrlist);
+NODE *create_index_node(PARSER *p, char *relname, char *attrname);
+NODE *drop_index_node(PARSER *p, char *relname, char *attrname);
+NODE *drop_table_node(PARSER *p, char *relname);
+NODE *load_node(PARSER *p, char *relname, char *filename);
+NODE *set_node(PARSER *p, char *paramName, char *string);
+NODE *help_node(PARSER *p, char *relname);
+NODE *print_node(PARSER *p, char *relname);
+NODE *query_node(PARSER *p, NODE *relattrlist, NODE *rellist,
+                 NODE *conditionlist);
+NODE *insert_node(PARSER *p, char *relname, NODE *valuelist);
+NODE *delete_node(PARSER *p, char *relname, NODE *conditionlist);
+NODE *update_node(PARSER *p, char *relname, NODE *relattr, NODE *value,
 		  NODE *conditionlist);
-NODE *relattr_node(char *relname, char *attrname);
-NODE *condition_node(NODE *lhsRelattr, CompOp op, NODE *rhsRelattrOrValue);
-NODE *value_node(AttrType type, void *value);
-NODE *relattr_or_value_node(NODE *relattr, NODE *value);
-NODE *attrtype_node(char *attrname, char *type);
-NODE *relation_node(char *relname);
-NODE *list_node(NODE *n);
-NODE *prepend(NODE *n, NODE *list);
-
-void reset_scanner(void);
-void reset_charptr(void);
-void new_query(void);
-RC   interp(NODE *n);
-int  yylex(void);
-int  yyparse(void);
+NODE *relattr_node(PARSER *p, char *relname, char *attrname);
+NODE *condition_node(PARSER *p, NODE *lhsRelattr, CompOp op,
+                     NODE *rhsRelattrOrValue);
+NODE *value_node(PARSER *p, AttrType type, void *value);
+NODE *relattr_or_value_node(PARSER *p, NODE *relattr, NODE *value);
+NODE *attrtype_node(PARSER *p, char *attrname, char *type);
+NODE *relation_node(PARSER *p, char *relname);
+NODE *list_node(PARSER *p, NODE *n);
+NODE *prepend(PARSER *p, NODE *n, NODE *list);
+
+yyscan_t open_scanner(PARSER *p);
+void close_scanner(yyscan_t scanner);
+void scan_file(yyscan_t scanner, FILE *in);
+void scan_string(yyscan_t scanner, const char *s);
+void reset_scanner(yyscan_t scanner);
+void reset_charptr(PARSER *p);
+void new_query(PARSER *p);
+RC   interp(PARSER *p, NODE *n);
 
 #endif
 
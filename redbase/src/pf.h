@@ -32,6 +32,78 @@ typedef int PageNum;
 //
 const int PF_PAGE_SIZE = 4096 - sizeof(int);
 
+//
+// Database page size
+//
+// The page size of a database (page header included) is chosen when the
+// database is created and is stored in the header of each of its files.
+// It is a power of 2 from PF_MIN_PAGE_SIZE to PF_MAX_PAGE_SIZE.
+// PF_PAGE_SIZE above is the usable size of a page of the default,
+// smallest size; PF_Manager::GetPageSize returns that of the pages of
+// the manager's files.
+//
+const int PF_MIN_PAGE_SIZE = 4096;
+const int PF_MAX_PAGE_SIZE = 65536;
+
+//
+// PF_ReplacePolicy: page replacement policy of the buffer manager
+//
+//   PF_LRU   - evict the least recently used unpinned page (default)
+//   PF_CLOCK - second chance: a reference bit instead of moving pages
+//              around on every access
+//   PF_2Q    - scan resistant: pages read once stay in a small FIFO and
+//              only pages referenced again after leaving it are kept
+//              in the main LRU list
+//
+enum PF_ReplacePolicy {
+   PF_LRU,
+   PF_CLOCK,
+   PF_2Q
+};
+
+//
+// PF_OpenMode: how a file is opened
+//
+//   PF_READWRITE - pages are read into the buffer pool, and changed pages
+//                  are written back from there (default)
+//   PF_MAPPED    - read only: the file is mapped into memory and pages are
+//                  read in place, without a copy into the buffer pool.
+//                  Meant for large, read-mostly tables.  Pages changed in
+//                  the buffer pool through another handle of the file are
+//                  only seen once they are written.
+//   PF_DIRECT    - like PF_READWRITE, but the file is opened with O_DIRECT
+//                  so that its pages are not cached a second time by the
+//                  OS.  Meant for a buffer pool that takes most of the
+//                  memory.  Falls back to PF_READWRITE where the file
+//                  system does not support O_DIRECT.
+//
+enum PF_OpenMode {
+   PF_READWRITE,
+   PF_MAPPED,
+   PF_DIRECT
+};
+
+//
+// PF_FileStats: buffer statistics of a file
+//
+// Kept by the buffer manager for each file name opened (PF_READWRITE or
+// PF_DIRECT) since it was created or the statistics were reset, when the
+// PF layer is compiled with PF_STATS.  The counters of a file carry on
+// when it is closed and opened again.
+//
+const int PF_FILENAME_LEN = MAXNAME + 8;  // max length of a file name kept
+
+struct PF_FileStats {
+   char fileName[PF_FILENAME_LEN + 1];  // name the file was opened with
+   int  hits;           // pages requested and found in the buffer
+   int  misses;         // pages requested and not found
+   int  reads;          // pages read from the file
+   int  writes;         // pages written to the file
+   int  evictions;      // pages replaced to make room for another page
+   long long pinWait;   // microseconds spent waiting for requested pages
+                        //   (reads, and the background writer)
+};
+
 //
 // PF_PageHandle: PF page interface
 //
@@ -58,8 +130,15 @@ private:
 // PF_FileHdr: Header structure for files
 //
 struct PF_FileHdr {
-   int firstFree;     // first free page in the linked list
+   int reserved;      // first free page of older files, which kept their
+                      //   free pages in a linked list
    int numPages;      // # of pages in the file
+   int pageSize;      // size of a page, header included (0 in older
+                      //   files: PF_MIN_PAGE_SIZE)
+   int bFreeMap;      // TRUE: the file has free-space map pages
+                      //   (FALSE in older files)
+   int numAllocated;  // # of pages the file has disk space for; the
+                      //   pages from numPages on are preallocated
 };
 
 //
@@ -67,6 +146,7 @@ struct PF_FileHdr {
 //
 class PF_BufferMgr;
 class LG_Manager;
+struct PF_FreeMap;
 
 class PF_FileHandle {
    friend class PF_Manager;
@@ -82,39 +162,92 @@ public:
    // Overload =
    PF_FileHandle& operator=(const PF_FileHandle &fileHandle);
 
+   // The page getters take a hint on how the client is going to access
+   // the file.  Pages read with SEQUENTIAL_SCAN are kept in a small ring
+   // of buffer frames so that a large scan does not flush the buffer.
+
    // Get the first page
-   RC GetFirstPage(PF_PageHandle &pageHandle) const;
+   RC GetFirstPage(PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
    // Get the next page after current
-   RC GetNextPage (PageNum current, PF_PageHandle &pageHandle) const;
+   RC GetNextPage (PageNum current, PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
    // Get a specific page
-   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle) const;
+   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
    // Get the last page
-   RC GetLastPage(PF_PageHandle &pageHandle) const;
+   RC GetLastPage(PF_PageHandle &pageHandle,
+                  ClientHint pinHint = NO_HINT) const;
    // Get the prev page after current
-   RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle) const;
+   RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
+
+   // Get several pages at once.  Pages that are not in the buffer are
+   // read together, consecutive pages with a single read.
+
+   // Get the pages whose numbers are given
+   RC GetThesePages(const PageNum *pageNums, int numPages,
+                    PF_PageHandle *pageHandles,
+                    ClientHint pinHint = NO_HINT) const;
+   // Get up to maxPages of the next pages after current
+   RC GetNextPages (PageNum current, int maxPages,
+                    PF_PageHandle *pageHandles, int &numPages,
+                    ClientHint pinHint = NO_HINT) const;
+   // Unpin the pages of a set of page handles
+   RC UnpinPages  (const PF_PageHandle *pageHandles, int numPages) const;
 
    RC AllocatePage(PF_PageHandle &pageHandle);    // Allocate a new page
    RC DisposePage (PageNum pageNum);              // Dispose of a page
    RC MarkDirty   (PageNum pageNum) const;        // Mark page as dirty
    RC UnpinPage   (PageNum pageNum) const;        // Unpin the page
 
+   // Latch a pinned page shared (for reading) or exclusive (for changing
+   // it and marking it dirty) when it is shared between threads
+   RC LatchPage   (PageNum pageNum, int bExclusive = FALSE) const;
+   RC UnlatchPage (PageNum pageNum) const;        // Release the latch
+
    // Flush pages from buffer pool.  Will write dirty pages to disk.
    RC FlushPages  () const;
 
    // Force a page or pages to disk (but do not remove from the buffer pool)
    RC ForcePages  (PageNum pageNum=ALL_PAGES) const;
 
+   // Check the copy on disk of a page against its checksum, without
+   // going through the buffer pool
+   RC VerifyPage  (PageNum pageNum) const;
+
 private:
 
    // IsValidPageNum will return TRUE if page number is valid and FALSE
    // otherwise
    int IsValidPageNum (PageNum pageNum) const;
 
+   // Free-space map: IsUsedPage will return TRUE if page is used and
+   // FALSE if it is free
+   int IsUsedPage (PageNum pageNum) const;
+   void SetUsedPage (PageNum pageNum, int bUsed);
+
+   RC ReadHdr ();                                 // Read the file header
+   RC WriteHdr () const;                          // Write the file header
+   RC ReadMap ();                                 // Read the map pages
+   RC WriteMap () const;                          // Write the map pages
+   RC WriteChanged () const;                      // Write map and header
+                                                  //   back if changed
+   RC GrowMap ();                                 // Add a map page
+   RC ExtendFile ();                              // Preallocate pages
+
    PF_BufferMgr *pBufferMgr;                      // pointer to buffer manager
    PF_FileHdr hdr;                                // file header
    int bFileOpen;                                 // file open flag
    int bHdrChanged;                               // dirty flag for file hdr
    int unixfd;                                    // OS file descriptor
+   int bDirect;                                   // opened with O_DIRECT
+   char *pMap;                                    // mapped file (PF_MAPPED),
+                                                  //   else NULL
+   long mapSize;                                  // size of the mapping
+   unsigned char *pChecked;                       // mapped pages whose
+                                                  //   checksum was verified
+   PF_FreeMap *pFreeMap;                          // free-space map
 };
 
 //
@@ -123,12 +256,18 @@ private:
 class PF_Manager {
 public:
    PF_Manager    ();                              // Constructor
+   PF_Manager    (int numBufferPages,             // Constructor with the
+                  PF_ReplacePolicy policy = PF_LRU,  // # of buffer pages
+                  int pageSize = PF_MIN_PAGE_SIZE);  // and page size
    ~PF_Manager   ();                              // Destructor
    RC CreateFile    (const char *fileName);       // Create a new file
    RC DestroyFile   (const char *fileName);       // Delete a file
+   RC UpgradeFile   (const char *fileName);       // Rewrite an older file
+                                                  //   with a free-space map
 
    // Open and close file methods
-   RC OpenFile      (const char *fileName, PF_FileHandle &fileHandle);
+   RC OpenFile      (const char *fileName, PF_FileHandle &fileHandle,
+                     PF_OpenMode mode = PF_READWRITE);
    RC CloseFile     (PF_FileHandle &fileHandle);
 
    // Three methods that manipulate the buffer manager.  The calls are
@@ -138,6 +277,23 @@ public:
    RC PrintBuffer   ();
    RC ResizeBuffer  (int iNewSize);
 
+   // Change the page replacement policy of the buffer manager
+   RC SetPolicy     (PF_ReplacePolicy policy);
+
+   // Open the files opened PF_READWRITE from now on as PF_DIRECT instead
+   RC SetDirectIO   (int bDirectIO);
+
+   // Write dirty buffer pages in the background (or stop doing so)
+   RC SetBackgroundWriter(int bWriter);
+
+   // Map the buffer with explicit huge pages (or transparent ones)
+   RC SetHugePages  (int bHugePages);
+
+   // Return the buffer statistics of the i-th file tracked (PF_EOF past
+   // the last one), or reset those of all files
+   RC GetFileStats  (int i, PF_FileStats &stats) const;
+   RC ResetFileStats();
+
    // Three Methods for manipulating raw memory buffers.  These memory
    // locations are handled by the buffer manager, but are not
    // associated with a particular file.  These should be used if you
@@ -152,6 +308,9 @@ public:
    // Return the size of the block that can be allocated.
    RC GetBlockSize  (int &length) const;
 
+   // Return the # of usable bytes of a page of the manager's files
+   RC GetPageSize   (int &length) const;
+
    // Allocate a memory chunk that lives in buffer manager
    RC AllocateBlock (char *&buffer);
    // Dispose of a memory chunk managed by the buffer manager.
@@ -159,6 +318,9 @@ public:
 
 private:
    PF_BufferMgr *pBufferMgr;                      // page-buffer manager
+   int bDirectIO;                                 // open files PF_DIRECT
+   int pageSize;                                  // size of a page, header
+                                                  //   included
 };
 
 //
@@ -166,6 +328,30 @@ private:
 //
 void PF_PrintError(RC rc);
 
+//
+// Parse a buffer size given by the user into a number of buffer pages
+// of pageSize bytes.  A plain number is a page count; a K, M or G suffix
+// gives a size in bytes (e.g. "256M").
+//
+RC PF_ParseBufferSize(const char *psSize, int &numPages,
+                      int pageSize = PF_MIN_PAGE_SIZE);
+
+//
+// Parse a page size given by the user (e.g. "16K" or "16384").
+//
+RC PF_ParsePageSize(const char *psSize, int &pageSize);
+
+//
+// Read the page size of an existing file, e.g. to create a PF_Manager
+// that can open it.
+//
+RC PF_ReadPageSize(const char *fileName, int &pageSize);
+
+//
+// Parse a replacement policy name ("lru", "clock" or "2q").
+//
+RC PF_ParsePolicy(const char *psPolicy, PF_ReplacePolicy &policy);
+
 #define PF_PAGEPINNED      (START_PF_WARN + 0) // page pinned in buffer
 #define PF_PAGENOTINBUF    (START_PF_WARN + 1) // page isn't pinned in buffer
 #define PF_INVALIDPAGE     (START_PF_WARN + 2) // invalid page number
@@ -175,7 +361,14 @@ void PF_PrintError(RC rc);
 #define PF_PAGEUNPINNED    (START_PF_WARN + 6) // page already unpinned
 #define PF_EOF             (START_PF_WARN + 7) // end of file
 #define PF_TOOSMALL        (START_PF_WARN + 8) // Resize buffer too small
-#define PF_LASTWARN        PF_TOOSMALL
+#define PF_BADBUFSIZE      (START_PF_WARN + 9) // invalid buffer size
+#define PF_BADPOLICY       (START_PF_WARN + 10) // invalid replacement policy
+#define PF_READONLY        (START_PF_WARN + 11) // file is open read only
+#define PF_BADPAGESIZE     (START_PF_WARN + 12) // invalid page size
+#define PF_WRONGPAGESIZE   (START_PF_WARN + 13) // file page size differs
+                                                //   from the buffer's
+#define PF_OLDFORMAT       (START_PF_WARN + 14) // file has no free-space map
+#define PF_LASTWARN        PF_OLDFORMAT
 
 #define PF_NOMEM           (START_PF_ERR - 0)  // no memory
 #define PF_NOBUF           (START_PF_ERR - 1)  // no buffer space
@@ -190,8 +383,11 @@ void PF_PrintError(RC rc);
 #define PF_HASHPAGEEXIST   (START_PF_ERR - 8) // page already in hash table
 #define PF_INVALIDNAME     (START_PF_ERR - 9) // invalid PC file name
 
+// Page read from the file does not match its checksum
+#define PF_BADCHECKSUM     (START_PF_ERR - 10) // damaged or torn page
+
 // Error in UNIX system call or library routine
-#define PF_UNIX            (START_PF_ERR - 10) // Unix error
+#define PF_UNIX            (START_PF_ERR - 11) // Unix error
 #define PF_LASTERROR       PF_UNIX
 
 #endif
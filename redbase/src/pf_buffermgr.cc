@@ -16,12 +16,17 @@
 //
 
 #include <cstdio>
+#include <ctime>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <iostream>
 #include "pf_buffermgr.h"
 
 using namespace std;
 
+static int ComparePageNum(const void *p1, const void *p2);
+
 // The switch PF_STATS indicates that the user wishes to have statistics
 // tracked for the PF layer
 #ifdef PF_STATS
@@ -76,6 +81,20 @@ void WriteLog(const char *psMessage)
 #endif
 
 
+//
+// HashTableSize
+//
+// Desc: Internal.  Number of entries to size the hash table for, given
+//       a buffer of numPages pages.  Every buffer slot holds at most one
+//       entry, so the table never has to grow while the buffer is in use.
+// In:   numPages - the number of pages in the buffer
+// Ret:  number of hash table entries
+//
+int PF_BufferMgr::HashTableSize(int numPages)
+{
+   return (numPages > PF_HASH_TBL_SIZE ? numPages : PF_HASH_TBL_SIZE);
+}
+
 //
 // PF_BufferMgr
 //
@@ -85,7 +104,10 @@ void WriteLog(const char *psMessage)
 //       can be pinned multiple times).  If not, it reads it from the file
 //       and pins it.  If the buffer is full and a new page needs to be
 //       inserted, an unpinned page is replaced according to an LRU
+//       (or the policy passed in) strategy.
 // In:   numPages - the number of pages in the buffer
+//       policy - the page replacement policy
+//       pageSize - the size of a page, header included
 //
 // Note: The constructor will initialize the global pStatisticsMgr.  We
 //       make it global so that other components may use it and to allow
@@ -94,11 +116,16 @@ void WriteLog(const char *psMessage)
 // Aut2003
 // numPages changed to _numPages for to eliminate CC warnings
 
-PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
+PF_BufferMgr::PF_BufferMgr(int _numPages, PF_ReplacePolicy _policy,
+      int _pageSize) :
+   hashTable(HashTableSize(_numPages)), ghostTable(HashTableSize(_numPages)),
+   prefetcher(_pageSize)
 {
    // Initialize local variables
-   this->numPages = _numPages;
-   pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);
+   this->numPages = (_numPages > PF_MAX_BUFFER_PAGES) ?
+      PF_MAX_BUFFER_PAGES : _numPages;
+   this->policy = _policy;
+   pageSize = _pageSize;
 
 #ifdef PF_STATS
    // Initialize the global variable for the statistics manager
@@ -108,33 +135,64 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
 #ifdef PF_LOG
    char psMessage[100];
    sprintf (psMessage, "Creating buffer manager. %d pages of size %d.\n",
-         numPages, PF_PAGE_SIZE+sizeof(PF_PageHdr));
+         numPages, pageSize);
    WriteLog(psMessage);
 #endif
 
-   // Allocate memory for buffer page description table
-   bufTable = new PF_BufPageDesc[numPages];
-
-   // Initialize the buffer table and allocate memory for buffer pages.
-   // Initially, the free list contains all pages
-   for (int i = 0; i < numPages; i++) {
-      if ((bufTable[i].pData = new char[pageSize]) == NULL) {
+   // Reserve address space for the largest buffer page description
+   // table, so that the table never moves when the buffer grows.  Memory
+   // is committed to it as slots are added (CommitSlots).
+   bufTable = (PF_BufPageDesc *)mmap(NULL,
+         (size_t)PF_MAX_BUFFER_PAGES * sizeof(PF_BufPageDesc), PROT_NONE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (bufTable == MAP_FAILED) {
+      cerr << "Not enough memory for buffer\n";
+      exit(1);
+   }
+   numSlots = numCommitted = 0;
+   free = first = last = INVALID_SLOT;
+
+   // Add the slots, whose frames come from one arena.  Initially, the
+   // free list contains all pages.
+   arenas = NULL;
+   bHugePages = FALSE;
+   while (numSlots < numPages)
+      if (AddFrames()) {
          cerr << "Not enough memory for buffer\n";
          exit(1);
       }
 
-      memset ((void *)bufTable[i].pData, 0, pageSize);
-
-      bufTable[i].prev = i - 1;
-      bufTable[i].next = i + 1;
-   }
-   bufTable[0].prev = bufTable[numPages - 1].next = INVALID_SLOT;
-   free = 0;
-   first = last = INVALID_SLOT;
+   pthread_mutex_init(&poolMutex, NULL);
 
    logfd = -1;
    logFile = NULL;
 
+   // The background writer is started on demand
+   bWriter = FALSE;
+   pthread_mutex_init(&writerMutex, NULL);
+   pthread_cond_init(&writerCond, NULL);
+
+   // Initialize the replacement policy state and the scan ring
+   ghosts = NULL;
+   numGhosts = 0;
+   ring = new int[PF_RING_SIZE];
+   ResetPolicy();
+
+   // No file is being read sequentially yet
+   for (int i = 0; i < PF_PREFETCH_STREAMS; i++) {
+      pthread_mutex_init(&streams[i].mutex, NULL);
+      streams[i].fd = -1;
+   }
+
+   // Nor has a reference to wait for the used list
+   for (int i = 0; i < PF_PAGE_PARTITIONS; i++)
+      touches[i].numTouches = 0;
+
+   // Nor tracked for statistics
+   numFileStats = 0;
+   for (int i = 0; i < PF_STAT_FDS; i++)
+      fdStats[i] = -1;
+
 #ifdef PF_LOG
    WriteLog("Succesfully created the buffer manager.\n");
 #endif
@@ -147,11 +205,26 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
 //
 PF_BufferMgr::~PF_BufferMgr()
 {
+   // Stop the background writer
+   StopWriter();
+   pthread_cond_destroy(&writerCond);
+   pthread_mutex_destroy(&writerMutex);
+
    // Free up buffer pages and tables
-   for (int i = 0; i < this->numPages; i++)
-      delete [] bufTable[i].pData;
+   for (int i = 0; i < numCommitted; i++) {
+      if (bufTable[i].pLatch == NULL)
+         continue;
+      pthread_rwlock_destroy(bufTable[i].pLatch);
+      delete bufTable[i].pLatch;
+   }
+   FreeArenas(0);
+   pthread_mutex_destroy(&poolMutex);
+   for (int i = 0; i < PF_PREFETCH_STREAMS; i++)
+      pthread_mutex_destroy(&streams[i].mutex);
 
-   delete [] bufTable;
+   munmap(bufTable, (size_t)PF_MAX_BUFFER_PAGES * sizeof(PF_BufPageDesc));
+   delete [] ghosts;
+   delete [] ring;
 
 #ifdef PF_STATS
    // Destroy the global statistics manager
@@ -175,14 +248,20 @@ PF_BufferMgr::~PF_BufferMgr()
 //       pageNum - number of the page to read
 //       bMultiplePins - if FALSE, it is an error to ask for a page that is
 //                       already pinned in the buffer.
+//       pinHint - SEQUENTIAL_SCAN reads the page into a frame of the scan
+//                 ring if it is not in the buffer, and does not count as
+//                 a reference for the replacement policy if it is.
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
 // Ret:  PF return code
 //
 RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
-      int bMultiplePins)
+      int bMultiplePins, ClientHint pinHint)
 {
    RC  rc;     // return code
    int slot;   // buffer slot where page is located
+#ifdef PF_STATS
+   PF_FileStats *pStats;   // statistics of the file
+#endif
 
 #ifdef PF_LOG
    char psMessage[100];
@@ -195,60 +274,86 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
    pStatisticsMgr->Register(PF_GETPAGE, STAT_ADDONE);
 #endif
 
-   // Search for page in buffer
-   if ((rc = hashTable.Find(fd, pageNum, slot)) &&
-         (rc != PF_HASHNOTFOUND))
-      return (rc);                // unexpected error
+   // Search for page in buffer, with only its partition of the page
+   // table locked.  A page that another thread is reading in is waited
+   // for, and looked up again.
+   for (;;) {
+      hashTable.Lock(fd, pageNum);
+      rc = hashTable.Find(fd, pageNum, slot);
+      if (rc || !bufTable[slot].bReading)
+         break;
+      hashTable.Unlock(fd, pageNum);
+      WaitIO(fd, slot);
+   }
 
    // If page not in buffer...
    if (rc == PF_HASHNOTFOUND) {
+      hashTable.Unlock(fd, pageNum);
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_PAGENOTFOUND, STAT_ADDONE);
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
 #endif
 
-      // Allocate an empty page, this will also promote the newly allocated
-      // page to the MRU slot
-      if ((rc = InternalAlloc(slot)))
+      // Read it into a frame of its own.  Another thread may have read
+      // it in the meantime, in which case it is looked up again.
+      if ((rc = ReadIn(fd, pageNum, pinHint, slot)) == PF_PAGEINBUF)
+         return (GetPage(fd, pageNum, ppBuffer, bMultiplePins, pinHint));
+      if (rc)
          return (rc);
 
-      // read the page, insert it into the hash table,
-      // and initialize the page description entry
-      if ((rc = ReadPage(fd, pageNum, bufTable[slot].pData)) ||
-            (rc = hashTable.Insert(fd, pageNum, slot)) ||
-            (rc = InitPageDesc(fd, pageNum, slot))) {
-
-         // Put the slot back on the free list before returning the error
-         Unlink(slot);
-         InsertFree(slot);
-         return (rc);
-      }
+#ifdef PF_STATS
+   pStatisticsMgr->Register(PF_PAGENOTFOUND, STAT_ADDONE);
+   if ((pStats = FileStats(fd)) != NULL)
+      __sync_add_and_fetch(&pStats->misses, 1);
+   CountWait(fd, start);
+#endif
 #ifdef PF_LOG
    WriteLog("Page not found in buffer. Loaded.\n");
 #endif
    }
+   else if (rc) {
+      hashTable.Unlock(fd, pageNum);
+      return (rc);                // unexpected error
+   }
    else {   // Page is in the buffer...
 
-#ifdef PF_STATS
-   pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
-#endif
-
       // Error if we don't want to get a pinned page
-      if (!bMultiplePins && bufTable[slot].pinCount > 0)
+      if (!bMultiplePins && PinCount(slot) > 0) {
+         hashTable.Unlock(fd, pageNum);
          return (PF_PAGEPINNED);
+      }
+
+      // Page is alredy in memory, just increment pin count.  Once it is
+      // pinned, the page stays in its frame.
+      __sync_add_and_fetch(&bufTable[slot].pinCount, 1);
+      int bWriting = bufTable[slot].bWriting;
+
+      // Let the replacement policy know about the reference (under LRU
+      // this makes the page the most recently used page).  A sequential
+      // scan reads each page once, which is not worth remembering.  Any
+      // other client takes the page out of the scan ring.
+      if (pinHint != SEQUENTIAL_SCAN)
+         rc = Reference(fd, pageNum, slot, TRUE);
+      hashTable.Unlock(fd, pageNum);
+
+      // The page is being written: wait until it is done before the
+      // client may change it
+      if (bWriting)
+         WaitIO(fd, slot);
+      if (rc)
+         return (rc);
 
-      // Page is alredy in memory, just increment pin count
-      bufTable[slot].pinCount++;
+#ifdef PF_STATS
+   pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
+   if ((pStats = FileStats(fd)) != NULL)
+      __sync_add_and_fetch(&pStats->hits, 1);
+#endif
 #ifdef PF_LOG
       sprintf (psMessage, "Page found in buffer.  %d pin count.\n",
-            bufTable[slot].pinCount);
+            PinCount(slot));
       WriteLog(psMessage);
 #endif
-
-      // Make this page the most recently used page
-      if ((rc = Unlink(slot)) ||
-            (rc = LinkHead (slot)))
-         return (rc);
    }
 
    // Point ppBuffer to page
@@ -258,6 +363,261 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
    return (0);
 }
 
+//
+// GetPages
+//
+// Desc: Get pointers to several pages pinned in the buffer, as GetPage
+//       does for one page, but with the pool mutex taken once for the
+//       frames of all the pages that are not in the buffer, and with
+//       those pages read together: each run of consecutive pages is read
+//       by a single preadv (see ReadPages).  Either all the pages are
+//       pinned or, on error, none is.  A page may be asked for more than
+//       once; it is then pinned as many times.
+// In:   fd - OS file descriptor of the file to read
+//       pageNums - numbers of the pages to read
+//       numPages - number of entries in pageNums
+//       pinHint - as for GetPage
+// Out:  ppBuffers - ppBuffers[i] points to page pageNums[i] in the buffer
+// Ret:  PF return code
+//
+RC PF_BufferMgr::GetPages(int fd, const PageNum *pageNums, int numPages,
+      char **ppBuffers, ClientHint pinHint)
+{
+   RC  rc = 0;       // return code
+   int slot;         // buffer slot where a page is located
+   int numMissed = 0;
+   int numRead = 0;
+   int bPoolLocked = FALSE;
+   int i, j;
+
+   int         *slots = new int[numPages];         // slot of each entry
+   int         *bPinned = new int[numPages];       // TRUE once pinned in
+                                                   //   the page table
+   PF_PageSlot *missed = new PF_PageSlot[numPages]; // pages read in here
+   PF_PageSlot *toRead = new PF_PageSlot[numPages]; // ... and not read ahead
+#ifdef PF_STATS
+   PF_FileStats *pStats = FileStats(fd);          // statistics of the file
+   struct timespec start;                         // when the first page was
+                                                  //   missed
+#endif
+
+#ifdef PF_LOG
+   char psMessage[100];
+   sprintf (psMessage, "Looking for %d pages of (%d).\n", numPages, fd);
+   WriteLog(psMessage);
+#endif
+
+   // Pin the pages that are in the buffer, waiting for those that other
+   // threads are reading in
+   for (i = 0; i < numPages; i++) {
+      PageNum pageNum = pageNums[i];
+
+#ifdef PF_STATS
+      pStatisticsMgr->Register(PF_GETPAGE, STAT_ADDONE);
+#endif
+
+      bPinned[i] = FALSE;
+      slots[i] = INVALID_SLOT;
+      hashTable.Lock(fd, pageNum);
+      while ((rc = hashTable.Find(fd, pageNum, slot)) == 0 &&
+            bufTable[slot].bReading) {
+         hashTable.Unlock(fd, pageNum);
+         WaitIO(fd, slot);
+         hashTable.Lock(fd, pageNum);
+      }
+
+      if (rc) {
+         hashTable.Unlock(fd, pageNum);
+         if (rc != PF_HASHNOTFOUND)
+            goto err;
+         continue;
+      }
+
+      // In the buffer: pin it, and let the replacement policy know
+      __sync_add_and_fetch(&bufTable[slot].pinCount, 1);
+      int bWriting = bufTable[slot].bWriting;
+      if (pinHint != SEQUENTIAL_SCAN)
+         rc = Reference(fd, pageNum, slot, TRUE);
+      hashTable.Unlock(fd, pageNum);
+      if (bWriting)
+         WaitIO(fd, slot);
+#ifdef PF_STATS
+      pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
+      if (pStats != NULL)
+         __sync_add_and_fetch(&pStats->hits, 1);
+#endif
+      slots[i] = slot;
+      bPinned[i] = TRUE;
+      if (rc)
+         goto err;
+   }
+   rc = 0;
+
+   // Take a frame for each page not found, as ReadIn does, and enter the
+   // page in the page table to be read in
+   pthread_mutex_lock(&poolMutex);
+   bPoolLocked = TRUE;
+   for (i = 0; i < numPages; i++) {
+      PageNum pageNum = pageNums[i];
+
+      if (slots[i] != INVALID_SLOT)
+         continue;
+
+      // Maybe already read in by this call
+      for (j = 0; j < numMissed; j++)
+         if (missed[j].pageNum == pageNum)
+            break;
+
+      if (j < numMissed) {
+         slots[i] = missed[j].slot;
+         __sync_add_and_fetch(&bufTable[slots[i]].pinCount, 1);
+         continue;
+      }
+
+      // The frame stays pinned from now on, so that it is not chosen
+      // again for another page of the set
+      if (pinHint == SEQUENTIAL_SCAN)
+         rc = RingAlloc(slot);
+      else
+         rc = InternalAlloc(slot);
+      if (rc)
+         goto err;
+
+      // Taking the frame may have released the pool mutex, and another
+      // thread may have read the page in meanwhile: it is pinned below
+      pthread_rwlock_wrlock(bufTable[slot].pLatch);
+      hashTable.Lock(fd, pageNum);
+      int other;
+      if ((rc = hashTable.Find(fd, pageNum, other)) != PF_HASHNOTFOUND ||
+            (rc = InitPageDesc(fd, pageNum, slot))) {
+         hashTable.Unlock(fd, pageNum);
+         pthread_rwlock_unlock(bufTable[slot].pLatch);
+         if (bufTable[slot].bRing)
+            LeaveRing(slot);
+         Unlink(slot);
+         InsertFree(slot);
+         if (rc)
+            goto err;
+         continue;
+      }
+      bufTable[slot].bReading = TRUE;
+      rc = hashTable.Insert(fd, pageNum, slot);
+      if (rc) {
+         bufTable[slot].bReading = FALSE;
+         bufTable[slot].pinCount = 0;
+         hashTable.Unlock(fd, pageNum);
+         pthread_rwlock_unlock(bufTable[slot].pLatch);
+         if (bufTable[slot].bRing)
+            LeaveRing(slot);
+         Unlink(slot);
+         InsertFree(slot);
+         goto err;
+      }
+      hashTable.Unlock(fd, pageNum);
+
+#ifdef PF_STATS
+      pStatisticsMgr->Register(PF_PAGENOTFOUND, STAT_ADDONE);
+      if (numMissed == 0)
+         clock_gettime(CLOCK_MONOTONIC, &start);
+      if (pStats != NULL)
+         __sync_add_and_fetch(&pStats->misses, 1);
+#endif
+      slots[i] = slot;
+      missed[numMissed].pageNum = pageNum;
+      missed[numMissed++].slot = slot;
+   }
+   pthread_mutex_unlock(&poolMutex);
+   bPoolLocked = FALSE;
+
+   // Copy the pages read ahead from the prefetcher, and read the others
+   for (j = 0; j < numMissed; j++) {
+      if (prefetcher.Take(fd, missed[j].pageNum,
+            bufTable[missed[j].slot].pData) == 0) {
+#ifdef PF_STATS
+         pStatisticsMgr->Register(PF_PREFETCHHIT, STAT_ADDONE);
+#endif
+         continue;
+      }
+      toRead[numRead++] = missed[j];
+   }
+   if ((rc = ReadPages(fd, toRead, numRead)))
+      goto err;
+
+   // The pages are ready: let the threads waiting for them go on
+   for (j = 0; j < numMissed; j++) {
+      PageNum pageNum = missed[j].pageNum;
+      hashTable.Lock(fd, pageNum);
+      bufTable[missed[j].slot].bReading = FALSE;
+      hashTable.Unlock(fd, pageNum);
+      pthread_rwlock_unlock(bufTable[missed[j].slot].pLatch);
+   }
+#ifdef PF_STATS
+   if (numMissed > 0)
+      CountWait(fd, start);
+#endif
+   numMissed = 0;
+   for (i = 0; i < numPages; i++)
+      if (slots[i] != INVALID_SLOT)
+         bPinned[i] = TRUE;
+
+   for (i = 0; i < numPages; i++)
+      if (slots[i] != INVALID_SLOT)
+         ppBuffers[i] = bufTable[slots[i]].pData;
+
+   // Get the pages that other threads read in meanwhile
+   for (i = 0; i < numPages; i++)
+      if (slots[i] == INVALID_SLOT) {
+         if ((rc = GetPage(fd, pageNums[i], &ppBuffers[i], TRUE, pinHint)))
+            goto err;
+         bPinned[i] = TRUE;
+      }
+
+   delete [] slots;
+   delete [] bPinned;
+   delete [] missed;
+   delete [] toRead;
+
+   // Return ok
+   return (0);
+
+err:
+   if (bPoolLocked)
+      pthread_mutex_unlock(&poolMutex);
+
+   // Give back the frames taken for the pages not found, and unpin the
+   // others
+   for (j = 0; j < numMissed; j++) {
+      PageNum pageNum = missed[j].pageNum;
+      hashTable.Lock(fd, pageNum);
+      bufTable[missed[j].slot].bReading = FALSE;
+      hashTable.Delete(fd, pageNum);
+      hashTable.Unlock(fd, pageNum);
+      pthread_rwlock_unlock(bufTable[missed[j].slot].pLatch);
+   }
+   if (numMissed > 0) {
+      pthread_mutex_lock(&poolMutex);
+      for (j = 0; j < numMissed; j++) {
+         slot = missed[j].slot;
+         if (bufTable[slot].bRing)
+            LeaveRing(slot);
+         bufTable[slot].pinCount = 0;
+         Unlink(slot);
+         InsertFree(slot);
+      }
+      pthread_mutex_unlock(&poolMutex);
+   }
+   for (i = 0; i < numPages; i++)
+      if (bPinned[i])
+         UnpinPage(fd, pageNums[i]);
+
+   delete [] slots;
+   delete [] bPinned;
+   delete [] missed;
+   delete [] toRead;
+
+   return (rc);
+}
+
 //
 // AllocatePage
 //
@@ -279,26 +639,38 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
 #endif
 
    // If page is already in buffer, return an error
-   if (!(rc = hashTable.Find(fd, pageNum, slot)))
-      return (PF_PAGEINBUF);
-   else if (rc != PF_HASHNOTFOUND)
-      return (rc);              // unexpected error
-
-   // Allocate an empty page
-   if ((rc = InternalAlloc(slot)))
+   hashTable.Lock(fd, pageNum);
+   rc = hashTable.Find(fd, pageNum, slot);
+   hashTable.Unlock(fd, pageNum);
+   if (rc != PF_HASHNOTFOUND)
+      return (rc ? rc : PF_PAGEINBUF);   // unexpected error or in buffer
+
+   // Allocate an empty page, initialize the page description entry, and
+   // insert the page into the hash table.  Allocating may release the
+   // pool mutex, so the page is looked for again.
+   pthread_mutex_lock(&poolMutex);
+   if ((rc = InternalAlloc(slot))) {
+      pthread_mutex_unlock(&poolMutex);
       return (rc);
-
-   // Insert the page into the hash table,
-   // and initialize the page description entry
-   if ((rc = hashTable.Insert(fd, pageNum, slot)) ||
-         (rc = InitPageDesc(fd, pageNum, slot))) {
-
+   }
+   hashTable.Lock(fd, pageNum);
+   int other;
+   if ((rc = hashTable.Find(fd, pageNum, other)) != PF_HASHNOTFOUND)
+      rc = rc ? rc : PF_PAGEINBUF;
+   else if (!(rc = InitPageDesc(fd, pageNum, slot)) &&
+         (rc = hashTable.Insert(fd, pageNum, slot)))
+      bufTable[slot].pinCount = 0;
+   hashTable.Unlock(fd, pageNum);
+   if (rc) {
       // Put the slot back on the free list before returning the error
       Unlink(slot);
       InsertFree(slot);
+      pthread_mutex_unlock(&poolMutex);
       return (rc);
    }
 
+   pthread_mutex_unlock(&poolMutex);
+
 #ifdef PF_LOG
    WriteLog("Succesfully allocated page.\n");
 #endif
@@ -331,26 +703,27 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
 #endif
 
    // The page must be found and pinned in the buffer
+   hashTable.Lock(fd, pageNum);
    if ((rc = hashTable.Find(fd, pageNum, slot))){
+      hashTable.Unlock(fd, pageNum);
       if ((rc == PF_HASHNOTFOUND))
          return (PF_PAGENOTINBUF);
       else
          return (rc);              // unexpected error
    }
 
-   if (bufTable[slot].pinCount == 0)
+   if (PinCount(slot) == 0) {
+      hashTable.Unlock(fd, pageNum);
       return (PF_PAGEUNPINNED);
+   }
 
-   // Mark this page dirty
-   bufTable[slot].bDirty = TRUE;
-
-   // Make this page the most recently used page
-   if ((rc = Unlink(slot)) ||
-         (rc = LinkHead (slot)))
-      return (rc);
+   // Mark this page dirty, and make it the most recently used page
+   __atomic_store_n(&bufTable[slot].bDirty, TRUE, __ATOMIC_RELAXED);
+   rc = Reference(fd, pageNum, slot, FALSE);
+   hashTable.Unlock(fd, pageNum);
 
-   // Return ok
-   return (0);
+   // Return ok, or the error of Reference
+   return (rc);
 }
 
 //
@@ -367,29 +740,99 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
    int slot;     // buffer slot where page is located
 
    // The page must be found and pinned in the buffer
+   hashTable.Lock(fd, pageNum);
    if ((rc = hashTable.Find(fd, pageNum, slot))){
+      hashTable.Unlock(fd, pageNum);
       if ((rc == PF_HASHNOTFOUND))
          return (PF_PAGENOTINBUF);
       else
          return (rc);              // unexpected error
    }
 
-   if (bufTable[slot].pinCount == 0)
+   if (PinCount(slot) == 0) {
+      hashTable.Unlock(fd, pageNum);
       return (PF_PAGEUNPINNED);
+   }
 
 #ifdef PF_LOG
    char psMessage[100];
    sprintf (psMessage, "Unpinning (%d,%d). %d Pin count\n",
-         fd, pageNum, bufTable[slot].pinCount-1);
+         fd, pageNum, PinCount(slot)-1);
    WriteLog(psMessage);
 #endif
 
    // If unpinning the last pin, make it the most recently used page
-   if (--(bufTable[slot].pinCount) == 0) {
-      if ((rc = Unlink(slot)) ||
-            (rc = LinkHead (slot)))
-         return (rc);
+   if (__sync_sub_and_fetch(&bufTable[slot].pinCount, 1) == 0)
+      rc = Reference(fd, pageNum, slot, FALSE);
+   hashTable.Unlock(fd, pageNum);
+
+   // Return ok, or the error of Reference
+   return (rc);
+}
+
+//
+// LatchPage
+//
+// Desc: Latch a page pinned in the buffer, so that threads sharing the
+//       page can read it (shared latch) or change it (exclusive latch)
+//       safely.  Waits until the latch can be granted.  The page must
+//       stay pinned until it is unlatched.
+// In:   fd - OS file descriptor of the file associated with the page
+//       pageNum - number of the page to latch
+//       bExclusive - TRUE for an exclusive latch, FALSE for a shared one
+// Ret:  PF return code
+//
+RC PF_BufferMgr::LatchPage(int fd, PageNum pageNum, int bExclusive)
+{
+   RC  rc;       // return code
+   int slot;     // buffer slot where page is located
+
+   // The page must be found and pinned in the buffer
+   hashTable.Lock(fd, pageNum);
+   if ((rc = hashTable.Find(fd, pageNum, slot))) {
+      hashTable.Unlock(fd, pageNum);
+      return (rc == PF_HASHNOTFOUND ? PF_PAGENOTINBUF : rc);
+   }
+   if (PinCount(slot) == 0) {
+      hashTable.Unlock(fd, pageNum);
+      return (PF_PAGEUNPINNED);
+   }
+   pthread_rwlock_t *pLatch = bufTable[slot].pLatch;
+   hashTable.Unlock(fd, pageNum);
+
+   // Since the page is pinned, it keeps its frame (and latch) while we
+   // wait
+   if (bExclusive)
+      pthread_rwlock_wrlock(pLatch);
+   else
+      pthread_rwlock_rdlock(pLatch);
+
+   // Return ok
+   return (0);
+}
+
+//
+// UnlatchPage
+//
+// Desc: Release the latch taken on a page by LatchPage.
+// In:   fd - OS file descriptor of the file associated with the page
+//       pageNum - number of the page to unlatch
+// Ret:  PF return code
+//
+RC PF_BufferMgr::UnlatchPage(int fd, PageNum pageNum)
+{
+   RC  rc;       // return code
+   int slot;     // buffer slot where page is located
+
+   hashTable.Lock(fd, pageNum);
+   if ((rc = hashTable.Find(fd, pageNum, slot))) {
+      hashTable.Unlock(fd, pageNum);
+      return (rc == PF_HASHNOTFOUND ? PF_PAGENOTINBUF : rc);
    }
+   pthread_rwlock_t *pLatch = bufTable[slot].pLatch;
+   hashTable.Unlock(fd, pageNum);
+
+   pthread_rwlock_unlock(pLatch);
 
    // Return ok
    return (0);
@@ -419,45 +862,64 @@ RC PF_BufferMgr::FlushPages(int fd)
    pStatisticsMgr->Register(PF_FLUSHPAGES, STAT_ADDONE);
 #endif
 
-   // Do a linear scan of the buffer to find pages belonging to the file
-   int slot = first;
-   while (slot != INVALID_SLOT) {
-
-      int next = bufTable[slot].next;
-
-      // If the page belongs to the passed-in file descriptor
-      if (bufTable[slot].fd == fd) {
+   // Wait for a round of the background writer, which may hold some of
+   // the pages
+   pthread_mutex_lock(&writerMutex);
+   pthread_mutex_lock(&poolMutex);
+
+   // The file is about to be closed: stop reading ahead in it
+   PF_ReadStream *pStream = &streams[(unsigned int)fd % PF_PREFETCH_STREAMS];
+   pthread_mutex_lock(&pStream->mutex);
+   if (pStream->fd == fd)
+      pStream->fd = -1;
+   pthread_mutex_unlock(&pStream->mutex);
+   prefetcher.Forget(fd);
+
+   // Do a linear scan of the buffer to find the dirty pages belonging to
+   // the file, and write them all together
+   int *slots = new int[numSlots];
+   int numDirty = 0;
+   int slot;
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
+      if (bufTable[slot].fd != fd)
+         continue;
 
 #ifdef PF_LOG
  sprintf (psMessage, "Page (%d) is in buffer manager.\n", bufTable[slot].pageNum);
  WriteLog(psMessage);
 #endif
-         // Ensure the page is not pinned
-         if (bufTable[slot].pinCount) {
-            rcWarn = PF_PAGEPINNED;
-         }
-         else {
-            // Write the page if dirty
-            if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-               if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-                  return (rc);
-               bufTable[slot].bDirty = FALSE;
-            }
+      // Ensure the page is not pinned
+      if (PinCount(slot) == 0 &&
+            __atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED))
+         slots[numDirty++] = slot;
+   }
+   rc = WriteFrames(slots, numDirty);
+   delete [] slots;
 
-            // Remove page from the hash table and add the slot to the free list
-            if ((rc = hashTable.Delete(fd, bufTable[slot].pageNum)) ||
-                  (rc = Unlink(slot)) ||
-                  (rc = InsertFree(slot)))
-               return (rc);
+   // Release the unpinned pages
+   slot = first;
+   while (!rc && slot != INVALID_SLOT) {
+
+      int next = bufTable[slot].next;
+
+      if (bufTable[slot].fd == fd) {
+
+         // Remove page from the hash table and add the slot to the free list
+         if ((rc = Evict(slot)) == PF_PAGEPINNED) {
+            rcWarn = PF_PAGEPINNED;
+            rc = 0;
          }
+         else if (!rc && !(rc = Unlink(slot)))
+            rc = InsertFree(slot);
       }
       slot = next;
    }
 
+   pthread_mutex_unlock(&poolMutex);
+   pthread_mutex_unlock(&writerMutex);
+   if (rc)
+      return (rc);
+
 #ifdef PF_LOG
    WriteLog("All necessary pages flushed.\n");
 #endif
@@ -478,7 +940,8 @@ RC PF_BufferMgr::FlushPages(int fd)
 //
 RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
 {
-   RC rc;  // return codes
+   RC rc = 0;  // return codes
+   int i, j, k;
 
 #ifdef PF_LOG
    char psMessage[100];
@@ -486,343 +949,1918 @@ RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
    WriteLog(psMessage);
 #endif
 
-   // Do a linear scan of the buffer to find the page for the file
-   int slot = first;
-   while (slot != INVALID_SLOT) {
-
-      int next = bufTable[slot].next;
-
-      // If the page belongs to the passed-in file descriptor
+   // Do a linear scan of the buffer to find the dirty pages for the file.
+   // I don't care if a page is pinned or not, just write it if it is
+   // dirty.  Each page found is pinned, so that it stays in its frame
+   // once the pool mutex is released.
+   pthread_mutex_lock(&poolMutex);
+   PF_PageSlot *pages = new PF_PageSlot[numSlots];
+   int numDirty = 0;
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
       if (bufTable[slot].fd == fd &&
+            __atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED) &&
             (pageNum==ALL_PAGES || bufTable[slot].pageNum == pageNum)) {
-
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is in buffer pool.\n", bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-         // I don't care if the page is pinned or not, just write it if
-         // it is dirty.
-         if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
-sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
-WriteLog(psMessage);
-#endif
-            if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-               return (rc);
-            bufTable[slot].bDirty = FALSE;
-         }
+         hashTable.Lock(fd, bufTable[slot].pageNum);
+         __sync_add_and_fetch(&bufTable[slot].pinCount, 1);
+         hashTable.Unlock(fd, bufTable[slot].pageNum);
+         pages[numDirty].pageNum = bufTable[slot].pageNum;
+         pages[numDirty].slot = slot;
+         numDirty++;
       }
-      slot = next;
    }
+   pthread_mutex_unlock(&poolMutex);
+   qsort(pages, numDirty, sizeof(PF_PageSlot), ComparePageNum);
+
+   // Write the pages in order under their shared latch, so that no
+   // thread changes them meanwhile.  The pages up to the first one that a
+   // client holds the exclusive latch of are written together; that one
+   // is waited for and written alone.  A page written by another thread
+   // meanwhile is clean by then.
+   PF_PageSlot *batch = new PF_PageSlot[numDirty];
+   for (i = 0; !rc && i < numDirty; i = j) {
+      for (j = i; j < numDirty; j++)
+         if (pthread_rwlock_tryrdlock(bufTable[pages[j].slot].pLatch))
+            break;
+      if (j == i)
+         pthread_rwlock_rdlock(bufTable[pages[j++].slot].pLatch);
+
+      int numBatch = 0;
+      for (k = i; k < j; k++)
+         if (__atomic_load_n(&bufTable[pages[k].slot].bDirty,
+               __ATOMIC_RELAXED))
+            batch[numBatch++] = pages[k];
+      rc = WritePages(fd, batch, numBatch);
+      for (k = i; k < j; k++)
+         pthread_rwlock_unlock(bufTable[pages[k].slot].pLatch);
+   }
+   delete [] batch;
 
-   return 0;
+   // Unpin the pages
+   for (k = 0; k < numDirty; k++) {
+      hashTable.Lock(fd, pages[k].pageNum);
+      __sync_sub_and_fetch(&bufTable[pages[k].slot].pinCount, 1);
+      hashTable.Unlock(fd, pages[k].pageNum);
+   }
+   delete [] pages;
+
+   return (rc);
 }
 
 
 //
-// PrintBuffer
+// CloseFile
 //
-// Desc: Display all of the pages within the buffer.
-//       This routine will be called via the system command.
-// In:   Nothing
-// Out:  Nothing
-// Ret:  Always returns 0
+// Desc: Close the OS file of a file whose pages have been flushed.  The
+//       background writer may be forcing the log (through its file
+//       handle) while writing the pages of another file: the file is
+//       closed in between two rounds, and is no longer the log after.
+// In:   fd - OS file descriptor
+// Ret:  PF return code
 //
-RC PF_BufferMgr::PrintBuffer()
+RC PF_BufferMgr::CloseFile(int fd)
 {
-   cout << "Buffer contains " << numPages << " pages of size "
-      << pageSize <<".\n";
-   cout << "Contents in order from most recently used to "
-      << "least recently used.\n";
+   RC rc = 0;
 
-   int slot, next;
-   slot = first;
-   while (slot != INVALID_SLOT) {
-      next = bufTable[slot].next;
-      cout << slot << " :: \n";
-      cout << "  fd = " << bufTable[slot].fd << "\n";
-      cout << "  pageNum = " << bufTable[slot].pageNum << "\n";
-      cout << "  bDirty = " << bufTable[slot].bDirty << "\n";
-      cout << "  pinCount = " << bufTable[slot].pinCount << "\n";
-      slot = next;
+   pthread_mutex_lock(&writerMutex);
+   pthread_mutex_lock(&poolMutex);
+   if (fd == logfd) {
+      logfd = -1;
+      logFile = NULL;
    }
+   if (fd >= 0 && fd < PF_STAT_FDS)
+      fdStats[fd] = -1;
+   pthread_mutex_unlock(&poolMutex);
 
-   if (first==INVALID_SLOT)
-      cout << "Buffer is empty!\n";
-   else
-      cout << "All remaining slots are free.\n";
+   if (close(fd) < 0)
+      rc = PF_UNIX;
+   pthread_mutex_unlock(&writerMutex);
 
-   return 0;
+   return (rc);
 }
 
-
 //
-// ClearBuffer
+// TrackFile
 //
-// Desc: Remove all entries from the buffer manager.
-//       This routine will be called via the system command and is only
-//       really useful if the user wants to run some performance
-//       comparison starting with an clean buffer.
-// In:   Nothing
-// Out:  Nothing
-// Ret:  Will return an error if a page is pinned and the Clear routine
-//       is called.
-RC PF_BufferMgr::ClearBuffer()
+// Desc: Keep statistics for the pages of a file just opened, under the
+//       name it was opened with.  A name seen before gets its statistics
+//       back.  Files opened once PF_STAT_FILES names are tracked, or whose
+//       descriptor is PF_STAT_FDS or more, get no statistics.
+// In:   fd - OS file descriptor of the file
+//       fileName - name of the file
+// Ret:  0
+//
+RC PF_BufferMgr::TrackFile(int fd, const char *fileName)
 {
-   RC rc;
+   int i;
 
-   int slot, next;
-   slot = first;
-   while (slot != INVALID_SLOT) {
-      next = bufTable[slot].next;
-      if (bufTable[slot].pinCount == 0)
-         if ((rc = hashTable.Delete(bufTable[slot].fd,
-               bufTable[slot].pageNum)) ||
-            (rc = Unlink(slot)) ||
-            (rc = InsertFree(slot)))
-         return (rc);
-      slot = next;
+   if (fd < 0 || fd >= PF_STAT_FDS)
+      return (0);
+
+   pthread_mutex_lock(&poolMutex);
+   for (i = 0; i < numFileStats; i++)
+      if (strncmp(fileStats[i].fileName, fileName, PF_FILENAME_LEN) == 0)
+         break;
+   if (i == numFileStats && numFileStats < PF_STAT_FILES) {
+      memset(&fileStats[i], 0, sizeof(PF_FileStats));
+      strncpy(fileStats[i].fileName, fileName, PF_FILENAME_LEN);
+      numFileStats++;
    }
+   fdStats[fd] = (i < numFileStats) ? i : -1;
+   pthread_mutex_unlock(&poolMutex);
 
-   return 0;
+   return (0);
+}
+
+//
+// GetFileStats
+//
+// Desc: Return the statistics of a file tracked.  The counters are read
+//       while other threads may be changing them.
+// In:   i - which file, from 0 on
+// Out:  stats - its statistics
+// Ret:  PF_EOF if fewer than i + 1 files are tracked
+//
+RC PF_BufferMgr::GetFileStats(int i, PF_FileStats &stats)
+{
+   RC rc = 0;
+
+   pthread_mutex_lock(&poolMutex);
+   if (i < 0 || i >= numFileStats)
+      rc = PF_EOF;
+   else {
+      PF_FileStats *pStats = &fileStats[i];
+      memcpy(stats.fileName, pStats->fileName, sizeof(stats.fileName));
+      stats.hits = __atomic_load_n(&pStats->hits, __ATOMIC_RELAXED);
+      stats.misses = __atomic_load_n(&pStats->misses, __ATOMIC_RELAXED);
+      stats.reads = __atomic_load_n(&pStats->reads, __ATOMIC_RELAXED);
+      stats.writes = __atomic_load_n(&pStats->writes, __ATOMIC_RELAXED);
+      stats.evictions = __atomic_load_n(&pStats->evictions,
+            __ATOMIC_RELAXED);
+      stats.pinWait = __atomic_load_n(&pStats->pinWait, __ATOMIC_RELAXED);
+   }
+   pthread_mutex_unlock(&poolMutex);
+
+   return (rc);
+}
+
+//
+// ResetFileStats
+//
+// Desc: Set the statistics of all the files tracked back to 0.  The files
+//       stay tracked.
+// Ret:  0
+//
+RC PF_BufferMgr::ResetFileStats()
+{
+   pthread_mutex_lock(&poolMutex);
+   for (int i = 0; i < numFileStats; i++) {
+      PF_FileStats *pStats = &fileStats[i];
+      __atomic_store_n(&pStats->hits, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pStats->misses, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pStats->reads, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pStats->writes, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pStats->evictions, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pStats->pinWait, 0, __ATOMIC_RELAXED);
+   }
+   pthread_mutex_unlock(&poolMutex);
+
+   return (0);
+}
+
+//
+// FileStats
+//
+// Desc: Internal.  Find the statistics of a file, without a lock: the
+//       entry of fd only changes when the file is opened or closed.
+// In:   fd - OS file descriptor
+// Ret:  the statistics of the file, NULL if it has none
+//
+PF_FileStats *PF_BufferMgr::FileStats(int fd)
+{
+   if (fd < 0 || fd >= PF_STAT_FDS || fdStats[fd] < 0)
+      return (NULL);
+   return (&fileStats[fdStats[fd]]);
+}
+
+//
+// CountWait
+//
+// Desc: Internal.  Add the time elapsed since start to the pin wait of a
+//       file.
+// In:   fd - OS file descriptor
+//       start - when the wait started (CLOCK_MONOTONIC)
+//
+void PF_BufferMgr::CountWait(int fd, const struct timespec &start)
+{
+   PF_FileStats *pStats = FileStats(fd);
+   struct timespec end;
+
+   if (pStats == NULL)
+      return;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   __sync_add_and_fetch(&pStats->pinWait,
+         (long long)(end.tv_sec - start.tv_sec) * 1000000 +
+         (end.tv_nsec - start.tv_nsec) / 1000);
+}
+
+//
+// StartWriter
+//
+// Desc: Start the background writer.  Every PF_WRITER_INTERVAL ms, or
+//       sooner when a client had to write a dirty page to get a frame,
+//       the writer writes the dirty unpinned pages found among the last
+//       1/PF_WRITER_SHARE of the frames of the used list.  The frames
+//       that the replacement policy picks next are then clean, so that
+//       clients rarely wait for a write to get one.
+// Ret:  PF_UNIX if the thread cannot be created
+//
+RC PF_BufferMgr::StartWriter()
+{
+   if (bWriter)
+      return (0);
+
+   bWriterStop = FALSE;
+   if (pthread_create(&writer, NULL, RunWriter, this))
+      return (PF_UNIX);
+   bWriter = TRUE;
+
+   return (0);
+}
+
+//
+// StopWriter
+//
+// Desc: Stop the background writer, once its current round is done.
+// Ret:  0
+//
+RC PF_BufferMgr::StopWriter()
+{
+   if (!bWriter)
+      return (0);
+
+   pthread_mutex_lock(&writerMutex);
+   bWriterStop = TRUE;
+   pthread_cond_signal(&writerCond);
+   pthread_mutex_unlock(&writerMutex);
+
+   pthread_join(writer, NULL);
+   bWriter = FALSE;
+
+   return (0);
+}
+
+//
+// RunWriter
+//
+// Desc: Internal.  Main loop of the background writer: a round, then a
+//       wait for PF_WRITER_INTERVAL ms or a signal, until stopped.
+// In:   pBufferMgr - the buffer manager
+//
+void *PF_BufferMgr::RunWriter(void *pBufferMgr)
+{
+   PF_BufferMgr *pMgr = (PF_BufferMgr *)pBufferMgr;
+   struct timespec wakeUp;
+
+   pthread_mutex_lock(&pMgr->writerMutex);
+   while (!pMgr->bWriterStop) {
+      pMgr->WriteTail();
+
+      clock_gettime(CLOCK_REALTIME, &wakeUp);
+      wakeUp.tv_nsec += PF_WRITER_INTERVAL * 1000000L;
+      wakeUp.tv_sec += wakeUp.tv_nsec / 1000000000L;
+      wakeUp.tv_nsec %= 1000000000L;
+      if (!pMgr->bWriterStop)
+         pthread_cond_timedwait(&pMgr->writerCond, &pMgr->writerMutex,
+               &wakeUp);
+   }
+   pthread_mutex_unlock(&pMgr->writerMutex);
+
+   return (NULL);
+}
+
+//
+// WriteTail
+//
+// Desc: Internal.  One round of the background writer.  With the pool
+//       mutex held, walk the used list from its LRU end until
+//       1/PF_WRITER_SHARE of the frames are unpinned and clean or about
+//       to be, taking the dirty pages found (see TakeForWrite).  Then
+//       write them without the pool mutex (see WriteLatched).  Errors
+//       are left for the client that evicts the page: a page that could
+//       not be written stays dirty.  writerMutex must be held.
+//
+void PF_BufferMgr::WriteTail()
+{
+   int *slots;                // pages to write
+   int numWrite = 0;          // # of entries in slots
+   int numClean = 0;          // # of clean frames found
+   int target;                // # of clean frames wanted
+   int slot;
+
+   pthread_mutex_lock(&poolMutex);
+   ApplyAllTouches();
+   target = numPages / PF_WRITER_SHARE;
+   if (target < 1)
+      target = 1;
+   slots = new int[target];
+
+   for (slot = last; slot != INVALID_SLOT && numClean < target;
+         slot = bufTable[slot].prev) {
+      if (PinCount(slot) != 0)
+         continue;
+      if (!__atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED)) {
+         numClean++;
+         continue;
+      }
+      if (TakeForWrite(slot)) {
+         slots[numWrite++] = slot;
+         numClean++;
+      }
+   }
+   pthread_mutex_unlock(&poolMutex);
+
+   WriteLatched(slots, numWrite);
+
+#ifdef PF_STATS
+   pStatisticsMgr->Register(PF_BGWRITEPAGE, STAT_ADDVALUE, &numWrite);
+#endif
+
+   delete [] slots;
+}
+
+//
+// TakeForWrite
+//
+// Desc: Internal.  Take a dirty, unpinned page to be written without the
+//       pool mutex: pin it, so that it stays in its frame, and latch it
+//       exclusively with bWriting set, so that it is not changed while
+//       it is written and a client pinning it meanwhile waits for the
+//       write (see WaitIO).  The pool mutex must be held.
+// In:   slot - slot of the page
+// Ret:  TRUE if the page was taken, FALSE if it is pinned, clean, or
+//       latched
+//
+int PF_BufferMgr::TakeForWrite(int slot)
+{
+   int     fd = bufTable[slot].fd;
+   PageNum pageNum = bufTable[slot].pageNum;
+
+   if (PinCount(slot) != 0 ||
+         !__atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED) ||
+         pthread_rwlock_trywrlock(bufTable[slot].pLatch))
+      return (FALSE);
+
+   hashTable.Lock(fd, pageNum);
+   if (PinCount(slot) != 0) {
+      hashTable.Unlock(fd, pageNum);
+      pthread_rwlock_unlock(bufTable[slot].pLatch);
+      return (FALSE);
+   }
+   __sync_add_and_fetch(&bufTable[slot].pinCount, 1);
+   bufTable[slot].bWriting = TRUE;
+   hashTable.Unlock(fd, pageNum);
+
+   return (TRUE);
+}
+
+//
+// WriteLatched
+//
+// Desc: Internal.  Write the pages taken by TakeForWrite, a file at a
+//       time, the log first since writing the pages of another file
+//       forces the log.  Then release them.  The pool mutex must not be
+//       held.
+// In:   slots - slots of the pages; overwritten by this call
+//       numWrite - number of entries in slots
+// Ret:  the first error met, if any
+//
+RC PF_BufferMgr::WriteLatched(int *slots, int numWrite)
+{
+   RC rc = 0;
+   int i, k;
+
+   PF_PageSlot *pages = new PF_PageSlot[numWrite];
+   for (;;) {
+      int fd = 0;
+      int bFound = FALSE;
+      int numDirty = 0;
+
+      for (i = 0; i < numWrite; i++)
+         if (slots[i] != INVALID_SLOT &&
+               (!bFound || bufTable[slots[i]].fd == logfd)) {
+            fd = bufTable[slots[i]].fd;
+            bFound = TRUE;
+         }
+      if (!bFound)
+         break;
+
+      for (i = 0; i < numWrite; i++)
+         if (slots[i] != INVALID_SLOT && bufTable[slots[i]].fd == fd) {
+            pages[numDirty].pageNum = bufTable[slots[i]].pageNum;
+            pages[numDirty].slot = slots[i];
+            numDirty++;
+            slots[i] = INVALID_SLOT;
+         }
+
+      RC rcWrite = WritePages(fd, pages, numDirty);
+      if (!rc)
+         rc = rcWrite;
+
+      // Release the pages
+      for (k = 0; k < numDirty; k++) {
+         int slot = pages[k].slot;
+         hashTable.Lock(fd, pages[k].pageNum);
+         bufTable[slot].bWriting = FALSE;
+         __sync_sub_and_fetch(&bufTable[slot].pinCount, 1);
+         hashTable.Unlock(fd, pages[k].pageNum);
+         pthread_rwlock_unlock(bufTable[slot].pLatch);
+      }
+   }
+   delete [] pages;
+
+   return (rc);
+}
+
+//
+// WriteFrames
+//
+// Desc: Internal.  Write the dirty, unpinned pages of a set of frames,
+//       as the background writer does: the pages are taken with the pool
+//       mutex held, which is then released while they are written.  The
+//       pages stay in their frames, and the caller must look at the
+//       frames again since other threads may have used the buffer
+//       meanwhile.  The pool mutex must be held.
+// In:   slots - slots of the frames, in the used list
+//       numFrames - number of entries in slots
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WriteFrames(int *slots, int numFrames)
+{
+   RC rc = 0;
+   int numWrite = 0;
+
+   int *taken = new int[numFrames];
+   for (int i = 0; i < numFrames; i++)
+      if (TakeForWrite(slots[i]))
+         taken[numWrite++] = slots[i];
+
+   if (numWrite > 0) {
+      pthread_mutex_unlock(&poolMutex);
+      rc = WriteLatched(taken, numWrite);
+      pthread_mutex_lock(&poolMutex);
+   }
+   delete [] taken;
+
+   return (rc);
+}
+
+//
+// WaitIO
+//
+// Desc: Wait until a page that another thread reads in (bReading) or
+//       writes (bWriting) is done with.  The thread holds the exclusive
+//       latch of the frame until then.  A client that just pinned a page
+//       being written would otherwise change it while it is written, and
+//       a change whose log record was not forced could reach the disk.
+//       The frame may hold another page once the wait is over.
+// In:   fd - file descriptor of the page
+//       slot - frame of the page
+//
+void PF_BufferMgr::WaitIO(int fd, int slot)
+{
+#ifdef PF_STATS
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+   pthread_rwlock_rdlock(bufTable[slot].pLatch);
+   pthread_rwlock_unlock(bufTable[slot].pLatch);
+
+#ifdef PF_STATS
+   CountWait(fd, start);
+#endif
+}
+
+//
+// ReadAhead
+//
+// Desc: Called by PF_FileHandle::GetNextPage before each page it reads.
+//       Each file is tracked as a stream; a read of the page that
+//       follows the previous one continues the stream, any other read
+//       starts it over.  While a stream continues, the prefetcher is
+//       asked to read up to PF_PREFETCH_WINDOW pages ahead of pageNum,
+//       skipping the pages already in the buffer.  The window is topped
+//       up once half of it has been consumed, so reads are issued in
+//       batches.  Only the stream's own mutex is taken, and the page
+//       table partitions of the pages read ahead.
+// In:   fd - OS file descriptor
+//       pageNum - page being read
+//       numPages - number of pages in the file (read-ahead stops there)
+// Ret:  PF return code
+//
+RC PF_BufferMgr::ReadAhead(int fd, PageNum pageNum, PageNum numPages)
+{
+   PF_ReadStream *pStream = &streams[(unsigned int)fd % PF_PREFETCH_STREAMS];
+   unsigned int partSet = 0;
+   PageNum p;
+   int slot;
+
+   pthread_mutex_lock(&pStream->mutex);
+
+   // The stream may be that of another file: take it over
+   if (pStream->fd != fd) {
+      pStream->fd = fd;
+      pStream->nextPage = -1;
+   }
+
+   // A read that does not continue the sequence starts it over
+   if (pageNum != pStream->nextPage) {
+      pStream->nextPage = pageNum + 1;
+      pStream->readAhead = pageNum + 1;
+      pthread_mutex_unlock(&pStream->mutex);
+      return (0);
+   }
+   pStream->nextPage = pageNum + 1;
+   if (pStream->readAhead <= pageNum)
+      pStream->readAhead = pageNum + 1;
+
+   PageNum end = pageNum + 1 + PF_PREFETCH_WINDOW;
+   if (end > numPages)
+      end = numPages;
+   if (pStream->readAhead >= end ||
+         pStream->readAhead - pageNum > PF_PREFETCH_WINDOW / 2) {
+      pthread_mutex_unlock(&pStream->mutex);
+      return (0);
+   }
+
+   // Issue the runs of pages that are not in the buffer.  Their
+   // partitions stay locked until the reads are queued, so that none of
+   // the pages is read into the buffer meanwhile: a staged page could
+   // otherwise miss the write of the buffered copy that makes it stale
+   // (see PF_Prefetcher::Invalidate).
+   PageNum first = pStream->readAhead;
+   for (p = first; p < end; p++)
+      partSet |= 1u << PF_PageTable::Partition(fd, p);
+   hashTable.LockSet(partSet);
+   for (p = first; p <= end; p++) {
+      if (p < end && hashTable.Find(fd, p, slot))
+         continue;
+
+      if (p > first) {
+         int numIssued = prefetcher.Issue(fd, first, p - first);
+#ifdef PF_STATS
+         pStatisticsMgr->Register(PF_PREFETCHPAGE, STAT_ADDVALUE, &numIssued);
+         PF_FileStats *pStats = FileStats(fd);
+         if (pStats != NULL)
+            __sync_add_and_fetch(&pStats->reads, numIssued);
+#endif
+         // Out of staging buffers: try again on a later page
+         if (numIssued < p - first) {
+            end = first + numIssued;
+            break;
+         }
+      }
+      first = p + 1;
+   }
+   hashTable.UnlockSet(partSet);
+   pStream->readAhead = end;
+
+   pthread_mutex_unlock(&pStream->mutex);
+   return (0);
+}
+
+//
+// PrintBuffer
+//
+// Desc: Display all of the pages within the buffer.
+//       This routine will be called via the system command.
+// In:   Nothing
+// Out:  Nothing
+// Ret:  Always returns 0
+//
+RC PF_BufferMgr::PrintBuffer()
+{
+   static const char *psPolicy[] = { "LRU", "CLOCK", "2Q" };
+
+   pthread_mutex_lock(&poolMutex);
+   ApplyAllTouches();
+
+   cout << "Buffer contains " << numPages << " pages of size "
+      << pageSize <<".\n";
+   if (numSlots > numPages)
+      cout << "Frames of up to " << numSlots - numPages
+         << " more pages are being retired.\n";
+   cout << "Replacement policy is " << psPolicy[policy] << ".\n";
+   cout << "Contents in order from most recently used to "
+      << "least recently used.\n";
+
+   int slot, next;
+   slot = first;
+   while (slot != INVALID_SLOT) {
+      next = bufTable[slot].next;
+      cout << slot << " :: \n";
+      cout << "  fd = " << bufTable[slot].fd << "\n";
+      cout << "  pageNum = " << bufTable[slot].pageNum << "\n";
+      cout << "  bDirty = " << bufTable[slot].bDirty << "\n";
+      cout << "  pinCount = " << PinCount(slot) << "\n";
+      slot = next;
+   }
+
+   if (first==INVALID_SLOT)
+      cout << "Buffer is empty!\n";
+   else
+      cout << "All remaining slots are free.\n";
+
+   pthread_mutex_unlock(&poolMutex);
+   return 0;
+}
+
+
+//
+// ClearBuffer
+//
+// Desc: Remove all entries from the buffer manager.
+//       This routine will be called via the system command and is only
+//       really useful if the user wants to run some performance
+//       comparison starting with an clean buffer.
+//       Dirty pages are written back before they are removed, so the
+//       buffer can be cleared (or resized) while the database is open.
+// In:   Nothing
+// Out:  Nothing
+// Ret:  Will return an error if a page is pinned and the Clear routine
+//       is called.
+RC PF_BufferMgr::ClearBuffer()
+{
+   RC rc = 0;
+   int slot, next;
+
+   pthread_mutex_lock(&poolMutex);
+
+   // Write the dirty pages first
+   int *slots = new int[numSlots];
+   int numDirty = 0;
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (__atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED))
+         slots[numDirty++] = slot;
+   rc = WriteFrames(slots, numDirty);
+   delete [] slots;
+
+   slot = first;
+   while (!rc && slot != INVALID_SLOT) {
+      next = bufTable[slot].next;
+
+      // Remove the page unless it is pinned, or dirty again
+      if ((rc = Evict(slot)) == PF_PAGEPINNED)
+         rc = 0;
+      else if (rc ||
+            (rc = Unlink(slot)) ||
+            (rc = InsertFree(slot)))
+         break;
+      slot = next;
+   }
+
+   pthread_mutex_unlock(&poolMutex);
+   return (rc);
+}
+
+//
+// ResizeBuffer
+//
+// Desc: Resizes the buffer manager to the size passed in, while clients
+//       keep using it.  This routine will be called via the system
+//       command and by SM_Manager::Set.
+// In:   The new buffer size
+// Out:  Nothing
+// Ret:  0 for success or,
+//       PF_TOOSMALL if iNewSize is not positive,
+//       PF_BADBUFSIZE if it is above PF_MAX_BUFFER_PAGES,
+//       Some other PF error
+//
+// Notes: The pages in the buffer stay there.  Frames are added, or
+// retired from the top slots down, PF_RESIZE_CHUNK at a time, with the
+// pool mutex taken for each chunk only.  A retired frame that holds a
+// dirty page is written first.  A frame whose page is pinned cannot be
+// retired yet: it is retired when its page is replaced, so the buffer
+// may hold more than iNewSize pages for a while.  The memory of the
+// retired frames is given back to the OS once the frames above them are
+// retired too.  The replacement policy starts over.
+//
+RC PF_BufferMgr::ResizeBuffer(int iNewSize)
+{
+   RC rc = 0;
+   int slot;
+
+   if (iNewSize <= 0)
+      return (PF_TOOSMALL);
+   if (iNewSize > PF_MAX_BUFFER_PAGES)
+      return (PF_BADBUFSIZE);
+
+   // Set the new size.  Frames being retired below it are back in use.
+   pthread_mutex_lock(&poolMutex);
+   int oldSize = numPages;
+   numPages = iNewSize;
+   for (slot = oldSize; slot < iNewSize && slot < numSlots; slot++)
+      if (bufTable[slot].bRetired) {
+         bufTable[slot].bRetired = FALSE;
+         InsertFree(slot);
+      }
+   ResetPolicy();
+   rc = ghostTable.Resize(HashTableSize(iNewSize));
+   pthread_mutex_unlock(&poolMutex);
+
+   // Rescale the hash table with the buffer
+   if (!rc)
+      rc = hashTable.Resize(HashTableSize(iNewSize));
+
+   // Add frames a chunk at a time
+   int bMore = TRUE;
+   while (!rc && bMore) {
+      pthread_mutex_lock(&poolMutex);
+      if ((bMore = (numSlots < numPages)))
+         rc = AddFrames();
+      pthread_mutex_unlock(&poolMutex);
+   }
+
+   // Retire the frames above the new size a chunk at a time, from the top
+   slot = PF_MAX_BUFFER_PAGES;
+   bMore = TRUE;
+   while (!rc && bMore) {
+      pthread_mutex_lock(&poolMutex);
+      if (slot > numSlots)
+         slot = numSlots;
+      int end = slot - PF_RESIZE_CHUNK;
+      if (end < numPages)
+         end = numPages;
+
+      // Write the dirty pages of the chunk first
+      int slots[PF_RESIZE_CHUNK];
+      int numDirty = 0;
+      for (int i = end; i < slot; i++)
+         if (!bufTable[i].bFree && !bufTable[i].bRetired &&
+               __atomic_load_n(&bufTable[i].bDirty, __ATOMIC_RELAXED))
+            slots[numDirty++] = i;
+      rc = WriteFrames(slots, numDirty);
+
+      // The buffer may have changed size meanwhile
+      if (slot > numSlots)
+         slot = numSlots;
+      if (end < numPages)
+         end = numPages;
+      while (!rc && slot > end)
+         rc = RetireSlot(--slot);
+      TrimSlots();
+      bMore = (slot > numPages);
+      pthread_mutex_unlock(&poolMutex);
+   }
+
+   return (rc);
+}
+
+//
+// SetHugePages
+//
+// Desc: Choose whether the frames of the buffer are mapped with explicit
+//       huge pages (MAP_HUGETLB) rather than advised to be backed by
+//       transparent ones.  If the buffer holds no page, it is mapped
+//       again at once; otherwise the choice applies to the frames added
+//       from now on.  If the OS has no huge pages reserved, the frames
+//       are mapped as usual.
+// In:   _bHugePages - TRUE for explicit huge pages
+// Ret:  0
+//
+RC PF_BufferMgr::SetHugePages(int _bHugePages)
+{
+   pthread_mutex_lock(&writerMutex);
+   pthread_mutex_lock(&poolMutex);
+
+   bHugePages = _bHugePages;
+   if (first == INVALID_SLOT && numSlots == numPages) {
+      FreeArenas(0);
+      AllocArena(0, numSlots);
+      for (int slot = 0; slot < numSlots; slot++)
+         bufTable[slot].pData = FrameOf(slot);
+   }
+
+   pthread_mutex_unlock(&poolMutex);
+   pthread_mutex_unlock(&writerMutex);
+
+   return (0);
+}
+
+//
+// CommitSlots
+//
+// Desc: Internal.  Commit memory to the buffer page description table
+//       for its first iNumSlots slots.  The memory is zeroed by the OS.
+// In:   iNumSlots - # of slots, at most PF_MAX_BUFFER_PAGES
+// Ret:  PF_NOMEM if there is not enough memory
+//
+RC PF_BufferMgr::CommitSlots(int iNumSlots)
+{
+   if (iNumSlots <= numCommitted)
+      return (0);
+
+   if (mprotect(bufTable, (size_t)iNumSlots * sizeof(PF_BufPageDesc),
+         PROT_READ | PROT_WRITE))
+      return (PF_NOMEM);
+   numCommitted = iNumSlots;
+
+   return (0);
+}
+
+//
+// AddFrames
+//
+// Desc: Internal.  Add up to PF_RESIZE_CHUNK slots on top of the buffer,
+//       and put them on the free list.  Their frames are those left in
+//       the top arena by an earlier shrink, or else come from a new arena
+//       mapped for all the slots still missing up to numPages, so that
+//       the frames of one resize are contiguous.  The pool mutex must be
+//       held.
+// Ret:  PF return code
+//
+RC PF_BufferMgr::AddFrames()
+{
+   RC rc;
+   int slot;
+
+   int newSlots = numSlots + PF_RESIZE_CHUNK;
+   if (newSlots > numPages)
+      newSlots = numPages;
+   if ((rc = CommitSlots(newSlots)))
+      return (rc);
+
+   int topEnd = (arenas == NULL) ? 0 : arenas->firstSlot + arenas->numFrames;
+   if (topEnd < newSlots) {
+      int firstSlot = (topEnd > numSlots) ? topEnd : numSlots;
+      AllocArena(firstSlot, numPages - firstSlot);
+   }
+
+   // Insert the slots in reverse, so that the lowest one is used first
+   for (slot = newSlots - 1; slot >= numSlots; slot--) {
+      PF_BufPageDesc *pDesc = &bufTable[slot];
+      pDesc->pData = FrameOf(slot);
+      if (pDesc->pLatch == NULL) {
+         pDesc->pLatch = new pthread_rwlock_t;
+         pthread_rwlock_init(pDesc->pLatch, NULL);
+      }
+      pDesc->pinCount = 0;
+      pDesc->bDirty = FALSE;
+      pDesc->bRing = FALSE;
+      pDesc->bWriting = FALSE;
+      pDesc->bReading = FALSE;
+      pDesc->bRetired = FALSE;
+      pDesc->next = pDesc->prev = INVALID_SLOT;
+      InsertFree(slot);
+   }
+   numSlots = newSlots;
+
+   // Return ok
+   return (0);
+}
+
+//
+// RetireSlot
+//
+// Desc: Internal.  Take a slot at or above numPages out of use.  A free
+//       slot leaves the free list; the page of a used slot is removed,
+//       and must have been written if dirty (see WriteFrames).  If the
+//       page is pinned or dirty, the slot stays in use until the page is
+//       replaced (see InsertFree).  The pool mutex must be held.
+// In:   slot - the slot
+// Ret:  PF return code
+//
+RC PF_BufferMgr::RetireSlot(int slot)
+{
+   RC rc;
+
+   if (bufTable[slot].bRetired)
+      return (0);
+
+   if (bufTable[slot].bFree)
+      RemoveFree(slot);
+   else {
+      if ((rc = Evict(slot)) == PF_PAGEPINNED)
+         return (0);
+      if (rc || (rc = Unlink(slot)))
+         return (rc);
+   }
+   bufTable[slot].bRetired = TRUE;
+
+   // Return ok
+   return (0);
+}
+
+//
+// TrimSlots
+//
+// Desc: Internal.  Drop the retired slots at the top of the buffer, and
+//       release the memory of their frames.  The pool mutex must be
+//       held.
+//
+void PF_BufferMgr::TrimSlots()
+{
+   int newSlots = numSlots;
+
+   while (newSlots > numPages && bufTable[newSlots - 1].bRetired)
+      newSlots--;
+   if (newSlots == numSlots)
+      return;
+
+   FreeArenas(newSlots);
+   numSlots = newSlots;
+}
+
+//
+// AllocArena
+//
+// Desc: Internal.  Map an arena for the frames of numFrames slots from
+//       firstSlot on, above those of the other arenas.  An arena
+//       spanning a huge page is rounded up to whole huge pages and
+//       aligned on one, so that the OS can back it with huge pages: with
+//       explicit ones if bHugePages is set and some are reserved, and
+//       otherwise with transparent ones.  Frames are aligned on pageSize,
+//       which is enough for direct I/O.  The OS zeroes the memory.
+//       Exits if there is not enough memory.
+// In:   firstSlot - first slot of the arena
+//       numFrames - # of frames, > 0
+//
+void PF_BufferMgr::AllocArena(int firstSlot, int numFrames)
+{
+   size_t size = (size_t)numFrames * pageSize;
+   size_t slack = 0;
+   char *pBase = (char *)MAP_FAILED;
+
+   if (size >= (size_t)PF_HUGE_PAGE_SIZE) {
+      size = (size + PF_HUGE_PAGE_SIZE - 1) &
+         ~(size_t)(PF_HUGE_PAGE_SIZE - 1);
+      slack = PF_HUGE_PAGE_SIZE;
+   }
+
+#ifdef MAP_HUGETLB
+   if (bHugePages && slack > 0)
+      pBase = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+   if (pBase == MAP_FAILED) {
+      // Map a huge page more than needed, and trim both ends to align
+      // the arena on a huge page
+      char *pMap = (char *)mmap(NULL, size + slack, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (pMap == MAP_FAILED) {
+         cerr << "Not enough memory for buffer\n";
+         exit(1);
+      }
+
+      pBase = pMap;
+      if (slack > 0) {
+         pBase = (char *)(((size_t)pMap + slack - 1) & ~(slack - 1));
+         if (pBase > pMap)
+            munmap(pMap, pBase - pMap);
+         if (pMap + slack > pBase)
+            munmap(pBase + size, pMap + slack - pBase);
+#ifdef MADV_HUGEPAGE
+         madvise(pBase, size, MADV_HUGEPAGE);
+#endif
+      }
+   }
+
+   PF_Arena *pArena = new PF_Arena;
+   pArena->pBase = pBase;
+   pArena->size = size;
+   pArena->firstSlot = firstSlot;
+   pArena->numFrames = numFrames;
+   pArena->next = arenas;
+   arenas = pArena;
+}
+
+//
+// FrameOf
+//
+// Desc: Internal.  Find the frame of a slot in the arenas.
+// In:   slot - the slot, which must have a frame
+// Ret:  the frame
+//
+char *PF_BufferMgr::FrameOf(int slot) const
+{
+   PF_Arena *pArena = arenas;
+   while (pArena->firstSlot > slot)
+      pArena = pArena->next;
+   return (pArena->pBase + (size_t)(slot - pArena->firstSlot) * pageSize);
+}
+
+//
+// FreeArenas
+//
+// Desc: Internal.  Release the frames of the slots from firstSlot on:
+//       unmap the arenas that hold only such frames, and give the memory
+//       of those in the arena below back to the OS.
+// In:   firstSlot - first slot whose frame is released
+//
+void PF_BufferMgr::FreeArenas(int firstSlot)
+{
+   while (arenas != NULL && arenas->firstSlot >= firstSlot) {
+      PF_Arena *pArena = arenas;
+      munmap(pArena->pBase, pArena->size);
+      arenas = pArena->next;
+      delete pArena;
+   }
+
+   if (arenas != NULL &&
+         arenas->firstSlot + arenas->numFrames > firstSlot)
+      madvise(FrameOf(firstSlot), (size_t)(arenas->firstSlot +
+            arenas->numFrames - firstSlot) * pageSize, MADV_DONTNEED);
+}
+
+//
+// SetPolicy
+//
+// Desc: Change the page replacement policy.  The pages in the buffer
+//       are kept, in their current recency order.
+// In:   _policy - the new policy
+// Ret:  PF return code
+//
+RC PF_BufferMgr::SetPolicy(PF_ReplacePolicy _policy)
+{
+   if (_policy != PF_LRU && _policy != PF_CLOCK && _policy != PF_2Q)
+      return (PF_BADPOLICY);
+
+   pthread_mutex_lock(&poolMutex);
+   policy = _policy;
+   ResetPolicy();
+   pthread_mutex_unlock(&poolMutex);
+
+   return 0;
+}
+
+
+//
+// InsertFree
+//
+// Desc: Internal.  Insert a slot at the head of the free list.  A slot
+//       at or above numPages is retired instead, since the buffer is
+//       being shrunk (see ResizeBuffer).
+// In:   slot - slot number to insert
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InsertFree(int slot)
+{
+   if (slot >= numPages) {
+      bufTable[slot].bRetired = TRUE;
+      TrimSlots();
+      return (0);
+   }
+
+   bufTable[slot].bFree = TRUE;
+   bufTable[slot].prev = INVALID_SLOT;
+   bufTable[slot].next = free;
+   if (free != INVALID_SLOT)
+      bufTable[free].prev = slot;
+   free = slot;
+
+   // Return ok
+   return (0);
+}
+
+//
+// RemoveFree
+//
+// Desc: Internal.  Remove a slot from the free list.
+// In:   slot - slot number to remove, on the free list
+//
+void PF_BufferMgr::RemoveFree(int slot)
+{
+   if (bufTable[slot].prev != INVALID_SLOT)
+      bufTable[bufTable[slot].prev].next = bufTable[slot].next;
+   else
+      free = bufTable[slot].next;
+   if (bufTable[slot].next != INVALID_SLOT)
+      bufTable[bufTable[slot].next].prev = bufTable[slot].prev;
+
+   bufTable[slot].prev = bufTable[slot].next = INVALID_SLOT;
+   bufTable[slot].bFree = FALSE;
+}
+
+//
+// LinkHead
+//
+// Desc: Internal.  Insert a slot at the head of the used list, making
+//       it the most-recently used slot.
+// In:   slot - slot number to insert
+// Ret:  PF return code
+//
+RC PF_BufferMgr::LinkHead(int slot)
+{
+   // The head of the list is never part of the FIFO of PF_2Q
+   bufTable[slot].bHot = TRUE;
+
+   // Set next and prev pointers of slot entry
+   bufTable[slot].next = first;
+   bufTable[slot].prev = INVALID_SLOT;
+
+   // If list isn't empty, point old first back to slot
+   if (first != INVALID_SLOT)
+      bufTable[first].prev = slot;
+
+   first = slot;
+
+   // if list was empty, set last to slot
+   if (last == INVALID_SLOT)
+      last = first;
+
+   // Return ok
+   return (0);
+}
+
+//
+// LinkTail
+//
+// Desc: Internal.  Insert a slot at the tail of the used list, making it
+//       the first candidate for replacement.  Under PF_2Q the tail is
+//       part of the FIFO.
+// In:   slot - slot number to insert
+// Ret:  PF return code
+//
+RC PF_BufferMgr::LinkTail(int slot)
+{
+   // Set next and prev pointers of slot entry
+   bufTable[slot].next = INVALID_SLOT;
+   bufTable[slot].prev = last;
+
+   // If list isn't empty, point old last forward to slot
+   if (last != INVALID_SLOT)
+      bufTable[last].next = slot;
+
+   last = slot;
+
+   // if list was empty, set first to slot
+   if (first == INVALID_SLOT)
+      first = last;
+
+   if (policy == PF_2Q) {
+      bufTable[slot].bHot = FALSE;
+      numCold++;
+      if (coldFirst == INVALID_SLOT)
+         coldFirst = slot;
+   }
+   else
+      bufTable[slot].bHot = TRUE;
+
+   // Return ok
+   return (0);
+}
+
+//
+// Unlink
+//
+// Desc: Internal.  Unlink the slot from the used list.  Assume that
+//       slot is valid.  Set prev and next pointers to INVALID_SLOT.
+//       The caller is responsible to either place the unlinked page into
+//       the free list or the used list.
+// In:   slot - slot number to unlink
+// Ret:  PF return code
+//
+RC PF_BufferMgr::Unlink(int slot)
+{
+   // A frame that leaves the used list leaves the scan ring too
+   if (bufTable[slot].bRing)
+      LeaveRing(slot);
+
+   // Keep the FIFO of PF_2Q and the clock hand pointing at used slots
+   if (coldFirst == slot)
+      coldFirst = bufTable[slot].next;
+   if (!bufTable[slot].bHot)
+      numCold--;
+   if (hand == slot)
+      hand = bufTable[slot].prev;
+
+   // If slot is at head of list, set first to next element
+   if (first == slot)
+      first = bufTable[slot].next;
+
+   // If slot is at end of list, set last to previous element
+   if (last == slot)
+      last = bufTable[slot].prev;
+
+   // If slot not at end of list, point next back to previous
+   if (bufTable[slot].next != INVALID_SLOT)
+      bufTable[bufTable[slot].next].prev = bufTable[slot].prev;
+
+   // If slot not at head of list, point prev forward to next
+   if (bufTable[slot].prev != INVALID_SLOT)
+      bufTable[bufTable[slot].prev].next = bufTable[slot].next;
+
+   // Set next and prev pointers of slot entry
+   bufTable[slot].prev = bufTable[slot].next = INVALID_SLOT;
+
+   // Return ok
+   return (0);
+}
+
+//
+// ReadIn
+//
+// Desc: Internal.  Read a page that is not in the buffer into a frame,
+//       pinned.  The frame is taken and the page entered in the page
+//       table with the pool mutex held; the page is then read without
+//       it, with bReading set and the frame latched exclusively, so that
+//       threads looking the page up meanwhile wait for the read (see
+//       WaitIO).  If the read fails, the page leaves the page table.
+// In:   fd - OS file descriptor of the file to read
+//       pageNum - number of the page to read
+//       pinHint - SEQUENTIAL_SCAN takes a frame of the scan ring
+// Out:  slot - the frame of the page
+// Ret:  PF_PAGEINBUF if another thread read the page in while the frame
+//       was taken, other PF return code otherwise
+//
+RC PF_BufferMgr::ReadIn(int fd, PageNum pageNum, ClientHint pinHint,
+      int &slot)
+{
+   RC  rc;      // return code
+   int other;   // slot of the page if another thread read it in
+
+   // Allocate an empty page, this will also promote the newly allocated
+   // page to the MRU slot.  Sequential scans get a frame of the ring.
+   pthread_mutex_lock(&poolMutex);
+   if (pinHint == SEQUENTIAL_SCAN)
+      rc = RingAlloc(slot);
+   else
+      rc = InternalAlloc(slot);
+   if (rc) {
+      pthread_mutex_unlock(&poolMutex);
+      return (rc);
+   }
+
+   // Latch the frame, and enter the page unless another thread read it
+   // in while a victim was written.  Only threads that waited for an
+   // earlier page of the frame can hold the latch, and not for long.
+   pthread_rwlock_wrlock(bufTable[slot].pLatch);
+   hashTable.Lock(fd, pageNum);
+   if ((rc = hashTable.Find(fd, pageNum, other)) != PF_HASHNOTFOUND)
+      rc = rc ? rc : PF_PAGEINBUF;
+   else if (!(rc = InitPageDesc(fd, pageNum, slot))) {
+      bufTable[slot].bReading = TRUE;
+      if ((rc = hashTable.Insert(fd, pageNum, slot)))
+         bufTable[slot].bReading = FALSE;
+   }
+   hashTable.Unlock(fd, pageNum);
+   if (rc) {
+      // Put the slot back on the free list before returning the error
+      pthread_rwlock_unlock(bufTable[slot].pLatch);
+      bufTable[slot].pinCount = 0;
+      if (bufTable[slot].bRing)
+         LeaveRing(slot);
+      Unlink(slot);
+      InsertFree(slot);
+      pthread_mutex_unlock(&poolMutex);
+      return (rc);
+   }
+   pthread_mutex_unlock(&poolMutex);
+
+   // If the page was read ahead, copy it from the prefetcher (this
+   // waits for the read if it is still in progress), otherwise read it
+   if ((rc = prefetcher.Take(fd, pageNum, bufTable[slot].pData)) == 0) {
+#ifdef PF_STATS
+      pStatisticsMgr->Register(PF_PREFETCHHIT, STAT_ADDONE);
+#endif
+   }
+   else
+      rc = ReadPage(fd, pageNum, bufTable[slot].pData);
+
+   // Let the threads waiting for the page go on
+   hashTable.Lock(fd, pageNum);
+   bufTable[slot].bReading = FALSE;
+   if (rc)
+      hashTable.Delete(fd, pageNum);
+   hashTable.Unlock(fd, pageNum);
+   pthread_rwlock_unlock(bufTable[slot].pLatch);
+
+   if (rc) {
+      pthread_mutex_lock(&poolMutex);
+      bufTable[slot].pinCount = 0;
+      if (bufTable[slot].bRing)
+         LeaveRing(slot);
+      Unlink(slot);
+      InsertFree(slot);
+      pthread_mutex_unlock(&poolMutex);
+   }
+
+   return (rc);
+}
+
+//
+// InternalAlloc
+//
+// Desc: Internal.  Allocate a buffer slot.  The slot is inserted at the
+//       head of the used list.  Here's how it chooses which slot to use:
+//       If there is something on the free list, then use it.
+//       Otherwise, choose a victim to replace (see ChooseVictim).  If a
+//       victim cannot be chosen (because all the pages are pinned), then
+//       return an error.  A dirty victim is written first (see
+//       WriteFrames), which releases the pool mutex, and the victim is
+//       chosen again.  A slot at or above numPages is retired rather
+//       than used, and another one is chosen.
+// Out:  slot - set to newly-allocated slot
+// Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
+//
+RC PF_BufferMgr::InternalAlloc(int &slot)
+{
+   RC  rc;       // return code
+
+   for (;;) {
+      // If the free list is not empty, choose a slot from the free list
+      if (free != INVALID_SLOT) {
+         slot = free;
+         RemoveFree(slot);
+      }
+      else {
+
+         // The references made since the last allocation decide which
+         // page goes
+         ApplyAllTouches();
+
+         // Choose an unpinned page, return error if all buffers were
+         // pinned
+         if ((rc = ChooseVictim(slot)))
+            return (rc);
+
+         // The victim must be written first: the background writer is
+         // falling behind
+         if (__atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED)) {
+            if (bWriter)
+               pthread_cond_signal(&writerCond);
+            if ((rc = WriteFrames(&slot, 1)))
+               return (rc);
+            continue;
+         }
+
+         // Another thread may pin the victim before it is removed from
+         // the hash table (by Evict), in which case choose again
+         if ((rc = Evict(slot)) == PF_PAGEPINNED)
+            continue;
+         if (rc)
+            return (rc);
+
+#ifdef PF_STATS
+         PF_FileStats *pStats = FileStats(bufTable[slot].fd);
+         if (pStats != NULL)
+            __sync_add_and_fetch(&pStats->evictions, 1);
+#endif
+
+         // A page leaving the FIFO of PF_2Q is remembered, so that it
+         // goes to the main list if it is read again soon
+         if (policy == PF_2Q && !bufTable[slot].bHot)
+            AddGhost(bufTable[slot].fd, bufTable[slot].pageNum);
+
+         // Remove slot from the used buffer list
+         if ((rc = Unlink(slot)))
+            return (rc);
+      }
+
+      if (slot < numPages)
+         break;
+      InsertFree(slot);
+   }
+
+   // Link slot at the head of the used list
+   if ((rc = LinkHead(slot)))
+      return (rc);
+
+   // Return ok
+   return (0);
+}
+
+//
+// Evict
+//
+// Desc: Internal.  Remove the page in slot from the hash table, unless it
+//       is pinned, latched, or dirty: a dirty page must be written first
+//       (see WriteFrames).  The frame stays in the used list.  The pool
+//       mutex must be held.
+// In:   slot - slot of the page
+// Ret:  PF_PAGEPINNED if the page is pinned, latched or dirty, other PF
+//       return code otherwise
+//
+RC PF_BufferMgr::Evict(int slot)
+{
+   RC      rc;
+   int     fd = bufTable[slot].fd;
+   PageNum pageNum = bufTable[slot].pageNum;
+   pthread_rwlock_t *pLatch = bufTable[slot].pLatch;
+
+   // Check the pin count with the partition locked, so that the page is
+   // not pinned concurrently.  A page that is latched stays too.
+   hashTable.Lock(fd, pageNum);
+   if (PinCount(slot) != 0 || pthread_rwlock_trywrlock(pLatch)) {
+      hashTable.Unlock(fd, pageNum);
+      return (PF_PAGEPINNED);
+   }
+
+   // Remove page from the hash table
+   if (__atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED))
+      rc = PF_PAGEPINNED;
+   else
+      rc = hashTable.Delete(fd, pageNum);
+   hashTable.Unlock(fd, pageNum);
+   pthread_rwlock_unlock(pLatch);
+
+   return (rc);
+}
+
+//
+// PinCount
+//
+// Desc: Internal.  Read the pin count of a slot.  Pin counts are changed
+//       with the page's partition of the page table locked, but may be
+//       read without it: a page found unpinned must be checked again
+//       with the partition locked before it is removed (see Evict).
+// In:   slot - slot of the page
+// Ret:  pin count
+//
+int PF_BufferMgr::PinCount(int slot) const
+{
+   return (__atomic_load_n(&bufTable[slot].pinCount, __ATOMIC_ACQUIRE));
+}
+
+//
+// LinkCold
+//
+// Desc: Internal.  Insert a slot at the head of the FIFO part of the used
+//       list (PF_2Q).  The FIFO is the tail of the used list, from
+//       coldFirst to last, and holds pages that were read only once.
+// In:   slot - slot number to insert
+// Ret:  PF return code
+//
+RC PF_BufferMgr::LinkCold(int slot)
+{
+   bufTable[slot].bHot = FALSE;
+   numCold++;
+
+   // Insert in front of the current head of the FIFO, or at the end of
+   // the used list if the FIFO is empty
+   bufTable[slot].next = coldFirst;
+   if (coldFirst != INVALID_SLOT) {
+      bufTable[slot].prev = bufTable[coldFirst].prev;
+      bufTable[coldFirst].prev = slot;
+   }
+   else {
+      bufTable[slot].prev = last;
+      last = slot;
+   }
+
+   if (bufTable[slot].prev != INVALID_SLOT)
+      bufTable[bufTable[slot].prev].next = slot;
+   else
+      first = slot;
+
+   coldFirst = slot;
+
+   // Return ok
+   return (0);
 }
 
 //
-// ResizeBuffer
-//
-// Desc: Resizes the buffer manager to the size passed in.
-//       This routine will be called via the system command.
-// In:   The new buffer size
-// Out:  Nothing
-// Ret:  0 for success or,
-//       Some other PF error (probably PF_NOBUF)
+// Touch
 //
-// Notes: This method attempts to copy all the old pages which I am
-// unable to kick out of the old buffer manager into the new buffer
-// manager.  This obviously cannot always be successfull!
+// Desc: Internal.  Record a reference to a page that is in the buffer.
+//       PF_LRU:   make it the most recently used page.
+//       PF_CLOCK: set its reference bit; the page is not moved.
+//       PF_2Q:    move it to the head if it is in the main list.  Pages
+//                 in the FIFO stay where they are, so that the repeated
+//                 references of a single scan do not make them hot.
+// In:   slot - slot of the page
+// Ret:  PF return code
 //
-RC PF_BufferMgr::ResizeBuffer(int iNewSize)
+RC PF_BufferMgr::Touch(int slot)
 {
-   int i;
    RC rc;
 
-   // First try and clear out the old buffer!
-   ClearBuffer();
-
-   // Allocate memory for a new buffer table
-   PF_BufPageDesc *pNewBufTable = new PF_BufPageDesc[iNewSize];
+   // Frames of the scan ring stay where they are
+   if (bufTable[slot].bRing)
+      return (0);
 
-   // Initialize the new buffer table and allocate memory for buffer
-   // pages.  Initially, the free list contains all pages
-   for (i = 0; i < iNewSize; i++) {
-      if ((pNewBufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
+   switch (policy) {
+   case PF_CLOCK:
+      __atomic_store_n(&bufTable[slot].bRef, TRUE, __ATOMIC_RELAXED);
+      break;
 
-      memset ((void *)pNewBufTable[i].pData, 0, pageSize);
+   case PF_2Q:
+      if (!bufTable[slot].bHot)
+         break;
+      // Fall through: the main list is LRU
 
-      pNewBufTable[i].prev = i - 1;
-      pNewBufTable[i].next = i + 1;
+   case PF_LRU:
+      if ((rc = Unlink(slot)) ||
+            (rc = LinkHead(slot)))
+         return (rc);
+      break;
    }
-   pNewBufTable[0].prev = pNewBufTable[iNewSize - 1].next = INVALID_SLOT;
-
-   // Now we must remember the old first and last slots and (of course)
-   // the buffer table itself.  Then we use insert methods to insert
-   // each of the entries into the new buffertable
-   int oldFirst = first;
-   PF_BufPageDesc *pOldBufTable = bufTable;
-
-   // Setup the new number of pages,  first, last and free
-   numPages = iNewSize;
-   first = last = INVALID_SLOT;
-   free = 0;
 
-   // Setup the new buffer table
-   bufTable = pNewBufTable;
+   // Return ok
+   return (0);
+}
 
-   // We must first remove from the hashtable any possible entries
-   int slot, next, newSlot;
-   slot = oldFirst;
-   while (slot != INVALID_SLOT) {
-      next = pOldBufTable[slot].next;
+//
+// Reference
+//
+// Desc: Internal.  Record a reference to a page that a client has found
+//       in the buffer, without the pool mutex: the partition of the page
+//       in the page table must be locked instead.  Under PF_CLOCK this
+//       only sets the reference bit.  Otherwise the reference goes to the
+//       batch of the partition, and the page is touched (and taken out of
+//       the scan ring if asked to) when the batch is applied.  A full
+//       batch is applied first if the pool mutex is free; if not, the
+//       reference is dropped, since the thread holding the mutex applies
+//       all the batches before it chooses a victim anyway.
+// In:   fd - file descriptor
+//       pageNum - page number
+//       slot - slot where the page was found
+//       bLeaveRing - TRUE to take the page out of the scan ring
+// Ret:  PF return code
+//
+RC PF_BufferMgr::Reference(int fd, PageNum pageNum, int slot, int bLeaveRing)
+{
+   // Frames of the scan ring stay where they are (see Touch)
+   int bRing = __atomic_load_n(&bufTable[slot].bRing, __ATOMIC_RELAXED);
+   if (bRing && !bLeaveRing)
+      return (0);
 
-      // Must remove the entry from the hashtable from the
-      if ((rc=hashTable.Delete(pOldBufTable[slot].fd, pOldBufTable[slot].pageNum)))
-         return (rc);
-      slot = next;
+   if (policy == PF_CLOCK && !bRing) {
+      __atomic_store_n(&bufTable[slot].bRef, TRUE, __ATOMIC_RELAXED);
+      return (0);
    }
 
-   // Now we traverse through the old buffer table and copy any old
-   // entries into the new one
-   slot = oldFirst;
-   while (slot != INVALID_SLOT) {
-
-      next = pOldBufTable[slot].next;
-      // Allocate a new slot for the old page
-      if ((rc = InternalAlloc(newSlot)))
-         return (rc);
+   int part = PF_PageTable::Partition(fd, pageNum);
+   PF_TouchBatch *pBatch = &touches[part];
+   if (pBatch->numTouches == PF_TOUCH_BATCH) {
+      if (pthread_mutex_trylock(&poolMutex))
+         return (0);
+      ApplyTouches(part);
+      pthread_mutex_unlock(&poolMutex);
+   }
 
-      // Insert the page into the hash table,
-      // and initialize the page description entry
-      if ((rc = hashTable.Insert(pOldBufTable[slot].fd,
-            pOldBufTable[slot].pageNum, newSlot)) ||
-            (rc = InitPageDesc(pOldBufTable[slot].fd,
-            pOldBufTable[slot].pageNum, newSlot)))
-         return (rc);
+   PF_Touch *pTouch = &pBatch->touches[pBatch->numTouches];
+   pTouch->slot = slot;
+   pTouch->fd = fd;
+   pTouch->pageNum = pageNum;
+   pTouch->bLeaveRing = bLeaveRing;
+   __atomic_store_n(&pBatch->numTouches, pBatch->numTouches + 1,
+         __ATOMIC_RELAXED);
 
-      // Put the slot back on the free list before returning the error
-      Unlink(newSlot);
-      InsertFree(newSlot);
+   // Return ok
+   return (0);
+}
 
-      slot = next;
+//
+// ApplyTouches
+//
+// Desc: Internal.  Apply the references recorded in the batch of a
+//       partition, in the order they were made, and empty it.  A page
+//       that was replaced since it was referenced is skipped.  The pool
+//       mutex and the partition must be locked.
+// In:   part - partition of the page table
+//
+void PF_BufferMgr::ApplyTouches(int part)
+{
+   PF_TouchBatch *pBatch = &touches[part];
+
+   for (int i = 0; i < pBatch->numTouches; i++) {
+      PF_Touch *pTouch = &pBatch->touches[i];
+      int slot = pTouch->slot;
+
+      // The frame must still hold the page, in the used list
+      if (slot >= numSlots || bufTable[slot].bFree ||
+            bufTable[slot].bRetired ||
+            bufTable[slot].fd != pTouch->fd ||
+            bufTable[slot].pageNum != pTouch->pageNum)
+         continue;
+
+      if (pTouch->bLeaveRing && bufTable[slot].bRing)
+         LeaveRing(slot);
+      Touch(slot);
    }
-
-   // Finally, delete the old buffer table
-   delete [] pOldBufTable;
-
-   return 0;
+   __atomic_store_n(&pBatch->numTouches, 0, __ATOMIC_RELAXED);
 }
 
+//
+// ApplyAllTouches
+//
+// Desc: Internal.  Apply the references recorded in the batches of all
+//       the partitions, so that the used list is up to date.  The pool
+//       mutex must be held, and no partition locked.
+//
+void PF_BufferMgr::ApplyAllTouches()
+{
+   for (int part = 0; part < PF_PAGE_PARTITIONS; part++) {
+      // An empty batch is not worth locking the partition for
+      if (__atomic_load_n(&touches[part].numTouches, __ATOMIC_RELAXED) == 0)
+         continue;
+      hashTable.LockSet(1u << part);
+      ApplyTouches(part);
+      hashTable.UnlockSet(1u << part);
+   }
+}
 
 //
-// InsertFree
+// PlaceNew
 //
-// Desc: Internal.  Insert a slot at the head of the free list
-// In:   slot - slot number to insert
+// Desc: Internal.  Place a page that was just read (or allocated) in
+//       slot.  InternalAlloc has linked it at the head of the used list.
+//       PF_2Q moves it to the FIFO, unless it left the FIFO recently,
+//       in which case it is being reused and stays in the main list.
+// In:   slot - slot of the page, fd and pageNum already set
 // Ret:  PF return code
 //
-RC PF_BufferMgr::InsertFree(int slot)
+RC PF_BufferMgr::PlaceNew(int slot)
 {
-   bufTable[slot].next = free;
-   free = slot;
+   RC rc;
+
+   // Frames of the scan ring were placed by RingAlloc
+   if (bufTable[slot].bRing) {
+      __atomic_store_n(&bufTable[slot].bRef, FALSE, __ATOMIC_RELAXED);
+      return (0);
+   }
+
+   __atomic_store_n(&bufTable[slot].bRef, TRUE, __ATOMIC_RELAXED);
+
+   if (policy == PF_2Q &&
+         !TakeGhost(bufTable[slot].fd, bufTable[slot].pageNum)) {
+      if ((rc = Unlink(slot)) ||
+            (rc = LinkCold(slot)))
+         return (rc);
+   }
 
    // Return ok
    return (0);
 }
 
 //
-// LinkHead
+// ChooseVictim
 //
-// Desc: Internal.  Insert a slot at the head of the used list, making
-//       it the most-recently used slot.
-// In:   slot - slot number to insert
-// Ret:  PF return code
+// Desc: Internal.  Choose an unpinned page to replace.
+//       PF_LRU:   the least recently used unpinned page.
+//       PF_CLOCK: sweep the clock hand from the tail towards the head of
+//                 the used list (wrapping around), clearing reference
+//                 bits, and stop at the first unpinned page whose bit
+//                 is already clear.
+//       PF_2Q:    the oldest unpinned page of the FIFO if the FIFO holds
+//                 more than a quarter of the buffer, otherwise the least
+//                 recently used unpinned page of the main list.  Either
+//                 part is used if the other has no unpinned page.
+// Out:  slot - the victim, still linked in the used list
+// Ret:  PF_NOBUF if all pages are pinned
 //
-RC PF_BufferMgr::LinkHead(int slot)
+RC PF_BufferMgr::ChooseVictim(int &slot)
 {
-   // Set next and prev pointers of slot entry
-   bufTable[slot].next = first;
-   bufTable[slot].prev = INVALID_SLOT;
+   int i;
 
-   // If list isn't empty, point old first back to slot
-   if (first != INVALID_SLOT)
-      bufTable[first].prev = slot;
+   switch (policy) {
+   case PF_CLOCK:
+      slot = (hand == INVALID_SLOT) ? last : hand;
+      for (i = 0; i < 2 * numSlots; i++) {
+         if (slot == INVALID_SLOT)
+            slot = last;
+         if (PinCount(slot) == 0) {
+            if (!__atomic_load_n(&bufTable[slot].bRef, __ATOMIC_RELAXED)) {
+               hand = slot;
+               return (0);
+            }
+            __atomic_store_n(&bufTable[slot].bRef, FALSE, __ATOMIC_RELAXED);
+         }
+         slot = bufTable[slot].prev;
+      }
+      break;
+
+   case PF_2Q: {
+      int hotLast = (coldFirst == INVALID_SLOT) ? last :
+         bufTable[coldFirst].prev;
+      int bColdFirst = (numCold > numPages / 4);
+
+      for (int pass = 0; pass < 2; pass++) {
+         if (bColdFirst == (pass == 0)) {
+            // Oldest unpinned page of the FIFO
+            for (slot = last; slot != INVALID_SLOT && !bufTable[slot].bHot;
+                  slot = bufTable[slot].prev)
+               if (PinCount(slot) == 0)
+                  return (0);
+         }
+         else {
+            // Least recently used unpinned page of the main list
+            for (slot = hotLast; slot != INVALID_SLOT;
+                  slot = bufTable[slot].prev)
+               if (PinCount(slot) == 0)
+                  return (0);
+         }
+      }
+      break;
+   }
 
-   first = slot;
+   case PF_LRU:
+      // Choose the least-recently used page that is unpinned
+      for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
+         if (PinCount(slot) == 0)
+            return (0);
+      }
+      break;
+   }
 
-   // if list was empty, set last to slot
-   if (last == INVALID_SLOT)
-      last = first;
+   // All buffers are pinned
+   return (PF_NOBUF);
+}
 
-   // Return ok
-   return (0);
+//
+// ResetPolicy
+//
+// Desc: Internal.  Forget the state kept by the replacement policy.
+//       All pages in the buffer go to the main list with a clear
+//       reference bit, and the ring of evicted pages is emptied and
+//       sized for the current buffer (half of it).
+//
+void PF_BufferMgr::ResetPolicy()
+{
+   int i;
+
+   // Clients read the flags without the pool mutex (see Reference)
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
+      __atomic_store_n(&bufTable[slot].bRef, FALSE, __ATOMIC_RELAXED);
+      bufTable[slot].bHot = TRUE;
+      __atomic_store_n(&bufTable[slot].bRing, FALSE, __ATOMIC_RELAXED);
+   }
+   hand = INVALID_SLOT;
+   coldFirst = INVALID_SLOT;
+   numCold = 0;
+
+   for (i = 0; i < numGhosts; i++)
+      if (ghosts[i].slot != PF_HASH_EMPTY)
+         ghostTable.Delete(ghosts[i].fd, ghosts[i].pageNum);
+   delete [] ghosts;
+
+   numGhosts = (numPages / 2 > 0) ? numPages / 2 : 1;
+   ghosts = new PF_HashEntry[numGhosts];
+   for (i = 0; i < numGhosts; i++)
+      ghosts[i].slot = PF_HASH_EMPTY;
+   nextGhost = 0;
+
+   // The scan ring gets at most a quarter of the buffer
+   numRing = 0;
+   nextRing = 0;
+   ringSize = numPages / 4;
+   if (ringSize > PF_RING_SIZE)
+      ringSize = PF_RING_SIZE;
+   if (ringSize < 1)
+      ringSize = 1;
 }
 
 //
-// Unlink
+// AddGhost
 //
-// Desc: Internal.  Unlink the slot from the used list.  Assume that
-//       slot is valid.  Set prev and next pointers to INVALID_SLOT.
-//       The caller is responsible to either place the unlinked page into
-//       the free list or the used list.
-// In:   slot - slot number to unlink
-// Ret:  PF return code
+// Desc: Internal.  Remember a page evicted from the FIFO (PF_2Q).  Only
+//       its identity is kept; the oldest one is forgotten when the ring
+//       is full.
+// In:   fd - file descriptor
+//       pageNum - page number
 //
-RC PF_BufferMgr::Unlink(int slot)
+void PF_BufferMgr::AddGhost(int fd, PageNum pageNum)
 {
-   // If slot is at head of list, set first to next element
-   if (first == slot)
-      first = bufTable[slot].next;
+   int i;
 
-   // If slot is at end of list, set last to previous element
-   if (last == slot)
-      last = bufTable[slot].prev;
+   if (fd == MEMORY_FD || !ghostTable.Find(fd, pageNum, i))
+      return;
 
-   // If slot not at end of list, point next back to previous
-   if (bufTable[slot].next != INVALID_SLOT)
-      bufTable[bufTable[slot].next].prev = bufTable[slot].prev;
+   if (ghosts[nextGhost].slot != PF_HASH_EMPTY)
+      ghostTable.Delete(ghosts[nextGhost].fd, ghosts[nextGhost].pageNum);
 
-   // If slot not at head of list, point prev forward to next
-   if (bufTable[slot].prev != INVALID_SLOT)
-      bufTable[bufTable[slot].prev].next = bufTable[slot].next;
+   ghosts[nextGhost].fd = fd;
+   ghosts[nextGhost].pageNum = pageNum;
+   ghosts[nextGhost].slot = nextGhost;
+   ghostTable.Insert(fd, pageNum, nextGhost);
 
-   // Set next and prev pointers of slot entry
-   bufTable[slot].prev = bufTable[slot].next = INVALID_SLOT;
+   nextGhost = (nextGhost + 1) % numGhosts;
+}
 
-   // Return ok
-   return (0);
+//
+// TakeGhost
+//
+// Desc: Internal.  Check whether a page was evicted from the FIFO
+//       recently, and forget it if so.
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  TRUE if the page was remembered
+//
+int PF_BufferMgr::TakeGhost(int fd, PageNum pageNum)
+{
+   int i;
+
+   if (ghostTable.Find(fd, pageNum, i))
+      return (FALSE);
+
+   ghostTable.Delete(fd, pageNum);
+   ghosts[i].slot = PF_HASH_EMPTY;
+   return (TRUE);
 }
 
 //
-// InternalAlloc
+// RingAlloc
 //
-// Desc: Internal.  Allocate a buffer slot.  The slot is inserted at the
-//       head of the used list.  Here's how it chooses which slot to use:
-//       If there is something on the free list, then use it.
-//       Otherwise, choose a victim to replace.  If a victim cannot be
-//       chosen (because all the pages are pinned), then return an error.
-// Out:  slot - set to newly-allocated slot
+// Desc: Internal.  Allocate a buffer slot for a page read by a
+//       sequential scan.  Such pages go to a small ring of frames at the
+//       tail of the used list instead of the head, so that a scan larger
+//       than the buffer only ever replaces ringSize pages of other
+//       clients.  While the ring is not full, a frame is taken from the
+//       shared pool (see InternalAlloc) and added to it.  Once it is
+//       full, its frames are reused in turn; a frame that is pinned is
+//       skipped.  If every frame of the ring is pinned, a frame of the
+//       shared pool is used.
+// Out:  slot - set to newly-allocated slot, linked in the used list
 // Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
 //
-RC PF_BufferMgr::InternalAlloc(int &slot)
+RC PF_BufferMgr::RingAlloc(int &slot)
 {
-   RC  rc;       // return code
-
-   // If the free list is not empty, choose a slot from the free list
-   if (free != INVALID_SLOT) {
-      slot = free;
-      free = bufTable[slot].next;
-   }
-   else {
+   RC  rc = 0;
+   int i;
 
-      // Choose the least-recently used page that is unpinned
-      for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
-         if (bufTable[slot].pinCount == 0)
+   while (numRing >= ringSize) {
+
+      // Pages referenced by other clients leave the ring first
+      ApplyAllTouches();
+
+      // Reuse the next unpinned frame of the ring.  Evict removes the
+      // page from the hash table; the frame stays linked.  A dirty page
+      // is written first, after which the ring is looked at again.
+      int bWritten = FALSE;
+      for (i = 0; i < numRing; i++) {
+         slot = ring[(nextRing + i) % numRing];
+         if (PinCount(slot) != 0)
+            continue;
+         if (__atomic_load_n(&bufTable[slot].bDirty, __ATOMIC_RELAXED)) {
+            if ((rc = WriteFrames(&slot, 1)))
+               return (rc);
+            bWritten = TRUE;
+            break;
+         }
+         if ((rc = Evict(slot)) != PF_PAGEPINNED)
             break;
       }
+      if (bWritten)
+         continue;
 
-      // Return error if all buffers were pinned
-      if (slot == INVALID_SLOT)
-         return (PF_NOBUF);
-
-      // Write out the page if it is dirty
-      if (bufTable[slot].bDirty) {
-         if ((rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,
-               bufTable[slot].pData)))
-            return (rc);
+      if (i == numRing)
+         return (InternalAlloc(slot));
+      if (rc)
+         return (rc);
 
-         bufTable[slot].bDirty = FALSE;
-      }
+#ifdef PF_STATS
+      PF_FileStats *pStats = FileStats(bufTable[slot].fd);
+      if (pStats != NULL)
+         __sync_add_and_fetch(&pStats->evictions, 1);
+#endif
 
-      // Remove page from the hash table and slot from the used buffer list
-      if ((rc = hashTable.Delete(bufTable[slot].fd, bufTable[slot].pageNum)) ||
-            (rc = Unlink(slot)))
-         return (rc);
+      nextRing = (nextRing + i + 1) % numRing;
+      return (0);
    }
 
-   // Link slot at the head of the used list
-   if ((rc = LinkHead(slot)))
+   // Grow the ring by a frame of the shared pool.  Another thread may
+   // have filled the ring while the pool mutex was released.
+   if ((rc = InternalAlloc(slot)))
+      return (rc);
+   if (numRing >= ringSize)
+      return (0);
+   if ((rc = Unlink(slot)) ||
+         (rc = LinkTail(slot)))
       return (rc);
 
+   __atomic_store_n(&bufTable[slot].bRing, TRUE, __ATOMIC_RELAXED);
+   ring[numRing++] = slot;
+
    // Return ok
    return (0);
 }
 
+//
+// LeaveRing
+//
+// Desc: Internal.  Remove a slot from the scan ring.  The page stays in
+//       the buffer and is managed by the replacement policy from now on.
+// In:   slot - slot number to remove
+//
+void PF_BufferMgr::LeaveRing(int slot)
+{
+   for (int i = 0; i < numRing; i++)
+      if (ring[i] == slot) {
+         ring[i] = ring[--numRing];
+         break;
+      }
+   if (nextRing >= numRing)
+      nextRing = 0;
+
+   __atomic_store_n(&bufTable[slot].bRing, FALSE, __ATOMIC_RELAXED);
+}
+
 //
 // ReadPage
 //
-// Desc: Read a page from disk
+// Desc: Read a page from disk, and check it against its checksum
 //
 // In:   fd - OS file descriptor
 //       pageNum - number of page to read
@@ -841,44 +2879,69 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
 
 #ifdef PF_STATS
    pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
+   PF_FileStats *pStats = FileStats(fd);
+   if (pStats != NULL)
+      __sync_add_and_fetch(&pStats->reads, 1);
 #endif
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
-
-   // Read the data
-   int numBytes = read(fd, dest, pageSize);
+   // Read the data at the page's offset in the file
+   ssize_t numBytes = pread(fd, dest, pageSize,
+         PF_PageOffset(pageNum, pageSize));
    if (numBytes < 0)
       return (PF_UNIX);
    else if (numBytes != pageSize)
       return (PF_INCOMPLETEREAD);
+   else if (!PF_VerifyChecksum(dest, pageSize))
+      return (PF_BADCHECKSUM);
    else
       return (0);
 }
 
 //
-// WritePage
+// ComparePageNum
+//
+// Desc: qsort comparison function that orders PF_PageSlot entries by
+//       page number
+//
+static int ComparePageNum(const void *p1, const void *p2)
+{
+   PageNum pageNum1 = ((const PF_PageSlot *)p1)->pageNum;
+   PageNum pageNum2 = ((const PF_PageSlot *)p2)->pageNum;
+
+   return (pageNum1 < pageNum2) ? -1 : (pageNum1 > pageNum2);
+}
+
 //
-// Desc: Write a page to disk
+// WritePages
 //
+// Desc: Internal.  Write a set of dirty pages of a file and mark them
+//       clean.  The pages are sorted by page number, and each run of
+//       consecutive pages (up to PF_WRITE_BATCH of them) is written with
+//       a single pwritev.  The log is forced once for the whole set
+//       rather than once per page.
 // In:   fd - OS file descriptor
-//       pageNum - number of page to write
-//       dest - pointer to buffer containing page contents
+//       pages - the pages to write; reordered by this call
+//       numDirty - number of entries in pages
 // Ret:  PF return code
 //
-RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
+RC PF_BufferMgr::WritePages(int fd, PF_PageSlot *pages, int numDirty)
 {
+   struct iovec iov[PF_WRITE_BATCH];
+   int i, j, k;
+
+   if (numDirty == 0)
+      return (0);
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Writing (%d,%d).\n", fd, pageNum);
+   sprintf (psMessage, "Writing %d pages of (%d).\n", numDirty, fd);
    WriteLog(psMessage);
 #endif
 
+   qsort(pages, numDirty, sizeof(PF_PageSlot), ComparePageNum);
+
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDONE);
+   PF_FileStats *pStats = FileStats(fd);
 #endif
 
    if (fd != logfd && logFile) {
@@ -886,19 +2949,113 @@ RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
       if (rc) return rc;
    }
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
+   for (i = 0; i < numDirty; i = j) {
 
-   // Read the data
-   int numBytes = write(fd, source, pageSize);
-   if (numBytes < 0)
-      return (PF_UNIX);
-   else if (numBytes != pageSize)
-      return (PF_INCOMPLETEWRITE);
-   else
+      // Find the run of consecutive pages starting at i
+      for (j = i + 1; j < numDirty && j - i < PF_WRITE_BATCH; j++)
+         if (pages[j].pageNum != pages[i].pageNum + (j - i) ||
+               PF_GroupStart(pages[j].pageNum, pageSize))
+            break;
+
+      // The pages are clean once written, unless changed again after
+      // this point.  Each carries the checksum of its data on disk.
+      for (k = i; k < j; k++) {
+         __atomic_store_n(&bufTable[pages[k].slot].bDirty, FALSE,
+               __ATOMIC_RELAXED);
+         PF_SetChecksum(bufTable[pages[k].slot].pData, pageSize);
+         iov[k - i].iov_base = bufTable[pages[k].slot].pData;
+         iov[k - i].iov_len = pageSize;
+
+         // A copy of the page read ahead is out of date after the write
+         prefetcher.Invalidate(fd, pages[k].pageNum);
+      }
+
+#ifdef PF_STATS
+      int numWritten = j - i;
+      pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDVALUE, &numWritten);
+      if (pStats != NULL)
+         __sync_add_and_fetch(&pStats->writes, numWritten);
+#endif
+
+      // Write the run at the offset of its first page
+      ssize_t numBytes = pwritev(fd, iov, j - i,
+            PF_PageOffset(pages[i].pageNum, pageSize));
+      if (numBytes != (ssize_t)(j - i) * pageSize) {
+         for (k = i; k < numDirty; k++)
+            __atomic_store_n(&bufTable[pages[k].slot].bDirty, TRUE,
+                  __ATOMIC_RELAXED);
+         return (numBytes < 0 ? PF_UNIX : PF_INCOMPLETEWRITE);
+      }
+   }
+
+   return (0);
+}
+
+//
+// ReadPages
+//
+// Desc: Internal.  Read a set of pages of a file into their frames.  The
+//       pages are sorted by page number, and each run of consecutive
+//       pages (up to PF_READ_BATCH of them) is read with a single preadv.
+//       Each page is checked against its checksum.
+// In:   fd - OS file descriptor
+//       pages - the pages to read and their frames; reordered by this call
+//       numRead - number of entries in pages
+// Ret:  PF return code
+//
+RC PF_BufferMgr::ReadPages(int fd, PF_PageSlot *pages, int numRead)
+{
+   struct iovec iov[PF_READ_BATCH];
+   int i, j, k;
+
+   if (numRead == 0)
       return (0);
+
+#ifdef PF_LOG
+   char psMessage[100];
+   sprintf (psMessage, "Reading %d pages of (%d).\n", numRead, fd);
+   WriteLog(psMessage);
+#endif
+
+   qsort(pages, numRead, sizeof(PF_PageSlot), ComparePageNum);
+
+#ifdef PF_STATS
+   PF_FileStats *pStats = FileStats(fd);
+#endif
+
+   for (i = 0; i < numRead; i = j) {
+
+      // Find the run of consecutive pages starting at i
+      for (j = i + 1; j < numRead && j - i < PF_READ_BATCH; j++)
+         if (pages[j].pageNum != pages[i].pageNum + (j - i) ||
+               PF_GroupStart(pages[j].pageNum, pageSize))
+            break;
+
+      for (k = i; k < j; k++) {
+         iov[k - i].iov_base = bufTable[pages[k].slot].pData;
+         iov[k - i].iov_len = pageSize;
+      }
+
+#ifdef PF_STATS
+      int numPagesRead = j - i;
+      pStatisticsMgr->Register(PF_READPAGE, STAT_ADDVALUE, &numPagesRead);
+      if (pStats != NULL)
+         __sync_add_and_fetch(&pStats->reads, numPagesRead);
+#endif
+
+      // Read the run at the offset of its first page
+      ssize_t numBytes = preadv(fd, iov, j - i,
+            PF_PageOffset(pages[i].pageNum, pageSize));
+      if (numBytes < 0)
+         return (PF_UNIX);
+      if (numBytes != (ssize_t)(j - i) * pageSize)
+         return (PF_INCOMPLETEREAD);
+      for (k = i; k < j; k++)
+         if (!PF_VerifyChecksum(bufTable[pages[k].slot].pData, pageSize))
+            return (PF_BADCHECKSUM);
+   }
+
+   return (0);
 }
 
 //
@@ -918,16 +3075,14 @@ RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
    bufTable[slot].bDirty   = FALSE;
    bufTable[slot].pinCount = 1;
 
-   // Return ok
-   return (0);
+   // Put the page where the replacement policy wants new pages
+   return (PlaceNew(slot));
 }
 
 //------------------------------------------------------------------------------
 // Methods for manipulating raw memory buffers
 //------------------------------------------------------------------------------
 
-#define MEMORY_FD -1
-
 //
 // GetBlockSize
 //
@@ -953,25 +3108,35 @@ RC PF_BufferMgr::AllocateBlock(char *&buffer)
 {
    RC rc = OK_RC;
 
+   pthread_mutex_lock(&poolMutex);
+
    // Get an empty slot from the buffer pool
    int slot;
-   if ((rc = InternalAlloc(slot)) != OK_RC)
+   if ((rc = InternalAlloc(slot)) != OK_RC) {
+      pthread_mutex_unlock(&poolMutex);
       return rc;
+   }
 
    // Create artificial page number (just needs to be unique for hash table)
    PageNum pageNum = bufTable[slot].pData - (char*)0;
 
-   // Insert the page into the hash table, and initialize the page description entry
-   if ((rc = hashTable.Insert(MEMORY_FD, pageNum, slot) != OK_RC) ||
-         (rc = InitPageDesc(MEMORY_FD, pageNum, slot)) != OK_RC) {
+   // Initialize the page description entry, and insert the page into the hash table
+   if ((rc = InitPageDesc(MEMORY_FD, pageNum, slot)) == OK_RC) {
+      hashTable.Lock(MEMORY_FD, pageNum);
+      rc = hashTable.Insert(MEMORY_FD, pageNum, slot);
+      hashTable.Unlock(MEMORY_FD, pageNum);
+   }
+   if (rc != OK_RC) {
       // Put the slot back on the free list before returning the error
       Unlink(slot);
       InsertFree(slot);
+      pthread_mutex_unlock(&poolMutex);
       return rc;
    }
 
    // Return pointer to buffer
    buffer = bufTable[slot].pData;
+   pthread_mutex_unlock(&poolMutex);
 
    // Return success code
    return OK_RC;
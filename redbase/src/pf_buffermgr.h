@@ -15,8 +15,10 @@
 #ifndef PF_BUFFERMGR_H
 #define PF_BUFFERMGR_H
 
+#include <pthread.h>
 #include "pf_internal.h"
 #include "pf_hashtable.h"
+#include "pf_prefetcher.h"
 
 //
 // Defines
@@ -28,6 +30,10 @@
 // next.
 #define INVALID_SLOT  (-1)
 
+// MEMORY_FD is the file descriptor used for the pages handed out by
+// AllocateBlock, which are not associated with a particular file.
+#define MEMORY_FD     (-1)
+
 //
 // PF_BufPageDesc - struct containing data about a page in the buffer
 //
@@ -36,36 +42,178 @@ struct PF_BufPageDesc {
     int        next;        // next in the linked list of buffer pages
     int        prev;        // prev in the linked list of buffer pages
     int        bDirty;      // TRUE if page is dirty
-    short int  pinCount;    // pin count
+    int        pinCount;    // pin count, changed atomically
     PageNum    pageNum;     // page number for this page
     int        fd;          // OS file descriptor of this page
+    int        bRef;        // reference bit (PF_CLOCK)
+    int        bHot;        // FALSE while the page is in the FIFO part
+                            // at the tail of the used list (PF_2Q)
+    int        bRing;       // TRUE if the frame belongs to the ring of
+                            // frames used by sequential scans
+    int        bWriting;    // TRUE while the page is written without the
+                            // pool mutex (by the background writer, or to
+                            // free the frame); changed with its partition
+                            // locked
+    int        bReading;    // TRUE while the page is read into the frame;
+                            // changed with its partition locked
+    int        bFree;       // TRUE while the slot is on the free list
+    int        bRetired;    // TRUE once the slot was taken out of use by
+                            // a shrink (see ResizeBuffer)
+    pthread_rwlock_t *pLatch;  // latch on the page contents
+};
+
+//
+// PF_Arena - frames of the buffer allocated together.  The frames are
+//            carved out of a few contiguous arenas, which the OS can map
+//            with huge pages, rather than allocated one by one.  Each
+//            arena holds the frames of a range of slots; a slot keeps
+//            its frame until the slot is trimmed off the buffer.
+//
+struct PF_Arena {
+    char       *pBase;      // frame of firstSlot
+    size_t     size;        // # of bytes mapped
+    int        firstSlot;   // first slot whose frame is in the arena
+    int        numFrames;   // # of frames in the arena
+    PF_Arena   *next;       // arena of the slots below
+};
+
+//
+// PF_ReadStream - sequential reads of a file, tracked for read-ahead.
+//                 The stream of a file is chosen by its descriptor; a
+//                 file whose descriptor maps to a stream in use takes
+//                 the stream over.
+//
+struct PF_ReadStream {
+    pthread_mutex_t mutex;  // protects the rest
+    int        fd;          // OS file descriptor, -1 if unused
+    PageNum    nextPage;    // page that continues the sequence
+    PageNum    readAhead;   // first page not requested from the prefetcher
+} __attribute__((aligned(64)));
+
+//
+// PF_Touch - a reference to a page found in the buffer, not applied to
+//            the used list yet
+//
+struct PF_Touch {
+    int        slot;        // frame where the page was found
+    int        fd;          // OS file descriptor of the page
+    PageNum    pageNum;     // page number
+    int        bLeaveRing;  // TRUE to take the page out of the scan ring
+};
+
+//
+// PF_TouchBatch - the references recorded for the pages of a partition of
+//                 the page table, protected by the partition's mutex
+//
+struct PF_TouchBatch {
+    PF_Touch   touches[PF_TOUCH_BATCH];
+    int        numTouches;  // # of entries in touches
+} __attribute__((aligned(64)));
+
+//
+// PF_PageSlot - a page and the frame holding it, in a set of pages read
+//               or written together
+//
+struct PF_PageSlot {
+    PageNum    pageNum;     // page number
+    int        slot;        // frame holding the page
 };
 
 //
 // PF_BufferMgr - manage the page buffer
 //
+// The buffer manager may be used by several threads at once.  Locking:
+//  - A page is looked up, pinned and unpinned with only its partition of
+//    the page table locked.  Pin counts are changed atomically, so the
+//    pool side can read them without that lock; a page is only removed
+//    from the buffer (Evict) after its pin count was checked with the
+//    partition locked.
+//  - Everything else (the used and free lists, the replacement policy
+//    and scan ring, and which page a frame holds) is protected by
+//    poolMutex, which misses take only to pick a frame.  Hits, MarkDirty
+//    and UnpinPage do not: PF_CLOCK only sets a reference bit, and
+//    PF_LRU and PF_2Q record the reference in the batch of the page's
+//    partition (see Reference).  The batches are applied to the used
+//    list under poolMutex, before a victim is chosen, or when one fills
+//    up and poolMutex is free.
+//  - No page is read or written with poolMutex held, and no thread
+//    waits with it held for a latch that a client may hold.  A miss enters the page in the page
+//    table with bReading set and the frame latched exclusively, then
+//    reads it without poolMutex (see ReadIn); a thread looking the page
+//    up meanwhile waits for the latch and looks again.  A dirty victim is
+//    written the way the background writer writes pages (see
+//    WriteFrames), and the victim is chosen again afterwards.  Writing a
+//    page forces the log, which takes poolMutex in ForcePages.
+//  - Each read-ahead stream has its own mutex; ReadAhead checks which
+//    pages are in the buffer with their partitions locked.
+//  - Clients that share a page between threads latch it (LatchPage) to
+//    read or change its contents, and mark it dirty while holding the
+//    exclusive latch.  Pages are written under a latch, and a latched
+//    page is never evicted.
+//  - ResizeBuffer adds or retires frames a chunk at a time, taking
+//    poolMutex for each chunk, so clients keep running meanwhile.  The
+//    table of slots is reserved for PF_MAX_BUFFER_PAGES slots once, so
+//    it never moves.  ClearBuffer and SetPolicy must not run
+//    concurrently with other calls, and a file is flushed only once no
+//    other thread uses it.
+//  - The background writer (StartWriter) writes dirty, unpinned pages
+//    near the LRU end of the used list, pinning them and latching them
+//    exclusively meanwhile with bWriting set, and holds writerMutex for
+//    the whole round.  A client pinning such a page waits until it is
+//    written, since clients do not latch the pages they own.
+//    SetHugePages, FlushPages and CloseFile take writerMutex (before
+//    poolMutex) so as not to overlap a round.
+//
 class PF_BufferMgr {
     friend class PF_Manager;
     friend class LG_Manager;
 public:
 
-    PF_BufferMgr     (int numPages);             // Constructor - allocate
+    PF_BufferMgr     (int numPages,              // Constructor - allocate
+                      PF_ReplacePolicy policy = PF_LRU,
+                      int pageSize = PF_MIN_PAGE_SIZE);
                                                   // numPages buffer pages
+                                                  // of pageSize bytes
     ~PF_BufferMgr    ();                         // Destructor
 
     // Read pageNum into buffer, point *ppBuffer to location
     RC  GetPage      (int fd, PageNum pageNum, char **ppBuffer,
-                      int bMultiplePins = TRUE);
+                      int bMultiplePins = TRUE,
+                      ClientHint pinHint = NO_HINT);
+    // Read several pages into buffer at once, point ppBuffers to them
+    RC  GetPages     (int fd, const PageNum *pageNums, int numPages,
+                      char **ppBuffers, ClientHint pinHint = NO_HINT);
     // Allocate a new page in the buffer, point *ppBuffer to its location
     RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
 
     RC  MarkDirty    (int fd, PageNum pageNum);  // Mark page dirty
     RC  UnpinPage    (int fd, PageNum pageNum);  // Unpin page from the buffer
+
+    // Latch a pinned page for reading (shared) or writing (exclusive)
+    RC  LatchPage    (int fd, PageNum pageNum, int bExclusive);
+    RC  UnlatchPage  (int fd, PageNum pageNum);  // Release the latch
     RC  FlushPages   (int fd);                   // Flush pages for file
 
+    // Note that pageNum of fd is being read, and read ahead of it if the
+    // file is being read sequentially.  numPages bounds the read-ahead.
+    RC  ReadAhead    (int fd, PageNum pageNum, PageNum numPages);
+
     // Force a page to the disk, but do not remove from the buffer pool
     RC ForcePages    (int fd, PageNum pageNum);
 
+    // Close the OS file of a file whose pages were flushed
+    RC  CloseFile    (int fd);
+
+    // Start or stop writing dirty pages in the background
+    RC  StartWriter  ();
+    RC  StopWriter   ();
+
+    // Keep statistics for the pages of fd under fileName
+    RC  TrackFile    (int fd, const char *fileName);
+    // Return the statistics of the i-th file tracked, or reset them all
+    RC  GetFileStats (int i, PF_FileStats &stats);
+    RC  ResetFileStats();
+
 
     // Remove all entries from the Buffer Manager.
     RC  ClearBuffer  ();
@@ -75,6 +223,12 @@ public:
     // Attempts to resize the buffer to the new size
     RC ResizeBuffer  (int iNewSize);
 
+    // Change the page replacement policy
+    RC SetPolicy     (PF_ReplacePolicy policy);
+
+    // Map the frames of the buffer with explicit huge pages (or not)
+    RC SetHugePages  (int bHugePages);
+
     // Three Methods for manipulating raw memory buffers.  These memory
     // locations are handled by the buffer manager, but are not
     // associated with a particular file.  These should be used if you
@@ -89,30 +243,140 @@ public:
     RC DisposeBlock  (char *buffer);
 
 private:
+    static int HashTableSize(int numPages);      // # of hash entries to size for
+
     RC  InsertFree   (int slot);                 // Insert slot at head of free
     RC  LinkHead     (int slot);                 // Insert slot at head of used
+    RC  LinkTail     (int slot);                 // Insert slot at tail of used
     RC  Unlink       (int slot);                 // Unlink slot
     RC  InternalAlloc(int &slot);                // Get a slot to use
+    RC  Evict        (int slot);                 // Remove an unpinned,
+                                                  //   clean page
+    RC  ReadIn       (int fd, PageNum pageNum,   // Read a missing page
+                      ClientHint pinHint, int &slot); //   into a frame
+    void RemoveFree  (int slot);                 // Take slot off free list
+    int PinCount     (int slot) const;           // Read a pin count
+
+    // Slots and frame memory
+    RC  CommitSlots  (int iNumSlots);            // Make slots usable
+    RC  AddFrames    ();                         // Add a chunk of slots
+    RC  RetireSlot   (int slot);                 // Take a slot out of use
+    void TrimSlots   ();                         // Drop retired top slots
+    void AllocArena  (int firstSlot, int numFrames);
+                                                  // Map frames for slots
+    char *FrameOf    (int slot) const;           // Frame of a slot
+    void FreeArenas  (int firstSlot);            // Release the frames of
+                                                  //   firstSlot and up
+
+    // Replacement policy
+    RC  LinkCold     (int slot);                 // Insert slot at head of
+                                                  //   the FIFO part (PF_2Q)
+    RC  Touch        (int slot);                 // Record a reference
+    RC  Reference    (int fd, PageNum pageNum,   // Record a reference made
+                      int slot, int bLeaveRing); //   without poolMutex
+    void ApplyTouches(int part);                 // Apply the references of
+                                                  //   a partition
+    void ApplyAllTouches();                      // ... of all partitions
+    RC  PlaceNew     (int slot);                 // Place a newly read page
+    RC  ChooseVictim (int &slot);                // Pick an unpinned page
+    void ResetPolicy ();                         // Forget policy state
+    void AddGhost    (int fd, PageNum pageNum);  // Remember evicted page
+    int  TakeGhost   (int fd, PageNum pageNum);  // TRUE if it was remembered
+
+    // Frames of sequential scans
+    RC  RingAlloc    (int &slot);                // Get a slot of the ring
+    void LeaveRing   (int slot);                 // Remove slot from the ring
 
     // Read a page
     RC  ReadPage     (int fd, PageNum pageNum, char *dest);
 
-    // Write a page
-    RC  WritePage    (int fd, PageNum pageNum, char *source);
+    // Read a set of pages of a file into their frames, in page order
+    RC  ReadPages    (int fd, PF_PageSlot *pages, int numRead);
+
+    // Write a set of dirty pages of a file, in page order
+    RC  WritePages   (int fd, PF_PageSlot *pages, int numDirty);
 
     // Init the page desc entry
     RC  InitPageDesc (int fd, PageNum pageNum, int slot);
 
+    // Writes without the pool mutex
+    int  TakeForWrite(int slot);                 // Pin and latch a page
+                                                  //   to write
+    RC  WriteLatched (int *slots, int numWrite); // Write and release them
+    RC  WriteFrames  (int *slots, int numFrames);// Write the dirty pages
+                                                  //   of frames
+    void WaitIO      (int fd, int slot);         // Wait for a read or write
+
+    // Background writer
+    static void *RunWriter(void *pBufferMgr);    // writer thread main loop
+    void WriteTail   ();                         // Clean the LRU end
+
+    // Per-file statistics
+    PF_FileStats *FileStats(int fd);             // Those of fd, or NULL
+    void CountWait   (int fd, const struct timespec &start);
+                                                  // Add the time since start
+                                                  //   to the pin wait of fd
+
     PF_BufPageDesc *bufTable;                     // info on buffer pages
-    PF_HashTable   hashTable;                     // Hash table object
+    int            numSlots;                      // # of slots in use or
+                                                  //   being retired
+    int            numCommitted;                  // # of slots with memory
+    PF_Arena       *arenas;                       // memory of the frames,
+                                                  //   top slots first
+    int            bHugePages;                    // TRUE to map the arenas
+                                                  //   with explicit huge
+                                                  //   pages
+    PF_PageTable   hashTable;                     // Page table object
+    pthread_mutex_t poolMutex;                    // protects the rest
     int            numPages;                      // # of pages in the buffer
+                                                  //   (slots from numPages
+                                                  //   to numSlots retire)
     int            pageSize;                      // Size of pages in the buffer
     int            first;                         // MRU page slot
     int            last;                          // LRU page slot
     int            free;                          // head of free list
 
+    PF_ReplacePolicy policy;                      // replacement policy
+    int            hand;                          // clock hand (PF_CLOCK)
+    int            coldFirst;                     // first slot of the FIFO
+                                                  //   part (PF_2Q)
+    int            numCold;                       // # of pages in the FIFO
+    PF_HashEntry   *ghosts;                       // ring of pages recently
+                                                  //   evicted from the FIFO
+    int            numGhosts;                     // size of the ring
+    int            nextGhost;                     // next ring entry to use
+    PF_HashTable   ghostTable;                    // ring entry of a page
+
+    int            *ring;                         // frames of the scan ring
+    int            numRing;                       // # of frames in the ring
+    int            ringSize;                      // max # of frames in it
+    int            nextRing;                      // next ring frame to reuse
+
+    PF_Prefetcher  prefetcher;                    // background reads
+    PF_ReadStream  streams[PF_PREFETCH_STREAMS];  // files read sequentially
+
+    PF_TouchBatch  touches[PF_PAGE_PARTITIONS];   // references not applied
+                                                  //   yet, per partition
+
     int            logfd;
     PF_FileHandle  *logFile;
+
+    pthread_t      writer;                        // background writer
+    int            bWriter;                       // TRUE while it runs
+    int            bWriterStop;                   // TRUE to stop it
+    pthread_mutex_t writerMutex;                  // held by the writer for
+                                                  //   a round, and by calls
+                                                  //   that must not overlap
+                                                  //   one
+    pthread_cond_t writerCond;                    // signaled to start a
+                                                  //   round early, or stop
+
+    PF_FileStats   fileStats[PF_STAT_FILES];      // statistics of the files
+                                                  //   tracked (changed
+                                                  //   atomically)
+    int            numFileStats;                  // # of files tracked
+    int            fdStats[PF_STAT_FDS];          // entry of fileStats of
+                                                  //   each fd, -1 if none
 };
 
 #endif
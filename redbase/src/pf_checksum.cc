@@ -0,0 +1,165 @@
+//
+// File:        pf_checksum.cc
+// Description: CRC32C checksums of the pages of a paged file
+//
+
+#include "pf_internal.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+//
+// The checksum of a page is the CRC32C (Castagnoli polynomial) of the
+// page after its header, stored in the header when the page is written.
+// The SSE4.2 crc32 instruction computes it 8 bytes at a time; a table is
+// used on processors without it.
+//
+
+static const unsigned int PF_CRC32C_POLY = 0x82F63B78;  // reflected
+
+static unsigned int crcTable[256];         // byte-at-a-time CRC32C
+
+//
+// PF_InitCrc32cTable
+//
+// Desc: Internal.  Compute the table of the byte-at-a-time CRC32C
+// Ret:  TRUE
+//
+static int PF_InitCrc32cTable()
+{
+   for (unsigned int i = 0; i < 256; i++) {
+      unsigned int crc = i;
+      for (int j = 0; j < 8; j++)
+         crc = (crc >> 1) ^ (PF_CRC32C_POLY & (0 - (crc & 1)));
+      crcTable[i] = crc;
+   }
+   return (TRUE);
+}
+
+//
+// PF_Crc32cTableSum
+//
+// Desc: Internal.  CRC32C of a buffer, a byte at a time
+// In:   crc - CRC of the bytes before the buffer (inverted)
+//       p - buffer
+//       len - # of bytes in the buffer
+// Ret:  CRC including the buffer (inverted)
+//
+static unsigned int PF_Crc32cTableSum(unsigned int crc,
+      const unsigned char *p, int len)
+{
+   static const int bTable = PF_InitCrc32cTable();
+
+   (void)bTable;
+   while (len-- > 0)
+      crc = crcTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+   return (crc);
+}
+
+#if defined(__x86_64__)
+
+//
+// PF_Crc32cHardSum
+//
+// Desc: Internal.  CRC32C of a buffer with the SSE4.2 crc32 instruction,
+//       8 bytes at a time once the buffer is aligned
+// In:   crc - CRC of the bytes before the buffer (inverted)
+//       p - buffer
+//       len - # of bytes in the buffer
+// Ret:  CRC including the buffer (inverted)
+//
+__attribute__((target("sse4.2")))
+static unsigned int PF_Crc32cHardSum(unsigned int crc,
+      const unsigned char *p, int len)
+{
+   while (len > 0 && ((unsigned long)p & 7) != 0) {
+      crc = _mm_crc32_u8(crc, *p++);
+      len--;
+   }
+
+   unsigned long long crc64 = crc;
+   for (; len >= 8; len -= 8, p += 8)
+      crc64 = _mm_crc32_u64(crc64, *(const unsigned long long *)p);
+   crc = (unsigned int)crc64;
+
+   while (len-- > 0)
+      crc = _mm_crc32_u8(crc, *p++);
+   return (crc);
+}
+
+#endif
+
+//
+// PF_Checksum
+//
+// Desc: Compute the checksum of a page.  The header of the page is not
+//       covered, since the checksum is stored there.
+// In:   pPage - the page, header included
+//       pageSize - size of the page, header included
+// Ret:  checksum; never PF_PAGE_USED, which marks a page written without
+//       a checksum
+//
+unsigned int PF_Checksum(const char *pPage, int pageSize)
+{
+   const unsigned char *p = (const unsigned char *)pPage + sizeof(PF_PageHdr);
+   int len = pageSize - sizeof(PF_PageHdr);
+   unsigned int crc;
+
+#if defined(__x86_64__)
+   static const int bHardware =
+      (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+
+   if (bHardware)
+      crc = ~PF_Crc32cHardSum(~0U, p, len);
+   else
+#endif
+      crc = ~PF_Crc32cTableSum(~0U, p, len);
+
+   if (crc == (unsigned int)PF_PAGE_USED)
+      crc--;
+   return (crc);
+}
+
+//
+// PF_SetChecksum
+//
+// Desc: Store the checksum of a page in its header before the page is
+//       written.  The page may be latched shared by other threads, which
+//       can read but not change its data.
+// In:   pPage - the page, header included
+//       pageSize - size of the page, header included
+//
+void PF_SetChecksum(char *pPage, int pageSize)
+{
+   __atomic_store_n(&((PF_PageHdr *)pPage)->checksum,
+         (int)PF_Checksum(pPage, pageSize), __ATOMIC_RELAXED);
+}
+
+//
+// PF_VerifyChecksum
+//
+// Desc: Check a page just read against the checksum in its header.  A
+//       page written without a checksum (by an older version) is not
+//       checked, and a page of zeros is a page that was preallocated but
+//       never written.
+// In:   pPage - the page, header included
+//       pageSize - size of the page, header included
+// Ret:  TRUE if the page is intact, FALSE if it was damaged or only
+//       partly written
+//
+int PF_VerifyChecksum(const char *pPage, int pageSize)
+{
+   int checksum = ((const PF_PageHdr *)pPage)->checksum;
+
+   if (checksum == PF_PAGE_USED ||
+         (unsigned int)checksum == PF_Checksum(pPage, pageSize))
+      return (TRUE);
+
+   if (checksum != 0)
+      return (FALSE);
+   for (int i = sizeof(PF_PageHdr); i < pageSize; i++)
+      if (pPage[i] != 0)
+         return (FALSE);
+   return (TRUE);
+}
@@ -25,7 +25,12 @@ static char *PF_WarnMsg[] = {
   (char*)"page already unpinned",
   (char*)"end of file",
   (char*)"attempting to resize the buffer too small",
-  (char*)"invalid filename"
+  (char*)"invalid buffer size",
+  (char*)"invalid page replacement policy",
+  (char*)"file is open read only",
+  (char*)"invalid page size",
+  (char*)"page size of file differs from that of the buffer",
+  (char*)"file has an older format without a free-space map (see dbupgrade)"
 };
 
 static char *PF_ErrorMsg[] = {
@@ -38,7 +43,8 @@ static char *PF_ErrorMsg[] = {
   (char*)"new page to be allocated already in buffer",
   (char*)"hash table entry not found",
   (char*)"page already in hash table",
-  (char*)"invalid file name"
+  (char*)"invalid file name",
+  (char*)"page does not match its checksum (damaged or partly written)"
 };
 
 //
@@ -5,6 +5,8 @@
 //              Dallan Quass (quass@cs.stanford.edu)
 //
 
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include "pf_internal.h"
@@ -29,6 +31,10 @@ PF_FileHandle::PF_FileHandle()
    // Initialize local variables
    bFileOpen = FALSE;
    pBufferMgr = NULL;
+   bDirect = FALSE;
+   pMap = NULL;
+   pChecked = NULL;
+   pFreeMap = NULL;
 }
 
 //
@@ -52,11 +58,17 @@ PF_FileHandle::~PF_FileHandle()
 PF_FileHandle::PF_FileHandle(const PF_FileHandle &fileHandle)
 {
    // Just copy the data members since there is no memory allocation involved
+   // (the free-space map is shared, and freed when the file is closed)
    this->pBufferMgr  = fileHandle.pBufferMgr;
    this->hdr         = fileHandle.hdr;
    this->bFileOpen   = fileHandle.bFileOpen;
    this->bHdrChanged = fileHandle.bHdrChanged;
    this->unixfd      = fileHandle.unixfd;
+   this->bDirect     = fileHandle.bDirect;
+   this->pMap        = fileHandle.pMap;
+   this->mapSize     = fileHandle.mapSize;
+   this->pChecked    = fileHandle.pChecked;
+   this->pFreeMap    = fileHandle.pFreeMap;
 }
 
 //
@@ -79,6 +91,11 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
       this->bFileOpen   = fileHandle.bFileOpen;
       this->bHdrChanged = fileHandle.bHdrChanged;
       this->unixfd      = fileHandle.unixfd;
+      this->bDirect     = fileHandle.bDirect;
+      this->pMap        = fileHandle.pMap;
+      this->mapSize     = fileHandle.mapSize;
+      this->pChecked    = fileHandle.pChecked;
+      this->pFreeMap    = fileHandle.pFreeMap;
    }
 
    // Return a reference to this
@@ -90,13 +107,15 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
 //
 // Desc: Get the first page in a file
 //       The file handle must refer to an open file
+// In:   pinHint - how the client is going to access the file
 // Out:  pageHandle - becomes a handle to the first page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
-   return (GetNextPage((PageNum)-1, pageHandle));
+   return (GetNextPage((PageNum)-1, pageHandle, pinHint));
 }
 
 //
@@ -104,13 +123,15 @@ RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
 //
 // Desc: Get the last page in a file
 //       The file handle must refer to an open file
+// In:   pinHint - how the client is going to access the file
 // Out:  pageHandle - becomes a handle to the last page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
-   return (GetPrevPage((PageNum)hdr.numPages, pageHandle));
+   return (GetPrevPage((PageNum)hdr.numPages, pageHandle, pinHint));
 }
 
 //
@@ -120,11 +141,13 @@ RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
 //       The file handle must refer to an open file
 // In:   current - get the next valid page after this page number
 //       current can refer to a page that has been disposed
+//       pinHint - how the client is going to access the file
 // Out:  pageHandle - becomes a handle to the next page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
    int rc;               // return code
 
@@ -139,8 +162,14 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
    // Scan the file until a valid used page is found
    for (current++; current < hdr.numPages; current++) {
 
+      // Let the buffer manager read ahead if the file is read in order
+      // (the OS reads ahead of a mapped file)
+      if (pinHint != RANDOM_ACCESS && pMap == NULL &&
+            (rc = pBufferMgr->ReadAhead(unixfd, current, hdr.numPages)))
+         return (rc);
+
       // If this is a valid (used) page, we're done
-      if (!(rc = GetThisPage(current, pageHandle)))
+      if (!(rc = GetThisPage(current, pageHandle, pinHint)))
          return (0);
 
       // If unexpected error, return it
@@ -159,11 +188,13 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
 //       The file handle must refer to an open file
 // In:   current - get the prev valid page before this page number
 //       current can refer to a page that has been disposed
+//       pinHint - how the client is going to access the file
 // Out:  pageHandle - becomes a handle to the prev page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
    int rc;               // return code
 
@@ -179,7 +210,7 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
    for (current--; current >= 0; current--) {
 
       // If this is a valid (used) page, we're done
-      if (!(rc = GetThisPage(current, pageHandle)))
+      if (!(rc = GetThisPage(current, pageHandle, pinHint)))
          return (0);
 
       // If unexpected error, return it
@@ -197,12 +228,16 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
 // Desc: Get a specific page in a file
 //       The file handle must refer to an open file
 // In:   pageNum - the number of the page to get
+//       pinHint - how the client is going to access the file
 // Out:  pageHandle - becomes a handle to the this page of the file
 //                    this function modifies local var's in pageHandle
-//       The referenced page is pinned in the buffer pool.
-// Ret:  PF return code
+//       The referenced page is pinned in the buffer pool, unless the
+//       file is mapped: then pageHandle points into the mapping, and the
+//       page is checked against its checksum the first time it is used.
+// Ret:  PF_BADCHECKSUM if the page is damaged, or another PF return code
 //
-RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
    int  rc;               // return code
    char *pPageBuf;        // address of page in buffer pool
@@ -211,37 +246,210 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
-   // Validate page number
-   if (!IsValidPageNum(pageNum))
+   // Validate page number.  A free page is not read at all.
+   if (!IsValidPageNum(pageNum) || !IsUsedPage(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A mapped page is used where it is, once checked as the buffer
+   // manager checks the pages it reads
+   if (pMap != NULL) {
+      pPageBuf = pMap + PF_PageOffset(pageNum, hdr.pageSize);
+      unsigned char bit = 1 << (pageNum % 8);
+      if (!(__atomic_load_n(&pChecked[pageNum / 8], __ATOMIC_RELAXED) & bit)) {
+         if (!PF_VerifyChecksum(pPageBuf, hdr.pageSize))
+            return (PF_BADCHECKSUM);
+         __atomic_fetch_or(&pChecked[pageNum / 8], bit, __ATOMIC_RELAXED);
+      }
+   }
+
    // Get this page from the buffer manager
-   if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf)))
+   else if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf, TRUE,
+         pinHint)))
       return (rc);
 
-   // If the page is valid, then set pageHandle to this page and return ok
-   if (((PF_PageHdr*)pPageBuf)->nextFree == PF_PAGE_USED) {
+   // Set the pageHandle local variables
+   pageHandle.pageNum = pageNum;
+   pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+
+   // Return ok
+   return (0);
+}
+
+//
+// GetThesePages
+//
+// Desc: Get several specific pages of a file at once.  The pages that
+//       are not in the buffer pool are read together, each run of
+//       consecutive pages with a single read.  Either all the pages are
+//       pinned, or none is.
+//       The file handle must refer to an open file
+// In:   pageNums - the numbers of the pages to get
+//       numPages - number of entries in pageNums
+//       pinHint - how the client is going to access the file
+// Out:  pageHandles - pageHandles[i] becomes a handle to page pageNums[i]
+//       The referenced pages are pinned in the buffer pool.
+// Ret:  PF_INVALIDPAGE if one of the pages is not a valid (used) page, or
+//       another PF return code
+//
+RC PF_FileHandle::GetThesePages(const PageNum *pageNums, int numPages,
+      PF_PageHandle *pageHandles, ClientHint pinHint) const
+{
+   int  rc;               // return code
+   int  i;
+   char **ppPageBufs;     // addresses of pages in buffer pool
+
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
 
-      // Set the pageHandle local variables
-      pageHandle.pageNum = pageNum;
-      pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+   // Validate page numbers
+   for (i = 0; i < numPages; i++)
+      if (!IsValidPageNum(pageNums[i]) || !IsUsedPage(pageNums[i]))
+         return (PF_INVALIDPAGE);
 
-      // Return ok
+   // Mapped pages are used where they are
+   if (pMap != NULL) {
+      for (i = 0; i < numPages; i++)
+         if ((rc = GetThisPage(pageNums[i], pageHandles[i], pinHint)))
+            return (rc);
       return (0);
    }
 
-   // If the page is *not* a valid one, then unpin the page
-   if ((rc = UnpinPage(pageNum)))
+   // Get the pages from the buffer manager
+   ppPageBufs = new char *[numPages];
+   if (!(rc = pBufferMgr->GetPages(unixfd, pageNums, numPages, ppPageBufs,
+         pinHint))) {
+      for (i = 0; i < numPages; i++) {
+         pageHandles[i].pageNum = pageNums[i];
+         pageHandles[i].pPageData = ppPageBufs[i] + sizeof(PF_PageHdr);
+      }
+   }
+
+   delete [] ppPageBufs;
+   return (rc);
+}
+
+//
+// GetNextPages
+//
+// Desc: Get up to maxPages of the next (valid) pages after current at
+//       once.  The pages are found in the free-space map, and read
+//       together as by GetThesePages.  Fewer than maxPages pages are
+//       returned if the buffer pool has too few free frames, or at the
+//       end of the file.
+//       The file handle must refer to an open file
+// In:   current - get the valid pages after this page number
+//       current can refer to a page that has been disposed
+//       maxPages - maximum number of pages to get
+//       pinHint - how the client is going to access the file
+// Out:  pageHandles - the first numPages entries become handles to the
+//       pages, in page order.  The pages are pinned in the buffer pool.
+//       numPages - number of pages gotten
+// Ret:  PF_EOF if there is no valid page after current, or another PF
+//       return code
+//
+RC PF_FileHandle::GetNextPages(PageNum current, int maxPages,
+      PF_PageHandle *pageHandles, int &numPages, ClientHint pinHint) const
+{
+   int     rc = 0;        // return code
+   int     i, n;
+   PageNum *pageNums;     // pages read together
+   char    **ppPageBufs;  // addresses of pages in buffer pool
+
+   numPages = 0;
+
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number (note that -1 is acceptable here)
+   if (current != -1 && !IsValidPageNum(current))
+      return (PF_INVALIDPAGE);
+
+   if (maxPages < 1)
+      maxPages = 1;
+
+   // Mapped pages are used where they are
+   if (pMap != NULL) {
+      while (numPages < maxPages &&
+            !(rc = GetNextPage(current, pageHandles[numPages], pinHint)))
+         pageHandles[numPages++].GetPageNum(current);
+      return ((rc == PF_EOF && numPages > 0) ? 0 : rc);
+   }
+
+   pageNums = new PageNum[maxPages];
+   ppPageBufs = new char *[maxPages];
+
+   // Find the next used pages, and let the buffer manager read ahead if
+   // the file is read in order
+   for (n = 0, current++; n < maxPages && current < hdr.numPages; current++) {
+      if (!IsUsedPage(current))
+         continue;
+      if (pinHint != RANDOM_ACCESS &&
+            (rc = pBufferMgr->ReadAhead(unixfd, current, hdr.numPages)))
+         break;
+      pageNums[n++] = current;
+   }
+
+   // If the buffer pool cannot hold all the pages, fall back to one page
+   if (!rc && n > 0 &&
+         (rc = pBufferMgr->GetPages(unixfd, pageNums, n, ppPageBufs,
+            pinHint)) == PF_NOBUF && n > 1) {
+      n = 1;
+      rc = pBufferMgr->GetPages(unixfd, pageNums, n, ppPageBufs, pinHint);
+   }
+
+   if (!rc) {
+      for (i = 0; i < n; i++) {
+         pageHandles[i].pageNum = pageNums[i];
+         pageHandles[i].pPageData = ppPageBufs[i] + sizeof(PF_PageHdr);
+      }
+      numPages = n;
+   }
+
+   delete [] pageNums;
+   delete [] ppPageBufs;
+
+   if (rc)
       return (rc);
 
-   return (PF_INVALIDPAGE);
+   // No valid (used) page found
+   return (numPages > 0 ? 0 : PF_EOF);
+}
+
+//
+// UnpinPages
+//
+// Desc: Unpin the pages referred to by a set of page handles, e.g. those
+//       gotten by GetThesePages or GetNextPages.  All the pages are
+//       unpinned even if some of them cannot be.
+//       The file handle must refer to an open file.
+// In:   pageHandles - handles of the pages to unpin
+//       numPages - number of entries in pageHandles
+// Ret:  PF return code (the first error, if any)
+//
+RC PF_FileHandle::UnpinPages(const PF_PageHandle *pageHandles,
+      int numPages) const
+{
+   RC      rc;
+   RC      firstRc = 0;
+   PageNum pageNum;
+
+   for (int i = 0; i < numPages; i++)
+      if (((rc = pageHandles[i].GetPageNum(pageNum)) ||
+            (rc = UnpinPage(pageNum))) && !firstRc)
+         firstRc = rc;
+
+   return (firstRc);
 }
 
 //
 // AllocatePage
 //
 // Desc: Allocate a new page in the file (may get a page which was
-//       previously disposed)
+//       previously disposed).  The free page with the lowest number is
+//       taken, so that the used pages of the file stay together in page
+//       order on disk.  The page is not read.
 //       The file handle must refer to an open file
 // Out:  pageHandle - becomes a handle to the newly-allocated page
 //                    this function modifies local var's in pageHandle
@@ -257,44 +465,57 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
-   // If the free list isn't empty...
-   if (hdr.firstFree != PF_PAGE_LIST_END) {
-      pageNum = hdr.firstFree;
-
-      // Get the first free page into the buffer
-      if ((rc = pBufferMgr->GetPage(unixfd,
-            pageNum,
-            &pPageBuf)))
-         return (rc);
-
-      // Set the first free page to the next page on the free list
-      hdr.firstFree = ((PF_PageHdr*)pPageBuf)->nextFree;
+   // A mapped file is read only
+   if (pMap != NULL)
+      return (PF_READONLY);
+
+   // Find the first free page in the map, if any
+   pthread_mutex_lock(&pFreeMap->mutex);
+   for (pageNum = pFreeMap->firstFree; pageNum < hdr.numPages; pageNum++) {
+      if (pageNum % 8 == 0 && pFreeMap->pBits[pageNum / 8] == 0xFF)
+         pageNum += 7;
+      else if (!IsUsedPage(pageNum))
+         break;
    }
-   else {
 
-      // The free list is empty...
+   // Otherwise add a page at the end of the file, and a map page first if
+   // the page starts a new group.  Disk space is preallocated for a few
+   // pages at a time.
+   if (pageNum >= hdr.numPages) {
       pageNum = hdr.numPages;
-
-      // Allocate a new page in the file
-      if ((rc = pBufferMgr->AllocatePage(unixfd,
-            pageNum,
-            &pPageBuf)))
+      if ((pageNum >= hdr.numAllocated && (rc = ExtendFile())) ||
+            (PF_GroupStart(pageNum, hdr.pageSize) && (rc = GrowMap()))) {
+         pthread_mutex_unlock(&pFreeMap->mutex);
          return (rc);
-
-      // Increment the number of pages for this file
+      }
       hdr.numPages++;
+      bHdrChanged = TRUE;
    }
 
-   // Mark the header as changed
-   bHdrChanged = TRUE;
-
    // Mark this page as used
-   ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
+   SetUsedPage(pageNum, TRUE);
+   pFreeMap->firstFree = pageNum + 1;
+   pthread_mutex_unlock(&pFreeMap->mutex);
+
+   // Get a buffer frame for the page.  Its old contents do not matter,
+   // but a disposed page may still be in the buffer pool.
+   if ((rc = pBufferMgr->AllocatePage(unixfd, pageNum, &pPageBuf)) ==
+         PF_PAGEINBUF)
+      rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf);
+   if (rc) {
+      pthread_mutex_lock(&pFreeMap->mutex);
+      SetUsedPage(pageNum, FALSE);
+      if (pageNum < pFreeMap->firstFree)
+         pFreeMap->firstFree = pageNum;
+      pthread_mutex_unlock(&pFreeMap->mutex);
+      return (rc);
+   }
+   ((PF_PageHdr *)pPageBuf)->checksum = PF_PAGE_USED;
 
    // Zero out the page data
-   memset(pPageBuf + sizeof(PF_PageHdr), 0, PF_PAGE_SIZE);
+   memset(pPageBuf + sizeof(PF_PageHdr), 0, hdr.pageSize - sizeof(PF_PageHdr));
 
-   // Mark the page dirty because we changed the next pointer
+   // Mark the page dirty because its contents changed
    if ((rc = MarkDirty(pageNum)))
       return (rc);
 
@@ -309,7 +530,7 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
 //
 // DisposePage
 //
-// Desc: Dispose of a page
+// Desc: Dispose of a page.  The page is only marked free in the map.
 //       The file handle must refer to an open file
 //       PF_PageHandle objects referring to this page should not be used
 //       after making this call.
@@ -329,37 +550,31 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
-   // Get the page (but don't re-pin it if it's already pinned)
-   if ((rc = pBufferMgr->GetPage(unixfd,
-         pageNum,
-         &pPageBuf,
-         FALSE)))
-      return (rc);
+   // A mapped file is read only
+   if (pMap != NULL)
+      return (PF_READONLY);
 
    // Page must be valid (used)
-   if (((PF_PageHdr *)pPageBuf)->nextFree != PF_PAGE_USED) {
-
-      // Unpin the page
-      if ((rc = UnpinPage(pageNum)))
-         return (rc);
-
-      // Return page already free
+   if (!IsUsedPage(pageNum))
       return (PF_PAGEFREE);
-   }
-
-   // Put this page onto the free list
-   ((PF_PageHdr *)pPageBuf)->nextFree = hdr.firstFree;
-   hdr.firstFree = pageNum;
-   bHdrChanged = TRUE;
 
-   // Mark the page dirty because we changed the next pointer
-   if ((rc = MarkDirty(pageNum)))
+   // The page must not be pinned (get it, but don't re-pin it if it's
+   // already pinned)
+   if ((rc = pBufferMgr->GetPage(unixfd,
+         pageNum,
+         &pPageBuf,
+         FALSE)))
       return (rc);
-
-   // Unpin the page
    if ((rc = UnpinPage(pageNum)))
       return (rc);
 
+   // Mark the page free in the map
+   pthread_mutex_lock(&pFreeMap->mutex);
+   SetUsedPage(pageNum, FALSE);
+   if (pageNum < pFreeMap->firstFree)
+      pFreeMap->firstFree = pageNum;
+   pthread_mutex_unlock(&pFreeMap->mutex);
+
    // Return ok
    return (0);
 }
@@ -384,6 +599,10 @@ RC PF_FileHandle::MarkDirty(PageNum pageNum) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A mapped file is read only
+   if (pMap != NULL)
+      return (PF_READONLY);
+
    // Tell the buffer manager to mark the page dirty
    return (pBufferMgr->MarkDirty(unixfd, pageNum));
 }
@@ -409,10 +628,69 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // Pages of a mapped file are not pinned
+   if (pMap != NULL)
+      return (0);
+
    // Tell the buffer manager to unpin the page
    return (pBufferMgr->UnpinPage(unixfd, pageNum));
 }
 
+//
+// LatchPage
+//
+// Desc: Latch a page that is pinned by this thread.  Threads sharing a
+//       page take the shared latch to read it, and the exclusive latch to
+//       change it (and mark it dirty).  Waits until the latch is granted.
+//       The file handle must refer to an open file.
+// In:   pageNum - number of the page to latch
+//       bExclusive - TRUE for the exclusive latch
+// Ret:  PF return code
+//
+RC PF_FileHandle::LatchPage(PageNum pageNum, int bExclusive) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // Pages of a mapped file never change
+   if (pMap != NULL)
+      return (bExclusive ? PF_READONLY : 0);
+
+   // Tell the buffer manager to latch the page
+   return (pBufferMgr->LatchPage(unixfd, pageNum, bExclusive));
+}
+
+//
+// UnlatchPage
+//
+// Desc: Release the latch taken on a page by LatchPage.  A page is
+//       unlatched before it is unpinned.
+// In:   pageNum - number of the page to unlatch
+// Ret:  PF return code
+//
+RC PF_FileHandle::UnlatchPage(PageNum pageNum) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // Pages of a mapped file are not latched
+   if (pMap != NULL)
+      return (0);
+
+   // Tell the buffer manager to release the latch
+   return (pBufferMgr->UnlatchPage(unixfd, pageNum));
+}
+
 //
 // FlushPages
 //
@@ -423,31 +701,23 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
 //
 RC PF_FileHandle::FlushPages() const
 {
+   RC rc;
+
    // File must be open
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
-   // If the file header has changed, write it back to the file
-   if (bHdrChanged) {
-
-      // First seek to the appropriate place
-      if (lseek(unixfd, 0, L_SET) < 0)
-         return (PF_UNIX);
-
-      // Write header
-      int numBytes = write(unixfd,
-            (char *)&hdr,
-            sizeof(PF_FileHdr));
-      if (numBytes < 0)
-         return (PF_UNIX);
-      if (numBytes != sizeof(PF_FileHdr))
-         return (PF_HDRWRITE);
+   // If the free-space map or the file header has changed, write it back
+   // to the file
+   pthread_mutex_lock(&pFreeMap->mutex);
+   rc = WriteChanged();
+   pthread_mutex_unlock(&pFreeMap->mutex);
+   if (rc)
+      return (rc);
 
-      // This function is declared const, but we need to change the
-      // bHdrChanged variable.  Cast away the constness
-      PF_FileHandle *dummy = (PF_FileHandle *)this;
-      dummy->bHdrChanged = FALSE;
-   }
+   // A mapped file has no pages in the buffer pool
+   if (pMap != NULL)
+      return (0);
 
    // Tell Buffer Manager to flush pages
    return (pBufferMgr->FlushPages(unixfd));
@@ -465,36 +735,342 @@ RC PF_FileHandle::FlushPages() const
 //
 RC PF_FileHandle::ForcePages(PageNum pageNum) const
 {
+   RC rc;
+
    // File must be open
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
-   // If the file header has changed, write it back to the file
-   if (bHdrChanged) {
+   // If the free-space map or the file header has changed, write it back
+   // to the file
+   pthread_mutex_lock(&pFreeMap->mutex);
+   rc = WriteChanged();
+   pthread_mutex_unlock(&pFreeMap->mutex);
+   if (rc)
+      return (rc);
 
-      // First seek to the appropriate place
-      if (lseek(unixfd, 0, L_SET) < 0)
-         return (PF_UNIX);
+   // A mapped file has no pages in the buffer pool
+   if (pMap != NULL)
+      return (0);
 
-      // Write header
-      int numBytes = write(unixfd,
-            (char *)&hdr,
-            sizeof(PF_FileHdr));
-      if (numBytes < 0)
-         return (PF_UNIX);
-      if (numBytes != sizeof(PF_FileHdr))
-         return (PF_HDRWRITE);
+   // Tell Buffer Manager to Force the page
+   return (pBufferMgr->ForcePages(unixfd, pageNum));
+}
+
+//
+// VerifyPage
+//
+// Desc: Check the copy on disk of a used page against its checksum.  The
+//       page is read into a buffer of its own, not into the buffer pool,
+//       so a newer copy of the page may be in the buffer pool: it is
+//       checksummed when it is written.
+//       The file handle must refer to an open file
+// In:   pageNum - number of the page to check
+// Ret:  PF_BADCHECKSUM if the page is damaged or was partly written,
+//       PF_PAGEFREE if the page is free, or another PF return code
+//
+RC PF_FileHandle::VerifyPage(PageNum pageNum) const
+{
+   char *pPageBuf;
+   RC   rc = 0;
+
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // A free page holds nothing to check
+   pthread_mutex_lock(&pFreeMap->mutex);
+   int bUsed = IsUsedPage(pageNum);
+   pthread_mutex_unlock(&pFreeMap->mutex);
+   if (!bUsed)
+      return (PF_PAGEFREE);
+
+   // A mapped page is checked where it is
+   if (pMap != NULL)
+      return (PF_VerifyChecksum(pMap + PF_PageOffset(pageNum, hdr.pageSize),
+            hdr.pageSize) ? 0 : PF_BADCHECKSUM);
+
+   if ((pPageBuf = PF_AllocAligned(hdr.pageSize)) == NULL)
+      return (PF_NOMEM);
+
+   ssize_t numBytes = pread(unixfd, pPageBuf, hdr.pageSize,
+         PF_PageOffset(pageNum, hdr.pageSize));
+   if (numBytes < 0)
+      rc = PF_UNIX;
+   else if (numBytes != hdr.pageSize)
+      rc = PF_INCOMPLETEREAD;
+   else if (!PF_VerifyChecksum(pPageBuf, hdr.pageSize))
+      rc = PF_BADCHECKSUM;
+
+   PF_FreeAligned(pPageBuf);
+   return (rc);
+}
+
+//
+// ReadHdr
+//
+// Desc: Internal.  Read the file header from the start of the file.  A
+//       file opened with O_DIRECT can only be read in aligned blocks, so
+//       its whole header page is read into an aligned buffer.
+// Ret:  PF return code
+//
+RC PF_FileHandle::ReadHdr()
+{
+   int numBytes;
+
+   if (!bDirect)
+      numBytes = pread(unixfd, (char *)&hdr, sizeof(PF_FileHdr), 0);
+   else {
+      char *pHdrBuf;
+      if ((pHdrBuf = PF_AllocAligned(PF_FILE_HDR_SIZE)) == NULL)
+         return (PF_NOMEM);
+      numBytes = pread(unixfd, pHdrBuf, PF_FILE_HDR_SIZE, 0);
+      if (numBytes == PF_FILE_HDR_SIZE) {
+         memcpy(&hdr, pHdrBuf, sizeof(PF_FileHdr));
+         numBytes = sizeof(PF_FileHdr);
+      }
+      PF_FreeAligned(pHdrBuf);
+   }
+
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != sizeof(PF_FileHdr))
+      return (PF_HDRREAD);
+
+   return (0);
+}
+
+//
+// WriteChanged
+//
+// Desc: Internal.  Write back the free-space map and the file header if
+//       they have changed: the map first, since the header must not count
+//       pages that the map on disk does not cover.  The map mutex must be
+//       held, so that AllocatePage does not change them meanwhile (the
+//       background writer may force the log from another thread).
+// Ret:  PF return code
+//
+RC PF_FileHandle::WriteChanged() const
+{
+   RC rc;
+
+   if (pFreeMap->bChanged && (rc = WriteMap()))
+      return (rc);
+   if (bHdrChanged && (rc = WriteHdr()))
+      return (rc);
+   return (0);
+}
+
+//
+// WriteHdr
+//
+// Desc: Internal.  Write the file header at the start of the file, and
+//       mark it unchanged.  A file opened with O_DIRECT is written a whole
+//       (aligned) header page at a time; the rest of the page is zeroed,
+//       as it was when the file was created.  The map mutex must be held.
+// Ret:  PF return code
+//
+RC PF_FileHandle::WriteHdr() const
+{
+   RC   rc = 0;
+   int  numBytes;
+   char *pHdrBuf = NULL;
+
+   if (bDirect && (pHdrBuf = PF_AllocAligned(PF_FILE_HDR_SIZE)) == NULL)
+      return (PF_NOMEM);
 
+   if (!bDirect)
+      numBytes = pwrite(unixfd, (char *)&hdr, sizeof(PF_FileHdr), 0);
+   else {
+      memset(pHdrBuf, 0, PF_FILE_HDR_SIZE);
+      memcpy(pHdrBuf, &hdr, sizeof(PF_FileHdr));
+      numBytes = pwrite(unixfd, pHdrBuf, PF_FILE_HDR_SIZE, 0);
+      if (numBytes == PF_FILE_HDR_SIZE)
+         numBytes = sizeof(PF_FileHdr);
+   }
+
+   if (numBytes < 0)
+      rc = PF_UNIX;
+   else if (numBytes != sizeof(PF_FileHdr))
+      rc = PF_HDRWRITE;
+   else {
       // This function is declared const, but we need to change the
       // bHdrChanged variable.  Cast away the constness
       PF_FileHandle *dummy = (PF_FileHandle *)this;
       dummy->bHdrChanged = FALSE;
    }
 
-   // Tell Buffer Manager to Force the page
-   return (pBufferMgr->ForcePages(unixfd, pageNum));
+   PF_FreeAligned(pHdrBuf);
+   return (rc);
+}
+
+//
+// ReadMap
+//
+// Desc: Internal.  Read the map pages of the file into its free-space
+//       map, which must be allocated.  Called once the header is read.
+// Ret:  PF return code
+//
+RC PF_FileHandle::ReadMap()
+{
+   int numBytes;
+   int group;
+
+   pFreeMap->numGroups = (hdr.numPages + PF_GroupPages(hdr.pageSize) - 1) /
+      PF_GroupPages(hdr.pageSize);
+   pFreeMap->pBits = NULL;
+   pFreeMap->bChanged = FALSE;
+
+   if (pFreeMap->numGroups > 0 &&
+         (pFreeMap->pBits = (unsigned char *)PF_AllocAligned(
+            pFreeMap->numGroups * hdr.pageSize)) == NULL)
+      return (PF_NOMEM);
+
+   for (group = 0; group < pFreeMap->numGroups; group++) {
+      numBytes = pread(unixfd, pFreeMap->pBits + group * hdr.pageSize,
+            hdr.pageSize, PF_MapOffset(group, hdr.pageSize));
+      if (numBytes < 0)
+         return (PF_UNIX);
+      if (numBytes != hdr.pageSize)
+         return (PF_HDRREAD);
+   }
+
+   // Look for free pages from the first page on
+   pFreeMap->firstFree = 0;
+
+   return (0);
+}
+
+//
+// WriteMap
+//
+// Desc: Internal.  Write the free-space map back to the map pages of the
+//       file, and mark it unchanged.  The map mutex must be held.
+// Ret:  PF return code
+//
+RC PF_FileHandle::WriteMap() const
+{
+   RC  rc = 0;
+   int numBytes;
+   int group;
+
+   for (group = 0; !rc && group < pFreeMap->numGroups; group++) {
+      numBytes = pwrite(unixfd, pFreeMap->pBits + group * hdr.pageSize,
+            hdr.pageSize, PF_MapOffset(group, hdr.pageSize));
+      if (numBytes < 0)
+         rc = PF_UNIX;
+      else if (numBytes != hdr.pageSize)
+         rc = PF_HDRWRITE;
+   }
+   if (!rc)
+      pFreeMap->bChanged = FALSE;
+
+   return (rc);
 }
 
+//
+// GrowMap
+//
+// Desc: Internal.  Add an empty map page to the free-space map, for the
+//       group of pages that starts at the end of the file.  The map mutex
+//       must be held.
+// Ret:  PF return code
+//
+RC PF_FileHandle::GrowMap()
+{
+   unsigned char *pBits;
+   long size = (long)pFreeMap->numGroups * hdr.pageSize;
+
+   if ((pBits = (unsigned char *)PF_AllocAligned(size + hdr.pageSize)) ==
+         NULL)
+      return (PF_NOMEM);
+   if (size > 0)
+      memcpy(pBits, pFreeMap->pBits, size);
+   memset(pBits + size, 0, hdr.pageSize);
+
+   PF_FreeAligned((char *)pFreeMap->pBits);
+   pFreeMap->pBits = pBits;
+   pFreeMap->numGroups++;
+   pFreeMap->bChanged = TRUE;
+
+   return (0);
+}
+
+//
+// ExtendFile
+//
+// Desc: Internal.  Preallocate disk space at the end of the file for the
+//       next pages to be added (and the map pages among them), so that
+//       the file does not grow, and get fragmented, a page at a time.  A
+//       file grows by as many pages as it has, up to PF_EXTENT_SIZE
+//       bytes.  File systems that cannot preallocate space still grow
+//       the file as its pages are written.  The map mutex must be held.
+// Ret:  PF return code
+//
+RC PF_FileHandle::ExtendFile()
+{
+   int   numPages;        // # of pages to preallocate
+   off_t start, end;      // bytes to preallocate
+
+   if (hdr.numAllocated < hdr.numPages)
+      hdr.numAllocated = hdr.numPages;
+
+   numPages = hdr.numPages < PF_EXTENT_SIZE / hdr.pageSize ?
+      hdr.numPages : PF_EXTENT_SIZE / hdr.pageSize;
+   if (numPages < 1)
+      numPages = 1;
+
+   start = PF_GroupStart(hdr.numAllocated, hdr.pageSize) ?
+      PF_MapOffset(hdr.numAllocated / PF_GroupPages(hdr.pageSize),
+         hdr.pageSize) :
+      PF_PageOffset(hdr.numAllocated, hdr.pageSize);
+   end = PF_PageOffset(hdr.numAllocated + numPages - 1, hdr.pageSize) +
+      hdr.pageSize;
+
+#ifdef __linux__
+   if (fallocate(unixfd, 0, start, end - start) < 0 &&
+         errno != EOPNOTSUPP && errno != ENOSYS)
+      return (PF_UNIX);
+#endif
+
+   hdr.numAllocated += numPages;
+   bHdrChanged = TRUE;
+
+   return (0);
+}
+
+//
+// IsUsedPage
+//
+// Desc: Internal.  Return TRUE if page pageNum is used according to the
+//       free-space map, FALSE if it is free
+// In:   pageNum - page number to test; must be valid
+// Ret:  TRUE or FALSE
+//
+int PF_FileHandle::IsUsedPage(PageNum pageNum) const
+{
+   return ((pFreeMap->pBits[pageNum / 8] >> (pageNum % 8)) & 1);
+}
+
+//
+// SetUsedPage
+//
+// Desc: Internal.  Mark page pageNum used or free in the free-space map
+// In:   pageNum - page number; its group must have a map page
+//       bUsed - TRUE for used, FALSE for free
+//
+void PF_FileHandle::SetUsedPage(PageNum pageNum, int bUsed)
+{
+   if (bUsed)
+      pFreeMap->pBits[pageNum / 8] |= (1 << (pageNum % 8));
+   else
+      pFreeMap->pBits[pageNum / 8] &= ~(1 << (pageNum % 8));
+   pFreeMap->bChanged = TRUE;
+}
 
 //
 // IsValidPageNum
@@ -13,19 +13,21 @@
 //
 // Desc: Constructor for PF_HashTable object, which allows search, insert,
 //       and delete of hash table entries.
-// In:   numBuckets - number of hash table buckets
+// In:   numEntries - number of entries the table is expected to hold
 //
-PF_HashTable::PF_HashTable(int _numBuckets)
+PF_HashTable::PF_HashTable(int _numEntries)
 {
-  // Initialize numBuckets local variable from parameter
-  this->numBuckets = _numBuckets;
+  // Size the array from the expected number of entries
+  numSlots = TableSize(_numEntries);
+  mask = numSlots - 1;
+  numEntries = 0;
 
   // Allocate memory for hash table
-  hashTable = new PF_HashEntry* [numBuckets];
+  hashTable = new PF_HashEntry [numSlots];
 
-  // Initialize all buckets to empty
-  for (int i = 0; i < numBuckets; i++)
-    hashTable[i] = NULL;
+  // Initialize all slots to empty
+  for (int i = 0; i < numSlots; i++)
+    hashTable[i].slot = PF_HASH_EMPTY;
 }
 
 //
@@ -35,20 +37,82 @@ PF_HashTable::PF_HashTable(int _numBuckets)
 //
 PF_HashTable::~PF_HashTable()
 {
-  // Clear out all buckets
-  for (int i = 0; i < numBuckets; i++) {
+  // Entries live in the array itself, so just delete it
+  delete[] hashTable;
+}
 
-    // Delete all entries in the bucket
-    PF_HashEntry *entry = hashTable[i];
-    while (entry != NULL) {
-      PF_HashEntry *next = entry->next;
-      delete entry;
-      entry = next;
-    }
-  }
+//
+// TableSize
+//
+// Desc: Internal.  Return the array size to use for numEntries entries:
+//       the smallest power of two that is at least twice numEntries.
+// In:   numEntries - number of entries to hold
+// Ret:  array size
+//
+int PF_HashTable::TableSize(int _numEntries)
+{
+  int size = 16;
+  while (size < 2 * _numEntries)
+    size <<= 1;
+  return (size);
+}
 
-  // Finally delete the hash table
-  delete[] hashTable;
+//
+// Mix
+//
+// Desc: Mix fd and pageNum into a 64-bit key and scramble it (the
+//       finalizer of MurmurHash3), so that consecutive pages of
+//       different files do not collide.  Every bit of the result depends
+//       on every bit of the key.
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  scrambled key
+//
+unsigned long long PF_HashTable::Mix(int fd, PageNum pageNum)
+{
+  unsigned long long key = ((unsigned long long)(unsigned int)fd << 32) |
+                           (unsigned int)pageNum;
+
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+
+  return (key);
+}
+
+//
+// Hash
+//
+// Desc: Internal.  Hash function: the low bits of the scrambled key.
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  index into the array
+//
+int PF_HashTable::Hash(int fd, PageNum pageNum) const
+{
+  return ((int)(Mix(fd, pageNum) & mask));
+}
+
+//
+// Probe
+//
+// Desc: Internal.  Walk the probe sequence of (fd, pageNum).
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  index of the entry for fd and pageNum if there is one, otherwise
+//       index of the empty slot where the search stopped
+//
+int PF_HashTable::Probe(int fd, PageNum pageNum) const
+{
+  int i = Hash(fd, pageNum);
+
+  while (hashTable[i].slot != PF_HASH_EMPTY &&
+         (hashTable[i].fd != fd || hashTable[i].pageNum != pageNum))
+    i = (i + 1) & mask;
+
+  return (i);
 }
 
 //
@@ -62,26 +126,15 @@ PF_HashTable::~PF_HashTable()
 //
 RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  if (bucket<0)
-     return (PF_HASHNOTFOUND);
-
-  // Go through the linked list of this bucket
-  for (PF_HashEntry *entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum) {
-
-      // Found it
-      slot = entry->slot;
-      return (0);
-    }
-  }
+  int i = Probe(fd, pageNum);
 
   // Didn't find it
-  return (PF_HASHNOTFOUND);
+  if (hashTable[i].slot == PF_HASH_EMPTY)
+    return (PF_HASHNOTFOUND);
+
+  // Found it
+  slot = hashTable[i].slot;
+  return (0);
 }
 
 //
@@ -95,31 +148,23 @@ RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 //
 RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
+  RC rc;
 
-  // Check entry doesn't already exist in the bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      return (PF_HASHPAGEEXIST);
-  }
+  // Keep the table at most half full
+  if (2 * (numEntries + 1) > numSlots)
+    if ((rc = Resize(numEntries + 1)))
+      return (rc);
 
-  // Allocate memory for new hash entry
-  if ((entry = new PF_HashEntry) == NULL)
-    return (PF_NOMEM);
+  // Check entry doesn't already exist
+  int i = Probe(fd, pageNum);
+  if (hashTable[i].slot != PF_HASH_EMPTY)
+    return (PF_HASHPAGEEXIST);
 
-  // Insert entry at head of list for this bucket
-  entry->fd = fd;
-  entry->pageNum = pageNum;
-  entry->slot = slot;
-  entry->next = hashTable[bucket];
-  entry->prev = NULL;
-  if (hashTable[bucket] != NULL)
-    hashTable[bucket]->prev = entry;
-  hashTable[bucket] = entry;
+  // Fill in the empty slot that ended the probe sequence
+  hashTable[i].fd = fd;
+  hashTable[i].pageNum = pageNum;
+  hashTable[i].slot = slot;
+  numEntries++;
 
   // Return ok
   return (0);
@@ -133,35 +178,255 @@ RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 //       pagenum - page number
 // Ret:  PF return code
 //
+// Notes: Entries after the deleted one whose probe sequence passes
+// through the hole are moved back into it, so that searches never stop
+// early at an empty slot.
+//
 RC PF_HashTable::Delete(int fd, PageNum pageNum)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
+  int i = Probe(fd, pageNum);
 
-  // Find the entry is in this bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
+  // Did we find hash entry?
+  if (hashTable[i].slot == PF_HASH_EMPTY)
+    return (PF_HASHNOTFOUND);
+
+  // Remove this entry, shifting back the rest of the cluster
+  int hole = i;
+  int j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (hashTable[j].slot == PF_HASH_EMPTY)
       break;
+
+    // The entry at j may fill the hole only if its home slot is not
+    // (cyclically) between the hole and j
+    int home = Hash(hashTable[j].fd, hashTable[j].pageNum);
+    if (((j - home) & mask) >= ((j - hole) & mask)) {
+      hashTable[hole] = hashTable[j];
+      hole = j;
+    }
   }
+  hashTable[hole].slot = PF_HASH_EMPTY;
+  numEntries--;
 
-  // Did we find hash entry?
-  if (entry == NULL)
-    return (PF_HASHNOTFOUND);
+  // Return ok
+  return (0);
+}
+
+//
+// Resize
+//
+// Desc: Change the size of the table so that it can hold numEntries
+//       entries, and rehash every entry into the new array.  The table
+//       is never made too small for the entries it holds.
+// In:   _numEntries - number of entries the table should hold
+// Ret:  PF return code
+//
+RC PF_HashTable::Resize(int _numEntries)
+{
+  if (_numEntries <= 0)
+    return (PF_TOOSMALL);
+  if (_numEntries < numEntries)
+    _numEntries = numEntries;
 
-  // Remove this entry
-  if (entry == hashTable[bucket])
-    hashTable[bucket] = entry->next;
-  if (entry->prev != NULL)
-    entry->prev->next = entry->next;
-  if (entry->next != NULL)
-    entry->next->prev = entry->prev;
-  delete entry;
+  // Allocate the new array
+  int newNumSlots = TableSize(_numEntries);
+  PF_HashEntry *newTable = new PF_HashEntry [newNumSlots];
+  for (int i = 0; i < newNumSlots; i++)
+    newTable[i].slot = PF_HASH_EMPTY;
 
-  // Return ook
+  // Switch to the new array and reinsert the old entries
+  PF_HashEntry *oldTable = hashTable;
+  int oldNumSlots = numSlots;
+  hashTable = newTable;
+  numSlots = newNumSlots;
+  mask = numSlots - 1;
+  for (int i = 0; i < oldNumSlots; i++) {
+    if (oldTable[i].slot == PF_HASH_EMPTY)
+      continue;
+    hashTable[Probe(oldTable[i].fd, oldTable[i].pageNum)] = oldTable[i];
+  }
+
+  // Delete the old array
+  delete[] oldTable;
+
+  // Return ok
   return (0);
 }
 
+//
+// PF_PageTable
+//
+// Desc: Constructor for PF_PageTable object.  The expected entries are
+//       spread evenly over the partitions.
+// In:   numEntries - number of entries the table is expected to hold
+//
+PF_PageTable::PF_PageTable(int numEntries)
+{
+  for (int i = 0; i < PF_PAGE_PARTITIONS; i++) {
+    pthread_mutex_init(&parts[i].mutex, NULL);
+    parts[i].pTable = new PF_HashTable(PartitionSize(numEntries));
+  }
+}
+
+//
+// ~PF_PageTable
+//
+// Desc: Destructor
+//
+PF_PageTable::~PF_PageTable()
+{
+  for (int i = 0; i < PF_PAGE_PARTITIONS; i++) {
+    delete parts[i].pTable;
+    pthread_mutex_destroy(&parts[i].mutex);
+  }
+}
+
+//
+// Partition
+//
+// Desc: Return the partition of an entry: the high bits of
+//       its scrambled key, which are independent of the low bits used
+//       by the partition's table.
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  partition number
+//
+int PF_PageTable::Partition(int fd, PageNum pageNum)
+{
+  return ((int)(PF_HashTable::Mix(fd, pageNum) >> 32) &
+          (PF_PAGE_PARTITIONS - 1));
+}
+
+//
+// PartitionSize
+//
+// Desc: Internal.  Number of entries to size each partition for.  Some
+//       slack is left since entries do not spread perfectly evenly; a
+//       partition that fills up grows by itself.
+// In:   numEntries - number of entries in the whole table
+// Ret:  number of entries per partition
+//
+int PF_PageTable::PartitionSize(int numEntries)
+{
+  return (2 * numEntries / PF_PAGE_PARTITIONS + 1);
+}
+
+//
+// Lock
+//
+// Desc: Lock the partition of fd and pageNum
+// In:   fd - file descriptor
+//       pageNum - page number
+//
+void PF_PageTable::Lock(int fd, PageNum pageNum)
+{
+  pthread_mutex_lock(&parts[Partition(fd, pageNum)].mutex);
+}
+
+//
+// Unlock
+//
+// Desc: Unlock the partition of fd and pageNum
+// In:   fd - file descriptor
+//       pageNum - page number
+//
+void PF_PageTable::Unlock(int fd, PageNum pageNum)
+{
+  pthread_mutex_unlock(&parts[Partition(fd, pageNum)].mutex);
+}
+
+//
+// LockSet
+//
+// Desc: Lock a set of partitions, in increasing order so that threads
+//       locking overlapping sets do not deadlock
+// In:   partSet - bit i is set to lock partition i
+//
+void PF_PageTable::LockSet(unsigned int partSet)
+{
+  for (int i = 0; i < PF_PAGE_PARTITIONS; i++)
+    if (partSet & (1u << i))
+      pthread_mutex_lock(&parts[i].mutex);
+}
+
+//
+// UnlockSet
+//
+// Desc: Unlock a set of partitions locked by LockSet
+// In:   partSet - bit i is set to unlock partition i
+//
+void PF_PageTable::UnlockSet(unsigned int partSet)
+{
+  for (int i = 0; i < PF_PAGE_PARTITIONS; i++)
+    if (partSet & (1u << i))
+      pthread_mutex_unlock(&parts[i].mutex);
+}
 
+//
+// Find
+//
+// Desc: Find an entry.  The partition must be locked.
+// In:   fd - file descriptor
+//       pageNum - page number
+// Out:  slot - set to slot associated with fd and pageNum
+// Ret:  PF return code
+//
+RC PF_PageTable::Find(int fd, PageNum pageNum, int &slot)
+{
+  return (parts[Partition(fd, pageNum)].pTable->Find(fd, pageNum, slot));
+}
+
+//
+// Insert
+//
+// Desc: Insert an entry.  The partition must be locked.
+// In:   fd - file descriptor
+//       pageNum - page number
+//       slot - slot associated with fd and pageNum
+// Ret:  PF return code
+//
+RC PF_PageTable::Insert(int fd, PageNum pageNum, int slot)
+{
+  return (parts[Partition(fd, pageNum)].pTable->Insert(fd, pageNum, slot));
+}
+
+//
+// Delete
+//
+// Desc: Delete an entry.  The partition must be locked.
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  PF return code
+//
+RC PF_PageTable::Delete(int fd, PageNum pageNum)
+{
+  return (parts[Partition(fd, pageNum)].pTable->Delete(fd, pageNum));
+}
+
+//
+// Resize
+//
+// Desc: Resize every partition for its share of numEntries entries.
+//       Each partition is locked while it is resized.
+// In:   numEntries - number of entries the table should hold
+// Ret:  PF return code
+//
+RC PF_PageTable::Resize(int numEntries)
+{
+  RC rc;
+
+  if (numEntries <= 0)
+    return (PF_TOOSMALL);
+
+  for (int i = 0; i < PF_PAGE_PARTITIONS; i++) {
+    pthread_mutex_lock(&parts[i].mutex);
+    rc = parts[i].pTable->Resize(PartitionSize(numEntries));
+    pthread_mutex_unlock(&parts[i].mutex);
+    if (rc)
+      return (rc);
+  }
+
+  // Return ok
+  return (0);
+}
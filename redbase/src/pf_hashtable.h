@@ -8,25 +8,33 @@
 #ifndef PF_HASHTABLE_H
 #define PF_HASHTABLE_H
 
+#include <pthread.h>
 #include "pf_internal.h"
 
 //
-// HashEntry - Hash table bucket entries
+// HashEntry - Hash table slot.  A slot whose entry slot is
+// PF_HASH_EMPTY is unused.
 //
 struct PF_HashEntry {
-    PF_HashEntry *next;   // next hash table element or NULL
-    PF_HashEntry *prev;   // prev hash table element or NULL
     int          fd;      // file descriptor
     PageNum      pageNum; // page number
     int          slot;    // slot of this page in the buffer
 };
 
+#define PF_HASH_EMPTY   (-1)
+
 //
 // PF_HashTable - allow search, insertion, and deletion of hash table entries
 //
+// The table is a flat array searched with linear probing (open
+// addressing), so no memory is allocated on Insert or Delete.  The array
+// has a power of two size at least twice the number of entries it was
+// created for, which keeps probe sequences short.  Delete shifts later
+// entries of the probe sequence back instead of leaving tombstones.
+//
 class PF_HashTable {
 public:
-    PF_HashTable (int numBuckets);           // Constructor
+    PF_HashTable (int numEntries);           // Constructor
     ~PF_HashTable();                         // Destructor
     RC  Find     (int fd, PageNum pageNum, int &slot);
                                              // Set slot to the hash table
@@ -34,12 +42,69 @@ public:
     RC  Insert   (int fd, PageNum pageNum, int slot);
                                              // Insert a hash table entry
     RC  Delete   (int fd, PageNum pageNum);  // Delete a hash table entry
+    RC  Resize   (int numEntries);           // Resize for numEntries
+
+    static unsigned long long Mix(int fd, PageNum pageNum);
+                                             // Scrambled key of an entry
 
 private:
-    int Hash     (int fd, PageNum pageNum) const
-      { return ((fd + pageNum) % numBuckets); }   // Hash function
-    int numBuckets;                               // Number of hash table buckets
-    PF_HashEntry **hashTable;                     // Hash table
+    int Hash     (int fd, PageNum pageNum) const;   // Hash function
+    int Probe    (int fd, PageNum pageNum) const;   // Index of entry or of
+                                                    //   the empty slot that
+                                                    //   ends its sequence
+    static int TableSize(int numEntries);           // Array size to use
+
+    int numSlots;                                   // Size of the array
+    int mask;                                       // numSlots - 1
+    int numEntries;                                 // # of entries in use
+    PF_HashEntry *hashTable;                        // Hash table
+};
+
+//
+// PF_PageTable - a PF_HashTable split into partitions that can be locked
+// separately
+//
+// Each entry belongs to one of PF_PAGE_PARTITIONS partitions, chosen by
+// the high bits of its scrambled key (the low bits index the partition's
+// own table).  Each partition has its own table and mutex, so threads
+// looking up different pages rarely wait for each other.  The partition
+// of an entry must be locked with Lock around Find, Insert and Delete.
+// Several partitions are locked together with LockSet, which locks them
+// in increasing order.
+//
+class PF_PageTable {
+public:
+    PF_PageTable (int numEntries);           // Constructor
+    ~PF_PageTable();                         // Destructor
+
+    void Lock    (int fd, PageNum pageNum);  // Lock the partition of
+    void Unlock  (int fd, PageNum pageNum);  //   fd and pageNum
+    void LockSet (unsigned int partSet);     // Lock or unlock the
+    void UnlockSet(unsigned int partSet);    //   partitions whose bits
+                                             //   are set in partSet
+
+    RC  Find     (int fd, PageNum pageNum, int &slot);
+                                             // Set slot to the entry for
+                                             // fd and pageNum
+    RC  Insert   (int fd, PageNum pageNum, int slot);
+                                             // Insert an entry
+    RC  Delete   (int fd, PageNum pageNum);  // Delete an entry
+    RC  Resize   (int numEntries);           // Resize for numEntries,
+                                             // locks every partition
+
+    static int Partition(int fd, PageNum pageNum);  // Partition of an entry
+
+private:
+    static int PartitionSize(int numEntries);       // Entries per partition
+
+    // A partition gets a cache line of its own, so that threads locking
+    // neighbouring partitions do not slow each other down
+    struct Part {
+        pthread_mutex_t mutex;                      // protects table
+        PF_HashTable    *pTable;                    // entries
+    } __attribute__((aligned(64)));
+
+    Part parts[PF_PAGE_PARTITIONS];                 // the partitions
 };
 
 #endif
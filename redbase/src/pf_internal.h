@@ -11,16 +11,46 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <sys/types.h>
+#include <pthread.h>
 #include "pf.h"
 
 //
 // Constants and defines
 //
-const int PF_BUFFER_SIZE = 40;     // Number of pages in the buffer
-const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
+const int PF_BUFFER_SIZE = 40;     // Default number of pages in the buffer
+const int PF_HASH_TBL_SIZE = 20;   // Minimum size of hash table
+const int PF_RING_SIZE = 16;       // Max # of frames used by sequential scans
+const int PF_PREFETCH_PAGES = 64;  // # of pages staged by the prefetcher
+const int PF_PREFETCH_CHUNK = 8;   // Max # of pages read by one preadv
+const int PF_PREFETCH_WINDOW = 32; // # of pages read ahead of a scan
+const int PF_PREFETCH_STREAMS = 32; // # of files tracked for sequential
+                                   //   reads (by file descriptor)
+const int PF_WRITE_BATCH = 64;     // Max # of pages written by one pwritev
+const int PF_READ_BATCH = 64;      // Max # of pages read by one preadv
+const int PF_PAGE_PARTITIONS = 16; // # of separately locked parts of the
+                                   //   page table (a power of 2, at most 32)
+const int PF_TOUCH_BATCH = 64;     // # of references to pages of a partition
+                                   //   recorded before they are applied to
+                                   //   the used list
+const int PF_IO_ALIGN = 4096;      // Alignment of buffers read or written
+                                   //   with O_DIRECT
+const int PF_MAX_BUFFER_PAGES = 1 << 26; // Max # of pages in the buffer
+const int PF_RESIZE_CHUNK = 1024;  // # of frames added or retired at a time
+                                   //   by ResizeBuffer
+const int PF_HUGE_PAGE_SIZE = 2 << 20; // Size of a huge page, to which the
+                                   //   frames of the buffer are aligned
+const int PF_EXTENT_SIZE = 1 << 20; // Max # of bytes of pages preallocated
+                                   //   at once when a file grows
+const int PF_WRITER_INTERVAL = 100; // ms between rounds of the background
+                                   //   writer
+const int PF_WRITER_SHARE = 8;     // The background writer keeps the last
+                                   //   1/PF_WRITER_SHARE of the frames clean
+const int PF_STAT_FILES = 64;      // Max # of files with buffer statistics
+const int PF_STAT_FDS = 1024;      // Files with a greater descriptor have
+                                   //   no statistics
 
 #define CREATION_MASK      0600    // r/w privileges to owner only
-#define PF_PAGE_LIST_END  -1       // end of list of free pages
 #define PF_PAGE_USED      -2       // page is being used
 
 // L_SET is used to indicate the "whence" argument of the lseek call
@@ -34,13 +64,94 @@ const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
 // PF_PageHdr: Header structure for pages
 //
 struct PF_PageHdr {
-    int nextFree;       // nextFree can be any of these values:
-                        //  - the number of the next free page
-                        //  - PF_PAGE_LIST_END if this is last free page
-                        //  - PF_PAGE_USED if the page is not free
+    int checksum;       // CRC32C of the rest of the page when it was
+                        //   last written (see PF_Checksum), or
+                        //   PF_PAGE_USED if written without one.  Free
+                        //   pages are found in the free-space map of the
+                        //   file, not linked through their headers.
 };
 
-// Justify the file header to the length of one page
-const int PF_FILE_HDR_SIZE = PF_PAGE_SIZE + sizeof(PF_PageHdr);
+//
+// Page checksums (pf_checksum.cc)
+//
+unsigned int PF_Checksum      (const char *pPage, int pageSize);
+void         PF_SetChecksum   (char *pPage, int pageSize);
+int          PF_VerifyChecksum(const char *pPage, int pageSize);
+
+// The file header takes up the first page of the file.  Only the first
+// PF_FILE_HDR_SIZE bytes of it (a page of the smallest size) are ever
+// read or written.
+const int PF_FILE_HDR_SIZE = PF_MIN_PAGE_SIZE;
+
+//
+// File layout
+//
+// The pages of a file follow the header page in groups of
+// PF_GroupPages(pageSize) pages.  Each group is preceded by a map page:
+// a bitmap with one bit per page of the group, set if the page is used.
+// Pages with consecutive numbers are thus next to each other on disk,
+// except where a group starts.
+//
+inline int PF_GroupPages(int pageSize)
+{
+   return (pageSize * 8);
+}
+
+// Offset of a page in the file
+inline off_t PF_PageOffset(PageNum pageNum, int pageSize)
+{
+   return (((off_t)pageNum + pageNum / PF_GroupPages(pageSize) + 2) *
+         pageSize);
+}
+
+// Offset of the map page of a group in the file
+inline off_t PF_MapOffset(int group, int pageSize)
+{
+   return (((off_t)group * (PF_GroupPages(pageSize) + 1) + 1) * pageSize);
+}
+
+// TRUE if a page is not next to the page before it on disk
+inline int PF_GroupStart(PageNum pageNum, int pageSize)
+{
+   return (pageNum % PF_GroupPages(pageSize) == 0);
+}
+
+//
+// PF_FreeMap: free-space map of an open file
+//
+// The map pages of the file, one after another in memory.  The bits are
+// thus indexed by page number.  The map is shared by all the copies of
+// the file handle.
+//
+struct PF_FreeMap {
+   unsigned char *pBits;    // map pages (NULL if the file has no pages)
+   int     numGroups;       // # of map pages
+   PageNum firstFree;       // no page before this one is free
+   int     bChanged;        // TRUE if the map must be written back
+   pthread_mutex_t mutex;   // protects the map, and the header of the
+                            //   handle changing it: the background writer
+                            //   writes both back when it forces the log
+};
+
+//
+// PF_AllocAligned, PF_FreeAligned
+//
+// Allocate and free memory used for file I/O.  A file opened with
+// O_DIRECT is read and written straight from this memory, which must
+// then be aligned on PF_IO_ALIGN bytes.  PF_AllocAligned returns NULL if
+// there is not enough memory.
+//
+inline char *PF_AllocAligned(int size)
+{
+   void *p;
+   if (posix_memalign(&p, PF_IO_ALIGN, size))
+      return (NULL);
+   return ((char *)p);
+}
+
+inline void PF_FreeAligned(char *p)
+{
+   free(p);
+}
 
 #endif
@@ -6,9 +6,14 @@
 //
 
 #include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <strings.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include "pf_internal.h"
 #include "pf_buffermgr.h"
@@ -24,7 +29,36 @@
 PF_Manager::PF_Manager()
 {
    // Create Buffer Manager
-   pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE);
+   pageSize = PF_MIN_PAGE_SIZE;
+   pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE, PF_LRU, pageSize);
+   bDirectIO = FALSE;
+}
+
+//
+// PF_Manager
+//
+// Desc: Constructor - intended to be called once at begin of program
+//       Creates a buffer manager of numBufferPages pages instead of the
+//       default PF_BUFFER_SIZE.  The size can still be changed later
+//       with ResizeBuffer.  The files created by the manager have pages
+//       of pageSize bytes, and only files with pages of that size can be
+//       opened (other than PF_MAPPED).
+// In:   numBufferPages - number of pages in the buffer pool (> 0)
+//       policy - page replacement policy of the buffer pool
+//       pageSize - size of a page, header included (see PF_ParsePageSize)
+//
+PF_Manager::PF_Manager(int numBufferPages, PF_ReplacePolicy policy,
+      int _pageSize)
+{
+   // Create Buffer Manager
+   if (numBufferPages <= 0)
+      numBufferPages = PF_BUFFER_SIZE;
+   if (_pageSize < PF_MIN_PAGE_SIZE || _pageSize > PF_MAX_PAGE_SIZE ||
+         (_pageSize & (_pageSize - 1)))
+      _pageSize = PF_MIN_PAGE_SIZE;
+   pageSize = _pageSize;
+   pBufferMgr = new PF_BufferMgr(numBufferPages, policy, pageSize);
+   bDirectIO = FALSE;
 }
 
 //
@@ -61,20 +95,22 @@ RC PF_Manager::CreateFile (const char *fileName)
          CREATION_MASK)) < 0)
       return (PF_UNIX);
 
-   // Initialize the file header: must reserve FileHdrSize bytes in memory
+   // Initialize the file header: must reserve a whole page in memory
    // though the actual size of FileHdr is smaller
-   char hdrBuf[PF_FILE_HDR_SIZE];
+   char *hdrBuf = new char[pageSize];
 
    // So that Purify doesn't complain
-   memset(hdrBuf, 0, PF_FILE_HDR_SIZE);
+   memset(hdrBuf, 0, pageSize);
 
    PF_FileHdr *hdr = (PF_FileHdr*)hdrBuf;
-   hdr->firstFree = PF_PAGE_LIST_END;
    hdr->numPages = 0;
+   hdr->pageSize = pageSize;
+   hdr->bFreeMap = TRUE;
 
    // Write header to file
-   if((numBytes = write(fd, hdrBuf, PF_FILE_HDR_SIZE))
-         != PF_FILE_HDR_SIZE) {
+   numBytes = write(fd, hdrBuf, pageSize);
+   delete [] hdrBuf;
+   if (numBytes != pageSize) {
 
       // Error while writing: close and remove file
       close(fd);
@@ -112,6 +148,119 @@ RC PF_Manager::DestroyFile (const char *fileName)
    return (0);
 }
 
+//
+// UpgradeFile
+//
+// Desc: Rewrite a file created before the free-space map, which OpenFile
+//       rejects with PF_OLDFORMAT, in the current layout.  The pages of
+//       the older file follow the header page one after another; those
+//       in use have PF_PAGE_USED in their header, the others are in the
+//       old free list.  They are copied to their offsets in a new file,
+//       behind map pages with the bits of the used pages set, and the new
+//       file then replaces the old one.  A file that already has a
+//       free-space map is left as it is.  The file must not be open.
+// In:   fileName - name of file to upgrade
+// Ret:  PF return code
+//
+RC PF_Manager::UpgradeFile (const char *fileName)
+{
+   RC rc = 0;
+   int oldfd, newfd;
+   int numBytes;
+   PF_FileHdr hdr;
+
+   if ((oldfd = open(fileName, O_RDONLY)) < 0)
+      return (PF_UNIX);
+
+   numBytes = pread(oldfd, (char *)&hdr, sizeof(PF_FileHdr), 0);
+   if (numBytes != sizeof(PF_FileHdr)) {
+      close(oldfd);
+      return (numBytes < 0 ? PF_UNIX : PF_HDRREAD);
+   }
+   if (hdr.bFreeMap) {
+      close(oldfd);
+      return (0);
+   }
+   if (hdr.pageSize == 0)
+      hdr.pageSize = PF_MIN_PAGE_SIZE;
+
+   // The new file is written next to the old one
+   char *newName = new char[strlen(fileName) + 5];
+   sprintf(newName, "%s.new", fileName);
+   if ((newfd = open(newName,
+#ifdef PC
+         O_BINARY |
+#endif
+         O_CREAT | O_EXCL | O_WRONLY, CREATION_MASK)) < 0) {
+      close(oldfd);
+      delete[] newName;
+      return (PF_UNIX);
+   }
+
+   int groupPages = PF_GroupPages(hdr.pageSize);
+   char *pPageBuf = new char[hdr.pageSize];
+   unsigned char *pMapBuf = new unsigned char[hdr.pageSize];
+   PageNum pageNum;
+
+   for (pageNum = 0; !rc && pageNum < hdr.numPages; pageNum++) {
+      int bit = pageNum % groupPages;
+      if (bit == 0)
+         memset(pMapBuf, 0, hdr.pageSize);
+
+      // Copy the page, free or not: the map tells them apart
+      numBytes = pread(oldfd, pPageBuf, hdr.pageSize,
+            ((off_t)pageNum + 1) * hdr.pageSize);
+      if (numBytes != hdr.pageSize) {
+         rc = (numBytes < 0) ? PF_UNIX : PF_INCOMPLETEREAD;
+         break;
+      }
+      if (((PF_PageHdr *)pPageBuf)->checksum == PF_PAGE_USED)
+         pMapBuf[bit / 8] |= 1 << (bit % 8);
+      numBytes = pwrite(newfd, pPageBuf, hdr.pageSize,
+            PF_PageOffset(pageNum, hdr.pageSize));
+      if (numBytes != hdr.pageSize) {
+         rc = (numBytes < 0) ? PF_UNIX : PF_INCOMPLETEWRITE;
+         break;
+      }
+
+      // Write the map page of the group once its last page is copied
+      if (bit == groupPages - 1 || pageNum == hdr.numPages - 1) {
+         numBytes = pwrite(newfd, pMapBuf, hdr.pageSize,
+               PF_MapOffset(pageNum / groupPages, hdr.pageSize));
+         if (numBytes != hdr.pageSize)
+            rc = (numBytes < 0) ? PF_UNIX : PF_HDRWRITE;
+      }
+   }
+
+   // Write the header of the new file
+   if (!rc) {
+      memset(pPageBuf, 0, hdr.pageSize);
+      hdr.reserved = 0;
+      hdr.bFreeMap = TRUE;
+      hdr.numAllocated = hdr.numPages;
+      memcpy(pPageBuf, &hdr, sizeof(PF_FileHdr));
+      numBytes = pwrite(newfd, pPageBuf, hdr.pageSize, 0);
+      if (numBytes != hdr.pageSize)
+         rc = (numBytes < 0) ? PF_UNIX : PF_HDRWRITE;
+   }
+
+   // The new file must be on disk before it replaces the old one
+   if (!rc && fsync(newfd) < 0)
+      rc = PF_UNIX;
+   if (close(newfd) < 0 && !rc)
+      rc = PF_UNIX;
+   close(oldfd);
+   if (!rc && rename(newName, fileName) < 0)
+      rc = PF_UNIX;
+   if (rc)
+      unlink(newName);
+
+   delete[] pPageBuf;
+   delete[] pMapBuf;
+   delete[] newName;
+   return (rc);
+}
+
 //
 // OpenFile
 //
@@ -122,14 +271,20 @@ RC PF_Manager::DestroyFile (const char *fileName)
 //       circumstances, crash the PF layer. Note that even if only one instance
 //       of a file is for writing, problems may occur because some writes may
 //       not be seen by a reader of another instance of the file.
+//       A file opened with mode PF_MAPPED is read only, and is mapped into
+//       memory as a whole: its pages are used in place and do not take
+//       up buffer frames.  A file opened with mode PF_DIRECT (or
+//       PF_READWRITE, after SetDirectIO(TRUE)) bypasses the OS cache.
 // In:   fileName - name of file to open
+//       mode - PF_READWRITE (default), PF_MAPPED or PF_DIRECT
 // Out:  fileHandle - refer to the open file
 //                    this function modifies local var's in fileHandle
 //       to point to the file data in the file table, and to point to the
 //       buffer manager object
 // Ret:  PF_FILEOPEN or other PF return code
 //
-RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
+RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle,
+      PF_OpenMode mode)
 {
    int rc;                   // return code
 
@@ -137,22 +292,86 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
    if (fileHandle.bFileOpen)
       return (PF_FILEOPEN);
 
+   if (mode == PF_READWRITE && bDirectIO)
+      mode = PF_DIRECT;
+
+   // Open the file bypassing the OS cache if asked to.  File systems that
+   // do not support O_DIRECT (e.g. tmpfs) refuse it with EINVAL: open the
+   // file the usual way then.
+   fileHandle.bDirect = FALSE;
+#ifdef O_DIRECT
+   if (mode == PF_DIRECT) {
+      if ((fileHandle.unixfd = open(fileName, O_RDWR | O_DIRECT)) >= 0)
+         fileHandle.bDirect = TRUE;
+      else if (errno != EINVAL)
+         return (PF_UNIX);
+   }
+#endif
+
    // Open the file
-   if ((fileHandle.unixfd = open(fileName,
+   if (!fileHandle.bDirect && (fileHandle.unixfd = open(fileName,
 #ifdef PC
          O_BINARY |
 #endif
-         O_RDWR)) < 0)
+         (mode == PF_MAPPED ? O_RDONLY : O_RDWR))) < 0)
       return (PF_UNIX);
 
    // Read the file header
-   {
-      int numBytes = read(fileHandle.unixfd, (char *)&fileHandle.hdr,
-            sizeof(PF_FileHdr));
-      if (numBytes != sizeof(PF_FileHdr)) {
-         rc = (numBytes < 0) ? PF_UNIX : PF_HDRREAD;
+   if ((rc = fileHandle.ReadHdr()))
+      goto err;
+
+   // The pages of the file must fit in the buffer frames
+   if (fileHandle.hdr.pageSize == 0)
+      fileHandle.hdr.pageSize = PF_MIN_PAGE_SIZE;
+   if (mode != PF_MAPPED && fileHandle.hdr.pageSize != pageSize) {
+      rc = PF_WRONGPAGESIZE;
+      goto err;
+   }
+
+   // Older files kept their free pages in a list, and have no map pages
+   // between their pages (UpgradeFile rewrites them)
+   if (!fileHandle.hdr.bFreeMap) {
+      rc = PF_OLDFORMAT;
+      goto err;
+   }
+
+   // Read the free-space map
+   fileHandle.pFreeMap = new PF_FreeMap;
+   pthread_mutex_init(&fileHandle.pFreeMap->mutex, NULL);
+   if ((rc = fileHandle.ReadMap()))
+      goto err;
+
+   // Map the header and all the pages of the file
+   fileHandle.pMap = NULL;
+   fileHandle.pChecked = NULL;
+   if (mode == PF_MAPPED) {
+      struct stat fileStat;
+      fileHandle.mapSize = (fileHandle.hdr.numPages == 0) ?
+         fileHandle.hdr.pageSize :
+         (long)PF_PageOffset(fileHandle.hdr.numPages - 1,
+            fileHandle.hdr.pageSize) + fileHandle.hdr.pageSize;
+
+      // Touching a page beyond the end of the file would raise SIGBUS
+      if (fstat(fileHandle.unixfd, &fileStat) < 0) {
+         rc = PF_UNIX;
+         goto err;
+      }
+      if (fileStat.st_size < fileHandle.mapSize) {
+         rc = PF_INCOMPLETEREAD;
          goto err;
       }
+
+      void *pMap = mmap(NULL, fileHandle.mapSize, PROT_READ, MAP_SHARED,
+            fileHandle.unixfd, 0);
+      if (pMap == MAP_FAILED) {
+         rc = PF_UNIX;
+         goto err;
+      }
+      fileHandle.pMap = (char *)pMap;
+
+      // No page has been checked against its checksum yet
+      fileHandle.pChecked =
+         new unsigned char[(fileHandle.hdr.numPages + 7) / 8]();
    }
 
    // Set file header to be not changed
@@ -165,6 +384,12 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
    if (!strcmp(fileName, "log")) pBufferMgr->logfd = fileHandle.unixfd;
    if (!strcmp(fileName, "log")) pBufferMgr->logFile = &fileHandle;
 
+#ifdef PF_STATS
+   // Pages of a mapped file do not go through the buffer
+   if (mode != PF_MAPPED)
+      pBufferMgr->TrackFile(fileHandle.unixfd, fileName);
+#endif
+
    // Return ok
    return 0;
 
@@ -172,6 +397,12 @@ err:
    // Close file
    close(fileHandle.unixfd);
    fileHandle.bFileOpen = FALSE;
+   if (fileHandle.pFreeMap != NULL) {
+      pthread_mutex_destroy(&fileHandle.pFreeMap->mutex);
+      PF_FreeAligned((char *)fileHandle.pFreeMap->pBits);
+      delete fileHandle.pFreeMap;
+      fileHandle.pFreeMap = NULL;
+   }
 
    // Return error
    return (rc);
@@ -202,11 +433,26 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    if ((rc = fileHandle.FlushPages()))
       return (rc);
 
+   // Unmap a mapped file
+   if (fileHandle.pMap != NULL) {
+      if (munmap(fileHandle.pMap, fileHandle.mapSize) < 0)
+         return (PF_UNIX);
+      fileHandle.pMap = NULL;
+      delete [] fileHandle.pChecked;
+      fileHandle.pChecked = NULL;
+   }
+
    // Close the file
-   if (close(fileHandle.unixfd) < 0)
-      return (PF_UNIX);
+   if ((rc = pBufferMgr->CloseFile(fileHandle.unixfd)))
+      return (rc);
    fileHandle.bFileOpen = FALSE;
 
+   // Free the free-space map
+   pthread_mutex_destroy(&fileHandle.pFreeMap->mutex);
+   PF_FreeAligned((char *)fileHandle.pFreeMap->pBits);
+   delete fileHandle.pFreeMap;
+   fileHandle.pFreeMap = NULL;
+
    // Reset the buffer manager pointer in the file handle
    fileHandle.pBufferMgr = NULL;
 
@@ -250,18 +496,278 @@ RC PF_Manager::PrintBuffer()
 // ResizeBuffer
 //
 // Desc: Resizes the buffer manager to the size passed in.
-//       This routine will be called via the system command.
+//       This routine will be called via the system command.  Other
+//       threads may keep using the buffer meanwhile.
 // In:   The new buffer size
 // Out:  Nothing
 // Ret:  Returns the result of PF_BufferMgr::ResizeBuffer
 //       It is a code: 0 for success, PF_TOOSMALL when iNewSize
-//       would be too small.
+//       is not positive, PF_BADBUFSIZE when it is too large.
 //
 RC PF_Manager::ResizeBuffer(int iNewSize)
 {
    return pBufferMgr->ResizeBuffer(iNewSize);
 }
 
+//
+// SetPolicy
+//
+// Desc: Change the page replacement policy of the buffer manager.
+//       The pages in the buffer are kept.
+// In:   policy - the new policy
+// Ret:  Returns the result of PF_BufferMgr::SetPolicy
+//
+RC PF_Manager::SetPolicy(PF_ReplacePolicy policy)
+{
+   return pBufferMgr->SetPolicy(policy);
+}
+
+//
+// SetDirectIO
+//
+// Desc: Choose whether the files opened (with the default mode) from now
+//       on bypass the OS cache.  Files already open are not affected.
+//       Direct I/O is meant for a buffer pool sized to take most of the
+//       memory, so that pages are not cached twice.
+// In:   bDirectIO - TRUE to open files PF_DIRECT, FALSE for PF_READWRITE
+// Ret:  0
+//
+RC PF_Manager::SetDirectIO(int bDirectIO)
+{
+   this->bDirectIO = bDirectIO;
+   return (0);
+}
+
+//
+// SetBackgroundWriter
+//
+// Desc: Start or stop the background writer of the buffer manager, which
+//       writes the dirty pages about to be replaced before clients need
+//       their frames.  It is stopped when the manager is destroyed.
+// In:   bWriter - TRUE to start it, FALSE to stop it
+// Ret:  PF return code
+//
+RC PF_Manager::SetBackgroundWriter(int bWriter)
+{
+   return (bWriter ? pBufferMgr->StartWriter() : pBufferMgr->StopWriter());
+}
+
+//
+// SetHugePages
+//
+// Desc: Choose whether the buffer is mapped with explicit huge pages,
+//       which must have been reserved (vm.nr_hugepages), or only advised
+//       to use transparent ones.  Either cuts the TLB misses of scans
+//       over a large buffer.  The buffer is remapped at once.
+// In:   bHugePages - TRUE for explicit huge pages
+// Ret:  Returns the result of PF_BufferMgr::SetHugePages
+//
+RC PF_Manager::SetHugePages(int bHugePages)
+{
+   return pBufferMgr->SetHugePages(bHugePages);
+}
+
+//
+// GetFileStats
+//
+// Desc: Return the buffer statistics of a file (see PF_FileStats).  The
+//       files are numbered from 0 in the order they were first opened.
+//       No file has statistics unless the PF layer is compiled with
+//       PF_STATS.
+// In:   i - which file
+// Out:  stats - its statistics
+// Ret:  PF_EOF if there are only i files
+//
+RC PF_Manager::GetFileStats(int i, PF_FileStats &stats) const
+{
+   return (pBufferMgr->GetFileStats(i, stats));
+}
+
+//
+// ResetFileStats
+//
+// Desc: Set the buffer statistics of all files back to 0.
+// Ret:  0
+//
+RC PF_Manager::ResetFileStats()
+{
+   return (pBufferMgr->ResetFileStats());
+}
+
+//
+// GetPageSize
+//
+// Desc: Return the number of bytes of a page that can be used by the
+//       client (like PF_PAGE_SIZE, for the manager's page size).
+// Out:  length - usable size of a page
+// Ret:  0
+//
+RC PF_Manager::GetPageSize(int &length) const
+{
+   length = pageSize - sizeof(PF_PageHdr);
+   return (0);
+}
+
+//
+// PF_ParseBufferSize
+//
+// Desc: Convert a buffer size given by the user (command line or SET)
+//       into a number of buffer pages.  A plain number is taken as a
+//       page count.  A number followed by K, M or G (either case) is
+//       taken as a size in bytes and rounded down to whole pages.
+// In:   psSize - the size string, e.g. "40", "65536" or "512M"
+//       pageSize - size of a buffer page, header included
+// Out:  numPages - number of buffer pages
+// Ret:  0 for success, PF_BADBUFSIZE if psSize is not a positive size
+//       or is more than PF_MAX_BUFFER_PAGES pages
+//
+RC PF_ParseBufferSize(const char *psSize, int &numPages, int pageSize)
+{
+   char *psEnd;
+   long long size;
+   long long unit = 0;
+
+   if (psSize == NULL)
+      return (PF_BADBUFSIZE);
+
+   errno = 0;
+   size = strtoll(psSize, &psEnd, 10);
+   if (errno || psEnd == psSize || size <= 0)
+      return (PF_BADBUFSIZE);
+
+   switch (*psEnd) {
+   case '\0':
+      break;
+   case 'k': case 'K':
+      unit = 1LL << 10;
+      break;
+   case 'm': case 'M':
+      unit = 1LL << 20;
+      break;
+   case 'g': case 'G':
+      unit = 1LL << 30;
+      break;
+   default:
+      return (PF_BADBUFSIZE);
+   }
+
+   // Anything after the suffix (other than a trailing "B") is an error
+   if (unit) {
+      psEnd++;
+      if (*psEnd == 'b' || *psEnd == 'B')
+         psEnd++;
+      if (*psEnd != '\0' || size > LLONG_MAX / unit)
+         return (PF_BADBUFSIZE);
+      size = size * unit / pageSize;
+   }
+
+   if (size <= 0 || size > PF_MAX_BUFFER_PAGES)
+      return (PF_BADBUFSIZE);
+
+   numPages = (int)size;
+   return (0);
+}
+
+//
+// PF_ParsePageSize
+//
+// Desc: Convert a page size given by the user (command line of dbcreate)
+//       into a number of bytes.  A K suffix (either case) gives the size
+//       in kilobytes.  The size must be a power of 2 from
+//       PF_MIN_PAGE_SIZE to PF_MAX_PAGE_SIZE.
+// In:   psSize - the size string, e.g. "8K" or "8192"
+// Out:  pageSize - size of a page, header included
+// Ret:  0 for success, PF_BADPAGESIZE if psSize is not a valid size
+//
+RC PF_ParsePageSize(const char *psSize, int &pageSize)
+{
+   char *psEnd;
+   long size;
+
+   if (psSize == NULL)
+      return (PF_BADPAGESIZE);
+
+   errno = 0;
+   size = strtol(psSize, &psEnd, 10);
+   if (errno || psEnd == psSize)
+      return (PF_BADPAGESIZE);
+
+   if (*psEnd == 'k' || *psEnd == 'K') {
+      psEnd++;
+      if (*psEnd == 'b' || *psEnd == 'B')
+         psEnd++;
+      if (size > PF_MAX_PAGE_SIZE)
+         return (PF_BADPAGESIZE);
+      size <<= 10;
+   }
+
+   if (*psEnd != '\0' || size < PF_MIN_PAGE_SIZE ||
+         size > PF_MAX_PAGE_SIZE || (size & (size - 1)))
+      return (PF_BADPAGESIZE);
+
+   pageSize = (int)size;
+   return (0);
+}
+
+//
+// PF_ReadPageSize
+//
+// Desc: Read the page size of an existing PF file from its header, so
+//       that a PF_Manager able to open the file can be created.
+// In:   fileName - name of the file
+// Out:  pageSize - size of a page of the file, header included
+// Ret:  PF return code
+//
+RC PF_ReadPageSize(const char *fileName, int &pageSize)
+{
+   PF_FileHdr hdr;
+   int fd;
+   int numBytes;
+
+   if ((fd = open(fileName,
+#ifdef PC
+         O_BINARY |
+#endif
+         O_RDONLY)) < 0)
+      return (PF_UNIX);
+
+   numBytes = pread(fd, (char *)&hdr, sizeof(PF_FileHdr), 0);
+   close(fd);
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != sizeof(PF_FileHdr))
+      return (PF_HDRREAD);
+
+   pageSize = hdr.pageSize ? hdr.pageSize : PF_MIN_PAGE_SIZE;
+   return (0);
+}
+
+//
+// PF_ParsePolicy
+//
+// Desc: Convert a replacement policy name given by the user (command
+//       line or SET) into a PF_ReplacePolicy.  Case is ignored.
+// In:   psPolicy - "lru", "clock" or "2q"
+// Out:  policy - the policy
+// Ret:  0 for success, PF_BADPOLICY if the name is not known
+//
+RC PF_ParsePolicy(const char *psPolicy, PF_ReplacePolicy &policy)
+{
+   if (psPolicy == NULL)
+      return (PF_BADPOLICY);
+
+   if (strcasecmp(psPolicy, "lru") == 0)
+      policy = PF_LRU;
+   else if (strcasecmp(psPolicy, "clock") == 0)
+      policy = PF_CLOCK;
+   else if (strcasecmp(psPolicy, "2q") == 0)
+      policy = PF_2Q;
+   else
+      return (PF_BADPOLICY);
+
+   return (0);
+}
+
 //------------------------------------------------------------------------------
 // Three Methods for manipulating raw memory buffers.  These memory
 // locations are handled by the buffer manager, but are not
@@ -0,0 +1,342 @@
+//
+// File:        pf_prefetcher.cc
+// Description: PF_Prefetcher class implementation
+//
+
+#include <cstdio>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <iostream>
+#include "pf_prefetcher.h"
+
+using namespace std;
+
+//
+// PF_Prefetcher
+//
+// Desc: Constructor - called by PF_BufferMgr::PF_BufferMgr
+//       Allocates the staging buffers.  The I/O thread is started by the
+//       first call to Issue, so programs that never scan a file
+//       sequentially do not pay for it.
+// In:   _pageSize - size of a page, header included
+//
+PF_Prefetcher::PF_Prefetcher(int _pageSize) : lookup(PF_PREFETCH_PAGES)
+{
+   pageSize = _pageSize;
+
+   for (int i = 0; i < PF_PREFETCH_PAGES; i++) {
+      if ((pages[i].pData = PF_AllocAligned(pageSize)) == NULL) {
+         cerr << "Not enough memory for prefetch buffers\n";
+         exit(1);
+      }
+      pages[i].state = PF_PREFETCH_FREE;
+      pages[i].next = i + 1;
+   }
+   pages[PF_PREFETCH_PAGES - 1].next = PF_PREFETCH_LIST_END;
+   free = 0;
+
+   queueHead = queueLen = 0;
+
+   bThread = FALSE;
+   bStop = FALSE;
+   pthread_mutex_init(&mutex, NULL);
+   pthread_cond_init(&cond, NULL);
+}
+
+//
+// ~PF_Prefetcher
+//
+// Desc: Destructor - stops the I/O thread and frees the staging buffers
+//
+PF_Prefetcher::~PF_Prefetcher()
+{
+   if (bThread) {
+      pthread_mutex_lock(&mutex);
+      bStop = TRUE;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(thread, NULL);
+   }
+
+   pthread_cond_destroy(&cond);
+   pthread_mutex_destroy(&mutex);
+
+   for (int i = 0; i < PF_PREFETCH_PAGES; i++)
+      PF_FreeAligned(pages[i].pData);
+}
+
+//
+// Issue
+//
+// Desc: Queue reads of the pages firstPage .. firstPage + numPages - 1
+//       of fd.  Pages that are already staged are skipped, and
+//       consecutive pages are grouped into runs of at most
+//       PF_PREFETCH_CHUNK pages, each read by a single preadv.  Stops
+//       early when the staging buffers run out.
+// In:   fd - OS file descriptor
+//       firstPage - first page to read
+//       numPages - number of pages to read
+// Ret:  number of pages queued
+//
+int PF_Prefetcher::Issue(int fd, PageNum firstPage, int numPages)
+{
+   int numIssued = 0;
+   int slot;
+
+   pthread_mutex_lock(&mutex);
+
+   // Start the I/O thread the first time around
+   if (!bThread) {
+      if (pthread_create(&thread, NULL, Run, this)) {
+         pthread_mutex_unlock(&mutex);
+         return (0);
+      }
+      bThread = TRUE;
+   }
+
+   PF_PrefetchRun *pRun = NULL;
+   for (PageNum pageNum = firstPage; pageNum < firstPage + numPages;
+         pageNum++) {
+
+      // Out of staging buffers (or of queue entries)
+      if (free == PF_PREFETCH_LIST_END ||
+            (pRun == NULL && queueLen == PF_PREFETCH_PAGES))
+         break;
+
+      // Already staged: end the current run
+      if (!lookup.Find(fd, pageNum, slot)) {
+         pRun = NULL;
+         continue;
+      }
+
+      // Start a new run if needed (a run cannot span the map page at the
+      // start of a group)
+      if (pRun == NULL || pRun->numPages == PF_PREFETCH_CHUNK ||
+            PF_GroupStart(pageNum, pageSize)) {
+         if (queueLen == PF_PREFETCH_PAGES)
+            break;
+         pRun = &queue[(queueHead + queueLen++) % PF_PREFETCH_PAGES];
+         pRun->fd = fd;
+         pRun->firstPage = pageNum;
+         pRun->numPages = 0;
+      }
+
+      // Take a staging buffer for the page
+      int page = free;
+      free = pages[page].next;
+      pages[page].fd = fd;
+      pages[page].pageNum = pageNum;
+      pages[page].state = PF_PREFETCH_QUEUED;
+      pages[page].bStale = FALSE;
+      lookup.Insert(fd, pageNum, page);
+
+      pRun->pages[pRun->numPages++] = page;
+      numIssued++;
+   }
+
+   if (numIssued)
+      pthread_cond_broadcast(&cond);
+
+   pthread_mutex_unlock(&mutex);
+
+   return (numIssued);
+}
+
+//
+// Take
+//
+// Desc: Copy the staged contents of a page to dest.  If the read of the
+//       page is queued or in progress, wait for it.  The staging buffer
+//       is freed in any case.
+// In:   fd - OS file descriptor
+//       pageNum - page number
+//       dest - where to copy the page
+// Ret:  0 if dest holds the page, PF_HASHNOTFOUND if the page is not
+//       staged (or its read failed) and must be read by the caller
+//
+RC PF_Prefetcher::Take(int fd, PageNum pageNum, char *dest)
+{
+   int page;
+   RC  rc = PF_HASHNOTFOUND;
+
+   pthread_mutex_lock(&mutex);
+
+   // Look the page up again after each wait: the I/O thread frees the
+   // buffer of a page that went stale while it was being read
+   while (!lookup.Find(fd, pageNum, page)) {
+
+      if (pages[page].state == PF_PREFETCH_QUEUED ||
+            pages[page].state == PF_PREFETCH_READING) {
+         pthread_cond_wait(&cond, &mutex);
+         continue;
+      }
+
+      if (pages[page].state == PF_PREFETCH_DONE && !pages[page].bStale) {
+         memcpy(dest, pages[page].pData, pageSize);
+         rc = 0;
+      }
+      Release(page);
+      break;
+   }
+
+   pthread_mutex_unlock(&mutex);
+
+   return (rc);
+}
+
+//
+// Invalidate
+//
+// Desc: Called before a page is written.  A staged copy of the page is
+//       out of date once the write is done, so it is dropped (or marked
+//       stale if its read is still queued or in progress).
+// In:   fd - OS file descriptor
+//       pageNum - page number
+//
+void PF_Prefetcher::Invalidate(int fd, PageNum pageNum)
+{
+   int page;
+
+   pthread_mutex_lock(&mutex);
+
+   if (!lookup.Find(fd, pageNum, page)) {
+      if (pages[page].state == PF_PREFETCH_QUEUED ||
+            pages[page].state == PF_PREFETCH_READING)
+         pages[page].bStale = TRUE;
+      else
+         Release(page);
+   }
+
+   pthread_mutex_unlock(&mutex);
+}
+
+//
+// Forget
+//
+// Desc: Drop every staged page of a file and wait until the I/O thread
+//       has no read of the file queued or in progress, so that the file
+//       descriptor can be closed (and reused) safely.
+// In:   fd - OS file descriptor
+//
+void PF_Prefetcher::Forget(int fd)
+{
+   int i;
+   int bBusy;
+
+   pthread_mutex_lock(&mutex);
+
+   do {
+      bBusy = FALSE;
+      for (i = 0; i < PF_PREFETCH_PAGES; i++) {
+         if (pages[i].state == PF_PREFETCH_FREE || pages[i].fd != fd)
+            continue;
+         if (pages[i].state == PF_PREFETCH_QUEUED ||
+               pages[i].state == PF_PREFETCH_READING) {
+            pages[i].bStale = TRUE;
+            bBusy = TRUE;
+         }
+         else
+            Release(i);
+      }
+      if (bBusy)
+         pthread_cond_wait(&cond, &mutex);
+   } while (bBusy);
+
+   pthread_mutex_unlock(&mutex);
+}
+
+//
+// Run
+//
+// Desc: Internal.  Main loop of the I/O thread: read the queued runs in
+//       order until asked to stop.
+// In:   pPrefetcher - the PF_Prefetcher object
+//
+void *PF_Prefetcher::Run(void *pPrefetcher)
+{
+   PF_Prefetcher *p = (PF_Prefetcher *)pPrefetcher;
+
+   pthread_mutex_lock(&p->mutex);
+   for (;;) {
+      while (p->queueLen == 0 && !p->bStop)
+         pthread_cond_wait(&p->cond, &p->mutex);
+      if (p->bStop)
+         break;
+
+      // Take the run off the queue; its pages are ours until completed
+      PF_PrefetchRun run = p->queue[p->queueHead];
+      p->queueHead = (p->queueHead + 1) % PF_PREFETCH_PAGES;
+      p->queueLen--;
+      for (int i = 0; i < run.numPages; i++)
+         p->pages[run.pages[i]].state = PF_PREFETCH_READING;
+
+      pthread_mutex_unlock(&p->mutex);
+      p->ReadRun(run);
+      pthread_mutex_lock(&p->mutex);
+
+      pthread_cond_broadcast(&p->cond);
+   }
+   pthread_mutex_unlock(&p->mutex);
+
+   return (NULL);
+}
+
+//
+// ReadRun
+//
+// Desc: Internal.  Read the pages of a run with a single preadv, then
+//       (with the mutex held) mark them done.  Pages beyond a short read
+//       or a page that fails its checksum are marked failed; stale pages
+//       are freed.
+// In:   run - the run to read
+//
+void PF_Prefetcher::ReadRun(PF_PrefetchRun &run)
+{
+   struct iovec iov[PF_PREFETCH_CHUNK];
+   int i;
+
+   for (i = 0; i < run.numPages; i++) {
+      iov[i].iov_base = pages[run.pages[i]].pData;
+      iov[i].iov_len = pageSize;
+   }
+
+   ssize_t numBytes = preadv(run.fd, iov, run.numPages,
+         PF_PageOffset(run.firstPage, pageSize));
+
+   // A page that does not match its checksum ends the run, so that Take
+   // fails and the page is read again (and the error reported) by the
+   // buffer manager
+   for (i = 0; i < run.numPages && numBytes >= (ssize_t)(i + 1) * pageSize;
+         i++)
+      if (!PF_VerifyChecksum(pages[run.pages[i]].pData, pageSize)) {
+         numBytes = (ssize_t)i * pageSize;
+         break;
+      }
+
+   pthread_mutex_lock(&mutex);
+   for (i = 0; i < run.numPages; i++) {
+      int page = run.pages[i];
+      if (pages[page].bStale)
+         Release(page);
+      else if (numBytes >= (ssize_t)(i + 1) * pageSize)
+         pages[page].state = PF_PREFETCH_DONE;
+      else
+         pages[page].state = PF_PREFETCH_FAILED;
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+//
+// Release
+//
+// Desc: Internal.  Put a staging buffer back on the free list.  The
+//       mutex must be held.
+// In:   page - the staging buffer
+//
+void PF_Prefetcher::Release(int page)
+{
+   lookup.Delete(pages[page].fd, pages[page].pageNum);
+   pages[page].state = PF_PREFETCH_FREE;
+   pages[page].next = free;
+   free = page;
+}
@@ -0,0 +1,95 @@
+//
+// File:        pf_prefetcher.h
+// Description: PF_Prefetcher class interface
+//
+// The prefetcher reads pages ahead of a sequential scan on a background
+// I/O thread.  Pages are read with preadv, several pages per call, into
+// staging buffers owned by the prefetcher.  The buffer manager copies a
+// staged page into a buffer frame when the page is actually requested,
+// so the I/O thread never touches the buffer manager's own structures.
+//
+
+#ifndef PF_PREFETCHER_H
+#define PF_PREFETCHER_H
+
+#include <pthread.h>
+#include "pf_internal.h"
+#include "pf_hashtable.h"
+
+//
+// PF_PrefetchPage - a staging buffer and the page it holds
+//
+struct PF_PrefetchPage {
+    char       *pData;      // page contents
+    int        fd;          // OS file descriptor of the page
+    PageNum    pageNum;     // page number
+    int        state;       // PF_PREFETCH_FREE, ...
+    int        bStale;      // TRUE if the page was written after the read
+                            // was issued; the contents must not be used
+    int        next;        // next page on the free list
+};
+
+#define PF_PREFETCH_FREE     0   // buffer is unused
+#define PF_PREFETCH_QUEUED   1   // read is waiting for the I/O thread
+#define PF_PREFETCH_READING  2   // read is in progress
+#define PF_PREFETCH_DONE     3   // contents are valid
+#define PF_PREFETCH_FAILED   4   // read failed (or hit the end of file)
+
+#define PF_PREFETCH_LIST_END (-1) // end of the free list
+
+//
+// PF_PrefetchRun - a read of consecutive pages of one file
+//
+struct PF_PrefetchRun {
+    int        fd;                         // OS file descriptor
+    PageNum    firstPage;                  // first page of the run
+    int        numPages;                   // # of pages in the run
+    int        pages[PF_PREFETCH_CHUNK];   // staging buffer of each page
+};
+
+//
+// PF_Prefetcher - read pages ahead on a background thread
+//
+class PF_Prefetcher {
+public:
+    PF_Prefetcher    (int pageSize);             // Constructor
+    ~PF_Prefetcher   ();                         // Destructor - stops the
+                                                  // I/O thread
+
+    // Queue reads of numPages pages starting at firstPage.  Pages that
+    // are already staged are skipped.  Returns the # of pages queued.
+    int Issue        (int fd, PageNum firstPage, int numPages);
+
+    // Copy a staged page to dest, waiting for its read if needed
+    RC  Take         (int fd, PageNum pageNum, char *dest);
+
+    // The page is about to be written: drop any staged copy
+    void Invalidate  (int fd, PageNum pageNum);
+
+    // The file is being closed: drop all its pages, and wait until no
+    // read on fd is in progress
+    void Forget      (int fd);
+
+private:
+    static void *Run (void *pPrefetcher);        // I/O thread main loop
+    void ReadRun     (PF_PrefetchRun &run);      // Do one read
+    void Release     (int page);                 // Free a staging buffer
+
+    int             pageSize;                     // size of a page
+    PF_PrefetchPage pages[PF_PREFETCH_PAGES];     // staging buffers
+    int             free;                         // head of free list
+    PF_HashTable    lookup;                       // staging buffer of a page
+
+    PF_PrefetchRun  queue[PF_PREFETCH_PAGES];     // runs waiting to be read
+    int             queueHead;                    // next run to read
+    int             queueLen;                     // # of runs waiting
+
+    pthread_t       thread;                       // I/O thread
+    int             bThread;                      // TRUE once started
+    int             bStop;                        // TRUE to stop the thread
+    pthread_mutex_t mutex;                        // protects all of the above
+    pthread_cond_t  cond;                         // signaled when a run is
+                                                  // queued or completed
+};
+
+#endif
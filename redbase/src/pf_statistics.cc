@@ -30,6 +30,9 @@ void PF_Statistics()
    int *piRP = pStatisticsMgr->Get(PF_READPAGE);
    int *piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
    int *piFP = pStatisticsMgr->Get(PF_FLUSHPAGES);
+   int *piPP = pStatisticsMgr->Get(PF_PREFETCHPAGE);
+   int *piPH = pStatisticsMgr->Get(PF_PREFETCHHIT);
+   int *piBW = pStatisticsMgr->Get(PF_BGWRITEPAGE);
 
    cout << "PF Layer Statistics\n";
    cout << "-------------------\n";
@@ -46,6 +49,12 @@ void PF_Statistics()
    if (piRP) cout << *piRP; else cout << "None";
    cout << "\nNumber of write requests: ";
    if (piWP) cout << *piWP; else cout << "None";
+   cout << "\n  Written in the background: ";
+   if (piBW) cout << *piBW; else cout << "None";
+   cout << "\nNumber of pages read ahead: ";
+   if (piPP) cout << *piPP; else cout << "None";
+   cout << "\n  Number used: ";
+   if (piPH) cout << *piPH; else cout << "None";
    cout << "\n-------------------\n";
    cout << "Number of flushes: ";
    if (piFP) cout << *piFP; else cout << "None";
@@ -58,6 +67,9 @@ void PF_Statistics()
    delete piRP;
    delete piWP;
    delete piFP;
+   delete piPP;
+   delete piPH;
+   delete piBW;
 }
 
 #endif
@@ -0,0 +1,239 @@
+//
+// File:        pf_test4.cc
+// Description: Test the page checksums of the PF component
+//
+// A byte of a page is changed on disk, behind the back of PF.  Reading
+// the page with GetThisPage must then fail with PF_BADCHECKSUM, through
+// the buffer pool and through a mapped file alike, and dbverify must
+// report the page.  The other pages must still read.  Run from the
+// directory holding dbverify.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define DBDIR     "pf_test4db"
+#define FILE1     DBDIR "/file1"
+#define NUMPAGES  5                    // # of pages of FILE1
+#define BADPAGE   2                    // page damaged by the test
+
+//
+// RunVerify
+//
+// Run dbverify on DBDIR.  Returns its exit status, or -1 if it could not
+// be run; its output is in output.
+//
+int RunVerify(string &output)
+{
+   FILE *pipe;
+   char buf[1024];
+   size_t n;
+
+   if ((pipe = popen("./dbverify " DBDIR " 2>&1", "r")) == NULL)
+      return (-1);
+   output.clear();
+   while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+      output.append(buf, n);
+
+   int status = pclose(pipe);
+   return (WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+//
+// WriteFile
+//
+// Create FILE1 with NUMPAGES pages, each holding its page number
+//
+RC WriteFile(PF_Manager &pfm)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int i;
+
+   cout << "Creating file: " << FILE1 << "\n";
+   if ((rc = pfm.CreateFile(FILE1)) ||
+         (rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (i = 0; i < NUMPAGES; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+      memcpy(pData, (char *)&pageNum, sizeof(PageNum));
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   // Closing the file writes its pages, with their checksums
+   return (pfm.CloseFile(fh));
+}
+
+//
+// DamagePage
+//
+// Flip a byte in the middle of page BADPAGE of FILE1 on disk
+//
+RC DamagePage(PF_Manager &pfm)
+{
+   int pageSize;
+   int fd;
+   char c;
+
+   pfm.GetPageSize(pageSize);
+   pageSize += sizeof(PF_PageHdr);
+   off_t offset = PF_PageOffset(BADPAGE, pageSize) + pageSize / 2;
+
+   cout << "Damaging page " << BADPAGE << " on disk.\n";
+   if ((fd = open(FILE1, O_RDWR)) < 0)
+      return (PF_UNIX);
+   if (pread(fd, &c, 1, offset) != 1) {
+      close(fd);
+      return (PF_UNIX);
+   }
+   c ^= 0xff;
+   if (pwrite(fd, &c, 1, offset) != 1) {
+      close(fd);
+      return (PF_UNIX);
+   }
+   close(fd);
+   return (0);
+}
+
+//
+// ReadPages
+//
+// Read every page of FILE1, opened with mode.  BADPAGE must fail with
+// PF_BADCHECKSUM every time it is read, and the others must hold their
+// page number.
+//
+RC ReadPages(PF_Manager &pfm, PF_OpenMode mode)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int i;
+
+   if ((rc = pfm.OpenFile(FILE1, fh, mode)))
+      return (rc);
+
+   for (i = 0; i < NUMPAGES; i++) {
+      rc = fh.GetThisPage(i, ph);
+      if (i == BADPAGE) {
+         if (rc != PF_BADCHECKSUM ||
+               (rc = fh.GetThisPage(i, ph)) != PF_BADCHECKSUM) {
+            cout << "GetThisPage of the damaged page returned " << rc
+               << ", not PF_BADCHECKSUM\n";
+            return (rc ? rc : PF_BADCHECKSUM);
+         }
+         continue;
+      }
+      if (rc ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+      memcpy((char *)&pageNum, pData, sizeof(PageNum));
+      if (pageNum != i) {
+         cout << "Page " << i << " holds " << pageNum << "\n";
+         exit(1);
+      }
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+RC TestChecksum()
+{
+   PF_Manager pfm;
+   RC rc;
+   string output;
+   int status;
+
+   // Start from an empty database directory
+   unlink(FILE1);
+   rmdir(DBDIR);
+   if (mkdir(DBDIR, 0755) < 0)
+      return (PF_UNIX);
+
+   if ((rc = WriteFile(pfm)))
+      return (rc);
+
+   cout << "Verifying the database: ";
+   if ((status = RunVerify(output)) != 0) {
+      cout << "FAILED! (status " << status << ")\n" << output;
+      exit(1);
+   }
+   cout << "Pass\n";
+
+   if ((rc = DamagePage(pfm)))
+      return (rc);
+
+   cout << "Reading the pages: ";
+   if ((rc = ReadPages(pfm, PF_READWRITE)))
+      return (rc);
+   cout << "Pass\n";
+
+   cout << "Reading the mapped pages: ";
+   if ((rc = ReadPages(pfm, PF_MAPPED)))
+      return (rc);
+   cout << "Pass\n";
+
+   // dbverify prints the damaged page with the PF_BADCHECKSUM message
+   cout << "Verifying the damaged database: ";
+   char psPage[32];
+   sprintf(psPage, "page %d: ", BADPAGE);
+   if ((status = RunVerify(output)) != 1 ||
+         output.find(psPage) == string::npos ||
+         output.find("checksum") == string::npos) {
+      cout << "FAILED! (status " << status << ")\n" << output;
+      exit(1);
+   }
+   cout << "Pass\n";
+
+   if ((rc = pfm.DestroyFile(FILE1)))
+      return (rc);
+   rmdir(DBDIR);
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "Starting PF checksum test.\n";
+   cout.flush();
+
+   // Do tests
+   if ((rc = TestChecksum())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   // Write ending message and exit
+   cout << "Ending PF checksum test.\n\n";
+
+   return (0);
+}
@@ -0,0 +1,239 @@
+//
+// File:        pf_test5.cc
+// Description: Test the page table of the PF component
+//
+// Pages of a few files are inserted into and deleted from a PF_HashTable
+// and a PF_PageTable in a fixed pseudo-random order, and the tables are
+// resized between rounds, to sizes too small as well as large.  After
+// every round each page is looked up again: the pages inserted must be
+// found with their slot, and the others must not be found.  Deletes move
+// entries of a probe sequence back into the hole, so a wrong shift shows
+// up as a page that can no longer be found.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstdlib>
+#include "pf.h"
+#include "pf_internal.h"
+#include "pf_hashtable.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define NUMFDS     4                   // # of files
+#define NUMPAGES   500                 // # of pages of each file
+#define NUMROUNDS  20                  // # of rounds of inserts and deletes
+#define NUMOPS     2000                // # of inserts and deletes per round
+#define NOSLOT     (-1)                // page not in the table
+
+int slots[NUMFDS][NUMPAGES];           // slot of each page in the table
+
+//
+// Find, Insert, Delete
+//
+// Operations on a PF_HashTable or on a PF_PageTable, whose partition is
+// locked around them
+//
+RC Find(PF_HashTable &table, int fd, PageNum pageNum, int &slot)
+{
+   return (table.Find(fd, pageNum, slot));
+}
+
+RC Insert(PF_HashTable &table, int fd, PageNum pageNum, int slot)
+{
+   return (table.Insert(fd, pageNum, slot));
+}
+
+RC Delete(PF_HashTable &table, int fd, PageNum pageNum)
+{
+   return (table.Delete(fd, pageNum));
+}
+
+RC Find(PF_PageTable &table, int fd, PageNum pageNum, int &slot)
+{
+   table.Lock(fd, pageNum);
+   RC rc = table.Find(fd, pageNum, slot);
+   table.Unlock(fd, pageNum);
+   return (rc);
+}
+
+RC Insert(PF_PageTable &table, int fd, PageNum pageNum, int slot)
+{
+   table.Lock(fd, pageNum);
+   RC rc = table.Insert(fd, pageNum, slot);
+   table.Unlock(fd, pageNum);
+   return (rc);
+}
+
+RC Delete(PF_PageTable &table, int fd, PageNum pageNum)
+{
+   table.Lock(fd, pageNum);
+   RC rc = table.Delete(fd, pageNum);
+   table.Unlock(fd, pageNum);
+   return (rc);
+}
+
+//
+// Verify
+//
+// Look up every page of every file in table.  Exits if a page is not
+// where slots says it is.
+//
+template <class Table>
+void Verify(Table &table, const char *when)
+{
+   int fd, slot;
+   PageNum pageNum;
+   RC rc;
+
+   for (fd = 0; fd < NUMFDS; fd++)
+      for (pageNum = 0; pageNum < NUMPAGES; pageNum++) {
+         rc = Find(table, fd, pageNum, slot);
+         if (slots[fd][pageNum] == NOSLOT && rc != PF_HASHNOTFOUND) {
+            cout << "FAILED!\n" << when << ": deleted page " << pageNum
+               << " of file " << fd << " found (" << rc << ")\n";
+            exit(1);
+         }
+         if (slots[fd][pageNum] != NOSLOT &&
+               (rc != 0 || slot != slots[fd][pageNum])) {
+            cout << "FAILED!\n" << when << ": page " << pageNum
+               << " of file " << fd << " not found (" << rc << ")\n";
+            exit(1);
+         }
+      }
+}
+
+//
+// TestTable
+//
+// Run the rounds of inserts and deletes on an empty table, then delete
+// the remaining pages one by one
+//
+template <class Table>
+RC TestTable(Table &table)
+{
+   int fd, round, i, slot;
+   PageNum pageNum;
+   char when[80];
+   RC rc;
+
+   srand(1);
+   for (fd = 0; fd < NUMFDS; fd++)
+      for (pageNum = 0; pageNum < NUMPAGES; pageNum++)
+         slots[fd][pageNum] = NOSLOT;
+
+   for (round = 0; round < NUMROUNDS; round++) {
+      for (i = 0; i < NUMOPS; i++) {
+         fd = rand() % NUMFDS;
+         pageNum = rand() % NUMPAGES;
+
+         // Delete the page if it is there, otherwise insert it.  Every
+         // tenth operation is also tried a second time, and must fail.
+         if (slots[fd][pageNum] != NOSLOT) {
+            if ((rc = Delete(table, fd, pageNum)))
+               return (rc);
+            slots[fd][pageNum] = NOSLOT;
+            if (i % 10 == 0 &&
+                  (rc = Delete(table, fd, pageNum)) != PF_HASHNOTFOUND) {
+               cout << "FAILED!\nDeleted page deleted again (" << rc
+                  << ")\n";
+               exit(1);
+            }
+         }
+         else {
+            slot = rand() % (NUMFDS * NUMPAGES);
+            if ((rc = Insert(table, fd, pageNum, slot)))
+               return (rc);
+            slots[fd][pageNum] = slot;
+            if (i % 10 == 0 &&
+                  (rc = Insert(table, fd, pageNum, slot)) != PF_HASHPAGEEXIST) {
+               cout << "FAILED!\nInserted page inserted again (" << rc
+                  << ")\n";
+               exit(1);
+            }
+         }
+      }
+      sprintf(when, "Round %d", round);
+      Verify(table, when);
+
+      // Shrink the table as much as it allows, or make it roomy; the
+      // next round goes on from the resized table
+      if ((rc = table.Resize(round % 2 ? NUMFDS * NUMPAGES * 4 : 1)))
+         return (rc);
+      sprintf(when, "Resize after round %d", round);
+      Verify(table, when);
+   }
+
+   // Empty the table in a random order
+   for (i = 0; i < NUMFDS * NUMPAGES; i++) {
+      fd = rand() % NUMFDS;
+      pageNum = rand() % NUMPAGES;
+      if (slots[fd][pageNum] == NOSLOT)
+         continue;
+      if ((rc = Delete(table, fd, pageNum)))
+         return (rc);
+      slots[fd][pageNum] = NOSLOT;
+      if (i % 50 == 0)
+         Verify(table, "Emptying");
+   }
+   for (fd = 0; fd < NUMFDS; fd++)
+      for (pageNum = 0; pageNum < NUMPAGES; pageNum++)
+         if (slots[fd][pageNum] != NOSLOT) {
+            if ((rc = Delete(table, fd, pageNum)))
+               return (rc);
+            slots[fd][pageNum] = NOSLOT;
+         }
+   Verify(table, "Empty");
+
+   return (0);
+}
+
+RC TestHashTable()
+{
+   PF_HashTable table(PF_HASH_TBL_SIZE);
+   RC rc;
+
+   cout << "Inserting and deleting PF_HashTable entries: ";
+   if ((rc = TestTable(table)))
+      return (rc);
+   cout << "Pass\n";
+   return (0);
+}
+
+RC TestPageTable()
+{
+   PF_PageTable table(PF_HASH_TBL_SIZE);
+   RC rc;
+
+   cout << "Inserting and deleting PF_PageTable entries: ";
+   if ((rc = TestTable(table)))
+      return (rc);
+   cout << "Pass\n";
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "Starting PF page table test.\n";
+   cout.flush();
+
+   // Do tests
+   if ((rc = TestHashTable()) ||
+         (rc = TestPageTable())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   // Write ending message and exit
+   cout << "Ending PF page table test.\n\n";
+
+   return (0);
+}
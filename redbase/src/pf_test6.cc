@@ -0,0 +1,220 @@
+//
+// File:        pf_test6.cc
+// Description: Test the page replacement policies of the PF component
+//
+// The pages of a file are read in a fixed order through a small buffer,
+// and the pages left in the buffer are then checked against those the
+// policy must keep: each must be found in the buffer, as counted by the
+// hits of the file's statistics.  The same order is run under PF_LRU
+// too, which must keep other pages.  Build with -DPF_STATS.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include "pf.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1      "file1"
+#define NUMPAGES   24                  // # of pages of FILE1
+#define BUFPAGES   8                   // # of pages of the buffer
+#define END        (-1)                // end of a list of pages
+
+//
+// WriteFile
+//
+// Create FILE1 with NUMPAGES pages
+//
+RC WriteFile()
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   PageNum pageNum;
+   int i;
+
+   if ((rc = pfm.CreateFile(FILE1)) ||
+         (rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (i = 0; i < NUMPAGES; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetPageNum(pageNum)) ||
+            (rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// Hits
+//
+// Return the number of hits of FILE1 in the statistics of pfm
+//
+int Hits(PF_Manager &pfm)
+{
+   PF_FileStats stats;
+
+   for (int i = 0; !pfm.GetFileStats(i, stats); i++)
+      if (!strcmp(stats.fileName, FILE1))
+         return (stats.hits);
+   return (0);
+}
+
+//
+// ReadPages
+//
+// Get and unpin the pages of list, in order
+//
+RC ReadPages(PF_FileHandle &fh, const PageNum *list)
+{
+   PF_PageHandle ph;
+   RC rc;
+
+   for (; *list != END; list++)
+      if ((rc = fh.GetThisPage(*list, ph)) ||
+            (rc = fh.UnpinPage(*list)))
+         return (rc);
+   return (0);
+}
+
+//
+// CheckBuffer
+//
+// Check that every page of list is in the buffer.  Exits if one is not.
+//
+RC CheckBuffer(PF_Manager &pfm, PF_FileHandle &fh, const PageNum *list)
+{
+   PF_PageHandle ph;
+   RC rc;
+   int hits;
+
+   for (; *list != END; list++) {
+      hits = Hits(pfm);
+      if ((rc = fh.GetThisPage(*list, ph)) ||
+            (rc = fh.UnpinPage(*list)))
+         return (rc);
+      if (Hits(pfm) != hits + 1) {
+         cout << "FAILED!\nPage " << *list << " is not in the buffer\n";
+         exit(1);
+      }
+   }
+   return (0);
+}
+
+//
+// RunPolicy
+//
+// Read the pages of access under policy, then check that those of
+// resident are in the buffer.  Each run has a PF_Manager of its own,
+// which is the only one while it lasts (PF_STATS keeps the statistics
+// of a single manager).
+//
+RC RunPolicy(PF_ReplacePolicy policy, const char *name,
+      const PageNum *access, const PageNum *resident)
+{
+   PF_Manager pfm(BUFPAGES, policy);
+   PF_FileHandle fh;
+   RC rc;
+
+   cout << "  " << name << ": ";
+   if ((rc = pfm.OpenFile(FILE1, fh)) ||
+         (rc = ReadPages(fh, access)) ||
+         (rc = CheckBuffer(pfm, fh, resident)) ||
+         (rc = pfm.CloseFile(fh)))
+      return (rc);
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// TestClock
+//
+// The buffer is filled, and reading page 8 sweeps the clock hand once
+// around, clearing every reference bit; the hand then stops at page 1.
+// Page 2 is referenced again.  Reading page 10 passes over page 2 and
+// clears its bit, and pages 9 to 14 go in the frames of the pages ahead
+// of the hand.  For page 15 the hand clears the bits of the pages read
+// since, wraps around and evicts page 2, where LRU evicts page 8.
+//
+RC TestClock()
+{
+   static const PageNum access[] =
+      { 0, 1, 2, 3, 4, 5, 6, 7, 8, 2, 9, 10, 11, 12, 13, 14, 15, END };
+   static const PageNum clockPages[] =
+      { 8, 9, 10, 11, 12, 13, 14, 15, END };
+   static const PageNum lruPages[] =
+      { 2, 9, 10, 11, 12, 13, 14, 15, END };
+   RC rc;
+
+   cout << "Second chance of referenced pages:\n";
+   if ((rc = RunPolicy(PF_CLOCK, "PF_CLOCK", access, clockPages)) ||
+         (rc = RunPolicy(PF_LRU, "PF_LRU", access, lruPages)))
+      return (rc);
+   return (0);
+}
+
+//
+// Test2Q
+//
+// Pages 0 to 8 fill the buffer's FIFO, pushing page 0 out.  Pages 0 to
+// 3 are read again while they are remembered as recently evicted, each
+// pushing the next page out of the FIFO, so they go to the main list.
+// A scan of pages 10 to 19 then only replaces pages of the FIFO under
+// 2Q; under LRU it replaces the whole buffer.
+//
+RC Test2Q()
+{
+   static const PageNum access[] =
+      { 0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3,
+        10, 11, 12, 13, 14, 15, 16, 17, 18, 19, END };
+   static const PageNum twoQPages[] =
+      { 0, 1, 2, 3, 16, 17, 18, 19, END };
+   static const PageNum lruPages[] =
+      { 12, 13, 14, 15, 16, 17, 18, 19, END };
+   RC rc;
+
+   cout << "Scan resistance:\n";
+   if ((rc = RunPolicy(PF_2Q, "PF_2Q", access, twoQPages)) ||
+         (rc = RunPolicy(PF_LRU, "PF_LRU", access, lruPages)))
+      return (rc);
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "Starting PF replacement policy test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   // Do tests
+   if ((rc = WriteFile()) ||
+         (rc = TestClock()) ||
+         (rc = Test2Q())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF replacement policy test.\n\n";
+
+   return (0);
+}
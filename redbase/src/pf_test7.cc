@@ -0,0 +1,221 @@
+//
+// File:        pf_test7.cc
+// Description: Test that pages read ahead are not used once out of date
+//
+// A file is scanned with GetNextPage through a small buffer, so that the
+// prefetcher reads ahead of the scan.  Pages ahead of the scan were
+// disposed of before it started; once the read-ahead is issued they are
+// allocated again and written with new contents, and the scan pushes
+// them out of the buffer before it gets to them.  The write must drop the
+// copies read ahead: the scan must see the new contents.  Build with
+// -DPF_STATS.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1      "file1"
+#define NUMPAGES   64                  // # of pages of FILE1
+#define BUFPAGES   8                   // # of pages of the buffer
+#define NUMNEW     3                   // # of pages written during the scan
+
+static const PageNum newPages[NUMNEW] = { 10, 20, 30 };
+
+//
+// Contents of a page: its number, and how many times it was written
+//
+struct TestPage {
+   PageNum pageNum;
+   int     version;
+};
+
+//
+// WritePage
+//
+// Fill a pinned page and unpin it
+//
+RC WritePage(PF_FileHandle &fh, PF_PageHandle &ph, int version)
+{
+   TestPage page;
+   char *pData;
+   RC rc;
+
+   if ((rc = ph.GetData(pData)) ||
+         (rc = ph.GetPageNum(page.pageNum)))
+      return (rc);
+   page.version = version;
+   memcpy(pData, &page, sizeof(page));
+   if ((rc = fh.MarkDirty(page.pageNum)) ||
+         (rc = fh.UnpinPage(page.pageNum)))
+      return (rc);
+   return (0);
+}
+
+//
+// WriteFile
+//
+// Create FILE1 with NUMPAGES pages of version 0, and dispose of the
+// pages of newPages
+//
+RC WriteFile(PF_Manager &pfm)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   int i;
+
+   if ((rc = pfm.CreateFile(FILE1)) ||
+         (rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (i = 0; i < NUMPAGES; i++)
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = WritePage(fh, ph, 0)))
+         return (rc);
+
+   for (i = 0; i < NUMNEW; i++)
+      if ((rc = fh.DisposePage(newPages[i])))
+         return (rc);
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// Reads
+//
+// Return the number of pages of FILE1 read, read ahead included
+//
+int Reads(PF_Manager &pfm)
+{
+   PF_FileStats stats;
+
+   for (int i = 0; !pfm.GetFileStats(i, stats); i++)
+      if (!strcmp(stats.fileName, FILE1))
+         return (stats.reads);
+   return (0);
+}
+
+//
+// CheckPage
+//
+// Check the contents of a page got by the scan, and unpin it.  Exits if
+// they are not the expected ones.
+//
+RC CheckPage(PF_FileHandle &fh, PF_PageHandle &ph)
+{
+   TestPage page;
+   PageNum pageNum;
+   char *pData;
+   int version = 0;
+   RC rc;
+
+   if ((rc = ph.GetData(pData)) ||
+         (rc = ph.GetPageNum(pageNum)))
+      return (rc);
+   memcpy(&page, pData, sizeof(page));
+
+   for (int i = 0; i < NUMNEW; i++)
+      if (pageNum == newPages[i])
+         version = 1;
+   if (page.pageNum != pageNum || page.version != version) {
+      cout << "FAILED!\nPage " << pageNum << " holds page " << page.pageNum
+         << ", version " << page.version << " instead of version "
+         << version << "\n";
+      exit(1);
+   }
+
+   return (fh.UnpinPage(pageNum));
+}
+
+RC TestInvalidate()
+{
+   PF_Manager pfm(BUFPAGES);
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   PageNum pageNum;
+   RC rc;
+   int i;
+
+   if ((rc = WriteFile(pfm)))
+      return (rc);
+
+   cout << "Writing pages read ahead of a scan: ";
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   // The second page of the scan starts the read-ahead
+   for (pageNum = -1; pageNum < 1; ) {
+      if ((rc = fh.GetNextPage(pageNum, ph)) ||
+            (rc = ph.GetPageNum(pageNum)) ||
+            (rc = CheckPage(fh, ph)))
+         return (rc);
+   }
+   if (Reads(pfm) < 2 + PF_PREFETCH_WINDOW) {
+      cout << "FAILED!\nNo pages were read ahead\n";
+      exit(1);
+   }
+
+   // Get the last page read ahead, which waits until the I/O thread has
+   // read all of them: the pages are then written after they were read
+   pageNum = 1 + PF_PREFETCH_WINDOW;
+   if ((rc = fh.GetThisPage(pageNum, ph)) ||
+         (rc = CheckPage(fh, ph)))
+      return (rc);
+   pageNum = 1;
+
+   // Write the disposed pages again, where the read-ahead got them
+   for (i = 0; i < NUMNEW; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = WritePage(fh, ph, 1)))
+         return (rc);
+   }
+
+   // Scan the rest of the file
+   while ((rc = fh.GetNextPage(pageNum, ph)) != PF_EOF) {
+      if (rc ||
+            (rc = ph.GetPageNum(pageNum)) ||
+            (rc = CheckPage(fh, ph)))
+         return (rc);
+   }
+
+   if ((rc = pfm.CloseFile(fh)) ||
+         (rc = pfm.DestroyFile(FILE1)))
+      return (rc);
+   cout << "Pass\n";
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "Starting PF read-ahead test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   // Do tests
+   if ((rc = TestInvalidate())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   // Write ending message and exit
+   cout << "Ending PF read-ahead test.\n\n";
+
+   return (0);
+}
@@ -0,0 +1,219 @@
+//
+// File:        pf_test8.cc
+// Description: Test the free-space map of PF files
+//
+// Pages of a file that spans two map pages are disposed of, in both
+// groups.  After the file is closed and opened again they must still be
+// free, and AllocatePage must hand them out again, lowest first, before
+// it adds pages at the end of the file.  The pages allocated must still
+// be used once the file is opened again.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1       "file1"
+#define GROUPPAGES  PF_GroupPages(PF_MIN_PAGE_SIZE)  // pages per map page
+#define NUMPAGES    (GROUPPAGES + 16)   // # of pages of FILE1
+#define NUMFREE     6                   // # of pages disposed of
+
+// Pages disposed of, in increasing order: in the first group, at its
+// end, and in the second group
+static const PageNum freePages[NUMFREE] =
+   { 3, 4, 100, GROUPPAGES - 1, GROUPPAGES, GROUPPAGES + 5 };
+
+//
+// IsFree
+//
+// Return TRUE if pageNum is one of freePages
+//
+int IsFree(PageNum pageNum)
+{
+   for (int i = 0; i < NUMFREE; i++)
+      if (pageNum == freePages[i])
+         return (TRUE);
+   return (FALSE);
+}
+
+//
+// WriteFile
+//
+// Create FILE1 with NUMPAGES pages, each holding its page number
+//
+RC WriteFile(PF_Manager &pfm)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int i;
+
+   cout << "Creating file: " << FILE1 << "\n";
+   if ((rc = pfm.CreateFile(FILE1)) ||
+         (rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (i = 0; i < NUMPAGES; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+      if (pageNum != i) {
+         cout << "AllocatePage returned page " << pageNum << " instead of "
+            << i << "\n";
+         return (PF_INVALIDPAGE);
+      }
+      memcpy(pData, (char *)&pageNum, sizeof(PageNum));
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckPages
+//
+// Check the pages of freePages and their neighbours: the pages of
+// freePages must be free if bFree, and the others must hold their page
+// number.  Exits if one does not.
+//
+RC CheckPages(PF_FileHandle &fh, int bFree)
+{
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum, pageData;
+   int i;
+
+   for (i = 0; i < NUMFREE; i++)
+      for (pageNum = freePages[i] - 1; pageNum <= freePages[i] + 1;
+            pageNum++) {
+         rc = fh.GetThisPage(pageNum, ph);
+         if (bFree && IsFree(pageNum)) {
+            if (rc != PF_INVALIDPAGE) {
+               cout << "FAILED!\nFree page " << pageNum << " was read ("
+                  << rc << ")\n";
+               exit(1);
+            }
+            continue;
+         }
+         if (rc ||
+               (rc = ph.GetData(pData)))
+            return (rc);
+         memcpy((char *)&pageData, pData, sizeof(PageNum));
+         if (pageData != pageNum) {
+            cout << "FAILED!\nPage " << pageNum << " holds " << pageData
+               << "\n";
+            exit(1);
+         }
+         if ((rc = fh.UnpinPage(pageNum)))
+            return (rc);
+      }
+   return (0);
+}
+
+RC TestFreeMap()
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int i;
+
+   if ((rc = WriteFile(pfm)))
+      return (rc);
+
+   cout << "Disposing of pages: ";
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+   for (i = 0; i < NUMFREE; i++)
+      if ((rc = fh.DisposePage(freePages[i])))
+         return (rc);
+   if ((rc = CheckPages(fh, TRUE)) ||
+         (rc = pfm.CloseFile(fh)))
+      return (rc);
+   cout << "Pass\n";
+
+   // The pages are still free, and are allocated again in order, before
+   // a page is added at the end
+   cout << "Allocating the free pages: ";
+   if ((rc = pfm.OpenFile(FILE1, fh)) ||
+         (rc = CheckPages(fh, TRUE)))
+      return (rc);
+   for (i = 0; i <= NUMFREE; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+      if (pageNum != (i < NUMFREE ? freePages[i] : NUMPAGES)) {
+         cout << "FAILED!\nAllocatePage returned page " << pageNum << "\n";
+         exit(1);
+      }
+      memcpy(pData, (char *)&pageNum, sizeof(PageNum));
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+   if ((rc = pfm.CloseFile(fh)))
+      return (rc);
+   cout << "Pass\n";
+
+   // They are used once the file is opened again
+   cout << "Reading the pages allocated: ";
+   if ((rc = pfm.OpenFile(FILE1, fh)) ||
+         (rc = CheckPages(fh, FALSE)) ||
+         (rc = fh.GetThisPage(NUMPAGES, ph)) ||
+         (rc = fh.UnpinPage(NUMPAGES)) ||
+         (rc = fh.AllocatePage(ph)) ||
+         (rc = ph.GetPageNum(pageNum)))
+      return (rc);
+   if (pageNum != NUMPAGES + 1) {
+      cout << "FAILED!\nAllocatePage returned page " << pageNum << "\n";
+      exit(1);
+   }
+   if ((rc = fh.UnpinPage(pageNum)) ||
+         (rc = pfm.CloseFile(fh)))
+      return (rc);
+   cout << "Pass\n";
+
+   return (pfm.DestroyFile(FILE1));
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "Starting PF free-space map test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   // Do tests
+   if ((rc = TestFreeMap())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   // Write ending message and exit
+   cout << "Ending PF free-space map test.\n\n";
+
+   return (0);
+}
@@ -175,10 +175,20 @@ RC FindAccessMethods(const char* relName, qNode* &branch,
     RC rc;
     if ((rc = smm->FillDataAttributes(relName, attributes, attrCount))) return rc;        
 
+    /* bufstat has no file: its tuples come from the buffer manager, and
+       all the conditions on it are left to a filter */
+    if (strcmp(relName, "bufstat") == 0) {
+        branch = static_cast<qNode*> (new qStatScan(attrCount, attributes, smm));
+        return 0;
+    }
+
+    /* The tuples of a select are only read: the scans return them where
+       they are in their pages instead of copying them */
+
     /* Attempt to find an indexed condition for IndexScan */
     int indexedCond = FindIndexedAttrCond(remainingCond.size(), conditions, attributes, attrCount, -1);
     if (indexedCond != -1) {
-        branch = static_cast<qNode*> (new qIndexScan(attrCount, attributes, conditions[indexedCond], rmm, ixm));
+        branch = static_cast<qNode*> (new qIndexScan(attrCount, attributes, conditions[indexedCond], rmm, ixm, 1));
         remainingCond.erase(std::remove(remainingCond.begin(), remainingCond.end(), indexedCond), remainingCond.end());
     
     /* If attempt failed, do TableScan instead */
@@ -188,7 +198,7 @@ RC FindAccessMethods(const char* relName, qNode* &branch,
             Condition c = conditions[remainingCond[j]];
             DataAttrInfo info;
             if (!c.bRhsIsAttr && checkAttrExists(c.lhsAttr, attributes, attrCount, info) == 0) {
-                branch = static_cast<qNode*> (new qTableScan(attrCount, attributes, conditions[remainingCond[j]], NULL, rmm));
+                branch = static_cast<qNode*> (new qTableScan(attrCount, attributes, conditions[remainingCond[j]], NULL, rmm, 1, smm->MappedScans()));
                 remainingCond.erase(remainingCond.begin() + j);
                 scanConditionFound = 1;
                 break;
@@ -197,7 +207,7 @@ RC FindAccessMethods(const char* relName, qNode* &branch,
 
         if (!scanConditionFound) {
             Condition nullCondition;
-            branch = static_cast<qNode*> (new qTableScan(attrCount, attributes, nullCondition, relName, rmm));
+            branch = static_cast<qNode*> (new qTableScan(attrCount, attributes, nullCondition, relName, rmm, 1, smm->MappedScans()));
         }
     }
     return 0;
@@ -369,6 +379,8 @@ RC QL_Manager::Insert(const char *relName,
         abort();
     }
 
+    if (strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
+
     RM_Record relRecord;
     if ((rc = smm_->FindRelMetadata(relName, relRecord))) return rc;
     RelcatTuple *relMetadata = smm_->GetRelcatTuple(relRecord);
@@ -388,9 +400,9 @@ RC QL_Manager::Insert(const char *relName,
     }
 
     int singleStatementXact = 0;
-    if (!lgm_->bInTransaction) {
+    if (!lgm_->InTransaction()) {
+        if ((rc = lgm_->BeginT())) { delete[] attributes; return rc; }
         singleStatementXact = 1;
-        lgm_->BeginT();
     } 
 
     /* Insert a new tuple into record file and create a corresponding log record */
@@ -478,6 +490,7 @@ RC QL_Manager::Delete(const char *relName,
     for (i = 0; i < nConditions; i++) 
         cout << "   conditions[" << i << "]:" << conditions[i] << "\n"; 
 
+    if (strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
     
     RM_Record relRecord;
     if ((rc = smm_->FindRelMetadata(relName, relRecord))) return rc;
@@ -533,9 +546,11 @@ RC QL_Manager::Delete(const char *relName,
     root = static_cast<qNode*> (new qDelete(root, relName, rmm_, ixm_, lgm_));
 
     int singleStatementXact = 0;
-    if (!lgm_->bInTransaction) {
+    if (!lgm_->InTransaction()) {
+        if ((rc = lgm_->BeginT())) {
+            DeleteQueryPlan(root); delete[] attributes; return rc;
+        }
         singleStatementXact = 1;
-        lgm_->BeginT();
     } 
     if ((rc = ExecuteQueryPlan(root)) == 0) {
         /* Update relation metadata (numTuples) */
@@ -575,6 +590,8 @@ RC QL_Manager::Update(const char *relName,
     for (i = 0; i < nConditions; i++) 
         cout << "   conditions[" << i << "]:" << conditions[i] << "\n";
     
+    if (strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
+
     /* Validate attributes and conditions */
     DataAttrInfo *attributes; int attrCount;
     if ((rc = smm_->FillDataAttributes(relName, attributes, attrCount))) return rc;
@@ -631,9 +648,11 @@ RC QL_Manager::Update(const char *relName,
 
 
     int singleStatementXact = 0;
-    if (!lgm_->bInTransaction) {
+    if (!lgm_->InTransaction()) {
+        if ((rc = lgm_->BeginT())) {
+            DeleteQueryPlan(root); delete[] attributes; return rc;
+        }
         singleStatementXact = 1;
-        lgm_->BeginT();
     } 
     rc = ExecuteQueryPlan(root);
     if (singleStatementXact) lgm_->CommitT();
@@ -45,7 +45,7 @@ int CheckConditionMet(int comp, const CompOp op) {
 }
 
 /* If relName != NULL, do a full scan. Otherwise, do a condition scan based on condition. */
-qTableScan::qTableScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, const char *relName, RM_Manager *rmm) {
+qTableScan::qTableScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, const char *relName, RM_Manager *rmm, int bView, int bMapped) {
     type = TABLE_SCAN;
     this->child = NULL; this->rchild = NULL;
     this->attrCount = attrCount;
@@ -60,16 +60,26 @@ qTableScan::qTableScan(int attrCount, DataAttrInfo *attributes, const Condition
         fullScan = 0;
     }
     this->rmm = rmm;
+    this->bView = bView;
+    this->bMapped = bMapped;
     initialized = 0;
 }
 
 RC qTableScan::Begin() {
     RC rc;
-    if ((rc = rmm->OpenFile(relName, fh))) return rc;
+    /* A select only reads the relation: it may map it instead of bringing
+       its pages into the buffer pool (Set mappedScans).  The catalogs stay
+       open for writing in the SM_Manager, so their latest pages may be in
+       the pool only. */
+    PF_OpenMode mode = PF_READWRITE;
+    if (bView && bMapped && strcmp(relName, "relcat") != 0 && strcmp(relName, "attrcat") != 0)
+        mode = PF_MAPPED;
+    if ((rc = rmm->OpenFile(relName, fh, mode))) return rc;
+    /* Every page of the relation is read once: keep them out of the shared buffer pool */
     if (fullScan) {
-        if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL))) return rc;    
+        if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL, SEQUENTIAL_SCAN))) return rc;    
     } else {
-        if ((rc = fs.OpenScan(fh, condAttrInfo.attrType, condAttrInfo.attrLength, condAttrInfo.offset, condition.op, condition.rhsValue.data))) return rc;
+        if ((rc = fs.OpenScan(fh, condAttrInfo.attrType, condAttrInfo.attrLength, condAttrInfo.offset, condition.op, condition.rhsValue.data, SEQUENTIAL_SCAN))) return rc;
     }
     initialized = 1;
     return 0;
@@ -82,9 +92,10 @@ RC qTableScan::GetNext(RM_Record &rec) {
         if ((rc = Begin())) return rc;
     }
 
-    rc = fs.GetNextRec(rec);
+    rc = fs.GetNextRec(rec, bView);
     /* Clean up if no more tuples */
     if (rc == RM_EOF) {
+        rec.Release();
         if ((rc = fs.CloseScan())) return rc;
         if ((rc = rmm->CloseFile(fh))) return rc;
         return QL_ENDOFRESULT;
@@ -105,7 +116,37 @@ void qTableScan::PrintOp(string whitespace) {
 
 
 
-qIndexScan::qIndexScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, RM_Manager *rmm, IX_Manager *ixm) {
+qStatScan::qStatScan(int attrCount, DataAttrInfo *attributes, SM_Manager *smm) {
+    type = STAT_SCAN;
+    this->child = NULL; this->rchild = NULL;
+    this->attrCount = attrCount;
+    this->attributes = attributes;
+    this->smm = smm;
+    nextFile = 0;
+    initialized = 1;
+}
+
+RC qStatScan::GetNext(RM_Record &rec) {
+    RC rc;
+    BufstatTuple tuple;
+    rc = smm->GetBufstatTuple(nextFile, tuple);
+    if (rc == PF_EOF) return QL_ENDOFRESULT;
+    if (rc) return rc;
+    nextFile++;
+
+    /* The tuple is made here: copy it into rec as qJoin does */
+    memcpy(rec.Alloc(sizeof(BufstatTuple)), &tuple, sizeof(BufstatTuple));
+    return 0;
+}
+
+void qStatScan::PrintOp(string whitespace) {
+    cout << whitespace << "<<STAT SCAN>> on bufstat" << endl;
+    cout << whitespace << "(Buffer statistics of each file)" << endl;
+}
+
+
+
+qIndexScan::qIndexScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, RM_Manager *rmm, IX_Manager *ixm, int bView) {
     type = INDEX_SCAN;
     this->child = NULL; this->rchild = NULL;
     this->attrCount = attrCount;
@@ -114,6 +155,7 @@ qIndexScan::qIndexScan(int attrCount, DataAttrInfo *attributes, const Condition
     FindAttributeInfo(condition.lhsAttr, attributes, attrCount, condAttrInfo);     
     this->rmm = rmm;
     this->ixm = ixm;
+    this->bView = bView;
     initialized = 0;
 }
 
@@ -137,6 +179,8 @@ RC qIndexScan::GetNext(RM_Record &rec) {
     rc = is.GetNextEntry(rid);
     /* Clean up if no more tuples */
     if (rc == IX_EOF) {
+        /* The last tuple may keep its page pinned */
+        if ((rc = rec.Release())) return rc;
         if ((rc = is.CloseScan())) return rc;
         if ((rc = ixm->CloseIndex(ih))) return rc;
         if ((rc = rmm->CloseFile(fh))) return rc;
@@ -145,7 +189,7 @@ RC qIndexScan::GetNext(RM_Record &rec) {
     if (rc) return rc;
 
     /* Fetch record from record file */
-    if ((rc = fh.GetRec(rid, rec))) return rc;
+    if ((rc = fh.GetRec(rid, rec, bView))) return rc;
     return 0;
 }
 
@@ -240,21 +284,21 @@ RC qJoin::GetNext(RM_Record &rec) {
 
     RID rid; char *pData1; char *pData2;
     while (1) {
-        /* Get next tuple in rchild */
+        /* Get next tuple in rchild: it is copied into the joined tuple, so
+           it is not copied out of its page first */
         RM_Record rec2;
-        rc = rchildFs.GetNextRec(rec2);
+        rc = rchildFs.GetNextRec(rec2, TRUE);
 
         if (rc != 0 && rc != RM_EOF) return rc;
 
         /* Combine a tuple from child and rchild and check if it meets condition */
         if (rc == 0) {
-            /* Combine data from two tuples */
-            if (rec.valid_) delete[] rec.contents_;
-            rec.contents_ = new char[joinedTupleSize];
+            /* Combine data from two tuples (in the buffer of rec, which
+               is reused from one tuple to the next) */
+            rec.Alloc(joinedTupleSize);
             rec1.GetData(pData1); rec2.GetData(pData2);
             memcpy(rec.contents_, pData1, childTupleSize);
             memcpy(rec.contents_ + childTupleSize, pData2, rchildTupleSize);
-            rec.valid_ = 1;
 
             /* Check if each condition is met */
             int conditionMet = 1;
@@ -9,6 +9,7 @@
 #include "printer.h"
 #include "rm.h"
 #include "ix.h"
+#include "sm.h"
 #include "comp.h"
 
 using namespace std;
@@ -16,7 +17,7 @@ using namespace std;
 #define QL_ENDOFRESULT  (START_QL_WARN + 0)
 
 enum OpType {
-    UPDATE, DELETE, PROJECT, FILTER, TABLE_SCAN, INDEX_SCAN, NESTED_LOOP_JOIN
+    UPDATE, DELETE, PROJECT, FILTER, TABLE_SCAN, INDEX_SCAN, NESTED_LOOP_JOIN, STAT_SCAN
 };
 
 /* Base qNode struct (for query tree traversal) */
@@ -39,8 +40,11 @@ public:
    Do a table scan and extract tuples that meet specified condition. */
 class qTableScan : public qNode {
 public:
-    /* If relName != NULL, do a full scan. Otherwise, do a condition scan based on condition. */
-    qTableScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, const char *relName, RM_Manager *rmm);
+    /* If relName != NULL, do a full scan. Otherwise, do a condition scan based on condition.
+       If bView, the tuples point into their pinned pages instead of being copied:
+       each is valid until the next call of GetNext.  Such a scan only reads,
+       and if bMapped, maps the file of a user relation (PF_MAPPED). */
+    qTableScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, const char *relName, RM_Manager *rmm, int bView = 0, int bMapped = 0);
     RC Begin();
     RC GetNext(RM_Record &rec);
     void PrintOp(string whitespace);
@@ -53,6 +57,8 @@ private:
     RM_FileHandle fh; 
     RM_FileScan fs;
     RM_Manager *rmm;
+    int bView;                  // 1 if tuples point into their pages
+    int bMapped;                // 1 if the file is mapped
 };
 
 
@@ -60,7 +66,8 @@ private:
    Do an index scan and extract tuples that meet specified condition. */
 class qIndexScan : public qNode {
 public:
-    qIndexScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, RM_Manager *rmm, IX_Manager *ixm);
+    /* If bView, each tuple points into its page, which stays pinned until the next call of GetNext */
+    qIndexScan(int attrCount, DataAttrInfo *attributes, const Condition &condition, RM_Manager *rmm, IX_Manager *ixm, int bView = 0);
     RC Begin();
     RC GetNext(RM_Record &rec);
     void PrintOp(string whitespace);
@@ -73,6 +80,21 @@ private:
     IX_IndexScan is;
     RM_Manager *rmm;
     IX_Manager *ixm;
+    int bView;                  // 1 if tuples point into their pages
+};
+
+
+/* Operand (leaf) of a query tree.
+   Return the tuples of the bufstat relation: the buffer statistics of each file. */
+class qStatScan : public qNode {
+public:
+    qStatScan(int attrCount, DataAttrInfo *attributes, SM_Manager *smm);
+    RC GetNext(RM_Record &rec);
+    void PrintOp(string whitespace);
+
+private:
+    int nextFile;               // # of the file whose statistics are returned next
+    SM_Manager *smm;
 };
 
 
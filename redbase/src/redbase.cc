@@ -6,11 +6,23 @@
 // This shell is provided for the student.
 
 #include <iostream>
+#include <sstream>
 #include <cstdio>
 #include <cstring>
+#include <string>
+#include <cerrno>
+#include <csignal>
 #include <unistd.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#undef PF_UNIX                     // pf.h has its own PF_UNIX, so AF_UNIX
+                                   //   is spelled AF_LOCAL below
 #include "redbase.h"
+#include "parser_internal.h"
+#include "pf.h"
 #include "rm.h"
 #include "sm.h"
 #include "ql.h"
@@ -18,6 +30,354 @@
 
 using namespace std;
 
+//
+// Server mode
+//
+// With -s, redbase serves clients over a Unix domain socket instead of
+// reading commands from the standard input.  Each connection is a
+// session, run by one of a fixed pool of worker threads (-w, default
+// DEFAULT_WORKERS); connections wait in a queue for a free worker.  All
+// sessions share the database, and so its buffer pool, catalog and log.
+//
+// Each session has a parser of its own, with its own scanner and
+// settings such as queryplans, and an output stream that collects what
+// its commands print.  A session reads a whole command from its client
+// without holding any lock.  The layers above PF are not reentrant, so
+// the command then runs under engineMutex, and its output is sent to the
+// client once engineMutex is released: no lock is held while waiting on
+// a client.
+//
+// Transactions do not hold engineMutex either.  The log runs one
+// transaction at a time, which belongs to the session that began it (see
+// LG_Manager::SetSession): other sessions can still query, but their
+// updates are refused until it commits or aborts.  A session that
+// disconnects aborts its transaction.
+//
+// The server stops on SIGINT or SIGTERM.
+//
+#define DEFAULT_WORKERS  4          // default # of worker threads
+#define MAX_WORKERS      64         // max # of worker threads
+#define MAX_PENDING      64         // max # of connections waiting
+
+struct Engine {
+    PF_Manager *pPfm;
+    SM_Manager *pSmm;
+    QL_Manager *pQlm;
+    LG_Manager *pLgm;
+};
+
+struct Session {
+    int    fd;                      // client socket
+    int    id;                      // session of the log (never 0)
+    string pending;                 // input read but not run yet
+    struct parser *pParser;         // parser of the session
+    ostringstream out;              // output of the command being run
+};
+
+static Engine          engine;
+static pthread_mutex_t engineMutex = PTHREAD_MUTEX_INITIALIZER;
+static int             lastSessionId;
+
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queueCond = PTHREAD_COND_INITIALIZER;
+static int             queue[MAX_PENDING];   // connections waiting
+static int             queueHead, queueLen;
+static int             activeFd[MAX_WORKERS];  // session of each worker
+static volatile sig_atomic_t bShutdown;
+
+//
+// Stop
+//
+// Signal handler: make the server stop accepting connections.
+//
+static void Stop(int)
+{
+    bShutdown = 1;
+}
+
+//
+// ReadCommand
+//
+// Read the next command of a session: everything up to a ';' that is
+// not in a string constant or comment, or a shell command line.  Reads
+// more from the client while the input holds no complete command.
+// Returns FALSE when the client is gone.
+//
+static int ReadCommand(Session &session, string &command)
+{
+    string &in = session.pending;
+    size_t i = 0;                   // how far in has been scanned
+    int bString = FALSE;
+    int bComment = FALSE;
+    char buf[4096];
+
+    for (;;) {
+        // Blanks between commands are dropped
+        if (i == 0) {
+            size_t start = in.find_first_not_of(" \t\r\n");
+            in.erase(0, start == string::npos ? in.size() : start);
+        }
+
+        for (; i < in.size(); i++) {
+            char c = in[i];
+            if (bComment) {
+                if (c == '/' && i > 0 && in[i - 1] == '*')
+                    bComment = FALSE;
+            }
+            else if (bString) {
+                if (c == '"')
+                    bString = FALSE;
+                else if (c == '\n')
+                    bString = FALSE;    // the scanner reports the error
+            }
+            else if (in[0] == '!') {
+                if (c == '\n')
+                    break;
+            }
+            else if (c == '"')
+                bString = TRUE;
+            else if (c == '*' && i > 0 && in[i - 1] == '/')
+                bComment = TRUE;
+            else if (c == ';')
+                break;
+        }
+
+        if (i < in.size()) {
+            command = in.substr(0, i + 1);
+            in.erase(0, i + 1);
+            return (TRUE);
+        }
+
+        ssize_t n = read(session.fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return (FALSE);
+        in.append(buf, n);
+    }
+}
+
+//
+// WriteAll
+//
+// Write all of buf to the client.  Returns FALSE when the client is gone.
+//
+static int WriteAll(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return (FALSE);
+        buf += n;
+        len -= n;
+    }
+    return (TRUE);
+}
+
+//
+// RunCommand
+//
+// Run a command of a session, then send its output to the client.
+// Returns TRUE if the session should end.
+//
+static int RunCommand(Session &session, const string &command)
+{
+    int bEnd;
+
+    pthread_mutex_lock(&engineMutex);
+    engine.pLgm->SetSession(session.id);
+    bEnd = RBexecute(session.pParser, command.c_str());
+    pthread_mutex_unlock(&engineMutex);
+
+    string output = session.out.str();
+    session.out.str("");
+    return (!WriteAll(session.fd, output.data(), output.size()) || bEnd);
+}
+
+//
+// RunSession
+//
+// Serve one client until it disconnects or exits.  A transaction left
+// running is aborted.
+//
+static void RunSession(int fd)
+{
+    Session session;
+    string command;
+    RC rc;
+
+    session.fd = fd;
+    session.id = __sync_add_and_fetch(&lastSessionId, 1);
+    session.pParser = RBopen(*engine.pPfm, *engine.pSmm, *engine.pQlm,
+                             *engine.pLgm, session.out);
+    if (session.pParser == NULL) {
+        WriteAll(fd, "Out of memory.\n", 15);
+        return;
+    }
+
+    while (WriteAll(fd, PROMPT, strlen(PROMPT)) &&
+           ReadCommand(session, command) &&
+           !RunCommand(session, command))
+        ;
+
+    pthread_mutex_lock(&engineMutex);
+    engine.pLgm->SetSession(session.id);
+    if (engine.pLgm->InTransaction() && (rc = engine.pLgm->AbortT()))
+        PrintError(rc);
+    pthread_mutex_unlock(&engineMutex);
+
+    RBclose(session.pParser);
+    WriteAll(fd, "Bye.\n", 5);
+}
+
+//
+// RemoveSocket
+//
+// Remove the socket left at psPath by an earlier server.  Anything but
+// a socket is left alone (and bind fails on it).
+//
+static void RemoveSocket(const char *psPath)
+{
+    struct stat st;
+
+    if (lstat(psPath, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(psPath);
+}
+
+//
+// Worker
+//
+// Worker thread: run the sessions of queued connections until the
+// server stops.
+//
+static void *Worker(void *arg)
+{
+    long id = (long)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&queueMutex);
+        while (queueLen == 0 && !bShutdown)
+            pthread_cond_wait(&queueCond, &queueMutex);
+        if (queueLen == 0) {
+            pthread_mutex_unlock(&queueMutex);
+            break;
+        }
+        int fd = queue[queueHead];
+        queueHead = (queueHead + 1) % MAX_PENDING;
+        queueLen--;
+        activeFd[id] = fd;
+        pthread_mutex_unlock(&queueMutex);
+
+        RunSession(fd);
+
+        pthread_mutex_lock(&queueMutex);
+        activeFd[id] = -1;
+        pthread_mutex_unlock(&queueMutex);
+        close(fd);
+    }
+
+    return (NULL);
+}
+
+//
+// Serve
+//
+// Accept connections on the Unix socket psPath and hand them to
+// numWorkers worker threads, until SIGINT or SIGTERM.  Returns 0, or -1
+// if the server could not be started.
+//
+static int Serve(const char *psPath, int numWorkers)
+{
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    sigset_t stopSignals, oldMask;
+    pthread_t workers[MAX_WORKERS];
+    int listenFd, fd;
+    long i;
+
+    if (strlen(psPath) >= sizeof(addr.sun_path)) {
+        cerr << "Socket path too long: " << psPath << "\n";
+        return (-1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_LOCAL;
+    strcpy(addr.sun_path, psPath);
+    RemoveSocket(psPath);
+
+    if ((listenFd = socket(AF_LOCAL, SOCK_STREAM, 0)) < 0 ||
+        bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listenFd, MAX_PENDING) < 0) {
+        perror(psPath);
+        return (-1);
+    }
+
+    // A client that goes away must not kill the server.  SIGINT and
+    // SIGTERM interrupt accept (no SA_RESTART), and are only handled by
+    // this thread.
+    signal(SIGPIPE, SIG_IGN);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = Stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &oldMask);
+
+    for (i = 0; i < numWorkers; i++) {
+        activeFd[i] = -1;
+        pthread_create(&workers[i], NULL, Worker, (void *)i);
+    }
+    pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+
+    cout << "Serving on " << psPath << " with " << numWorkers
+         << " workers.\n";
+    cout.flush();
+
+    while (!bShutdown) {
+        if ((fd = accept(listenFd, NULL, NULL)) < 0) {
+            if (errno != EINTR)
+                perror("accept");
+            continue;
+        }
+
+        pthread_mutex_lock(&queueMutex);
+        if (queueLen == MAX_PENDING) {
+            pthread_mutex_unlock(&queueMutex);
+            write(fd, "Server busy.\n", 13);
+            close(fd);
+            continue;
+        }
+        queue[(queueHead + queueLen++) % MAX_PENDING] = fd;
+        pthread_cond_signal(&queueCond);
+        pthread_mutex_unlock(&queueMutex);
+    }
+
+    // Stop: drop the waiting connections, end the running sessions (a
+    // transaction in progress is aborted), and wait for the workers
+    close(listenFd);
+    RemoveSocket(psPath);
+
+    pthread_mutex_lock(&queueMutex);
+    for (; queueLen > 0; queueLen--) {
+        close(queue[queueHead]);
+        queueHead = (queueHead + 1) % MAX_PENDING;
+    }
+    for (i = 0; i < numWorkers; i++)
+        if (activeFd[i] != -1)
+            shutdown(activeFd[i], SHUT_RDWR);
+    pthread_cond_broadcast(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+
+    for (i = 0; i < numWorkers; i++)
+        pthread_join(workers[i], NULL);
+
+    return (0);
+}
+
 //
 // main
 //
@@ -25,32 +385,107 @@ int main(int argc, char *argv[])
 {
     char *dbname;
     RC rc;
+    int numBufferPages = 0;             // 0 = default buffer size
+    char *psBufferSize = NULL;
+    int pageSize;
+    PF_ReplacePolicy policy = PF_LRU;
+    int bDirectIO = FALSE;
+    int bWriter = FALSE;
+    int bHugePages = FALSE;
+    char *psSocket = NULL;              // NULL = read from stdin
+    int numWorkers = DEFAULT_WORKERS;
+    int opt;
 
-    // Look for 2 arguments.  The first is always the name of the program
-    // that was executed, and the second should be the name of the
-    // database.
-    if (argc < 2 || argc > 3) {
-        cerr << "Usage: " << argv[0] << " dbname \n";
+    // Options come first:
+    //   -b size   number of buffer pages, or bytes with a K/M/G suffix
+    //   -p policy buffer replacement policy: lru (default), clock or 2q
+    //   -d        bypass the OS cache (O_DIRECT); for use with a large -b
+    //   -W        write dirty buffer pages in the background
+    //   -H        map the buffer with explicit (reserved) huge pages
+    //   -s path   serve clients on the Unix socket path
+    //   -w num    number of worker threads of the server
+    while ((opt = getopt(argc, argv, "b:p:dWHs:w:")) != -1) {
+        switch (opt) {
+        case 'b':
+            psBufferSize = optarg;
+            break;
+        case 'p':
+            if ((rc = PF_ParsePolicy(optarg, policy))) {
+                PrintError(rc);
+                exit(1);
+            }
+            break;
+        case 'd':
+            bDirectIO = TRUE;
+            break;
+        case 'W':
+            bWriter = TRUE;
+            break;
+        case 'H':
+            bHugePages = TRUE;
+            break;
+        case 's':
+            psSocket = optarg;
+            break;
+        case 'w':
+            numWorkers = atoi(optarg);
+            if (numWorkers < 1 || numWorkers > MAX_WORKERS) {
+                cerr << argv[0] << ": number of workers must be between 1 and "
+                     << MAX_WORKERS << "\n";
+                exit(1);
+            }
+            break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-b bufsize] [-p policy] [-d] [-W] [-H] "
+                 << "[-s socket [-w workers]] dbname \n";
+            exit(1);
+        }
+    }
+
+    // Look for 1 or 2 remaining arguments.  The first should be the
+    // name of the database, the optional second one the abort
+    // probability.
+    if (argc - optind < 1 || argc - optind > 2) {
+        cerr << "Usage: " << argv[0] << " [-b bufsize] [-p policy] [-d] [-W] [-H] "
+             << "[-s socket [-w workers]] dbname \n";
         exit(1);
     }
 
-    dbname = argv[1];
+    dbname = argv[optind];
 
     if (chdir(dbname) < 0) {
         cerr << argv[0] << " chdir error to " << dbname << "\n";
         exit(1);
     }
 
-    PF_Manager pfm;
+    // The pages of the buffer are those of the database, as created by
+    // dbcreate; a buffer size in bytes depends on them
+    if ((rc = PF_ReadPageSize("relcat", pageSize)) ||
+        (psBufferSize != NULL &&
+         (rc = PF_ParseBufferSize(psBufferSize, numBufferPages, pageSize)))) {
+        PrintError(rc);
+        exit(1);
+    }
+
+    PF_Manager pfm(numBufferPages, policy, pageSize);
+    pfm.SetDirectIO(bDirectIO);
+    if (bHugePages && (rc = pfm.SetHugePages(TRUE))) {
+        PrintError(rc);
+        exit(1);
+    }
+    if (bWriter && (rc = pfm.SetBackgroundWriter(TRUE))) {
+        PrintError(rc);
+        exit(1);
+    }
     RM_Manager rmm(pfm);
     LG_Manager lgm(pfm, rmm);
     IX_Manager ixm(pfm);
     SM_Manager smm(ixm, rmm, lgm);
     QL_Manager qlm(smm, ixm, rmm, lgm);
 
-    if (argc == 3) {
+    if (argc - optind == 2) {
         bAbort = 1;
-        abortProb = atoi(argv[2]);
+        abortProb = atoi(argv[optind + 1]);
     } else {
         bAbort = 0;
     }
@@ -61,8 +496,17 @@ int main(int argc, char *argv[])
         exit(1);
     }
    
-    // call the parser
-    RBparse(pfm, smm, qlm, lgm);
+    // call the parser, or serve clients that do
+    if (psSocket == NULL)
+        RBparse(pfm, smm, qlm, lgm);
+    else {
+        engine.pPfm = &pfm;
+        engine.pSmm = &smm;
+        engine.pQlm = &qlm;
+        engine.pLgm = &lgm;
+        if (Serve(psSocket, numWorkers))
+            exit(1);
+    }
     
     // close the database
     if ((rc = smm.CloseDb())) {
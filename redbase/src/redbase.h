@@ -79,7 +79,12 @@ enum CompOp {
 // Pin Strategy Hint
 //
 enum ClientHint {
-    NO_HINT                                     // default value
+    NO_HINT,                                    // default value
+    SEQUENTIAL_SCAN,                            // pages are read once, in
+                                                // order: keep them in a
+                                                // small ring of frames
+    RANDOM_ACCESS                               // pages are read in no
+                                                // particular order
 };
 
 //
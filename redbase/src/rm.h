@@ -32,11 +32,17 @@ class LG_Manager;
 // RM_FileHdr: Header structure for file
 //
 struct RM_FileHdr {
-    int firstFree;          // page# of page with free slot (head of linked list)
+    int firstFree;          // no page before this one has a free slot (a hint
+                            //   for the search of the free-space map)
     int recordSize;         // Size of each record
     int recordsPerPage;     // Maximum # of records per page
     int numPages;           // # of pages in the file
     int bitmapSize;         // Size of the bitmap used to indicate whether a slot in a page is filled
+    int bFreeMap;           // TRUE: free pages are kept in the free-space map
+                            //   (FALSE in older files, which linked them
+                            //   in a list from firstFree)
+    int nextMapPage;        // first page of the free-space map after the
+                            //   header page, or RM_PAGE_LIST_END
 };
 typedef struct RM_FileHdr RM_FileHdr;
 
@@ -51,7 +57,8 @@ public:
 
     RC CreateFile (const char *fileName, int recordSize);
     RC DestroyFile(const char *fileName);
-    RC OpenFile   (const char *fileName, RM_FileHandle &fileHandle);
+    RC OpenFile   (const char *fileName, RM_FileHandle &fileHandle,
+                   PF_OpenMode mode = PF_READWRITE);
     RC OpenFileWithFd(int fd, RM_FileHandle &fileHandle);
     RC CloseFile  (RM_FileHandle &fileHandle);
 
@@ -73,11 +80,18 @@ public:
     RM_FileHandle ();
     ~RM_FileHandle();
 
-    // Given a RID, return the record
-    RC GetRec     (const RID &rid, RM_Record &rec) const;
+    // Given a RID, return the record.  With bView, rec points into the
+    // page of the record instead of holding a copy of it, and keeps the
+    // page pinned until rec is released, set again or destroyed.
+    RC GetRec     (const RID &rid, RM_Record &rec, int bView = FALSE) const;
 
     RC InsertRec  (const char *pData, RID &rid);       // Insert a new record
     RC InsertRecAtRid(const char *recData, const RID &rid);
+
+    // Append numRecs records, stored one after the other at pData, on
+    // fresh pages at the end of the file (bulk load).  They are logged a
+    // page at a time.  If rids is given, it receives their RIDs.
+    RC AppendRecs (const char *pData, int numRecs, RID *rids = NULL);
     RC DeleteRec  (const RID &rid);                    // Delete a record
     RC UpdateRec  (const RM_Record &rec);              // Update a record
 
@@ -97,6 +111,25 @@ private:
     char filename[MAXNAME];
     LG_Manager *lgm_;
 
+    // Free-space map: one bit per page, set if the page is a data page
+    // with a free slot.  It follows the file header on the header page
+    // and goes on in map pages; it is kept in memory while the file is
+    // open and written back with the header.
+    unsigned char *freeMap_;
+    int mapBytes_;                                  // size of freeMap_
+    int pageSize_;                                  // usable size of a page
+    PageNum lastAppend_;                            // page AppendRecs is
+                                                    //   filling, or
+                                                    //   RM_PAGE_LIST_END
+
+    RC ReadFreeMap(const char *headerPageData);
+    RC BuildFreeMap();
+    RC WriteFreeMap(char *headerPageData);
+    void FreeFreeMap();
+    void GrowFreeMap(PageNum pageNum);
+    void SetFreePage(PageNum pageNum, int bFree);
+    PageNum FindFreePage();
+
     SlotNum FindAvailableSlot(char *pageData);
     RC GetPageData(PageNum pageNum, char *&pageData) const;
 };
@@ -105,6 +138,8 @@ private:
 //
 // RM_FileScan: condition-based scan of records in the file
 //
+#define RM_SCAN_BATCH 8    // # of pages pinned at once by a sequential scan
+
 class RM_FileScan {
 public:
     RM_FileScan  ();
@@ -117,7 +152,16 @@ public:
                   CompOp     compOp,
                   void       *value,
                   ClientHint pinHint = NO_HINT); // Initialize a file scan
-    RC GetNextRec(RM_Record &rec);               // Get next matching record
+    RC GetNextRec(RM_Record &rec,                // Get next matching record
+                  int bView = FALSE);            //   (with bView, rec points
+                                                 //   into the pinned page and
+                                                 //   is valid until the next
+                                                 //   call or CloseScan)
+    RC GetNextBatch(char *ppData[],              // Get up to maxRecs of the
+                    RID  rids[],                 //   next matching records of
+                    int  maxRecs,                //   a page, pointing into it
+                    int  &numRecs);              //   (valid until the next
+                                                 //   call or CloseScan)
     RC CloseScan ();                             // Close the scan
 
 private:
@@ -132,11 +176,22 @@ private:
     int valid_;
     int currentPage_;
     int currentSlot_;
-    PF_PageHandle pageHandle_;
+    PF_PageHandle batch_[RM_SCAN_BATCH];    // pages pinned together
+    int numBatch_;                          // # of pages in batch_
+    int batchPos_;                          // current page in batch_
     char *pageData_;
     RC FetchNextPage();
+    int MatchSlots();
+    int NextFullSlot(int slotNum);
     int ConditionMet(char *slotData);
     int scanComplete_;
+    unsigned long long *slotBits_;          // slots of the current page to
+                                            //   return, 64 to a word
+    int bPageCond_;                         // 1 if the condition is checked
+                                            //   for a whole page at once
+                                            //   (INT and FLOAT attributes)
+    int condMask_;                          // comparison outcomes that meet
+                                            //   the condition
 };
 
 
@@ -145,6 +200,7 @@ private:
 //
 class RM_Record {
     friend class qJoin;
+    friend class qStatScan;
     friend class RM_FileHandle;
     friend class RM_FileScan;
     friend class LG_Manager;
@@ -160,10 +216,24 @@ public:
     // Return the RID associated with the record
     RC GetRid (RID &rid) const;
 
+    // Release the record: a record that points into a page (see GetRec)
+    // unpins it.  The record is invalid until it is set again.
+    RC Release();
+
 private:
-    char *contents_;
+    char *contents_;            // record data: buffer_, or a view of the
+                                //   record in its page
     RID rid_;
     int valid_;
+    char *buffer_;              // copy of the data, reused by the next
+    int bufferSize_;            //   record copied into this object
+    const PF_FileHandle *pinFile_;  // file of the page pinned for the
+    PageNum pinPage_;               //   view, or NULL
+
+    char *Alloc  (int size);    // Set the record to a copy of size bytes
+    void SetView (char *pData,  // Set the record to point into a page
+                  const PF_FileHandle *pFile = NULL,
+                  PageNum pageNum = 0);
 };
 
 //
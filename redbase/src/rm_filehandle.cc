@@ -7,12 +7,15 @@ int GetSlotBit(int slotNum, char *pageData, Mode mode);
 RM_FileHandle::RM_FileHandle()
 {
     valid_ = 0;
+    freeMap_ = NULL;
+    mapBytes_ = 0;
+    lastAppend_ = RM_PAGE_LIST_END;
 }
 
 RM_FileHandle::~RM_FileHandle() {
 }
 
-RC RM_FileHandle::GetRec(const RID &rid, RM_Record &rec) const
+RC RM_FileHandle::GetRec(const RID &rid, RM_Record &rec, int bView) const
 {
     RC rc;
     if (!valid_) return RM_FILEINVALID;
@@ -36,16 +39,19 @@ RC RM_FileHandle::GetRec(const RID &rid, RM_Record &rec) const
         return RM_RECNOTEXIST;
     }
     
-    /* Copy record data to rec*/
     int recSz = hdr_.recordSize;
     char *slotData = pageData + sizeof(RM_PageHdr) + hdr_.bitmapSize  + recSz * slotNum;
-    
-    if (rec.valid_) delete[] rec.contents_;
-    rec.contents_ = new char[recSz];
-    
-    memcpy(rec.contents_, slotData, recSz);
+
+    /* Point rec at the record: the page stays pinned for it */
+    if (bView) {
+        rec.SetView(slotData, &PFfileHandle_, pageNum);
+        rec.rid_ = rid;
+        return 0;
+    }
+
+    /* Copy record data to rec*/
+    memcpy(rec.Alloc(recSz), slotData, recSz);
     rec.rid_ = rid;
-    rec.valid_ = 1;
 
     return PFfileHandle_.UnpinPage(pageNum);
 }
@@ -58,13 +64,28 @@ RC RM_FileHandle::InsertRec(const char *pData, RID &rid)
     if (pData == NULL) return RM_DATANULL;
 
     PageNum pageNum;
-    SlotNum slotNum;
+    SlotNum slotNum = -1;
     PF_PageHandle page;
     char *pageData;
     RM_PageHdr *phdr;
 
+    /* Use the first page with a free slot in the free-space map.  The map of
+       a file that was not closed may be out of date: a page found to be full
+       is taken out of it and the search goes on */
+    while ((pageNum = FindFreePage()) != RM_PAGE_LIST_END) {
+        rc = PFfileHandle_.GetThisPage(pageNum, page);
+        if (rc) return rc;
+
+        page.GetData(pageData);
+        if ((slotNum = FindAvailableSlot(pageData)) >= 0) break;
+
+        SetFreePage(pageNum, FALSE);
+        rc = PFfileHandle_.UnpinPage(pageNum);
+        if (rc) return rc;
+    }
+
     /* When there is no available page, allocate one */
-    if (hdr_.firstFree == RM_PAGE_LIST_END) {
+    if (pageNum == RM_PAGE_LIST_END) {
         rc = PFfileHandle_.AllocatePage(page);
         if (rc) return rc;
         
@@ -75,34 +96,23 @@ RC RM_FileHandle::InsertRec(const char *pData, RID &rid)
         /* Initialize page header */
         phdr = (RM_PageHdr*) pageData;
         phdr->numRecords = 0;
+        phdr->nextFree = RM_PAGE_LIST_END;
         char *bitmap = pageData + sizeof(RM_PageHdr);
         memset(bitmap, 0, hdr_.bitmapSize); // Zero out bitmap for slot status
 
-        /* Add the new page to linked list of free pages */
-        phdr->nextFree = RM_PAGE_LIST_END;
-        hdr_.firstFree = pageNum;
+        /* Add the new page to the free-space map */
+        GrowFreeMap(pageNum);
+        SetFreePage(pageNum, TRUE);
 
         /* Modify file header */
         hdr_.numPages++;
         hdrModified_= 1;
-
-    /* When there is an available page, use first free page */
-    } else {
-        rc = PFfileHandle_.GetThisPage(hdr_.firstFree, page);
-        if (rc) return rc;
-
-        page.GetPageNum(pageNum);
-        page.GetData(pageData);
-        slotNum = FindAvailableSlot(pageData);
     }
 
     phdr = (RM_PageHdr*) pageData;
-    /* If page has no more empty slots, remove from linked list of free pages */
-    if (++(phdr->numRecords) == hdr_.recordsPerPage) {
-        hdr_.firstFree = phdr->nextFree;
-        phdr->nextFree = RM_PAGE_FULL;
-        hdrModified_= 1;
-    }
+    /* If page has no more empty slots, take it out of the free-space map */
+    if (++(phdr->numRecords) == hdr_.recordsPerPage)
+        SetFreePage(pageNum, FALSE);
 
     /* Create RID object based on the free page/slot found */
     rid = RID(pageNum, slotNum);
@@ -152,16 +162,16 @@ RC RM_FileHandle::DeleteRec(const RID &rid)
     rc = GetPageData(pageNum, pageData);
     if (rc) return rc;
 
+    /* Nothing to do if the slot is already empty (when a delete is redone) */
+    if (!GetSlotBit(slotNum, pageData, GET))
+        return PFfileHandle_.UnpinPage(pageNum);
+
     RM_PageHdr *phdr = (RM_PageHdr *)pageData;
     GetSlotBit(slotNum, pageData, CLEAR); // Mark the slot as free on bitmap
 
-    // Decrement number of records in the page
-    if ((phdr->numRecords)-- == hdr_.recordsPerPage) {
-        /* Add current page to the list of free pages if it is now free */
-        phdr->nextFree = hdr_.firstFree;
-        hdr_.firstFree = pageNum;
-        hdrModified_ = 1;
-    }; 
+    /* Decrement number of records in the page: it now has a free slot */
+    phdr->numRecords--;
+    SetFreePage(pageNum, TRUE);
 
     rc = PFfileHandle_.MarkDirty(pageNum);
     if (rc) return rc;
@@ -198,14 +208,112 @@ RC RM_FileHandle::UpdateRec(const RM_Record &rec)
         return RM_RECNOTEXIST;
     }
     
-    /* Copy record data to rec*/
+    /* Copy record data to rec (unless rec already points into the page)*/
     char *slotData = pageData + sizeof(RM_PageHdr) + hdr_.bitmapSize + hdr_.recordSize * slotNum;
-    memcpy(slotData, updatedData, hdr_.recordSize);
+    if (slotData != updatedData)
+        memcpy(slotData, updatedData, hdr_.recordSize);
     rc = PFfileHandle_.MarkDirty(pageNum);
     if (rc) return rc;
     return PFfileHandle_.UnpinPage(pageNum);
 }
 
+/* Append numRecs records stored one after the other at pData.  They fill
+ * fresh pages from their first slot on, without going through the free-space
+ * map, and one log record covers the records put on a page (or as many of
+ * them as fit in a log page) */
+RC RM_FileHandle::AppendRecs(const char *pData, int numRecs, RID *rids)
+{
+    RC rc;
+    if (!valid_) return RM_FILEINVALID;
+    if (pData == NULL) return RM_DATANULL;
+
+    int recSz = hdr_.recordSize;
+    int bLog = strncmp(filename, "attrcat", MAXNAME) && strncmp(filename, "relcat", MAXNAME);
+    int maxLogRecs = (pageSize_ - (int)sizeof(LG_FullRec)) / recSz;
+    if (maxLogRecs < 1) maxLogRecs = 1;
+
+    for (int done = 0; done < numRecs; ) {
+        PageNum pageNum;
+        SlotNum slotNum = -1;
+        PF_PageHandle page;
+        char *pageData;
+        RM_PageHdr *phdr;
+
+        /* Go on filling the page of the last append if its free slots are
+           all after its records (nothing was deleted from it) */
+        if (lastAppend_ != RM_PAGE_LIST_END) {
+            pageNum = lastAppend_;
+            rc = PFfileHandle_.GetThisPage(pageNum, page);
+            if (rc) return rc;
+
+            page.GetData(pageData);
+            phdr = (RM_PageHdr*) pageData;
+            if (phdr->numRecords < hdr_.recordsPerPage &&
+                FindAvailableSlot(pageData) == phdr->numRecords) {
+                slotNum = phdr->numRecords;
+            } else {
+                rc = PFfileHandle_.UnpinPage(pageNum);
+                if (rc) return rc;
+            }
+        }
+
+        /* Otherwise start a fresh page */
+        if (slotNum < 0) {
+            rc = PFfileHandle_.AllocatePage(page);
+            if (rc) return rc;
+
+            page.GetPageNum(pageNum);
+            slotNum = 0;
+            page.GetData(pageData);
+
+            phdr = (RM_PageHdr*) pageData;
+            phdr->numRecords = 0;
+            phdr->nextFree = RM_PAGE_LIST_END;
+            memset(pageData + sizeof(RM_PageHdr), 0, hdr_.bitmapSize);
+
+            GrowFreeMap(pageNum);
+            hdr_.numPages++;
+            lastAppend_ = pageNum;
+        }
+
+        int n = hdr_.recordsPerPage - slotNum;
+        if (n > numRecs - done) n = numRecs - done;
+        const char *recData = pData + (long)done * recSz;
+
+        /* Log the records put on the page */
+        for (int i = 0; bLog && i < n; i += maxLogRecs) {
+            LG_FullRec logRec = LG_FullRec();
+            logRec.type = L_INSERTPAGE;
+            logRec.offset = 0;
+            logRec.dataSize = ((n - i < maxLogRecs) ? n - i : maxLogRecs) * recSz;
+            strncpy(logRec.fileName, filename, MAXNAME);
+            logRec.rid = RID(pageNum, slotNum + i);
+            if ((rc = lgm_->InsertLogRec(logRec, NULL, recData + (long)i * recSz))) {
+                PFfileHandle_.UnpinPage(pageNum);
+                return rc;
+            }
+            phdr->pageLSN = logRec.lsn;
+        }
+
+        /* Copy the records into consecutive slots and mark them full */
+        char *slotData = pageData + sizeof(RM_PageHdr) + hdr_.bitmapSize + recSz * slotNum;
+        memcpy(slotData, recData, (long)n * recSz);
+        for (int i = 0; i < n; i++) {
+            GetSlotBit(slotNum + i, pageData, SET);
+            if (rids) rids[done + i] = RID(pageNum, slotNum + i);
+        }
+        phdr->numRecords += n;
+        SetFreePage(pageNum, phdr->numRecords < hdr_.recordsPerPage);
+        done += n;
+
+        rc = PFfileHandle_.MarkDirty(pageNum);
+        if (rc) return rc;
+        rc = PFfileHandle_.UnpinPage(pageNum);
+        if (rc) return rc;
+    }
+    return 0;
+}
+
 /* Insert recData at position indicated by rid */
 RC RM_FileHandle::InsertRecAtRid(const char *recData, const RID &rid)
 {
@@ -229,7 +337,13 @@ RC RM_FileHandle::InsertRecAtRid(const char *recData, const RID &rid)
     char *slotData = pageData + sizeof(RM_PageHdr) + hdr_.bitmapSize + hdr_.recordSize * slotNum;
     memcpy(slotData, recData, hdr_.recordSize);
 
-    GetSlotBit(slotNum, pageData, SET);
+    /* Count the record if the slot was empty */
+    if (!GetSlotBit(slotNum, pageData, GET)) {
+        GetSlotBit(slotNum, pageData, SET);
+        RM_PageHdr *phdr = (RM_PageHdr *)pageData;
+        if (++(phdr->numRecords) == hdr_.recordsPerPage)
+            SetFreePage(pageNum, FALSE);
+    }
 
     rc = PFfileHandle_.MarkDirty(pageNum);
     if (rc) return rc;
@@ -275,15 +389,209 @@ RC RM_FileHandle::GetPageData(PageNum pageNum, char *&pageData) const {
     return page.GetData(pageData);
 }
 
-/* Find the first available slot in a given page from its bitmap */
+/* Find the first available slot in a given page from its bitmap, skipping
+ * the bytes of full slots */
 SlotNum RM_FileHandle::FindAvailableSlot(char *pageData) {
-    SlotNum s;
-    for (s = 0; s < hdr_.recordsPerPage; s++) {
-        if (!GetSlotBit(s, pageData, GET)) return s;
+    unsigned char *bitmap = (unsigned char *) (pageData + sizeof(RM_PageHdr));
+    for (int i = 0; i < hdr_.bitmapSize; i++) {
+        if (bitmap[i] != 0xFF) {
+            SlotNum s = i * BYTELEN + __builtin_ctz(~bitmap[i] & 0xFF);
+            return (s < hdr_.recordsPerPage) ? s : -1;
+        }
     }
     return -1;
 }
 
+/* Size of the part of the free-space map on the header page, and on each
+ * map page */
+static int HdrMapBytes(int pageSize) { return pageSize - sizeof(RM_FileHdr); }
+static int PageMapBytes(int pageSize) { return pageSize - sizeof(RM_PageHdr); }
+
+/* Read the free-space map of the file from the header page and the map pages.
+ * The map of an older file is built from its pages */
+RC RM_FileHandle::ReadFreeMap(const char *headerPageData)
+{
+    RC rc;
+    int pageBytes = PageMapBytes(pageSize_);
+
+    FreeFreeMap();
+    if (!hdr_.bFreeMap) return BuildFreeMap();
+
+    mapBytes_ = HdrMapBytes(pageSize_);
+    freeMap_ = new unsigned char[mapBytes_];
+    memcpy(freeMap_, headerPageData + sizeof(RM_FileHdr), mapBytes_);
+
+    PageNum pageNum = hdr_.nextMapPage;
+    while (pageNum != RM_PAGE_LIST_END) {
+        char *pageData;
+        if ((rc = GetPageData(pageNum, pageData))) return rc;
+
+        unsigned char *newMap = new unsigned char[mapBytes_ + pageBytes];
+        memcpy(newMap, freeMap_, mapBytes_);
+        memcpy(newMap + mapBytes_, pageData + sizeof(RM_PageHdr), pageBytes);
+        delete[] freeMap_;
+        freeMap_ = newMap;
+        mapBytes_ += pageBytes;
+
+        PageNum nextPage = ((RM_PageHdr *)pageData)->nextFree;
+        if ((rc = PFfileHandle_.UnpinPage(pageNum))) return rc;
+        pageNum = nextPage;
+    }
+    return 0;
+}
+
+/* Build the free-space map of a file made before there was one, from the
+ * record counts of its pages.  The map is written when the file is closed */
+RC RM_FileHandle::BuildFreeMap()
+{
+    RC rc;
+    PF_PageHandle page;
+    PageNum pageNum = HEADER_PAGENUM;
+
+    mapBytes_ = HdrMapBytes(pageSize_);
+    freeMap_ = new unsigned char[mapBytes_];
+    memset(freeMap_, 0, mapBytes_);
+
+    while ((rc = PFfileHandle_.GetNextPage(pageNum, page, SEQUENTIAL_SCAN)) == 0) {
+        char *pageData;
+        page.GetPageNum(pageNum);
+        page.GetData(pageData);
+        if (((RM_PageHdr *)pageData)->numRecords < hdr_.recordsPerPage) {
+            GrowFreeMap(pageNum);
+            freeMap_[pageNum / BYTELEN] |= 1 << (pageNum % BYTELEN);
+        }
+        if ((rc = PFfileHandle_.UnpinPage(pageNum))) return rc;
+    }
+    if (rc != PF_EOF) return rc;
+
+    hdr_.bFreeMap = TRUE;
+    hdr_.nextMapPage = RM_PAGE_LIST_END;
+    hdr_.firstFree = 0;
+    hdrModified_ = 1;
+    return 0;
+}
+
+/* Write the free-space map to the header page (before the file header is
+ * copied there) and to the map pages, allocating the map pages it has grown
+ * into */
+RC RM_FileHandle::WriteFreeMap(char *headerPageData)
+{
+    RC rc;
+    int hdrBytes = HdrMapBytes(pageSize_);
+    int pageBytes = PageMapBytes(pageSize_);
+
+    memcpy(headerPageData + sizeof(RM_FileHdr), freeMap_, hdrBytes);
+
+    PageNum prevPage = RM_PAGE_LIST_END;
+    PageNum pageNum = hdr_.nextMapPage;
+    for (int offset = hdrBytes; offset < mapBytes_; offset += pageBytes) {
+        PF_PageHandle page;
+        char *pageData;
+        RM_PageHdr *phdr;
+
+        if (pageNum != RM_PAGE_LIST_END) {
+            if ((rc = PFfileHandle_.GetThisPage(pageNum, page))) return rc;
+            page.GetData(pageData);
+            phdr = (RM_PageHdr *)pageData;
+        } else {
+            /* A new map page has no records, so that scans skip it */
+            if ((rc = PFfileHandle_.AllocatePage(page))) return rc;
+            page.GetPageNum(pageNum);
+            page.GetData(pageData);
+            phdr = (RM_PageHdr *)pageData;
+            phdr->numRecords = 0;
+            phdr->nextFree = RM_PAGE_LIST_END;
+            hdr_.numPages++;
+
+            /* Link it after the last map page */
+            if (prevPage == RM_PAGE_LIST_END) {
+                hdr_.nextMapPage = pageNum;
+            } else {
+                char *prevData;
+                if ((rc = GetPageData(prevPage, prevData))) return rc;
+                ((RM_PageHdr *)prevData)->nextFree = pageNum;
+                if ((rc = PFfileHandle_.MarkDirty(prevPage)) ||
+                    (rc = PFfileHandle_.UnpinPage(prevPage)))
+                    return rc;
+            }
+        }
+        memcpy(pageData + sizeof(RM_PageHdr), freeMap_ + offset, pageBytes);
+
+        prevPage = pageNum;
+        pageNum = phdr->nextFree;
+        if ((rc = PFfileHandle_.MarkDirty(prevPage)) ||
+            (rc = PFfileHandle_.UnpinPage(prevPage)))
+            return rc;
+    }
+    return 0;
+}
+
+/* Free the in-memory free-space map when the file is closed */
+void RM_FileHandle::FreeFreeMap()
+{
+    delete[] freeMap_;
+    freeMap_ = NULL;
+    mapBytes_ = 0;
+}
+
+/* Make the free-space map large enough for pageNum, a map page at a time */
+void RM_FileHandle::GrowFreeMap(PageNum pageNum)
+{
+    if (pageNum / BYTELEN < mapBytes_) return;
+
+    int pageBytes = PageMapBytes(pageSize_);
+    int newBytes = mapBytes_;
+    while (pageNum / BYTELEN >= newBytes) newBytes += pageBytes;
+
+    unsigned char *newMap = new unsigned char[newBytes];
+    memcpy(newMap, freeMap_, mapBytes_);
+    memset(newMap + mapBytes_, 0, newBytes - mapBytes_);
+    delete[] freeMap_;
+    freeMap_ = newMap;
+    mapBytes_ = newBytes;
+}
+
+/* Mark a page as having a free slot or not in the free-space map */
+void RM_FileHandle::SetFreePage(PageNum pageNum, int bFree)
+{
+    if (pageNum / BYTELEN >= mapBytes_) return;
+
+    if (bFree) {
+        freeMap_[pageNum / BYTELEN] |= 1 << (pageNum % BYTELEN);
+        if (pageNum < hdr_.firstFree) hdr_.firstFree = pageNum;
+    } else {
+        freeMap_[pageNum / BYTELEN] &= ~(1 << (pageNum % BYTELEN));
+    }
+    hdrModified_ = 1;
+}
+
+/* Find the first page with a free slot in the free-space map, or return
+ * RM_PAGE_LIST_END.  The search starts at the hint hdr_.firstFree, and goes
+ * through the map 8 bytes at a time once it is aligned */
+PageNum RM_FileHandle::FindFreePage()
+{
+    int i = (hdr_.firstFree > 0) ? hdr_.firstFree / BYTELEN : 0;
+
+    for (; i < mapBytes_ && i % 8 != 0 && freeMap_[i] == 0; i++)
+        ;
+    if (i % 8 == 0) {
+        unsigned long long word;
+        for (; i + 8 <= mapBytes_; i += 8) {
+            memcpy(&word, freeMap_ + i, sizeof(word));
+            if (word != 0) break;
+        }
+    }
+    for (; i < mapBytes_ && freeMap_[i] == 0; i++)
+        ;
+
+    if (i == mapBytes_) {
+        hdr_.firstFree = mapBytes_ * BYTELEN;
+        return RM_PAGE_LIST_END;
+    }
+    hdr_.firstFree = i * BYTELEN + __builtin_ctz(freeMap_[i]);
+    return hdr_.firstFree;
+}
+
 /* Checks or modifies the bit in slot availability bitmap 
  * if mode is 'GET', checks the bit and returns it
  * if mode is 'CLEAR', marks the slot as empty
@@ -3,16 +3,35 @@
 #include <stdint.h>
 #include <cstdio>
 #include <assert.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-int SlotFull(int slotNum, char *pageData);
+/* Outcomes of comparing an attribute with the scan value.  condMask_ holds
+ * the outcomes that satisfy the scan condition */
+#define RM_COMP_LT 1
+#define RM_COMP_EQ 2
+#define RM_COMP_GT 4
+
+static const int compOpMask[] = {
+  RM_COMP_LT | RM_COMP_EQ | RM_COMP_GT,   // NO_OP
+  RM_COMP_EQ,                             // EQ_OP
+  RM_COMP_LT | RM_COMP_GT,                // NE_OP
+  RM_COMP_LT,                             // LT_OP
+  RM_COMP_GT,                             // GT_OP
+  RM_COMP_LT | RM_COMP_EQ,                // LE_OP
+  RM_COMP_GT | RM_COMP_EQ                 // GE_OP
+};
 
 RM_FileScan::RM_FileScan() { 
   valid_ = 0;
+  slotBits_ = NULL;
 }
 
 RM_FileScan::~RM_FileScan() {
-  // Unpin the current page if the object is being destroyed amid scanning
-  if (valid_ && !scanComplete_) fileHandle_.PFfileHandle_.UnpinPage(currentPage_);
+  // Unpin the current pages if the object is being destroyed amid scanning
+  if (valid_ && !scanComplete_) fileHandle_.PFfileHandle_.UnpinPages(batch_, numBatch_);
+  delete[] slotBits_;
 }
 
 RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
@@ -41,16 +60,25 @@ RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
   compOp_ = compOp;
   value_ = value;
   pinHint_ = pinHint;
+
+  /* A condition on an INT or FLOAT attribute is checked for all the slots
+     of a page at once, when the page is fetched */
+  condMask_ = compOpMask[compOp];
+  bPageCond_ = ((attrType == INT || attrType == FLOAT) && compOp != NO_OP &&
+    attrOffset + attrLength <= fileHandle.hdr_.recordSize);
+  slotBits_ = new unsigned long long[(fileHandle.hdr_.recordsPerPage + 63) / 64];
   
   /* Initialize scan */
   valid_ = 1;
   currentPage_ = HEADER_PAGENUM;
   scanComplete_ = 0;
   currentSlot_ = 0;
+  numBatch_ = 0;
+  batchPos_ = 0;
   return FetchNextPage();
 }
 
-RC RM_FileScan::GetNextRec(RM_Record &rec)
+RC RM_FileScan::GetNextRec(RM_Record &rec, int bView)
 {
   if (!valid_) return RM_FILESCANINVALID;
   if (scanComplete_) return RM_EOF;
@@ -66,56 +94,98 @@ RC RM_FileScan::GetNextRec(RM_Record &rec)
       currentSlot_ = 0;
     }
 
-    // If the slot is not empty
-    if (SlotFull(currentSlot_, pageData_)) {
+    // Skip to the next slot that is not empty
+    currentSlot_ = NextFullSlot(currentSlot_);
+    if (currentSlot_ < (fileHandle_.hdr_).recordsPerPage) {
       int slotOffset = sizeof(RM_PageHdr) + (fileHandle_.hdr_).bitmapSize + recSz * currentSlot_;
       char *slotData = pageData_ + slotOffset;
 
-      // Check if the condition is met and copy record data
-      if (value_ == NULL || ConditionMet(slotData)) {
+      // Check if the condition is met and copy record data, or point
+      // rec at it in the pinned page
+      if (bPageCond_ || value_ == NULL || ConditionMet(slotData)) {
+        if (bView)
+          rec.SetView(slotData);
+        else
+          memcpy(rec.Alloc(recSz), slotData, recSz);
         rec.rid_ = RID(currentPage_, currentSlot_++);
 
-        //printf("valid?: %d\n", rec.valid_);
-
-        if (rec.valid_) {
-          //printf("%s\n", rec.contents_);
-          delete[] rec.contents_; // delete contents if record object already contains another record
-        }
-        rec.contents_ = new char[recSz];
-        rec.valid_ = 1;
-        memcpy(rec.contents_, slotData, recSz);
-
         return 0;
       }
+      currentSlot_++;
     }
+  }
+}
 
-    currentSlot_++;
+/* Get up to maxRecs of the next matching records at once.  They are all
+ * on the same page: ppData[i] points at record i in the pinned page, and
+ * rids[i] is its RID.  The records are valid until the next call or
+ * CloseScan.  numRecs is 0 only when RM_EOF or an error is returned */
+RC RM_FileScan::GetNextBatch(char *ppData[], RID rids[], int maxRecs, int &numRecs)
+{
+  numRecs = 0;
+  if (!valid_) return RM_FILESCANINVALID;
+  if (maxRecs <= 0) return RM_SCANPARAMINVALID;
+  if (scanComplete_) return RM_EOF;
+
+  int recSz = (fileHandle_.hdr_).recordSize;
+  int recordsPerPage = (fileHandle_.hdr_).recordsPerPage;
+  char *firstSlot;
+
+  while (numRecs == 0) {
+    // Pin the next page if all records in current page are scanned
+    if (currentSlot_ >= recordsPerPage) {
+      RC rc = FetchNextPage();
+      if (rc) return rc;
+      currentSlot_ = 0;
+    }
+    firstSlot = pageData_ + sizeof(RM_PageHdr) + (fileHandle_.hdr_).bitmapSize;
+
+    // Go through the full slots of the page, checking the condition on each
+    int slot = NextFullSlot(currentSlot_);
+    while (slot < recordsPerPage && numRecs < maxRecs) {
+      char *slotData = firstSlot + recSz * slot;
+      if (bPageCond_ || value_ == NULL || ConditionMet(slotData)) {
+        ppData[numRecs] = slotData;
+        rids[numRecs++] = RID(currentPage_, slot);
+      }
+      slot = NextFullSlot(slot + 1);
+    }
+    currentSlot_ = slot;
   }
+  return 0;
 }
 
-/* Fetch the next page containing some records */
+/* Fetch the next page containing some records.
+ * A sequential scan pins the following pages in batches of RM_SCAN_BATCH,
+ * so that they are looked up and read together; other scans pin one page
+ * at a time */
 RC RM_FileScan::FetchNextPage() {
   int openScan = ((currentPage_ == HEADER_PAGENUM) ? 1 : 0);
 
   while (1) {
 
-    /* Unpin the previous page */
-    if (currentPage_ != HEADER_PAGENUM) fileHandle_.PFfileHandle_.UnpinPage(currentPage_);
-    /* Get next page */
-    RC rc = fileHandle_.PFfileHandle_.GetNextPage(currentPage_, pageHandle_);
-    if (rc == PF_EOF) {
-      scanComplete_ = 1;
-      if (!openScan) return RM_EOF;
-      else return 0;
+    /* Get the next batch once all pages of the previous one are scanned */
+    if (++batchPos_ >= numBatch_) {
+      /* Unpin the previous batch */
+      fileHandle_.PFfileHandle_.UnpinPages(batch_, numBatch_);
+      numBatch_ = 0;
+      int maxPages = (pinHint_ == SEQUENTIAL_SCAN) ? RM_SCAN_BATCH : 1;
+      RC rc = fileHandle_.PFfileHandle_.GetNextPages(currentPage_, maxPages, batch_, numBatch_, pinHint_);
+      if (rc == PF_EOF) {
+        scanComplete_ = 1;
+        if (!openScan) return RM_EOF;
+        else return 0;
+      }
+      else if (rc) return rc;
+      batchPos_ = 0;
     }
-    else if (rc) return rc;
 
-    pageHandle_.GetPageNum(currentPage_);
-    pageHandle_.GetData(pageData_);
+    batch_[batchPos_].GetPageNum(currentPage_);
+    batch_[batchPos_].GetData(pageData_);
   
     RM_PageHdr *phdr = (RM_PageHdr *) pageData_;
     /* Return if there is at least one record to scan */
-    if (phdr->numRecords > 0) return 0;
+    if (phdr->numRecords > 0 && MatchSlots() > 0) return 0;
   }  
 }
 
@@ -173,18 +243,142 @@ RC RM_FileScan::CloseScan()
   if (!valid_) return RM_FILESCANINVALID;
   valid_ = 0;
   if (!scanComplete_) {
-    fileHandle_.PFfileHandle_.UnpinPage(currentPage_);
+    fileHandle_.PFfileHandle_.UnpinPages(batch_, numBatch_);
     scanComplete_ = 1;
   }
+  delete[] slotBits_;
+  slotBits_ = NULL;
   return 0;
 }
 
-/* Checks whether the slot is full by looking at the bitmap */
-int SlotFull(int slotNum, char *pageData) {
-    unsigned char *bitmap = (unsigned char *) (pageData + sizeof(RM_PageHdr));
+/* Returns the first slot of slotBits_ from slotNum on, or recordsPerPage if
+ * there is none.  The bits are read 64 slots at a time, so that the other
+ * slots are skipped without testing them one by one */
+int RM_FileScan::NextFullSlot(int slotNum) {
+  int recordsPerPage = (fileHandle_.hdr_).recordsPerPage;
+
+  while (slotNum < recordsPerPage) {
+    int base = slotNum & ~63;
+    uint64_t word = slotBits_[base / 64] & (~(uint64_t)0 << (slotNum - base));
+    if (word != 0)
+      return base + __builtin_ctzll(word);
+    slotNum = base + 64;
+  }
+  return recordsPerPage;
+}
+
+/* Returns the outcome (RM_COMP_*) of comparing the INT or FLOAT attribute at
+ * attrData with value.  A FLOAT that is not a number compares greater, as in
+ * FloatCompare */
+static int CompareOutcome(const char *attrData, AttrType attrType, const void *value) {
+  if (attrType == INT) {
+    int32_t key, val;
+    memcpy(&key, attrData, sizeof(key));
+    memcpy(&val, value, sizeof(val));
+    return (key < val) ? RM_COMP_LT : (key == val) ? RM_COMP_EQ : RM_COMP_GT;
+  } else {
+    float key, val;
+    memcpy(&key, attrData, sizeof(key));
+    memcpy(&val, value, sizeof(val));
+    return (key < val) ? RM_COMP_LT : (key == val) ? RM_COMP_EQ : RM_COMP_GT;
+  }
+}
+
+/* Clears the bits of bits[] of the slots whose attribute (at attrData +
+ * slot * recSz) does not meet the condition, numSlots slots in all */
+static void MatchCondition(const char *attrData, int recSz, int numSlots,
+    AttrType attrType, const void *value, int condMask, uint64_t *bits) {
+  for (int base = 0; base < numSlots; base += 64) {
+    uint64_t match = 0;
+    for (int i = 0; i < 64 && base + i < numSlots; i++)
+      if (CompareOutcome(attrData + (base + i) * recSz, attrType, value) & condMask)
+        match |= (uint64_t)1 << i;
+    bits[base / 64] &= match;
+  }
+}
+
+#if defined(__x86_64__)
+/* MatchCondition with AVX2: the attributes of 8 slots are gathered and
+ * compared at once */
+__attribute__((target("avx2")))
+static void MatchConditionAvx2(const char *attrData, int recSz, int numSlots,
+    AttrType attrType, const void *value, int condMask, uint64_t *bits) {
+  /* Offsets of the attributes of 8 consecutive slots */
+  __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+    _mm256_set1_epi32(recSz));
+  int32_t intValue; float floatValue;
+  memcpy(&intValue, value, sizeof(intValue));
+  memcpy(&floatValue, value, sizeof(floatValue));
+  __m256i intVal = _mm256_set1_epi32(intValue);
+  __m256 floatVal = _mm256_set1_ps(floatValue);
+
+  for (int base = 0; base < numSlots; base += 64) {
+    uint64_t match = 0;
+    int n = (numSlots - base < 64) ? numSlots - base : 64;
+    int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+      const char *p = attrData + (base + i) * recSz;
+      __m256i key = _mm256_i32gather_epi32((const int *)p, offsets, 1);
+      unsigned int lt, eq;
+      if (attrType == INT) {
+        lt = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(intVal, key)));
+        eq = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key, intVal)));
+      } else {
+        __m256 fkey = _mm256_castsi256_ps(key);
+        lt = _mm256_movemask_ps(_mm256_cmp_ps(fkey, floatVal, _CMP_LT_OQ));
+        eq = _mm256_movemask_ps(_mm256_cmp_ps(fkey, floatVal, _CMP_EQ_OQ));
+      }
+      unsigned int lanes = 0;
+      if (condMask & RM_COMP_LT) lanes |= lt;
+      if (condMask & RM_COMP_EQ) lanes |= eq;
+      if (condMask & RM_COMP_GT) lanes |= ~(lt | eq) & 0xFF;
+      match |= (uint64_t)lanes << i;
+    }
+    for (; i < n; i++)
+      if (CompareOutcome(attrData + (base + i) * recSz, attrType, value) & condMask)
+        match |= (uint64_t)1 << i;
+    bits[base / 64] &= match;
+  }
+}
+#endif
+
+/* Sets slotBits_ from the bitmap of the current page: the full slots, and
+ * only those meeting the condition if it is checked for the whole page.
+ * Returns the number of slots set */
+int RM_FileScan::MatchSlots() {
+  unsigned char *bitmap = (unsigned char *) (pageData_ + sizeof(RM_PageHdr));
+  int bitmapSize = (fileHandle_.hdr_).bitmapSize;
+  int recordsPerPage = (fileHandle_.hdr_).recordsPerPage;
+  int numWords = (recordsPerPage + 63) / 64;
+  uint64_t *bits = (uint64_t *) slotBits_;
 
-    int bytePos = slotNum / BYTELEN;
-    int bitPos = slotNum % BYTELEN;
+  /* Bit i of word w is the bit of slot w * 64 + i */
+  for (int w = 0; w < numWords; w++) {
+    int bytePos = w * 8;
+    int numBytes = bitmapSize - bytePos < 8 ? bitmapSize - bytePos : 8;
+    uint64_t word = 0;
+    for (int i = numBytes - 1; i >= 0; i--)
+      word = (word << BYTELEN) | bitmap[bytePos + i];
+    bits[w] = word;
+  }
+  if (recordsPerPage % 64 != 0)
+    bits[numWords - 1] &= ((uint64_t)1 << (recordsPerPage % 64)) - 1;
+
+  if (bPageCond_) {
+    char *attrData = pageData_ + sizeof(RM_PageHdr) + bitmapSize + attrOffset_;
+#if defined(__x86_64__)
+    static const int bAvx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    if (bAvx2)
+      MatchConditionAvx2(attrData, (fileHandle_.hdr_).recordSize, recordsPerPage,
+        attrType_, value_, condMask_, bits);
+    else
+#endif
+      MatchCondition(attrData, (fileHandle_.hdr_).recordSize, recordsPerPage,
+        attrType_, value_, condMask_, bits);
+  }
 
-    return (bitmap[bytePos] >> bitPos) & 1;
+  int numSlots = 0;
+  for (int w = 0; w < numWords; w++)
+    numSlots += __builtin_popcountll(bits[w]);
+  return numSlots;
 }
\ No newline at end of file
@@ -11,8 +11,8 @@
 // Constants and defines
 //
 
-#define RM_PAGE_LIST_END  -1       // end of list of free pages
-#define RM_PAGE_FULL      -2       // page is being used
+#define RM_PAGE_LIST_END  -1       // end of list of free pages or map pages
+#define RM_PAGE_FULL      -2       // page is being used (older files)
 #define HEADER_PAGENUM	0		// Page number of file header
 
 #define BYTELEN 8				// length of bits per byte
@@ -23,7 +23,8 @@
 //
 struct RM_PageHdr {
 	int numRecords;				// Number of records populating this page
-	int nextFree;				// page# of page with free slot
+	int nextFree;				// page# of next map page (map pages); older
+								// files linked their free pages through it
 	LSN pageLSN;
 };
 
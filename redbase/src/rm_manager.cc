@@ -13,7 +13,9 @@ RM_Manager::~RM_Manager() { }
 
 RC RM_Manager::CreateFile(const char *fileName, int recordSize)
 {
-    if (recordSize <=0 || recordSize >= PF_PAGE_SIZE) return RM_RECSZINVALID;
+    int pageSize;
+    pfmanager_->GetPageSize(pageSize);
+    if (recordSize <=0 || recordSize >= pageSize) return RM_RECSZINVALID;
     if (fileName == NULL) return RM_FILENAMENULL;
 
     RC rc = pfmanager_->CreateFile(fileName);
@@ -21,16 +23,18 @@ RC RM_Manager::CreateFile(const char *fileName, int recordSize)
 
     /* Calculate file header fields */
     RM_FileHdr fileHdr;
-    fileHdr.recordsPerPage = BYTELEN * (PF_PAGE_SIZE - sizeof(RM_PageHdr)) / (1 + BYTELEN * recordSize);
+    fileHdr.recordsPerPage = BYTELEN * (pageSize - sizeof(RM_PageHdr)) / (1 + BYTELEN * recordSize);
     if (fileHdr.recordsPerPage % BYTELEN == 0) {
         fileHdr.bitmapSize = fileHdr.recordsPerPage/BYTELEN;
     } else {
         fileHdr.bitmapSize = fileHdr.recordsPerPage/BYTELEN + 1;     
     }
-    assert(sizeof(RM_PageHdr) + fileHdr.bitmapSize + fileHdr.recordsPerPage * recordSize <= PF_PAGE_SIZE);
+    assert(sizeof(RM_PageHdr) + fileHdr.bitmapSize + fileHdr.recordsPerPage * recordSize <= (size_t)pageSize);
     fileHdr.recordSize = recordSize;
     fileHdr.numPages = 1; // 1 header page allocated for new file
-    fileHdr.firstFree = RM_PAGE_LIST_END; // No free data pages for new file
+    fileHdr.firstFree = 0; // Free-space map search starts at page 0
+    fileHdr.bFreeMap = TRUE; // Empty free-space map after the header
+    fileHdr.nextMapPage = RM_PAGE_LIST_END;
 
     /* Open the new file and allocate a new page for header */
     PF_FileHandle newFileHandle;
@@ -62,10 +66,13 @@ RC RM_Manager::DestroyFile(const char *fileName)
 }
 
 
-RC RM_Manager::OpenFile(const char *fileName, RM_FileHandle &fileHandle)
+/* A file opened with mode PF_MAPPED is read only: its pages are read in
+   place from the mapped file, and changing a record fails with PF_READONLY */
+RC RM_Manager::OpenFile(const char *fileName, RM_FileHandle &fileHandle,
+                        PF_OpenMode mode)
 {
     if (fileName == NULL) return RM_FILENAMENULL;
-    RC rc = pfmanager_->OpenFile(fileName, fileHandle.PFfileHandle_);
+    RC rc = pfmanager_->OpenFile(fileName, fileHandle.PFfileHandle_, mode);
     if (rc) return rc;
 
     /* Fetch header page */
@@ -80,10 +87,23 @@ RC RM_Manager::OpenFile(const char *fileName, RM_FileHandle &fileHandle)
     char *headerPageData;
     headerPageHandle.GetData(headerPageData);
     memcpy(&(fileHandle.hdr_), headerPageData, sizeof(RM_FileHdr));
+    fileHandle.hdrModified_ = 0;
+    fileHandle.lastAppend_ = RM_PAGE_LIST_END;
 
+    /* Load the free-space map */
+    pfmanager_->GetPageSize(fileHandle.pageSize_);
+    rc = fileHandle.ReadFreeMap(headerPageData);
     fileHandle.PFfileHandle_.UnpinPage(HEADER_PAGENUM);
+    if (rc) {
+        fileHandle.FreeFreeMap();
+        pfmanager_->CloseFile(fileHandle.PFfileHandle_);
+        return rc;
+    }
+    /* A map built from the pages of an older file is only stored by a
+       writable handle: a mapped one builds it again on each open */
+    if (mode == PF_MAPPED) fileHandle.hdrModified_ = 0;
+
     fileHandle.valid_ = 1;
-    fileHandle.hdrModified_ = 0;
     return 0;
 }
 
@@ -98,15 +118,18 @@ RC RM_Manager::CloseFile(RM_FileHandle &fileHandle)
         rc = fileHandle.PFfileHandle_.GetFirstPage(headerPageHandle);
         if (rc) return rc;
 
-        /* Copy file header onto header page */
+        /* Copy free-space map and file header onto header page */
         char *headerPageData;
         headerPageHandle.GetData(headerPageData);
+        rc = fileHandle.WriteFreeMap(headerPageData);
         memcpy(headerPageData, &(fileHandle.hdr_), sizeof(RM_FileHdr));
 
         /* Mark header page as dirty and unpin it */
         fileHandle.PFfileHandle_.MarkDirty(HEADER_PAGENUM);
         fileHandle.PFfileHandle_.UnpinPage(HEADER_PAGENUM);
+        if (rc) return rc;
     }
+    fileHandle.FreeFreeMap();
 
     rc = pfmanager_->CloseFile(fileHandle.PFfileHandle_);
     if (rc) return rc;
@@ -5,11 +5,15 @@ RM_Record::RM_Record()
 {
     valid_ = 0;
     contents_ = NULL;
+    buffer_ = NULL;
+    bufferSize_ = 0;
+    pinFile_ = NULL;
 }
 
 RM_Record::~RM_Record()
 {
-    if (valid_) delete[] contents_; // free memory if Record used to hold data
+    Release();
+    delete[] buffer_; // free memory if Record used to hold data
 }
 
 
@@ -24,7 +28,48 @@ RC RM_Record::GetData(char *&pData) const
 RC RM_Record::GetRid(RID &rid) const
 {
     if (!valid_) return RM_RECINVALID;
-    
+
     rid = rid_;
     return 0;
 }
+
+/* Invalidate the record, and unpin the page it points into if it pinned one */
+RC RM_Record::Release()
+{
+    RC rc = 0;
+    if (pinFile_ != NULL) {
+        rc = pinFile_->UnpinPage(pinPage_);
+        pinFile_ = NULL;
+    }
+    valid_ = 0;
+    contents_ = NULL;
+    return rc;
+}
+
+/* Make the record a copy of size bytes, to be filled in by the caller.
+ * The buffer of the previous record is reused when it is large enough, so
+ * that a scan does not allocate memory for each record */
+char *RM_Record::Alloc(int size)
+{
+    Release();
+    if (size > bufferSize_) {
+        delete[] buffer_;
+        buffer_ = new char[size];
+        bufferSize_ = size;
+    }
+    contents_ = buffer_;
+    valid_ = 1;
+    return contents_;
+}
+
+/* Make the record point at pData in a page.  If pFile is given, the page
+ * pageNum of pFile was pinned for the record, and is unpinned when the
+ * record is released */
+void RM_Record::SetView(char *pData, const PF_FileHandle *pFile, PageNum pageNum)
+{
+    Release();
+    contents_ = pData;
+    pinFile_ = pFile;
+    pinPage_ = pageNum;
+    valid_ = 1;
+}
@@ -20,10 +20,14 @@
 #include <cstring>
 #include <unistd.h>
 #include <cstdlib>
+#include <climits>
+#include <cmath>
 
 #include "redbase.h"
 #include "pf.h"
 #include "rm.h"
+#include "lg.h"
+#include "comp.h"
 
 using namespace std;
 
@@ -56,10 +60,34 @@ struct TestRec {
 };
 
 //
-// Global PF_Manager and RM_Manager variables
+// Layout of the records of Test7: 13 bytes, so that the attributes of
+// most slots are not aligned
+//
+#define PREDREC_SIZE   13            // record size
+#define PREDREC_INT    1             // offset of the INT attribute
+#define PREDREC_FLOAT  5             // offset of the FLOAT attribute
+#define PREDREC_ID     9             // offset of the record number
+
+//
+// Test8 frees pages of a file past the free-space map held on its header
+// page: these are FREEREC_TAIL records from its end
+//
+#define NUM_FREED      6             // # of records deleted by Test8
+#define FREEREC_TAIL   40            // # of records past the header's map
+
+//
+// Global PF_Manager, RM_Manager and LG_Manager variables.  Records
+// inserted into a file are logged, as when redbase runs.
 //
 PF_Manager pfm;
 RM_Manager rmm(pfm);
+LG_Manager lgm(pfm, rmm);
+
+//
+// Crash on purpose (set by redbase); the log manager looks at them
+//
+int bAbort = 0;
+int abortProb = 0;
 
 //
 // Function declarations
@@ -68,6 +96,10 @@ RC Test1(void);
 RC Test2(void);
 RC Test3(void);
 RC Test4(void);
+RC Test5(void);
+RC Test6(void);
+RC Test7(void);
+RC Test8(void);
 
 
 void PrintError(RC rc);
@@ -76,6 +108,13 @@ void PrintRecord(TestRec &recBuf);
 RC AddRecs(RM_FileHandle &fh, int numRecs);
 RC VerifyFile(RM_FileHandle &fh, int numRecs);
 RC PrintFile(RM_FileHandle &fh);
+RC CompareBatches(RM_FileHandle &fh, AttrType attrType, int attrLength,
+                  int attrOffset, CompOp compOp, void *value,
+                  ClientHint pinHint, int maxRecs, int &ok);
+int CompOpHolds(CompOp compOp, int cmp);
+RC CheckMatches(RM_FileHandle &fh, AttrType attrType, int attrOffset,
+                CompOp compOp, void *value, const int *expected,
+                int numRecs, int &ok);
 
 RC CreateFile(char *fileName, int recordSize);
 RC DestroyFile(char *fileName);
@@ -89,13 +128,17 @@ RC GetNextRecScan(RM_FileScan &fs, RM_Record &rec);
 //
 // Array of pointers to the test functions
 //
-#define NUM_TESTS       4               // number of tests
+#define NUM_TESTS       8               // number of tests
 int (*tests[])() =                      // RC doesn't work on some compilers
 {
     Test1,
     Test2,
     Test3,
-    Test4
+    Test4,
+    Test5,
+    Test6,
+    Test7,
+    Test8
 };
 
 //
@@ -115,6 +158,13 @@ int main(int argc, char *argv[])
 
     // Delete files from last time
     unlink(FILENAME);
+    unlink(LOGFILENAME);
+
+    // Start the log, as SM_Manager::OpenDb does
+    if ((rc = lgm.CreateLog())) {
+        PrintError(rc);
+        return (1);
+    }
 
     // If no argument given, do all tests
     if (argc == 1) {
@@ -153,6 +203,11 @@ int main(int argc, char *argv[])
         }
     }
 
+    if ((rc = lgm.DestroyLog())) {
+        PrintError(rc);
+        return (1);
+    }
+
     // Write ending message and exit
     cout << "Ending RM component test.\n\n";
 
@@ -171,6 +226,8 @@ void PrintError(RC rc)
         PF_PrintError(rc);
     else if (abs(rc) <= END_RM_WARN)
         RM_PrintError(rc);
+    else if (abs(rc) >= START_LG_WARN && abs(rc) <= END_LG_WARN)
+        LG_PrintError(rc);
     else
         cerr << "Error code out of range: " << rc << "\n";
 }
@@ -363,6 +420,140 @@ RC PrintFile(RM_FileScan &fs)
     return (0);
 }
 
+//
+// CompareBatches
+//
+// Desc: Scan the file with GetNextBatch, maxRecs records at a time, and
+//       with GetNextRec alongside.  ok is set to 0 unless both scans
+//       return the same records in the same order, and each batch holds
+//       1 to maxRecs records of a single page.
+//
+RC CompareBatches(RM_FileHandle &fh, AttrType attrType, int attrLength,
+                  int attrOffset, CompOp compOp, void *value,
+                  ClientHint pinHint, int maxRecs, int &ok)
+{
+    RC          rc;
+    int         i, numRecs;
+    char        *pData;
+    RID         rid;
+    PageNum     pageNum, batchPage, firstPage;
+    SlotNum     slotNum, batchSlot;
+    RM_Record   rec;
+    RM_FileScan recScan, batchScan;
+
+    char **ppData = new char *[maxRecs];
+    RID  *batchRids = new RID[maxRecs];
+
+    ok = 1;
+    if ((rc = recScan.OpenScan(fh, attrType, attrLength, attrOffset,
+                               compOp, value, pinHint)) ||
+        (rc = batchScan.OpenScan(fh, attrType, attrLength, attrOffset,
+                                 compOp, value, pinHint)))
+        goto err;
+
+    while ((rc = batchScan.GetNextBatch(ppData, batchRids, maxRecs,
+                                        numRecs)) == 0) {
+        if (numRecs < 1 || numRecs > maxRecs)
+            ok = 0;
+        for (i = 0; i < numRecs; i++) {
+            if ((rc = recScan.GetNextRec(rec)) == RM_EOF) {
+                ok = 0;
+                break;
+            }
+            if (rc ||
+                (rc = rec.GetData(pData)) ||
+                (rc = rec.GetRid(rid)) ||
+                (rc = rid.GetPageNum(pageNum)) ||
+                (rc = rid.GetSlotNum(slotNum)) ||
+                (rc = batchRids[i].GetPageNum(batchPage)) ||
+                (rc = batchRids[i].GetSlotNum(batchSlot)) ||
+                (rc = batchRids[0].GetPageNum(firstPage)))
+                goto err;
+            if (batchPage != pageNum || batchSlot != slotNum ||
+                batchPage != firstPage ||
+                memcmp(ppData[i], pData, fh.GetRecordSize()))
+                ok = 0;
+        }
+    }
+    if (rc != RM_EOF || numRecs != 0)
+        goto err;
+
+    // GetNextRec must be done too
+    if ((rc = recScan.GetNextRec(rec)) != RM_EOF)
+        ok = 0;
+    rc = 0;
+
+err:
+    recScan.CloseScan();
+    batchScan.CloseScan();
+    delete[] ppData;
+    delete[] batchRids;
+    return (rc);
+}
+
+//
+// CompOpHolds
+//
+// Desc: Return 1 if compOp holds for a key that compares to the value as
+//       cmp (< 0, 0 or > 0) does, as IntCompare and FloatCompare return
+//
+int CompOpHolds(CompOp compOp, int cmp)
+{
+    switch (compOp) {
+    case EQ_OP: return (cmp == 0);
+    case NE_OP: return (cmp != 0);
+    case LT_OP: return (cmp < 0);
+    case GT_OP: return (cmp > 0);
+    case LE_OP: return (cmp <= 0);
+    case GE_OP: return (cmp >= 0);
+    default:    return (1);
+    }
+}
+
+//
+// CheckMatches
+//
+// Desc: Scan a file of Test7 records with a condition.  ok is set to 0
+//       unless the scan returns each record numbered i with expected[i]
+//       set exactly once, and no other record.
+//
+RC CheckMatches(RM_FileHandle &fh, AttrType attrType, int attrOffset,
+                CompOp compOp, void *value, const int *expected,
+                int numRecs, int &ok)
+{
+    RC          rc;
+    int         i, id;
+    char        *pData;
+    RM_Record   rec;
+    RM_FileScan fs;
+
+    int *found = new int[numRecs];
+    memset(found, 0, numRecs * sizeof(int));
+
+    ok = 1;
+    if ((rc = fs.OpenScan(fh, attrType, 4, attrOffset, compOp, value)))
+        goto err;
+    while ((rc = GetNextRecScan(fs, rec)) == 0) {
+        if ((rc = rec.GetData(pData)))
+            goto err;
+        memcpy(&id, pData + PREDREC_ID, sizeof(int));
+        if (id < 0 || id >= numRecs || !expected[id] || found[id])
+            ok = 0;
+        else
+            found[id] = 1;
+    }
+    if (rc != RM_EOF)
+        goto err;
+    for (i = 0; i < numRecs; i++)
+        if (expected[i] && !found[i])
+            ok = 0;
+    rc = fs.CloseScan();
+
+err:
+    delete[] found;
+    return (rc);
+}
+
 ////////////////////////////////////////////////////////////////////////
 // The following functions are wrappers for some of the RM component  //
 // methods.  They give you an opportunity to add debugging statements //
@@ -679,4 +870,397 @@ RC Test4(void){
 
    printf("\ntest4 done ********************\n");
    return (0);
-}
\ No newline at end of file
+}
+
+//
+// Test5 tests records that point into their pages (views).  The page of
+// a view stays pinned until the view is released, so that it still
+// holds the record after the whole file went through the buffer, and it
+// sees the changes made to the record in the page.
+//
+RC Test5(void){
+   RC rc;
+   RM_FileHandle fh;
+   RM_Record views[FEW_RECS];
+   RM_Record rec, copy;
+   TestRec *pRecBuf, *pCopyBuf;
+   RID rid;
+   int i, counter, ok;
+   printf("test5 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, MANY_RECS)))
+        return (rc);
+
+    // Views of the first records
+    ok = 1;
+    for (i = 0; i < FEW_RECS; i++) {
+        if ((rc = fh.GetRec(rids[i], views[i], TRUE)) ||
+            (rc = views[i].GetData((char *&)pRecBuf)))
+            return (rc);
+        if (pRecBuf->num != i)
+            ok = 0;
+    }
+   printf("\n*** Getting views of records: %s\n",
+         ok ? "PASS" : "FAIL\a");
+
+    // Change the first record through a copy: its view sees the change
+    if ((rc = fh.GetRec(rids[0], copy)) ||
+        (rc = copy.GetData((char *&)pCopyBuf)))
+        return (rc);
+    pCopyBuf->r = -1;
+    if ((rc = UpdateRec(fh, copy)) ||
+        (rc = views[0].GetData((char *&)pRecBuf)))
+        return (rc);
+    ok = (pRecBuf->r == -1);
+    pCopyBuf->r = 0;
+    if ((rc = UpdateRec(fh, copy)))
+        return (rc);
+   printf("\n*** A view sees its record change: %s\n",
+         ok && pRecBuf->r == 0 ? "PASS" : "FAIL\a");
+
+    // Read every page through the buffer.  The views stay put.
+    if ((rc = VerifyFile(fh, MANY_RECS)))
+        return (rc);
+    ok = 1;
+    for (i = 0; i < FEW_RECS; i++) {
+        if ((rc = views[i].GetData((char *&)pRecBuf)))
+            return (rc);
+        if (pRecBuf->num != i || pRecBuf->r != (float)i)
+            ok = 0;
+    }
+   printf("\n*** Views keep their pages: %s\n",
+         ok ? "PASS" : "FAIL\a");
+
+    // A view set again lets go of its previous page: one record goes
+    // through all the records of the file
+    ok = 1;
+    for (i = 0; i < MANY_RECS; i++) {
+        if ((rc = fh.GetRec(rids[i], rec, TRUE)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            return (rc);
+        if (pRecBuf->num != i)
+            ok = 0;
+    }
+   printf("\n*** Setting a view again: %s\n",
+         ok ? "PASS" : "FAIL\a");
+
+    // The views of a scan are the records GetRec copies
+    RM_FileScan fs;
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          NO_OP, NULL)))
+        return (rc);
+    ok = 1;
+    for (counter = 0; (rc = fs.GetNextRec(rec, TRUE)) == 0; counter++) {
+        if ((rc = rec.GetData((char *&)pRecBuf)) ||
+            (rc = rec.GetRid(rid)) ||
+            (rc = fh.GetRec(rid, copy)) ||
+            (rc = copy.GetData((char *&)pCopyBuf)))
+            return (rc);
+        if (memcmp(pRecBuf, pCopyBuf, sizeof(TestRec)))
+            ok = 0;
+    }
+    fs.CloseScan();
+   printf("\n*** Scanning views: %s\n",
+         ok && counter == MANY_RECS && rc == RM_EOF ? "PASS" : "FAIL\a");
+
+    // Once released, the views leave no page pinned
+    for (i = 0; i < FEW_RECS; i++)
+        if ((rc = views[i].Release()))
+            return (rc);
+    if ((rc = rec.Release()))
+        return (rc);
+   printf("\n*** Closing a file after releasing the views: %s\n",
+         (CloseFile(FILENAME, fh)) ? "FAIL\a" : "PASS");
+
+   printf("\n*** Destroying a file: %s\n",
+         (DestroyFile(FILENAME)) ? "FAIL\a" : "PASS");
+
+   printf("\ntest5 done ********************\n");
+   return (0);
+}
+
+//
+// Test6 tests scanning records a batch at a time: GetNextBatch must
+// return the records GetNextRec returns, whatever the batch size, with
+// and without a condition, on a file with empty slots and empty pages.
+//
+RC Test6(void){
+   RC rc;
+   RM_FileHandle fh;
+   int i, ok, allOk;
+   printf("test6 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, MANY_RECS)))
+        return (rc);
+
+    // Delete every third record, and enough records in a row to empty
+    // whole pages
+    for (i = 0; i < MANY_RECS; i++)
+        if ((i % 3 == 0 || (i >= SOME_RECS && i < 2 * SOME_RECS)) &&
+            (rc = DeleteRec(fh, rids[i])))
+            return (rc);
+
+    int intValue = MANY_RECS / 2;
+    float floatValue = MANY_RECS / 4;
+    char stringValue[STRLEN];
+    memset(stringValue, ' ', STRLEN);
+    sprintf(stringValue, "a%d", MANY_RECS - 1);
+
+    struct {
+        const char *name;
+        AttrType   attrType;
+        int        attrLength;
+        int        attrOffset;
+        CompOp     compOp;
+        void       *value;
+        ClientHint pinHint;
+    } scans[] = {
+        { "no condition", INT, sizeof(int), offsetof(TestRec, num),
+          NO_OP, NULL, NO_HINT },
+        { "no condition, sequential", INT, sizeof(int),
+          offsetof(TestRec, num), NO_OP, NULL, SEQUENTIAL_SCAN },
+        { "INT condition", INT, sizeof(int), offsetof(TestRec, num),
+          LT_OP, &intValue, NO_HINT },
+        { "FLOAT condition", FLOAT, sizeof(float), offsetof(TestRec, r),
+          GE_OP, &floatValue, SEQUENTIAL_SCAN },
+        { "STRING condition", STRING, STRLEN, offsetof(TestRec, str),
+          EQ_OP, stringValue, NO_HINT }
+    };
+    int maxRecs[] = { 1, 7, MANY_RECS };
+
+    for (unsigned int s = 0; s < sizeof(scans) / sizeof(scans[0]); s++) {
+        allOk = 1;
+        for (unsigned int m = 0; m < sizeof(maxRecs) / sizeof(int); m++) {
+            if ((rc = CompareBatches(fh, scans[s].attrType,
+                                     scans[s].attrLength,
+                                     scans[s].attrOffset, scans[s].compOp,
+                                     scans[s].value, scans[s].pinHint,
+                                     maxRecs[m], ok)))
+                return (rc);
+            allOk = allOk && ok;
+        }
+   printf("\n*** Scanning batches, %s: %s\n", scans[s].name,
+         allOk ? "PASS" : "FAIL\a");
+    }
+
+   printf("\n*** Closing a file: %s\n",
+         (CloseFile(FILENAME, fh)) ? "FAIL\a" : "PASS");
+
+   printf("\n*** Destroying a file: %s\n",
+         (DestroyFile(FILENAME)) ? "FAIL\a" : "PASS");
+
+   printf("\ntest6 done ********************\n");
+   return (0);
+}
+
+//
+// Test7 tests conditions on INT and FLOAT attributes, which are checked
+// for all the slots of a page at once: the records a scan returns must be
+// those IntCompare and FloatCompare pick out one by one, for every
+// operator.  The values include the extremes, the values compared to,
+// infinities, -0.0 and NaN, which compares greater than any number.
+//
+RC Test7(void){
+   RC rc;
+   RM_FileHandle fh;
+   RID rid;
+   char recBuf[PREDREC_SIZE];
+   int i, j, op, ok, allOk;
+   static int intKeys[MANY_RECS];
+   static float floatKeys[MANY_RECS];
+   static int live[MANY_RECS], expected[MANY_RECS];
+   printf("test7 starting ****************\n");
+
+    int intValues[] = { INT_MIN, -42, 0, 42, INT_MAX };
+    float floatValues[] = { -INFINITY, -42.5, -0.0f, 0.0f, 42.5, INFINITY,
+                            NAN };
+    int numInts = sizeof(intValues) / sizeof(int);
+    int numFloats = sizeof(floatValues) / sizeof(float);
+
+    if ((rc = CreateFile(FILENAME, PREDREC_SIZE)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+
+    // Half of the keys are among the values compared to, the others are
+    // random
+    srand(7);
+    memset(recBuf, 'x', PREDREC_SIZE);
+    for (i = 0; i < MANY_RECS; i++) {
+        intKeys[i] = (rand() % 2) ? intValues[rand() % numInts]
+                                  : rand() - RAND_MAX / 2;
+        floatKeys[i] = (rand() % 2) ? floatValues[rand() % numFloats]
+                                    : (rand() % 2001 - 1000) / 8.0;
+        memcpy(recBuf + PREDREC_INT, &intKeys[i], sizeof(int));
+        memcpy(recBuf + PREDREC_FLOAT, &floatKeys[i], sizeof(float));
+        memcpy(recBuf + PREDREC_ID, &i, sizeof(int));
+        if ((rc = InsertRec(fh, recBuf, rids[i])))
+            return (rc);
+        live[i] = 1;
+    }
+
+    // Leave empty slots among the records
+    for (i = 0; i < MANY_RECS; i++)
+        if (rand() % 5 == 0) {
+            if ((rc = DeleteRec(fh, rids[i])))
+                return (rc);
+            live[i] = 0;
+        }
+
+    for (j = 0; j < numInts + numFloats; j++) {
+        AttrType attrType = (j < numInts) ? INT : FLOAT;
+        int attrOffset = (j < numInts) ? PREDREC_INT : PREDREC_FLOAT;
+        void *value = (j < numInts) ? (void *)&intValues[j]
+                                    : (void *)&floatValues[j - numInts];
+        allOk = 1;
+        for (op = EQ_OP; op <= GE_OP; op++) {
+            for (i = 0; i < MANY_RECS; i++) {
+                int cmp = (j < numInts)
+                    ? IntCompare((char *)&intKeys[i], value, sizeof(int))
+                    : FloatCompare((char *)&floatKeys[i], value,
+                                   sizeof(float));
+                expected[i] = live[i] && CompOpHolds((CompOp)op, cmp);
+            }
+            if ((rc = CheckMatches(fh, attrType, attrOffset, (CompOp)op,
+                                   value, expected, MANY_RECS, ok)))
+                return (rc);
+            allOk = allOk && ok;
+        }
+        if (j < numInts)
+   printf("\n*** INT conditions on %d: %s\n", intValues[j],
+         allOk ? "PASS" : "FAIL\a");
+        else
+   printf("\n*** FLOAT conditions on %g: %s\n", floatValues[j - numInts],
+         allOk ? "PASS" : "FAIL\a");
+    }
+
+   printf("\n*** Closing a file: %s\n",
+         (CloseFile(FILENAME, fh)) ? "FAIL\a" : "PASS");
+
+   printf("\n*** Destroying a file: %s\n",
+         (DestroyFile(FILENAME)) ? "FAIL\a" : "PASS");
+
+   printf("\ntest7 done ********************\n");
+   return (0);
+}
+
+//
+// Test8 tests the free-space map of a file with one record per page, and
+// more pages than the map on the header page has room for, so that the map
+// goes on in a map page.  Pages freed on both sides must still be free
+// after the file is closed and opened again: InsertRec must reuse them,
+// lowest first, before it adds a page, and the records it inserts must be
+// there once the file is opened again.
+//
+RC Test8(void){
+   RC rc;
+   RM_FileHandle fh;
+   RM_Record rec;
+   RID rid;
+   PageNum pageNum, freedPage, lastPage;
+   SlotNum slotNum, freedSlot;
+   char *pData;
+   int pageSize, recSize, numRecs, i, j, id, ok;
+   printf("test8 starting ****************\n");
+
+    // One record per page, and FREEREC_TAIL pages past those the header's
+    // map holds (8 pages a byte)
+    if ((rc = pfm.GetPageSize(pageSize)))
+        return (rc);
+    recSize = pageSize / 2 + 1;
+    numRecs = (pageSize - sizeof(RM_FileHdr)) * 8 + FREEREC_TAIL;
+
+    // Records deleted, in increasing page order: at the start of the file,
+    // and past the header's map
+    int freed[NUM_FREED] = { 2, 3, 500, numRecs - FREEREC_TAIL / 2,
+                             numRecs - 10, numRecs - 1 };
+
+    RID *recRids = new RID[numRecs];
+    int chunk = 1000;
+    char *recBuf = new char[chunk * recSize];
+
+    if ((rc = CreateFile(FILENAME, recSize)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+
+    // Each record starts with its number
+    printf("\nAdding %d records\n", numRecs);
+    memset(recBuf, 'r', chunk * recSize);
+    for (i = 0; i < numRecs; i += chunk) {
+        int n = (numRecs - i < chunk) ? numRecs - i : chunk;
+        for (j = 0; j < n; j++) {
+            id = i + j;
+            memcpy(recBuf + j * recSize, &id, sizeof(int));
+        }
+        if ((rc = fh.AppendRecs(recBuf, n, recRids + i)))
+            return (rc);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+
+    for (i = 0; i < NUM_FREED; i++)
+        if ((rc = DeleteRec(fh, recRids[freed[i]])))
+            return (rc);
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+
+    // The records inserted go where the deleted ones were, then on a new
+    // page
+    ok = 1;
+    if ((rc = recRids[numRecs - 1].GetPageNum(lastPage)))
+        return (rc);
+    for (i = 0; i <= NUM_FREED; i++) {
+        id = numRecs + i;
+        memcpy(recBuf, &id, sizeof(int));
+        if ((rc = InsertRec(fh, recBuf, rid)) ||
+            (rc = rid.GetPageNum(pageNum)) ||
+            (rc = rid.GetSlotNum(slotNum)))
+            return (rc);
+        if (i < NUM_FREED) {
+            if ((rc = recRids[freed[i]].GetPageNum(freedPage)) ||
+                (rc = recRids[freed[i]].GetSlotNum(freedSlot)))
+                return (rc);
+            if (pageNum != freedPage || slotNum != freedSlot)
+                ok = 0;
+            recRids[freed[i]] = rid;
+        }
+        else if (pageNum <= lastPage || slotNum != 0)
+            ok = 0;
+    }
+   printf("\n*** Reusing freed pages: %s\n", ok ? "PASS" : "FAIL\a");
+
+    // Every record is found where it was inserted
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    ok = 1;
+    for (i = 0, j = 0; i <= numRecs; i++) {
+        if ((rc = fh.GetRec(i < numRecs ? recRids[i] : rid, rec)) ||
+            (rc = rec.GetData(pData)))
+            return (rc);
+        memcpy(&id, pData, sizeof(int));
+        if (j < NUM_FREED && i == freed[j])
+            ok = ok && (id == numRecs + j++);
+        else
+            ok = ok && (id == (i < numRecs ? i : numRecs + NUM_FREED));
+    }
+   printf("\n*** Reading records after reopening: %s\n",
+         ok ? "PASS" : "FAIL\a");
+
+    delete[] recRids;
+    delete[] recBuf;
+
+   printf("\n*** Closing a file: %s\n",
+         (CloseFile(FILENAME, fh)) ? "FAIL\a" : "PASS");
+
+   printf("\n*** Destroying a file: %s\n",
+         (DestroyFile(FILENAME)) ? "FAIL\a" : "PASS");
+
+   printf("\ntest8 done ********************\n");
+   return (0);
+}
@@ -14,33 +14,25 @@
  */
 
 /*
- * size of buffer of strings
+ * Strings are allocated from the pool of the parser of the scanner
  */
-#define MAXCHAR		5000
-
-/*
- * buffer for string allocation
- */
-static char charpool[MAXCHAR];
-static int charptr = 0;
-
 static int lower(char *dst, char *src, int max);
-static char *mk_string(char *s, int len);
+static char *mk_string(PARSER *p, char *s, int len);
 
 /*
  * string_alloc: returns a pointer to a string of length len if possible
  */
-static char *string_alloc(int len)
+static char *string_alloc(PARSER *p, int len)
 {
    char *s;
 
-   if(charptr + len > MAXCHAR){
-      fprintf(stderr, "out of memory\n");
+   if(p->charptr + len > MAXCHAR){
+      std::cerr << "out of memory\n";
       exit(1);
    }
 
-   s = charpool + charptr;
-   charptr += len;
+   s = p->charpool + p->charptr;
+   p->charptr += len;
 
    return s;
 }
@@ -51,20 +43,75 @@ static char *string_alloc(int len)
  *
  * No return value.
  */
-void reset_charptr(void)
+void reset_charptr(PARSER *p)
+{
+    p->charptr = 0;
+}
+
+/*
+ * reset_scanner: resets the scanner after a syntax error.  The rest of
+ * a string being scanned is dropped with it by the next scan_string.
+ *
+ * No return value.
+ */
+void reset_scanner(yyscan_t scanner)
+{
+    PARSER *p = yyget_extra(scanner);
+
+    p->charptr = 0;
+    if(p->buffer == NULL)
+       yyrestart(yyget_in(scanner), scanner);
+}
+
+/*
+ * open_scanner: creates a scanner for the parser p, reading the
+ * standard input until scan_file or scan_string is called.
+ *
+ * Returns the scanner, or NULL if out of memory.
+ */
+yyscan_t open_scanner(PARSER *p)
+{
+    yyscan_t scanner;
+
+    p->buffer = NULL;
+    if(yylex_init_extra(p, &scanner))
+       return NULL;
+    return scanner;
+}
+
+/*
+ * close_scanner: destroys a scanner and its buffers
+ *
+ * No return value.
+ */
+void close_scanner(yyscan_t scanner)
 {
-    charptr = 0;
+    yylex_destroy(scanner);
 }
 
 /*
- * reset_scanner: resets the scanner after a syntax error
+ * scan_file: makes the scanner read from the file in
  *
  * No return value.
  */
-void reset_scanner(void)
+void scan_file(yyscan_t scanner, FILE *in)
 {
-    charptr = 0;
-    yyrestart(yyin);
+    yyset_in(in, scanner);
+}
+
+/*
+ * scan_string: makes the scanner read the string s, up to its end, in
+ * place of its previous input
+ *
+ * No return value.
+ */
+void scan_string(yyscan_t scanner, const char *s)
+{
+    PARSER *p = yyget_extra(scanner);
+
+    if(p->buffer != NULL)
+       yy_delete_buffer((YY_BUFFER_STATE)p->buffer, scanner);
+    p->buffer = yy_scan_string(s, scanner);
 }
 
 /*
@@ -74,9 +121,9 @@ void reset_scanner(void)
  * length (MAXSTRINGLEN) then it returns NOTOKEN, so that the parser will
  * flag an error (this is a stupid kludge).
  */
-static int get_id(char *s)
+static int get_id(char *s, YYSTYPE *lval, yyscan_t scanner)
 {
-   static char string[MAXSTRINGLEN];
+   char string[MAXSTRINGLEN + 1];
    int len;
 
    if((len = lower(string, s, MAXSTRINGLEN)) == MAXSTRINGLEN)
@@ -84,84 +131,84 @@ static int get_id(char *s)
 
    /* EX layer lexemes */
    if(!strcmp(string, "begin"))
-      return yylval.ival = RW_BEGIN;
+      return lval->ival = RW_BEGIN;
    if(!strcmp(string, "abort"))
-      return yylval.ival = RW_ABORT;
+      return lval->ival = RW_ABORT;
    if(!strcmp(string, "commit"))
-      return yylval.ival = RW_COMMIT;
+      return lval->ival = RW_COMMIT;
    if(!strcmp(string, "checkpoint"))
-      return yylval.ival = RW_CHECKPOINT;
+      return lval->ival = RW_CHECKPOINT;
    if(!strcmp(string, "transaction"))
-      return yylval.ival = RW_TRANSACTION;
+      return lval->ival = RW_TRANSACTION;
    if(!strcmp(string, "log"))
-      return yylval.ival = RW_LOG;
+      return lval->ival = RW_LOG;
    if(!strcmp(string, "program"))
-      return yylval.ival = RW_PROGRAM;
+      return lval->ival = RW_PROGRAM;
    /*  SM layer lexemes */
 
    if(!strcmp(string, "create"))
-      return yylval.ival = RW_CREATE;
+      return lval->ival = RW_CREATE;
    if(!strcmp(string, "drop"))
-      return yylval.ival = RW_DROP;
+      return lval->ival = RW_DROP;
    if(!strcmp(string, "table"))
-      return yylval.ival = RW_TABLE;
+      return lval->ival = RW_TABLE;
    if(!strcmp(string, "index"))
-      return yylval.ival = RW_INDEX;
+      return lval->ival = RW_INDEX;
    if(!strcmp(string, "load"))
-      return yylval.ival = RW_LOAD;
+      return lval->ival = RW_LOAD;
    if(!strcmp(string, "help"))
-      return yylval.ival = RW_HELP;
+      return lval->ival = RW_HELP;
    if(!strcmp(string, "exit"))
-      return yylval.ival = RW_EXIT;
+      return lval->ival = RW_EXIT;
    if(!strcmp(string, "print"))
-      return yylval.ival = RW_PRINT;
+      return lval->ival = RW_PRINT;
    if(!strcmp(string, "set"))
-      return yylval.ival = RW_SET;
+      return lval->ival = RW_SET;
 
    if(!strcmp(string, "and"))
-      return yylval.ival = RW_AND;
+      return lval->ival = RW_AND;
 
    if(!strcmp(string, "into"))
-      return yylval.ival = RW_INTO;
+      return lval->ival = RW_INTO;
    if(!strcmp(string, "values"))
-      return yylval.ival = RW_VALUES;
+      return lval->ival = RW_VALUES;
 
 
    /*  QL layer lexemes */
    if(!strcmp(string, "select"))
-      return yylval.ival = RW_SELECT;
+      return lval->ival = RW_SELECT;
    if(!strcmp(string, "from"))
-      return yylval.ival = RW_FROM;
+      return lval->ival = RW_FROM;
    if(!strcmp(string, "where"))
-      return yylval.ival = RW_WHERE;
+      return lval->ival = RW_WHERE;
    if(!strcmp(string, "insert"))
-      return yylval.ival = RW_INSERT;
+      return lval->ival = RW_INSERT;
    if(!strcmp(string, "delete"))
-      return yylval.ival = RW_DELETE;
+      return lval->ival = RW_DELETE;
    if(!strcmp(string, "update"))
-      return yylval.ival = RW_UPDATE;
+      return lval->ival = RW_UPDATE;
    
    /* IO Statistics lexemes */
    if(!strcmp(string, "reset"))
-      return yylval.ival = RW_RESET;
+      return lval->ival = RW_RESET;
    if(!strcmp(string, "io"))
-      return yylval.ival = RW_IO;
+      return lval->ival = RW_IO;
 
    if(!strcmp(string, "resize"))
-      return yylval.ival = RW_RESIZE;
+      return lval->ival = RW_RESIZE;
    if(!strcmp(string, "buffer"))
-      return yylval.ival = RW_BUFFER;
+      return lval->ival = RW_BUFFER;
 
    if(!strcmp(string, "queryplans"))
-      return yylval.ival = RW_QUERY_PLAN;
+      return lval->ival = RW_QUERY_PLAN;
    if(!strcmp(string, "on"))
-      return yylval.ival = RW_ON;
+      return lval->ival = RW_ON;
    if(!strcmp(string, "off"))
-      return yylval.ival = RW_OFF;
+      return lval->ival = RW_OFF;
 
    /*  unresolved lexemes are strings */
 
-   yylval.sval = mk_string(s, len);
+   lval->sval = mk_string(yyget_extra(scanner), s, len);
    return T_STRING;
 }
 
@@ -194,13 +241,13 @@ static int lower(char *dst, char *src, int max)
  * Returns:
  * 	a pointer to the new string
  */
-static char *get_qstring(char *qstring, int len)
+static char *get_qstring(char *qstring, int len, yyscan_t scanner)
 {
    /* replace ending quote with \0 */
    qstring[len - 1] = '\0';
 
    /* copy everything following beginning quote */
-   return mk_string(qstring + 1, len - 2);
+   return mk_string(yyget_extra(scanner), qstring + 1, len - 2);
 }
 
 /*
@@ -210,13 +257,13 @@ static char *get_qstring(char *qstring, int len)
  * Returns:
  * 	a pointer to the new string
  */
-static char *mk_string(char *s, int len)
+static char *mk_string(PARSER *p, char *s, int len)
 {
    char *copy;
 
    /* allocate space for new string */
-   if((copy = string_alloc(len + 1)) == NULL){
-      printf("out of string space\n");
+   if((copy = string_alloc(p, len + 1)) == NULL){
+      std::cout << "out of string space\n";
       exit(1);
    }
 
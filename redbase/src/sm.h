@@ -19,6 +19,8 @@
 #include "printer.h"
 
 #define CATALOGINDEXNO 0
+#define SM_PRINT_BATCH 64   /* # of tuples fetched at once by Print */
+#define SM_LOAD_BATCH 256   /* # of tuples appended at once by Load */
 
 struct RelcatTuple {
     char relName[MAXNAME];
@@ -39,6 +41,21 @@ struct AttrcatTuple {
 };
 static const int AttrcatCount = 6;
 
+/* bufstat is a virtual relation: it is in the catalogs, but its tuples
+ * are made from the buffer statistics of the files (PF_FileStats) when
+ * it is read, and it has no record file */
+struct BufstatTuple {
+    char fileName[PF_FILENAME_LEN];
+    int32_t hits;
+    int32_t misses;
+    int32_t reads;
+    int32_t writes;
+    int32_t evictions;
+    float hitRatio;         // hits / (hits + misses)
+    float pinWait;          // ms spent waiting for pages
+};
+static const int BufstatCount = 8;
+
 
 //
 // SM_Manager: provides data management
@@ -73,11 +90,15 @@ public:
 
     RC AddToCatalog(char *relName, int attrCount, AttrInfo *attributes);
     RC FillDataAttributes(const char *relName, DataAttrInfo *&attributes, int &attrCount);
+    RC GetBufstatTuple(int i, BufstatTuple &tuple);
+    int MappedScans() const;                      // 1 if selects map the
+                                                  //   relations they scan
 
 private:
     IX_Manager *ixm_;
     RM_Manager *rmm_;
     LG_Manager *lgm_;
+    int bMappedScans_;          // Set mappedScans
     RM_FileHandle attrcatFile_;
     RM_FileHandle relcatFile_;
     IX_IndexHandle relcatIndex_;
@@ -87,6 +108,9 @@ private:
     RC FindAttrMetadata(const char *relName, const char* attrName, RM_Record &rec);
     RelcatTuple* GetRelcatTuple(RM_Record &rec);
     AttrcatTuple* GetAttrcatTuple(RM_Record &rec);
+    RC LoadBatch(const char *relName, RM_FileHandle &fh,
+                 DataAttrInfo *attributes, int attrCount,
+                 char *tuples, int numTuples);
 };
 
 //
@@ -108,7 +132,9 @@ void SM_PrintError(RC rc);
 #define SM_CANTMODIFYCATALOG  (START_SM_WARN + 11)
 #define SM_RELALREADYEXISTS   (START_SM_WARN + 12)
 #define SM_DUPLICATEATTR      (START_SM_WARN + 13)
-#define SM_LASTWARN           SM_DUPLICATEATTR
+#define SM_INVALIDPARAM       (START_SM_WARN + 14)
+#define SM_INVALIDVALUE       (START_SM_WARN + 15)
+#define SM_LASTWARN           SM_INVALIDVALUE
 
 #define SM_LASTERROR       (END_SM_ERR)
 
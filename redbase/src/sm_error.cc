@@ -23,7 +23,9 @@ static char *SM_WarnMsg[] = {
   (char*)"can't drop index: the attribute is not indexed",
   (char*)"cannot modify catalog relations",
   (char*)"relation already exists",
-  (char*)"duplicate attrname"
+  (char*)"duplicate attrname",
+  (char*)"unknown parameter name",
+  (char*)"invalid parameter value"
 };
 
 static char *SM_ErrorMsg[] = {
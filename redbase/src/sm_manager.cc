@@ -8,7 +8,9 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <strings.h>
 #include <string>
+#include <vector>
 #include <assert.h>
 #include <stdlib.h>
 #include "redbase.h"
@@ -23,6 +25,7 @@ SM_Manager::SM_Manager(IX_Manager &ixm, RM_Manager &rmm, LG_Manager &lgm)
     ixm_ = &(ixm);
     rmm_ = &(rmm);
     lgm_ = &(lgm);
+    bMappedScans_ = 0;
 }
 
 SM_Manager::~SM_Manager()
@@ -65,6 +68,7 @@ RC SM_Manager::CreateTable(const char *relName,
 
     if (strlen(relName) > MAXNAME) return SM_RELNAMETOOLONG;
     if (attrCount > MAXATTRS) return SM_TOOMANYATTR;
+    if (strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
 
     /* Check if relName already exists */
     RM_Record rec;
@@ -185,7 +189,11 @@ RC SM_Manager::DropTable(const char *relName)
 {
     RC rc;
     if (strlen(relName) > MAXNAME) return SM_RELNAMETOOLONG;
-    if (strcmp(relName, "attrcat") == 0 || strcmp(relName, "relcat") == 0) return SM_CANTMODIFYCATALOG;
+    if (strcmp(relName, "attrcat") == 0 || strcmp(relName, "relcat") == 0 ||
+        strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
+
+    /* The transaction of another session may have to undo its updates */
+    if (lgm_->Locked()) return LG_TRANSACTIONLOCKED;
     
     /* Delete record of the relation from Relcat and Delete index entry for relName */
     RM_Record relMetadata; RID rid;
@@ -243,6 +251,7 @@ RC SM_Manager::CreateIndex(const char *relName,
 
     if (strlen(relName) > MAXNAME) return SM_RELNAMETOOLONG;
     if (strlen(attrName) > MAXNAME) return SM_ATTRNAMETOOLONG;
+    if (strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
     
     RM_Record relRecord;
     RM_Record attrRecord;
@@ -269,10 +278,10 @@ RC SM_Manager::CreateIndex(const char *relName,
     RM_FileScan scan;
     RM_Record rec;
     if ((rc = scan.OpenScan(fh, INT, sizeof(int), 0,
-        NO_OP, NULL))) return rc;
+        NO_OP, NULL, SEQUENTIAL_SCAN))) return rc;
 
     while (rc != RM_EOF) {
-       rc = scan.GetNextRec(rec);
+       rc = scan.GetNextRec(rec, TRUE);
        
        if (rc != 0 && rc != RM_EOF) return (rc);
 
@@ -336,6 +345,7 @@ RC SM_Manager::Load(const char *relName,
          << "   fileName=" << fileName << "\n";
 
     if (strlen(relName) > MAXNAME) return SM_RELNAMETOOLONG;
+    if (strcmp(relName, "bufstat") == 0) return SM_CANTMODIFYCATALOG;
 
     /* Open input file */
     ifstream inputfile(fileName);
@@ -355,22 +365,27 @@ RC SM_Manager::Load(const char *relName,
     if ((rc = FillDataAttributes(relName, attributes, attrCount))) return rc;
 
     int singleStatementXact = 0;
-    if (!lgm_->bInTransaction) {
+    if (!lgm_->InTransaction()) {
+        if ((rc = lgm_->BeginT())) {
+            delete[] attributes; rmm_->CloseFile(fh); return rc;
+        }
         singleStatementXact = 1;
-        lgm_->BeginT();
     }
 
-    /* Iterate through each line (tuple) */
+    /* Iterate through each line (tuple), appending the tuples to the
+       relation SM_LOAD_BATCH at a time */
     char line[MAXATTRS * (MAXSTRINGLEN+1)];
     int numTuplesAdded = 0;
+    vector<char> batch(SM_LOAD_BATCH * relMetadata->tupleLength);
+    char *batchData = &batch[0];
+    int numBatch = 0;
     while (inputfile.getline(line, MAXATTRS * (MAXSTRINGLEN+1), '\n')) {
         if (bAbort && (rand() % 100) < abortProb) {
             cout << "[ CRASH WHILE LOAD ]" << endl;
             abort();
         }
 
-        RID rid;
-        char recData[relMetadata->tupleLength];
+        char *recData = batchData + numBatch * relMetadata->tupleLength;
         memset(recData, 0, relMetadata->tupleLength);
         char *token = strtok(line, ",");
 
@@ -398,20 +413,17 @@ RC SM_Manager::Load(const char *relName,
             token = strtok(NULL, ",");
         }
 
-        /* Insert tuple into relation */
-        if ((rc = fh.InsertRec(recData, rid))) return rc;
-        numTuplesAdded++;
-
-        /* Insert index entry for indexed attributes */
-        for (int i = 0; i < attrCount; i++) {
-            if (attributes[i].indexNo != -1) {
-                IX_IndexHandle ih;
-                if ((rc = ixm_->OpenIndex(relName, attributes[i].indexNo, ih))) return rc;
-                if ((rc = ih.InsertEntry(recData + attributes[i].offset, rid))) return rc;
-                if ((rc = ixm_->CloseIndex(ih))) return rc;
-            }
+        /* Insert the tuples of a full batch into relation */
+        if (++numBatch == SM_LOAD_BATCH) {
+            if ((rc = LoadBatch(relName, fh, attributes, attrCount, batchData, numBatch)))
+                return rc;
+            numTuplesAdded += numBatch;
+            numBatch = 0;
         }
     }
+    if ((rc = LoadBatch(relName, fh, attributes, attrCount, batchData, numBatch)))
+        return rc;
+    numTuplesAdded += numBatch;
 
     if (singleStatementXact) lgm_->CommitT();
 
@@ -427,6 +439,35 @@ RC SM_Manager::Load(const char *relName,
     return (0);
 }
 
+/* Append numTuples tuples, stored one after the other, to the relation and
+   insert their index entries */
+RC SM_Manager::LoadBatch(const char *relName, RM_FileHandle &fh,
+                         DataAttrInfo *attributes, int attrCount,
+                         char *tuples, int numTuples)
+{
+    RC rc;
+    if (numTuples == 0) return 0;
+
+    /* Insert tuples into relation */
+    RID rids[SM_LOAD_BATCH];
+    if ((rc = fh.AppendRecs(tuples, numTuples, rids))) return rc;
+
+    /* Insert index entries for indexed attributes */
+    int tupleLength = fh.GetRecordSize();
+    for (int i = 0; i < attrCount; i++) {
+        if (attributes[i].indexNo != -1) {
+            IX_IndexHandle ih;
+            if ((rc = ixm_->OpenIndex(relName, attributes[i].indexNo, ih))) return rc;
+            for (int j = 0; j < numTuples; j++) {
+                char *recData = tuples + j * tupleLength;
+                if ((rc = ih.InsertEntry(recData + attributes[i].offset, rids[j]))) return rc;
+            }
+            if ((rc = ixm_->CloseIndex(ih))) return rc;
+        }
+    }
+    return 0;
+}
+
 RC SM_Manager::Print(const char *relName)
 {
     RC rc;
@@ -444,27 +485,36 @@ RC SM_Manager::Print(const char *relName)
     Printer p(attributes, attrCount);
     p.PrintHeader(cout);
 
+    // bufstat has no file: print the statistics of each file instead
+    if (strcmp(relName, "bufstat") == 0) {
+        BufstatTuple tuple;
+        for (int i = 0; (rc = GetBufstatTuple(i, tuple)) == 0; i++)
+            p.Print(cout, (char *)&tuple);
+        p.PrintFooter(cout);
+        delete[] attributes;
+        return (rc == PF_EOF) ? 0 : rc;
+    }
+
     // Open the file and set up the file scan
     RM_FileHandle rfh;
     if ((rc = rmm_->OpenFile(relName, rfh))) return(rc);
     RM_FileScan rfs;
-    if ((rc = rfs.OpenScan(rfh, INT, sizeof(int), 0, NO_OP, NULL))) {
+    if ((rc = rfs.OpenScan(rfh, INT, sizeof(int), 0, NO_OP, NULL, SEQUENTIAL_SCAN))) {
         cout  << "??" << rc << endl;        
         return (rc);
     }
 
-    RM_Record rec;
-    // Print each tuple
+    // Print each tuple, a page of them at a time
+    char *data[SM_PRINT_BATCH];
+    RID rids[SM_PRINT_BATCH];
+    int numRecs;
     while (rc != RM_EOF) {
-       rc = rfs.GetNextRec(rec);
-       
+       rc = rfs.GetNextBatch(data, rids, SM_PRINT_BATCH, numRecs);
+
        if (rc != 0 && rc != RM_EOF) return (rc);
 
-       if (rc != RM_EOF) {
-            char *data;
-            rec.GetData(data);
-            p.Print(cout, data);
-       }
+       for (int i = 0; i < numRecs; i++)
+            p.Print(cout, data[i]);
     }
     p.PrintFooter(cout);
 
@@ -478,10 +528,46 @@ RC SM_Manager::Print(const char *relName)
 
 RC SM_Manager::Set(const char *paramName, const char *value)
 {
+    RC rc;
     cout << "Set\n"
          << "   paramName=" << paramName << "\n"
          << "   value    =" << value << "\n";
-    return (0);
+
+    /* bufferSize: number of pages (or bytes with K/M/G suffix) in the pool */
+    if (strcasecmp(paramName, "bufferSize") == 0) {
+        int numPages, pageSize;
+        lgm_->pfm_->GetBlockSize(pageSize);
+        if (PF_ParseBufferSize(value, numPages, pageSize)) return SM_INVALIDVALUE;
+        if ((rc = lgm_->pfm_->ResizeBuffer(numPages))) return rc;
+        return (0);
+    }
+
+    /* bufferPolicy: page replacement policy, "lru", "clock" or "2q" */
+    if (strcasecmp(paramName, "bufferPolicy") == 0) {
+        PF_ReplacePolicy policy;
+        if (PF_ParsePolicy(value, policy)) return SM_INVALIDVALUE;
+        if ((rc = lgm_->pfm_->SetPolicy(policy))) return rc;
+        return (0);
+    }
+
+    /* mappedScans: "on" to have the table scans of a select map the file
+       of the relation instead of reading it through the buffer pool, or
+       "off" (the default) */
+    if (strcasecmp(paramName, "mappedScans") == 0) {
+        if (strcasecmp(value, "on") == 0) bMappedScans_ = 1;
+        else if (strcasecmp(value, "off") == 0) bMappedScans_ = 0;
+        else return SM_INVALIDVALUE;
+        return (0);
+    }
+
+    return SM_INVALIDPARAM;
+}
+
+/* Returns 1 if the table scans of a select map the file of the relation
+ * (Set mappedScans).
+ */
+int SM_Manager::MappedScans() const {
+    return bMappedScans_;
 }
 
 RC SM_Manager::Help()
@@ -537,6 +623,27 @@ RC SM_Manager::Help(const char *relName)
     return (0);
 }
 
+/* Makes the tuple of the bufstat relation for the i-th file tracked by
+ * the buffer manager.  Returns PF_EOF once all the files were seen.
+ */
+RC SM_Manager::GetBufstatTuple(int i, BufstatTuple &tuple) {
+    RC rc;
+    PF_FileStats stats;
+    if ((rc = lgm_->pfm_->GetFileStats(i, stats))) return rc;
+
+    memset(&tuple, 0, sizeof(BufstatTuple));
+    strncpy(tuple.fileName, stats.fileName, PF_FILENAME_LEN);
+    tuple.hits = stats.hits;
+    tuple.misses = stats.misses;
+    tuple.reads = stats.reads;
+    tuple.writes = stats.writes;
+    tuple.evictions = stats.evictions;
+    if (stats.hits + stats.misses > 0)
+        tuple.hitRatio = (float) stats.hits / (stats.hits + stats.misses);
+    tuple.pinWait = stats.pinWait / 1000.0f;
+    return (0);
+}
+
 /* Looks up relcat to find metadata about a given relation
  * Upon return, rec contains the corresponding relcat tuple
  */
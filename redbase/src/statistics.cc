@@ -23,15 +23,20 @@
 using namespace std;
 
 //
-// Here are Statistics Keys utilized by the PF layer of the Redbase
-// project.
-//
-const char *PF_GETPAGE = "GETPAGE";
-const char *PF_PAGEFOUND = "PAGEFOUND";
-const char *PF_PAGENOTFOUND = "PAGENOTFOUND";
-const char *PF_READPAGE = "READPAGE";           // IO
-const char *PF_WRITEPAGE = "WRITEPAGE";         // IO
-const char *PF_FLUSHPAGES = "FLUSHPAGES";
+// Names of the counters (see Stat_Counter), in the same order.  Here are
+// the Statistics Keys utilized by the PF layer of the Redbase project.
+//
+static const char *psCounterNames[STAT_NUM_COUNTERS] = {
+   "GETPAGE",
+   "PAGEFOUND",
+   "PAGENOTFOUND",
+   "READPAGE",           // IO
+   "WRITEPAGE",          // IO
+   "FLUSHPAGES",
+   "PREFETCHPAGE",       // IO, read ahead
+   "PREFETCHHIT",
+   "BGWRITEPAGE"         // IO, background writer
+};
 
 //
 // Statistic class
@@ -130,6 +135,12 @@ RC StatisticsMgr::Register (const char *psKey, const Stat_Operation op,
    if (psKey==NULL || (op != STAT_ADDONE && piValue == NULL))
       return STAT_INVALID_ARGS;
 
+   // The key may name a counter
+   if ((i = FindCounter(psKey)) >= 0)
+      return Register((Stat_Counter)i, op, piValue);
+
+   pthread_mutex_lock(&mutex);
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -175,6 +186,7 @@ RC StatisticsMgr::Register (const char *psKey, const Stat_Operation op,
       delete pStat;
    }
 
+   pthread_mutex_unlock(&mutex);
    return 0;
 }
 
@@ -212,6 +224,12 @@ int *StatisticsMgr::Get(const char *psKey)
 {
    int i, iCount;
    Statistic *pStat = NULL;
+   int *piValue = NULL;
+
+   if (psKey != NULL && (i = FindCounter(psKey)) >= 0)
+      return Get((Stat_Counter)i);
+
+   pthread_mutex_lock(&mutex);
 
    iCount = llStats.GetLength();
 
@@ -222,10 +240,11 @@ int *StatisticsMgr::Get(const char *psKey)
    }
 
    // Check to see if we found the Stat
-   if (i==iCount)
-      return NULL;
+   if (i!=iCount)
+      piValue = new int(pStat->iValue);
 
-   return new int(pStat->iValue);
+   pthread_mutex_unlock(&mutex);
+   return piValue;
 }
 
 //
@@ -238,12 +257,21 @@ void StatisticsMgr::Print()
    int i, iCount;
    Statistic *pStat = NULL;
 
+   // The counters first
+   for (i = 0; i < STAT_NUM_COUNTERS; i++)
+      if (__atomic_load_n(&bRegistered[i], __ATOMIC_RELAXED))
+         cout << psCounterNames[i] << "::" << Sum((Stat_Counter)i) << "\n";
+
+   pthread_mutex_lock(&mutex);
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
       pStat = llStats[i];
       cout << pStat->psKey << "::" << pStat->iValue << "\n";
    }
+
+   pthread_mutex_unlock(&mutex);
 }
 
 //
@@ -260,6 +288,16 @@ RC StatisticsMgr::Reset(const char *psKey)
    if (psKey==NULL)
       return STAT_INVALID_ARGS;
 
+   // A counter is set back to 0, and looks unregistered again
+   if ((i = FindCounter(psKey)) >= 0) {
+      if (!__atomic_load_n(&bRegistered[i], __ATOMIC_RELAXED))
+         return STAT_UNKNOWN_KEY;
+      Clear((Stat_Counter)i);
+      return 0;
+   }
+
+   pthread_mutex_lock(&mutex);
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -271,7 +309,10 @@ RC StatisticsMgr::Reset(const char *psKey)
    // If we found the statistic then remove it from the list
    if (i!=iCount)
       llStats.Delete(i);
-   else
+
+   pthread_mutex_unlock(&mutex);
+
+   if (i==iCount)
       return STAT_UNKNOWN_KEY;
 
    return 0;
@@ -285,6 +326,136 @@ RC StatisticsMgr::Reset(const char *psKey)
 //
 void StatisticsMgr::Reset()
 {
+   for (int i = 0; i < STAT_NUM_COUNTERS; i++)
+      Clear((Stat_Counter)i);
+
+   pthread_mutex_lock(&mutex);
    llStats.Erase();
+   pthread_mutex_unlock(&mutex);
+}
+
+//
+// Constructor
+//
+// All the counters start at 0, unregistered.
+//
+StatisticsMgr::StatisticsMgr()
+{
+   pthread_mutex_init(&mutex, NULL);
+   memset(counters, 0, sizeof(counters));
+   memset(bRegistered, 0, sizeof(bRegistered));
+}
+
+//
+// Get
+//
+// Return a pointer to the value of a counter, or NULL if it was not
+// registered since it was reset.  The caller must delete the memory
+// returned.
+//
+int *StatisticsMgr::Get(const Stat_Counter counter)
+{
+   if (!__atomic_load_n(&bRegistered[counter], __ATOMIC_RELAXED))
+      return NULL;
+   return new int(Sum(counter));
+}
+
+//
+// Stripe
+//
+// Return the part of the counters that the calling thread adds to.
+// Threads are given parts in turn, the first time they count something.
+//
+int StatisticsMgr::Stripe()
+{
+   static int iNextStripe = 0;
+   static __thread int iStripe = -1;
+
+   if (iStripe < 0)
+      iStripe = __atomic_fetch_add(&iNextStripe, 1, __ATOMIC_RELAXED) %
+         STAT_STRIPES;
+   return iStripe;
+}
+
+//
+// FindCounter
+//
+// Return the counter named psKey, or -1 if none is.
+//
+int StatisticsMgr::FindCounter(const char *psKey)
+{
+   for (int i = 0; i < STAT_NUM_COUNTERS; i++)
+      if (strcmp(psCounterNames[i], psKey) == 0)
+         return i;
+   return -1;
+}
+
+//
+// Sum
+//
+// Add up the parts of a counter.  Changes made meanwhile may or may not
+// be seen.
+//
+int StatisticsMgr::Sum(const Stat_Counter counter)
+{
+   int iValue = 0;
+   for (int i = 0; i < STAT_STRIPES; i++)
+      iValue += __atomic_load_n(&counters[i][counter].iValue,
+                                __ATOMIC_RELAXED);
+   return iValue;
+}
+
+//
+// Clear
+//
+// Set a counter back to 0, and mark it unregistered.
+//
+void StatisticsMgr::Clear(const Stat_Counter counter)
+{
+   __atomic_store_n(&bRegistered[counter], FALSE, __ATOMIC_RELAXED);
+   for (int i = 0; i < STAT_STRIPES; i++)
+      __atomic_store_n(&counters[i][counter].iValue, 0, __ATOMIC_RELAXED);
+}
+
+//
+// SetCounter
+//
+// Perform the operations of Register that do not simply add to a
+// counter.  The value is computed from the sum of the parts, and stored
+// in the first part.  Serialized by the mutex, but not with the
+// lock-free additions.
+//
+RC StatisticsMgr::SetCounter(const Stat_Counter counter,
+      const Stat_Operation op, const int *const piValue)
+{
+   int iValue;
+
+   if (piValue == NULL || (op == STAT_DIVVALUE && *piValue == 0))
+      return STAT_INVALID_ARGS;
+
+   pthread_mutex_lock(&mutex);
+
+   iValue = Sum(counter);
+   switch (op) {
+      case STAT_SETVALUE:
+         iValue = *piValue;
+         break;
+      case STAT_MULTVALUE:
+         iValue *= *piValue;
+         break;
+      case STAT_DIVVALUE:
+         iValue = (int) (iValue/(*piValue));
+         break;
+      default:
+         break;
+   };
+
+   for (int i = 1; i < STAT_STRIPES; i++)
+      __atomic_store_n(&counters[i][counter].iValue, 0, __ATOMIC_RELAXED);
+   __atomic_store_n(&counters[0][counter].iValue, iValue, __ATOMIC_RELAXED);
+   __atomic_store_n(&bRegistered[counter], TRUE, __ATOMIC_RELAXED);
+
+   pthread_mutex_unlock(&mutex);
+   return 0;
 }
 
@@ -46,6 +46,7 @@ const int STAT_BASE = 9000;
 #endif
 
 // This include must come after the common defines
+#include <pthread.h>
 #include "linkedlist.h"    // Template class for the link list
 
 // A single statistic will be tracked by a Statistic class
@@ -74,6 +75,39 @@ public:
     int iValue;
 };
 
+// Counters known when the program is compiled.  They are kept in fixed
+// arrays rather than in the list of statistics, and registering a change
+// to one of them (by far the most common use of the StatisticsMgr) takes
+// neither a lock nor a string comparison.  Their names are those printed,
+// and may be used as keys too.  Add new counters before
+// STAT_NUM_COUNTERS, and their names to psCounterNames in statistics.cc.
+enum Stat_Counter {
+    // The following are specifically for tracking the statistics in the
+    // PF component of Redbase.
+    PF_GETPAGE,
+    PF_PAGEFOUND,
+    PF_PAGENOTFOUND,
+    PF_READPAGE,         // IO
+    PF_WRITEPAGE,        // IO
+    PF_FLUSHPAGES,
+    PF_PREFETCHPAGE,     // IO, read ahead
+    PF_PREFETCHHIT,
+    PF_BGWRITEPAGE,      // IO, background writer
+    STAT_NUM_COUNTERS
+};
+
+// Each counter is split into STAT_STRIPES parts, each on a cache line of
+// its own.  A thread always adds to the same part, so that threads
+// counting the same event do not write to the same line; reading a
+// counter adds its parts up.
+const int STAT_STRIPES = 8;
+const int STAT_CACHE_LINE = 64;
+
+struct StatCounter {
+    int iValue;                  // this part of the value
+    char pad[STAT_CACHE_LINE - sizeof(int)];
+} __attribute__((aligned(STAT_CACHE_LINE)));
+
 // These are the different operations that a single statistic can undergo
 // duing a call to StatisticsMgr::Register.
 enum Stat_Operation {
@@ -85,12 +119,13 @@ enum Stat_Operation {
     STAT_SUBVALUE
 };
 
-// The StatisticsMgr will track a group of statistics
+// The StatisticsMgr will track a group of statistics.  It may be used by
+// several threads at once.
 class StatisticsMgr {
 
 public:
-    StatisticsMgr() {};
-    ~StatisticsMgr() {};
+    StatisticsMgr();
+    ~StatisticsMgr() { pthread_mutex_destroy(&mutex); };
 
     // Add a new statistic or register a change to an existing statistic.
     // The piValue for can be NULL, except for those operations that require
@@ -99,9 +134,30 @@ public:
     RC Register(const char *psKey, const Stat_Operation op,
                 const int *const piValue = NULL);
 
+    // Register a change to a counter.  STAT_ADDONE, STAT_ADDVALUE and
+    // STAT_SUBVALUE are lock free; the other operations are not atomic
+    // with respect to concurrent changes of the same counter.
+    RC Register(const Stat_Counter counter, const Stat_Operation op,
+                const int *const piValue = NULL)
+    {
+        if (op == STAT_ADDONE || ((op == STAT_ADDVALUE ||
+                op == STAT_SUBVALUE) && piValue != NULL)) {
+            int iDelta = (op == STAT_ADDONE) ? 1 :
+                (op == STAT_ADDVALUE) ? *piValue : -*piValue;
+            __atomic_fetch_add(&counters[Stripe()][counter].iValue, iDelta,
+                               __ATOMIC_RELAXED);
+            if (!__atomic_load_n(&bRegistered[counter], __ATOMIC_RELAXED))
+                __atomic_store_n(&bRegistered[counter], TRUE,
+                                 __ATOMIC_RELAXED);
+            return 0;
+        }
+        return SetCounter(counter, op, piValue);
+    };
+
     // Get will return the value associated with a particular statistic.
     // Caller is responsible for deleting the memory returned.
     int *Get(const char *psKey);
+    int *Get(const Stat_Counter counter);
 
     // Print out a specific statistic
     RC Print(const char *psKey);
@@ -117,6 +173,19 @@ public:
 
 private:
     LinkList<Statistic> llStats;
+    pthread_mutex_t mutex;          // protects llStats
+
+    // The counters, and whether each was registered since it was reset
+    // (Get returns NULL otherwise)
+    StatCounter counters[STAT_STRIPES][STAT_NUM_COUNTERS];
+    int bRegistered[STAT_NUM_COUNTERS];
+
+    static int Stripe();            // Part of the counters of this thread
+    static int FindCounter(const char *psKey);   // Counter named psKey
+    int  Sum(const Stat_Counter counter);        // Add the parts up
+    void Clear(const Stat_Counter counter);      // Reset a counter
+    RC   SetCounter(const Stat_Counter counter, const Stat_Operation op,
+                    const int *const piValue);   // Other Register ops
 };
 
 //
@@ -125,17 +194,5 @@ private:
 const int STAT_INVALID_ARGS = STAT_BASE+1;  // Bad Args in call to method
 const int STAT_UNKNOWN_KEY  = STAT_BASE+2;  // No such Key being tracked
 
-//
-// The following are specifically for tracking the statistics in the PF
-// component of Redbase.  When statistics are utilized, these constants
-// will be used as the keys for the statistics manager.
-//
-extern const char *PF_GETPAGE;
-extern const char *PF_PAGEFOUND;
-extern const char *PF_PAGENOTFOUND;
-extern const char *PF_READPAGE;         // IO
-extern const char *PF_WRITEPAGE;        // IO
-extern const char *PF_FLUSHPAGES;
-
 #endif
 